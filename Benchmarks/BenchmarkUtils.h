@@ -0,0 +1,64 @@
+#ifndef _BENCHMARK_UTILS_H_
+#define _BENCHMARK_UTILS_H_
+
+#include "boost/cstdint.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define BENCHMARK_STRINGIZE_INNER(x) #x
+#define BENCHMARK_STRINGIZE(x) BENCHMARK_STRINGIZE_INNER(x)
+
+//Measures wall-clock time from its construction.
+class BenchmarkTimer
+{
+public:
+    BenchmarkTimer() : _startTime(boost::posix_time::microsec_clock::universal_time())
+    {
+    }
+    void Restart()
+    {
+        _startTime = boost::posix_time::microsec_clock::universal_time();
+    }
+    double GetSeconds() const
+    {
+        return (boost::posix_time::microsec_clock::universal_time() - _startTime)
+            .total_microseconds() / 1000000.0;
+    }
+private:
+    boost::posix_time::ptime _startTime;
+};
+
+//@return : the peak resident set size of the process, or 0 where unsupported.
+inline boost::uint64_t GetPeakRSSKilobytes()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return (boost::uint64_t) usage.ru_maxrss;
+    }
+#endif
+    return 0;
+}
+
+//@return : the compiler and build type, so that results of different builds can
+//          be told apart.
+inline const char *GetBuildDescription()
+{
+#if defined(_MSC_VER)
+    #define BENCHMARK_COMPILER "msvc " BENCHMARK_STRINGIZE(_MSC_VER)
+#elif defined(__GNUC__)
+    #define BENCHMARK_COMPILER "gcc " __VERSION__
+#else
+    #define BENCHMARK_COMPILER "unknown compiler"
+#endif
+#ifdef NDEBUG
+    return BENCHMARK_COMPILER ", release";
+#else
+    return BENCHMARK_COMPILER ", debug";
+#endif
+}
+
+#endif //_BENCHMARK_UTILS_H_
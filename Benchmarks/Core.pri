@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Core/ and the workload generator, shared by every
+# benchmark. Include with include(Core.pri).
+#
+#-------------------------------------------------
+
+include(../Core/Core.pri)
+
+SOURCES += WorkloadGenerator.cpp
+
+HEADERS += WorkloadGenerator.h \
+    BenchmarkUtils.h
@@ -0,0 +1,381 @@
+/*
+    Merge microbenchmarks.
+
+    Measures GetMatchingNode, ModifyNodeUsingValuesFromNewNode,
+    MergeObjectIntoCatalog and CustomItem::AddToMap in isolation, merging
+    different numbers of objects into catalogs of different sizes, under every
+    merge policy. Every merged object has array-like children (Cost, Effect,
+    LayoutButtons). Results are printed as JSON, one entry per measurement.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "boost/program_options.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/tokenizer.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/foreach.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "pugixml.hpp"
+#include "CommonConstants.h"
+#include "NodeMatch.h"
+#include "ObjectMerge.h"
+#include "Template.h"
+#include "CustomItem.h"
+#include "MapManager.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "JsonUtils.h"
+#include "WorkloadGenerator.h"
+#include "BenchmarkUtils.h"
+using namespace std;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+//---------------- CONSTANTS ------------------
+static const string MAP_DATA_FILENAME("UnitData.xml");
+
+struct BenchmarkArgsT
+{
+    vector<size_t> catalogSizes;
+    vector<size_t> numsObjectsMerged;
+    size_t numRepetitions;
+    double maxWork;             /* combinations whose catalog size times the number
+                                   of objects merged exceed this are skipped. */
+    fs::path workspaceFolder;
+    fs::path resultsFile;
+};
+
+/* A single measurement. */
+struct ResultT
+{
+    string operation;
+    size_t catalogSize;
+    size_t numObjectsMerged;
+    string policy;
+    bool wasSkipped;
+    double seconds;             /* fastest of the repetitions. */
+};
+
+//---------------- HELPERS ------------------
+static bool ParseSizes(const string &sizesStr, vector<size_t> &sizes)
+{
+    sizes.clear();
+    boost::char_separator<char> sep(",");
+    boost::tokenizer<boost::char_separator<char> > tokens(sizesStr, sep);
+    try
+    {
+        BOOST_FOREACH(const string &token, tokens)
+        {
+            sizes.push_back(boost::lexical_cast<size_t>(token));
+        }
+    }
+    catch(boost::bad_lexical_cast &)
+    {
+        cerr << "ERROR: invalid list of sizes \"" << sizesStr << "\".\n";
+        return false;
+    }
+    return !sizes.empty();
+}
+
+static bool ParseArgs(int argc, char *argv[], BenchmarkArgsT &args)
+{
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "print this message")
+        ("catalog-sizes", po::value<string>()->default_value("1000,10000,100000"),
+            "comma-separated numbers of objects in the map's catalog, i.e. "
+            "1000,10000,100000,1000000.")
+        ("objects", po::value<string>()->default_value("1,100,10000"),
+            "comma-separated numbers of objects merged into the catalog.")
+        ("repetitions", po::value<size_t>(&args.numRepetitions)->default_value(3),
+            "number of times each measurement is taken. The fastest is reported.")
+        ("max-work", po::value<double>(&args.maxWork)->default_value(1e9),
+            "skip measurements whose catalog size times objects merged exceeds this.")
+        ("workspace", po::value<string>()->default_value("MergeBenchmarkWorkspace"),
+            "folder that maps and templates are generated in.")
+        ("results", po::value<string>()->default_value(""),
+            "file to write the JSON results to. Printed if empty.");
+    try
+    {
+        po::variables_map variables;
+        po::store(po::parse_command_line(argc, argv, description), variables);
+        po::notify(variables);
+        if(variables.count("help"))
+        {
+            cout << description << "\n";
+            return false;
+        }
+        args.workspaceFolder = variables["workspace"].as<string>();
+        args.resultsFile = variables["results"].as<string>();
+        return ParseSizes(variables["catalog-sizes"].as<string>(), args.catalogSizes)
+            && ParseSizes(variables["objects"].as<string>(), args.numsObjectsMerged);
+    }
+    catch(std::exception &e)
+    {
+        cerr << "ERROR: " << e.what() << "\n" << description << "\n";
+        return false;
+    }
+}
+
+/* The objects that are merged: existing objects of the catalog, spread evenly over
+   it, each with a changed attribute and array-like children. */
+static string GenerateMergedObjects(size_t catalogSize, size_t numObjects, const string &policy)
+{
+    size_t stride = max((size_t) 1, catalogSize / numObjects);
+    ostringstream data;
+    data << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<Catalog>\n";
+    for(size_t objectIndex = 0; objectIndex < numObjects; ++objectIndex)
+    {
+        data << "    <CUnit id=\"Unit" << (objectIndex * stride) % catalogSize << "\" "
+            << OBJECT_REQUIRED_AGE_ATTR_NAME << "=\"idc\" "
+            << OBJECT_OLD_AGE_ACTION_ATTR_NAME << "=\"" << policy << "\">\n"
+            << "        <LifeMax value=\"999\"/>\n"
+            << "        <Cost Resource=\"Minerals\" Amount=\"75\"/>\n"
+            << "        <Effect index=\"1\" value=\"MergedSplash\"/>\n"
+            << "        <LayoutButtons Face=\"Attack\" Row=\"0\" Column=\"2\"/>\n"
+            << "    </CUnit>\n";
+    }
+    data << "</Catalog>\n";
+    return data.str();
+}
+
+static bool WriteFile(const fs::path &filePath, const string &contents)
+{
+    ofstream fileWriter(filePath.string().c_str(), ios_base::trunc);
+    fileWriter << contents;
+    fileWriter.close();
+    return !fileWriter.fail();
+}
+
+static bool LoadDocument(xml_document &doc, const fs::path &filePath)
+{
+    if(!doc.load_file(filePath.string().c_str()))
+    {
+        cerr << "ERROR: could not load " << filePath.string() << ".\n";
+        return false;
+    }
+    return true;
+}
+
+//---------------- MEASUREMENTS ------------------
+/* Each measurement takes freshly loaded copies of the catalog and the merged
+   objects, since merging changes the catalog. Loading is not timed. */
+class MergeMeasurement
+{
+public:
+    MergeMeasurement(const fs::path &mapPath, const fs::path &templatePath)
+        : _mapPath(mapPath), _templatePath(templatePath)
+    {
+    }
+
+    bool TimeGetMatchingNode(double &seconds)
+    {
+        xml_document catalogDoc, mergedDoc;
+        if(!LoadDocument(catalogDoc, _mapPath/GAME_DATA_PATH/MAP_DATA_FILENAME)
+            || !LoadDocument(mergedDoc, _templatePath/MAP_DATA_FILENAME))
+        {
+            return false;
+        }
+        xml_node catalog = catalogDoc.child(CATALOG_NAME.c_str());
+        size_t numMatched = 0;
+        BenchmarkTimer timer;
+        for(xml_node object = mergedDoc.child(CATALOG_NAME.c_str()).first_child(); object;
+            object = object.next_sibling())
+        {
+            if(GetMatchingNode(object, catalog))
+            {
+                ++numMatched;
+            }
+        }
+        seconds = timer.GetSeconds();
+        return numMatched > 0;
+    }
+
+    bool TimeModifyNode(double &seconds)
+    {
+        xml_document catalogDoc, mergedDoc;
+        if(!LoadDocument(catalogDoc, _mapPath/GAME_DATA_PATH/MAP_DATA_FILENAME)
+            || !LoadDocument(mergedDoc, _templatePath/MAP_DATA_FILENAME))
+        {
+            return false;
+        }
+        //match outside of the timer, so that only the modification is measured.
+        xml_node catalog = catalogDoc.child(CATALOG_NAME.c_str());
+        vector<pair<xml_node, xml_node> > matches;
+        for(xml_node object = mergedDoc.child(CATALOG_NAME.c_str()).first_child(); object;
+            object = object.next_sibling())
+        {
+            matches.push_back(make_pair(GetMatchingNode(object, catalog), object));
+        }
+        BenchmarkTimer timer;
+        for(size_t i = 0; i < matches.size(); ++i)
+        {
+            ModifyNodeUsingValuesFromNewNode(matches[i].first, matches[i].second);
+        }
+        seconds = timer.GetSeconds();
+        return true;
+    }
+
+    //follows each object's SC2DM_whatToDoIfExists, as CustomItem::AddToMap does.
+    bool TimeMergeObjectIntoCatalog(double &seconds)
+    {
+        MapManager mapManager;
+        xml_document mergedDoc;
+        if(!mapManager.Create(_mapPath) || !LoadDocument(mergedDoc, _templatePath/MAP_DATA_FILENAME))
+        {
+            return false;
+        }
+        xml_node catalog = mapManager.GetDataFileCatalog(MAP_DATA_FILENAME);
+        bool success = true;
+        bool wasEdited = false;
+        BenchmarkTimer timer;
+        for(xml_node object = mergedDoc.child(CATALOG_NAME.c_str()).first_child(); success && object;
+            object = object.next_sibling())
+        {
+            success = MergeObjectIntoCatalog(object, catalog, MAP_DATA_FILENAME, wasEdited);
+        }
+        seconds = timer.GetSeconds();
+        return success;
+    }
+
+    bool TimeAddToMap(double &seconds)
+    {
+        MapManager mapManager;
+        Template mergedTemplate;
+        CustomItem mergedItem;
+        if(!mapManager.Create(_mapPath) || !mergedTemplate.Create(_templatePath)
+            || !mergedItem.Create(mergedTemplate, map<string, string>()))
+        {
+            return false;
+        }
+        BenchmarkTimer timer;
+        bool success = mergedItem.AddToMap(mapManager);
+        seconds = timer.GetSeconds();
+        return success;
+    }
+
+private:
+    fs::path _mapPath;
+    fs::path _templatePath;
+};
+
+static void WriteResults(ostream &resultsWriter, const vector<ResultT> &results)
+{
+    resultsWriter << "{\n\"benchmark\":\"merge\",\n\"build\":"
+        << QuoteJSONString(GetBuildDescription()) << ",\n\"results\":[";
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const ResultT &result = results[i];
+        resultsWriter << (i == 0 ? "\n" : ",\n")
+            << "{\"operation\":" << QuoteJSONString(result.operation)
+            << ",\"catalogSize\":" << result.catalogSize
+            << ",\"objectsMerged\":" << result.numObjectsMerged
+            << ",\"policy\":" << QuoteJSONString(result.policy);
+        if(result.wasSkipped)
+        {
+            resultsWriter << ",\"skipped\":true}";
+            continue;
+        }
+        resultsWriter << ",\"seconds\":" << result.seconds
+            << ",\"nsPerObject\":" << result.seconds * 1e9 / result.numObjectsMerged << "}";
+    }
+    resultsWriter << "\n]\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkArgsT args;
+    if(!ParseArgs(argc, argv, args))
+    {
+        return 1;
+    }
+    if(!ErrorLogger::Init() || !Template::InitTemplates())
+    {
+        return 1;
+    }
+    ConsoleReporter::SetVerbosity(ConsoleReporter::QUIET_VERBOSITY);
+
+    vector<ResultT> results;
+    BOOST_FOREACH(size_t catalogSize, args.catalogSizes)
+    {
+        WorkloadSpecT spec;
+        spec.numMapObjects = catalogSize;
+        fs::path mapPath = args.workspaceFolder/MAPS_FOLDER/
+            ("Catalog" + boost::lexical_cast<string>(catalogSize) + SC2MAP_EXTENSION);
+        if(!GenerateMap(spec, mapPath))
+        {
+            return 1;
+        }
+        BOOST_FOREACH(size_t numObjects, args.numsObjectsMerged)
+        {
+            for(size_t policyIndex = 0; policyIndex < sizeof(OBJECT_OLD_AGE_ACTION_ATTR_VALUES)/sizeof(char *);
+                ++policyIndex)
+            {
+                string policy(OBJECT_OLD_AGE_ACTION_ATTR_VALUES[policyIndex]);
+                fs::path templatePath = args.workspaceFolder/TEMPLATES_FOLDER/
+                    ("Merge" + boost::lexical_cast<string>(numObjects) + policy);
+                fs::create_directories(templatePath);
+                if(!WriteFile(templatePath/MAP_DATA_FILENAME,
+                    GenerateMergedObjects(catalogSize, numObjects, policy)))
+                {
+                    return 1;
+                }
+                MergeMeasurement measurement(mapPath, templatePath);
+
+                //matching does not depend on the policy, and nodes are only modified under
+                //"modify", so those two are measured once.
+                const char *operations[] = { "GetMatchingNode", "ModifyNodeUsingValuesFromNewNode",
+                    "MergeObjectIntoCatalog", "AddToMap" };
+                for(size_t operationIndex = 0; operationIndex < 4; ++operationIndex)
+                {
+                    if(operationIndex <= 1 && policyIndex != 0)
+                    {
+                        continue;
+                    }
+                    ResultT result;
+                    result.operation = operations[operationIndex];
+                    result.catalogSize = catalogSize;
+                    result.numObjectsMerged = numObjects;
+                    result.policy = (operationIndex == 0 ? "" : policy);
+                    result.wasSkipped = ((double) catalogSize * numObjects > args.maxWork);
+                    result.seconds = 0;
+                    for(size_t rep = 0; !result.wasSkipped && rep < args.numRepetitions; ++rep)
+                    {
+                        double seconds = 0;
+                        bool success = false;
+                        switch(operationIndex)
+                        {
+                        case 0: success = measurement.TimeGetMatchingNode(seconds); break;
+                        case 1: success = measurement.TimeModifyNode(seconds); break;
+                        case 2: success = measurement.TimeMergeObjectIntoCatalog(seconds); break;
+                        default: success = measurement.TimeAddToMap(seconds); break;
+                        }
+                        if(!success)
+                        {
+                            cerr << "ERROR: " << result.operation << " failed.\n";
+                            ErrorLogger::Shutdown();
+                            return 1;
+                        }
+                        result.seconds = (rep == 0 ? seconds : min(result.seconds, seconds));
+                    }
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    if(args.resultsFile.empty())
+    {
+        WriteResults(cout, results);
+    }
+    else
+    {
+        ofstream resultsWriter(args.resultsFile.string().c_str(), ios_base::trunc);
+        WriteResults(resultsWriter, results);
+    }
+    ErrorLogger::Shutdown();
+    return 0;
+}
\ No newline at end of file
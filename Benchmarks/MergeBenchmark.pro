@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#
+# Merge microbenchmarks
+#
+#-------------------------------------------------
+
+include(Core.pri)
+
+TARGET = MergeBenchmark
+
+SOURCES += MergeBenchmark.cpp
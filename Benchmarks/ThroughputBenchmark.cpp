@@ -0,0 +1,227 @@
+/*
+    End-to-end throughput benchmark.
+
+    Generates a synthetic workload (a map, templates and custom items files), runs
+    the whole DataDuplicator::Execute pipeline on it several times, and reports the
+    items created per second, the time of each phase and, with --memory, the peak
+    memory of each run as JSON.
+    Run with --help for the workload options.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include "boost/program_options.hpp"
+#include "boost/filesystem.hpp"
+#include "CommonConstants.h"
+#include "DataDuplicator.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "MemoryAccounting.h"
+#include "JsonUtils.h"
+#include "WorkloadGenerator.h"
+#include "BenchmarkUtils.h"
+using namespace std;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+struct BenchmarkArgsT
+{
+    WorkloadSpecT spec;
+    fs::path workspaceFolder;
+    fs::path resultsFile;       /* empty to print the results. */
+    size_t numRepetitions;
+    bool usePipeline;
+    size_t numInstantiateThreads;
+    bool useFileMergeWorkers;
+    size_t numMergeStripes;
+    bool useBulkMerge;
+    bool useMemoryAccounting;
+};
+
+/* A single run of Execute. */
+struct RunResultT
+{
+    double seconds;
+    DataDuplicator::StatsT stats;
+    boost::uint64_t peakXMLBytes;   /* 0 unless memory is counted. */
+};
+
+static bool ParseArgs(int argc, char *argv[], BenchmarkArgsT &args)
+{
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "print this message")
+        ("workspace", po::value<string>()->default_value("BenchmarkWorkspace"),
+            "folder that the workload is generated in. Replaced on every run.")
+        ("results", po::value<string>()->default_value(""),
+            "file to write the JSON results to. Printed if empty.")
+        ("repetitions", po::value<size_t>(&args.numRepetitions)->default_value(3),
+            "number of times the workload is run.")
+        ("pipeline", po::bool_switch(&args.usePipeline), "use the ItemPipeline.")
+        ("threads", po::value<size_t>(&args.numInstantiateThreads)->default_value(1),
+            "number of instantiate threads of the ItemPipeline.")
+        ("parallel-merge", po::bool_switch(&args.useFileMergeWorkers),
+            "merge into each data file on its own thread (FileMergeWorkers).")
+        ("merge-stripes", po::value<size_t>(&args.numMergeStripes)->default_value(1),
+            "threads merging into each data file at once (StripedCatalogMerge). More than "
+            "1 implies --parallel-merge.")
+        ("bulk-merge", po::bool_switch(&args.useBulkMerge),
+            "merge every item at once, in a sorted pass per data file (BulkCatalogMerge).")
+        ("memory", po::bool_switch(&args.useMemoryAccounting),
+            "report the peak memory of the XML data of each run. Counting it slows down "
+            "every allocation, so items/s are not comparable with runs without it.")
+        ("map-objects", po::value<size_t>(&args.spec.numMapObjects)
+            ->default_value(args.spec.numMapObjects), "objects in the map's catalog.")
+        ("templates", po::value<size_t>(&args.spec.numTemplates)
+            ->default_value(args.spec.numTemplates), "number of templates.")
+        ("objects", po::value<size_t>(&args.spec.numObjectsPerTemplate)
+            ->default_value(args.spec.numObjectsPerTemplate), "new objects per template.")
+        ("vars", po::value<size_t>(&args.spec.numVarsPerObject)
+            ->default_value(args.spec.numVarsPerObject), "variables per object.")
+        ("formulas", po::value<size_t>(&args.spec.numFormulasPerObject)
+            ->default_value(args.spec.numFormulasPerObject), "formulas per object.")
+        ("foreach", po::value<size_t>(&args.spec.numForEachIterations)
+            ->default_value(args.spec.numForEachIterations),
+            "foreach iterations per object. 0 for no foreach.")
+        ("rows", po::value<size_t>(&args.spec.numRowsPerTemplate)
+            ->default_value(args.spec.numRowsPerTemplate), "custom item rows per template.");
+    try
+    {
+        po::variables_map variables;
+        po::store(po::parse_command_line(argc, argv, description), variables);
+        po::notify(variables);
+        if(variables.count("help"))
+        {
+            cout << description << "\n";
+            return false;
+        }
+        args.workspaceFolder = variables["workspace"].as<string>();
+        args.resultsFile = variables["results"].as<string>();
+    }
+    catch(std::exception &e)
+    {
+        cerr << "ERROR: " << e.what() << "\n" << description << "\n";
+        return false;
+    }
+    return true;
+}
+
+static void WriteResults(ostream &resultsWriter, const BenchmarkArgsT &args,
+    const vector<RunResultT> &runs)
+{
+    const WorkloadSpecT &spec = args.spec;
+    resultsWriter << "{\n\"benchmark\":\"throughput\",\n\"build\":"
+        << QuoteJSONString(GetBuildDescription()) << ",\n\"workload\":{"
+        << "\"mapObjects\":" << spec.numMapObjects
+        << ",\"templates\":" << spec.numTemplates
+        << ",\"objectsPerTemplate\":" << spec.numObjectsPerTemplate
+        << ",\"varsPerObject\":" << spec.numVarsPerObject
+        << ",\"formulasPerObject\":" << spec.numFormulasPerObject
+        << ",\"forEachIterations\":" << spec.numForEachIterations
+        << ",\"rowsPerTemplate\":" << spec.numRowsPerTemplate
+        << ",\"pipeline\":" << (args.usePipeline ? "true" : "false")
+        << ",\"threads\":" << args.numInstantiateThreads
+        << ",\"parallelMerge\":" << (args.useFileMergeWorkers ? "true" : "false")
+        << ",\"mergeStripes\":" << args.numMergeStripes
+        << ",\"bulkMerge\":" << (args.useBulkMerge ? "true" : "false")
+        << ",\"memory\":" << (args.useMemoryAccounting ? "true" : "false")
+        << "},\n\"runs\":[";
+    for(size_t runIndex = 0; runIndex < runs.size(); ++runIndex)
+    {
+        const RunResultT &run = runs[runIndex];
+        double itemsPerSecond = (run.seconds > 0 ? run.stats.numItemsCreated / run.seconds : 0);
+        resultsWriter << (runIndex == 0 ? "\n" : ",\n")
+            << "{\"seconds\":" << run.seconds
+            << ",\"itemsCreated\":" << run.stats.numItemsCreated
+            << ",\"itemsPerSecond\":" << itemsPerSecond;
+        if(args.useMemoryAccounting)
+        {
+            resultsWriter << ",\"peakXMLBytes\":" << run.peakXMLBytes;
+        }
+        resultsWriter << ",\"phaseSeconds\":{";
+        for(size_t phaseIndex = 0; phaseIndex < run.stats.phaseSeconds.size(); ++phaseIndex)
+        {
+            resultsWriter << (phaseIndex == 0 ? "" : ",")
+                << QuoteJSONString(run.stats.phaseSeconds[phaseIndex].first) << ":"
+                << run.stats.phaseSeconds[phaseIndex].second;
+        }
+        resultsWriter << "}}";
+    }
+    resultsWriter << "\n],\n\"peakRSSKilobytes\":" << GetPeakRSSKilobytes() << "\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkArgsT args;
+    if(!ParseArgs(argc, argv, args))
+    {
+        return 1;
+    }
+    if(!ErrorLogger::Init())
+    {
+        return 1;
+    }
+    ConsoleReporter::SetVerbosity(ConsoleReporter::QUIET_VERBOSITY);
+    if(args.useMemoryAccounting)
+    {
+        MemoryAccounting::Install();
+    }
+
+    DataDuplicator::OptionsT options;
+    if(!GenerateWorkload(args.spec, args.workspaceFolder, options.mapPath))
+    {
+        ErrorLogger::Shutdown();
+        return 1;
+    }
+    options.templatesFolder = args.workspaceFolder/TEMPLATES_FOLDER;
+    options.customItemsFolder = args.workspaceFolder/CUSTOM_ITEMS_FOLDER;
+    options.outputFolder = args.workspaceFolder/OUTPUT_FOLDER;
+    options.backupFolder = args.workspaceFolder/BACKUP_FILES_FOLDER;
+    options.usePipeline = args.usePipeline;
+    options.numInstantiateThreads = args.numInstantiateThreads;
+    options.useFileMergeWorkers = (args.useFileMergeWorkers || args.numMergeStripes > 1);
+    options.numMergeStripes = (args.numMergeStripes > 0 ? args.numMergeStripes : 1);
+    options.useBulkMerge = args.useBulkMerge;
+
+    vector<RunResultT> runs;
+    for(size_t runIndex = 0; runIndex < args.numRepetitions; ++runIndex)
+    {
+        //every run starts from the same, unmodified map.
+        if(runIndex > 0 && !GenerateMap(args.spec, options.mapPath))
+        {
+            ErrorLogger::Shutdown();
+            return 1;
+        }
+        RunResultT run;
+        run.peakXMLBytes = 0;
+        if(args.useMemoryAccounting)
+        {
+            MemoryAccounting::ResetPeakBytes();
+        }
+        BenchmarkTimer timer;
+        if(!DataDuplicator::Execute(options, run.stats))
+        {
+            ErrorLogger::Shutdown();
+            return 1;
+        }
+        run.seconds = timer.GetSeconds();
+        if(args.useMemoryAccounting)
+        {
+            run.peakXMLBytes = MemoryAccounting::GetPeakBytes();
+        }
+        runs.push_back(run);
+    }
+
+    if(args.resultsFile.empty())
+    {
+        WriteResults(cout, args, runs);
+    }
+    else
+    {
+        ofstream resultsWriter(args.resultsFile.string().c_str(), ios_base::trunc);
+        WriteResults(resultsWriter, args, runs);
+    }
+    ErrorLogger::Shutdown();
+    return 0;
+}
\ No newline at end of file
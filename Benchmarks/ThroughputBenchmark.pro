@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#
+# End-to-end throughput benchmark
+#
+#-------------------------------------------------
+
+include(Core.pri)
+
+TARGET = ThroughputBenchmark
+
+SOURCES += ThroughputBenchmark.cpp
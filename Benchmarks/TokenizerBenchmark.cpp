@@ -0,0 +1,339 @@
+/*
+    Attribute tokenizer and formula microbenchmarks.
+
+    Measures GetVariableTokensInStr, GetFormulaTokensInStr and EvaluateFormula,
+    which run for every attribute of every instantiated item, over corpora of
+    realistic attribute values. Reports nanoseconds and heap allocations per
+    attribute as JSON.
+*/
+
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include "boost/program_options.hpp"
+#include "boost/foreach.hpp"
+#include "muParser.h"
+#include "Template.h"
+#include "TemplateTokens.h"
+#include "ErrorLogger.h"
+#include "JsonUtils.h"
+#include "AtomicOps.h"
+#include "BenchmarkUtils.h"
+using namespace std;
+using namespace AtomicOps;
+namespace po = boost::program_options;
+
+//---------------- ALLOCATION COUNTING ------------------
+//Every heap allocation of the program goes through these, so the allocations of a
+//measurement are the difference of numAllocations before and after it. The
+//counter is atomic, since ErrorLogger's background thread may allocate while
+//measuring. The replacements have no exception specifications, which C++17 no
+//longer allows and which earlier standards do not require.
+static volatile AtomicUInt32 numAllocations = 0;
+
+void *operator new(size_t size)
+{
+    Increment(&numAllocations);
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if(!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr)
+{
+    free(ptr);
+}
+
+#if __cplusplus >= 201402L
+//C++14 compilers may call the sized forms instead, whose default versions are not
+//guaranteed to call the ones above.
+void operator delete(void *ptr, size_t)
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t)
+{
+    free(ptr);
+}
+#endif
+
+//---------------- CORPORA ------------------
+/* Expressions taken from muParser's own tests (muParserTest.cpp) that only use
+   the default parser's operators and functions, and contain no '=', which
+   delimits formulas in attributes. */
+static const char *MUPARSER_TEST_EXPRESSIONS[] =
+{
+    "2^2^3", "1/2/3", "3+4*2/(1-5)^2^3", "1 && 1", "1 && 0",
+    "sqrt((4))", "sqrt((2)+2)", "sqrt(2+(2))",
+    "1 ? 128 : 255", "1<2 ? 128 : 255", "(1) ? 10 : 11", "(0) ? 10 : 11",
+    "sum((1) ? 1 : 2)", "sum((1) ? 1 : 2, 100)",
+    "(1<2)&&(1<2) ? 128 : 255", "((1>2)&&(1<2)) ? 128 : 255",
+    "1>0 ? 1>2 ? 128 : 255 : 1>0 ? 32 : 64", "1>0 ? 50 : (1>0 ? 128 : 255)",
+    "1>2 ? 1>2 ? 128 : 255 : 1>0 ? 32 :(1>2 ? 64 : 16)"
+};
+
+struct CorpusT
+{
+    string name;
+    bool isInstantiated;        /* variables are filled in, so formulas can be evaluated. */
+    vector<string> attributes;
+};
+
+static string Repeat(const string &str, size_t numTimes)
+{
+    string repeated;
+    for(size_t i = 0; i < numTimes; ++i)
+    {
+        repeated += str;
+    }
+    return repeated;
+}
+
+/* Attribute values as they appear in SC2 data and templates. Values are listed
+   before and after variables are filled in, since formulas are only evaluated
+   once they hold numbers. */
+static void GetCorpora(vector<CorpusT> &corpora)
+{
+    corpora.clear();
+    CorpusT plainText;
+    plainText.name = "plainText";
+    plainText.isInstantiated = true;
+    const char *plainValues[] = { "Minerals", "100", "Assets\\Textures\\btn-unit-terran-marine.dds",
+        "Ground", "Unit/Name/Marine", "0.5", "Attack", "" };
+    plainText.attributes.assign(plainValues, plainValues + sizeof(plainValues)/sizeof(char *));
+    corpora.push_back(plainText);
+
+    CorpusT singleVariable;
+    singleVariable.name = "singleVariable";
+    singleVariable.isInstantiated = false;
+    const char *singleValues[] = { "#id#", "#damage#", "#id#Weapon", "Unit/Name/#id#",
+        "Assets\\Textures\\btn-#icon#.dds", "#cost#" };
+    singleVariable.attributes.assign(singleValues, singleValues + sizeof(singleValues)/sizeof(char *));
+    corpora.push_back(singleVariable);
+
+    CorpusT optionalVariable;
+    optionalVariable.name = "optionalVariable";
+    optionalVariable.isInstantiated = false;
+    const char *optionalValues[] = { "#armor=1#", "#impact model=None#", "#range=6#",
+        "#id#_#suffix=Splash#", "#speed=2.25#" };
+    optionalVariable.attributes.assign(optionalValues,
+        optionalValues + sizeof(optionalValues)/sizeof(char *));
+    corpora.push_back(optionalVariable);
+
+    CorpusT mixedFormula;
+    mixedFormula.name = "mixedFormula";
+    mixedFormula.isInstantiated = true;
+    const char *mixedValues[] = { "=2*15=", "=3*(10+2)=", "Deals =6*1.5= damage",
+        "=100/4= per =1+1= seconds", "=0.5*8+2=", "Level =3= of =5=" };
+    mixedFormula.attributes.assign(mixedValues, mixedValues + sizeof(mixedValues)/sizeof(char *));
+    corpora.push_back(mixedFormula);
+
+    CorpusT longTemplateString;
+    longTemplateString.name = "longTemplateString";
+    longTemplateString.isInstantiated = false;
+    longTemplateString.attributes.push_back(
+        Repeat("Deals #damage# damage to #target=enemies# within #radius# range. ", 20));
+    longTemplateString.attributes.push_back(Repeat("Upgrade =2*#level#= adds =#armor=1#/4= armor. ", 30));
+    corpora.push_back(longTemplateString);
+
+    CorpusT longString;
+    longString.name = "longString";
+    longString.isInstantiated = true;
+    longString.attributes.push_back(Repeat("A long tooltip that has no variables at all. ", 40));
+    longString.attributes.push_back(Repeat("Deals 20 damage to enemies within 3 range. ", 20));
+    longString.attributes.push_back(Repeat("Upgrade =2*3= adds =1/4= armor. ", 30));
+    corpora.push_back(longString);
+
+    CorpusT muParserTest;
+    muParserTest.name = "muParserTest";
+    muParserTest.isInstantiated = true;
+    for(size_t i = 0; i < sizeof(MUPARSER_TEST_EXPRESSIONS)/sizeof(char *); ++i)
+    {
+        muParserTest.attributes.push_back(string("=") + MUPARSER_TEST_EXPRESSIONS[i] + "=");
+    }
+    corpora.push_back(muParserTest);
+}
+
+//---------------- MEASUREMENTS ------------------
+enum OperationT
+{
+    VARIABLE_TOKENS_OPERATION,
+    FORMULA_TOKENS_OPERATION,
+    EVALUATE_OPERATION,         /* formula tokenizing plus evaluating every formula. */
+    NUM_OPERATIONS
+};
+static const char *OPERATION_NAMES[] = { "GetVariableTokensInStr", "GetFormulaTokensInStr",
+    "EvaluateFormula" };
+
+struct ResultT
+{
+    string corpus;
+    string operation;
+    size_t numAttributes;
+    double nsPerAttribute;
+    double allocationsPerAttribute;
+};
+
+/* @return : false if an attribute could not be processed. */
+static bool ProcessAttribute(OperationT operation, const string &attribute, double &checksum)
+{
+    vector<AttrToken> tokens;
+    if(operation == VARIABLE_TOKENS_OPERATION)
+    {
+        return GetVariableTokensInStr(attribute, tokens);
+    }
+    if(!GetFormulaTokensInStr(attribute, tokens))
+    {
+        return false;
+    }
+    if(operation == EVALUATE_OPERATION)
+    {
+        BOOST_FOREACH(const AttrToken &token, tokens)
+        {
+            if(token.type == FORMULA_TOK)
+            {
+                checksum += EvaluateFormula(token.formulaContents);
+            }
+        }
+    }
+    return true;
+}
+
+static bool Measure(const CorpusT &corpus, OperationT operation, size_t numIterations,
+    ResultT &result)
+{
+    double checksum = 0;
+    AtomicUInt32 numAllocationsBefore = Load(&numAllocations);
+    BenchmarkTimer timer;
+    try
+    {
+        for(size_t iteration = 0; iteration < numIterations; ++iteration)
+        {
+            BOOST_FOREACH(const string &attribute, corpus.attributes)
+            {
+                if(!ProcessAttribute(operation, attribute, checksum))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    catch(mu::Parser::exception_type &e)
+    {
+        cerr << "ERROR: could not evaluate a formula of " << corpus.name << ": " << e.GetMsg() << "\n";
+        return false;
+    }
+    double seconds = timer.GetSeconds();
+    size_t numAttributes = numIterations * corpus.attributes.size();
+    result.corpus = corpus.name;
+    result.operation = OPERATION_NAMES[operation];
+    result.numAttributes = numAttributes;
+    result.nsPerAttribute = seconds * 1e9 / numAttributes;
+    result.allocationsPerAttribute = (double) (AtomicUInt32) (Load(&numAllocations) - numAllocationsBefore)
+        / numAttributes;
+    //keeps the evaluations from being optimized away.
+    if(checksum != checksum)
+    {
+        cerr << "WARNING: a formula evaluated to NaN.\n";
+    }
+    return true;
+}
+
+static void WriteResults(ostream &resultsWriter, const vector<ResultT> &results)
+{
+    resultsWriter << "{\n\"benchmark\":\"tokenizer\",\n\"build\":"
+        << QuoteJSONString(GetBuildDescription()) << ",\n\"results\":[";
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const ResultT &result = results[i];
+        resultsWriter << (i == 0 ? "\n" : ",\n")
+            << "{\"corpus\":" << QuoteJSONString(result.corpus)
+            << ",\"operation\":" << QuoteJSONString(result.operation)
+            << ",\"attributes\":" << result.numAttributes
+            << ",\"nsPerAttribute\":" << result.nsPerAttribute
+            << ",\"allocationsPerAttribute\":" << result.allocationsPerAttribute << "}";
+    }
+    resultsWriter << "\n]\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    size_t numIterations;
+    string resultsFile;
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "print this message")
+        ("iterations", po::value<size_t>(&numIterations)->default_value(20000),
+            "number of times each corpus is processed.")
+        ("results", po::value<string>(&resultsFile)->default_value(""),
+            "file to write the JSON results to. Printed if empty.");
+    try
+    {
+        po::variables_map variables;
+        po::store(po::parse_command_line(argc, argv, description), variables);
+        po::notify(variables);
+        if(variables.count("help") || numIterations == 0)
+        {
+            cout << description << "\n";
+            return 1;
+        }
+    }
+    catch(std::exception &e)
+    {
+        cerr << "ERROR: " << e.what() << "\n" << description << "\n";
+        return 1;
+    }
+    if(!ErrorLogger::Init() || !Template::InitTemplates())
+    {
+        return 1;
+    }
+
+    vector<CorpusT> corpora;
+    GetCorpora(corpora);
+    vector<ResultT> results;
+    BOOST_FOREACH(const CorpusT &corpus, corpora)
+    {
+        for(int operation = 0; operation < NUM_OPERATIONS; ++operation)
+        {
+            if(operation == EVALUATE_OPERATION && !corpus.isInstantiated)
+            {
+                continue;
+            }
+            ResultT result;
+            if(!Measure(corpus, (OperationT) operation, numIterations, result))
+            {
+                ErrorLogger::Shutdown();
+                return 1;
+            }
+            results.push_back(result);
+        }
+    }
+
+    if(resultsFile.empty())
+    {
+        WriteResults(cout, results);
+    }
+    else
+    {
+        ofstream resultsWriter(resultsFile.c_str(), ios_base::trunc);
+        WriteResults(resultsWriter, results);
+    }
+    ErrorLogger::Shutdown();
+    return 0;
+}
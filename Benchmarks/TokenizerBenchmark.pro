@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#
+# Attribute tokenizer and formula microbenchmarks
+#
+#-------------------------------------------------
+
+include(Core.pri)
+
+TARGET = TokenizerBenchmark
+
+SOURCES += TokenizerBenchmark.cpp
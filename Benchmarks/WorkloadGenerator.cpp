@@ -0,0 +1,174 @@
+#include "WorkloadGenerator.h"
+#include <fstream>
+#include <sstream>
+#include "boost/filesystem.hpp"
+#include "CommonConstants.h"
+#include "ErrorLogger.h"
+
+namespace fs = boost::filesystem;
+
+//---------------- CONSTANTS ------------------
+static const string BENCHMARK_MAP_NAME("Benchmark" + SC2MAP_EXTENSION);
+static const string XML_HEADER("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+
+//---------------- HELPERS ------------------
+static bool WriteFile(const fs::path &filePath, const string &contents)
+{
+    ofstream fileWriter(filePath.string().c_str(), ios_base::trunc);
+    fileWriter << contents;
+    fileWriter.close();
+    if(fileWriter.fail())
+    {
+        ErrorLogger::Log("ERROR: WriteFile: could not write " + filePath.string() + ".");
+        return false;
+    }
+    return true;
+}
+
+static string GetTemplateName(size_t templateIndex)
+{
+    ostringstream name;
+    name << "Template" << templateIndex;
+    return name.str();
+}
+
+/* A template with numObjectsPerTemplate new objects, plus one object that modifies
+   an existing object of the map, so that every item is also matched against the
+   map's catalog. */
+static string GenerateTemplateUnitData(const WorkloadSpecT &spec, size_t templateIndex)
+{
+    ostringstream data;
+    data << XML_HEADER << "<Catalog>\n";
+    for(size_t objectIndex = 0; objectIndex < spec.numObjectsPerTemplate; ++objectIndex)
+    {
+        data << "    <CUnit id=\"#id#_" << objectIndex << "\" SC2DM_shouldAlreadyExist=\"no\">\n";
+        for(size_t varIndex = 0; varIndex < spec.numVarsPerObject; ++varIndex)
+        {
+            data << "        <Field" << varIndex << " value=\"#v" << varIndex << "#\"/>\n";
+        }
+        for(size_t formulaIndex = 0; formulaIndex < spec.numFormulasPerObject; ++formulaIndex)
+        {
+            data << "        <Formula" << formulaIndex << " value=\"=#v"
+                << formulaIndex % spec.numVarsPerObject << "#*" << formulaIndex + 2
+                << "+#v0#/4=\"/>\n";
+        }
+        if(spec.numForEachIterations > 0)
+        {
+            data << "        <SC2DM_foreach varName=\"i\" from=\"1\" to=\""
+                << spec.numForEachIterations << "\">\n"
+                << "            <CardLayouts index=\"#i#\" name=\"#id#_#i#\"/>\n"
+                << "        </SC2DM_foreach>\n";
+        }
+        data << "    </CUnit>\n";
+    }
+    if(spec.numMapObjects > 0)
+    {
+        data << "    <CUnit id=\"Unit" << templateIndex % spec.numMapObjects
+            << "\" SC2DM_shouldAlreadyExist=\"yes\" SC2DM_whatToDoIfExists=\"modify\">\n"
+            << "        <LifeMax value=\"#v0#\"/>\n"
+            << "    </CUnit>\n";
+    }
+    data << "</Catalog>\n";
+    return data.str();
+}
+
+static string GenerateCustomItems(const WorkloadSpecT &spec, size_t templateIndex)
+{
+    ostringstream rows;
+    rows << "id";
+    for(size_t varIndex = 0; varIndex < spec.numVarsPerObject; ++varIndex)
+    {
+        rows << ",v" << varIndex;
+    }
+    rows << "\n";
+    for(size_t rowIndex = 0; rowIndex < spec.numRowsPerTemplate; ++rowIndex)
+    {
+        rows << "T" << templateIndex << "R" << rowIndex;
+        for(size_t varIndex = 0; varIndex < spec.numVarsPerObject; ++varIndex)
+        {
+            rows << "," << rowIndex + varIndex + 1;
+        }
+        rows << "\n";
+    }
+    return rows.str();
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+string GenerateUnitCatalog(size_t numObjects)
+{
+    ostringstream data;
+    data << XML_HEADER << "<Catalog>\n";
+    for(size_t objectIndex = 0; objectIndex < numObjects; ++objectIndex)
+    {
+        data << "    <CUnit id=\"Unit" << objectIndex << "\">\n"
+            << "        <LifeMax value=\"" << 100 + objectIndex % 400 << "\"/>\n"
+            << "        <Cost Resource=\"Minerals\" Amount=\"50\"/>\n"
+            << "        <Cost Resource=\"Vespene\" Amount=\"25\"/>\n"
+            << "        <Effect index=\"0\" value=\"Effect" << objectIndex << "\"/>\n"
+            << "        <Effect index=\"1\" value=\"Effect" << objectIndex << "Splash\"/>\n"
+            << "        <LayoutButtons Face=\"Move\" Row=\"0\" Column=\"0\"/>\n"
+            << "        <LayoutButtons Face=\"Stop\" Row=\"0\" Column=\"1\"/>\n"
+            << "    </CUnit>\n";
+    }
+    data << "</Catalog>\n";
+    return data.str();
+}
+
+bool GenerateMap(const WorkloadSpecT &spec, const fs::path &mapPath)
+{
+    try
+    {
+        if(fs::exists(mapPath))
+        {
+            fs::remove_all(mapPath);
+        }
+        fs::create_directories(mapPath/GAME_DATA_PATH);
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: GenerateMap: ") + e.what() + ".");
+        return false;
+    }
+    return WriteFile(mapPath/GAME_DATA_PATH/"UnitData.xml",
+        GenerateUnitCatalog(spec.numMapObjects));
+}
+
+bool GenerateWorkload(const WorkloadSpecT &spec, const fs::path &workspaceFolder,
+    fs::path &mapPath)
+{
+    if(spec.numVarsPerObject == 0)
+    {
+        ErrorLogger::Log("ERROR: GenerateWorkload: objects need at least one variable.");
+        return false;
+    }
+    fs::path templatesFolder = workspaceFolder/TEMPLATES_FOLDER;
+    fs::path customItemsFolder = workspaceFolder/CUSTOM_ITEMS_FOLDER;
+    try
+    {
+        if(fs::exists(workspaceFolder))
+        {
+            fs::remove_all(workspaceFolder);
+        }
+        fs::create_directories(templatesFolder);
+        fs::create_directories(customItemsFolder);
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: GenerateWorkload: ") + e.what() + ".");
+        return false;
+    }
+    for(size_t templateIndex = 0; templateIndex < spec.numTemplates; ++templateIndex)
+    {
+        string templateName = GetTemplateName(templateIndex);
+        fs::path templateFolder = templatesFolder/templateName;
+        fs::create_directory(templateFolder);
+        if(!WriteFile(templateFolder/"UnitData.xml", GenerateTemplateUnitData(spec, templateIndex))
+            || !WriteFile(customItemsFolder/(templateName + ".csv"),
+                GenerateCustomItems(spec, templateIndex)))
+        {
+            return false;
+        }
+    }
+    mapPath = workspaceFolder/MAPS_FOLDER/BENCHMARK_MAP_NAME;
+    return GenerateMap(spec, mapPath);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef _WORKLOAD_GENERATOR_H_
+#define _WORKLOAD_GENERATOR_H_
+
+#include <string>
+#include "boost/filesystem/path.hpp"
+using namespace std;
+
+//Describes a synthetic, SC2-style workload. Every generated value is derived from
+//the spec alone, so the same spec always produces the same files.
+struct WorkloadSpecT
+{
+    size_t numMapObjects;           /* objects in the map's UnitData catalog. */
+    size_t numTemplates;            /* one custom items file per template. */
+    size_t numObjectsPerTemplate;   /* new objects that each item adds. */
+    size_t numVarsPerObject;        /* attributes of each object that hold a variable. */
+    size_t numFormulasPerObject;    /* attributes of each object that hold a formula. */
+    size_t numForEachIterations;    /* iterations of each object's foreach. 0 for none. */
+    size_t numRowsPerTemplate;
+
+    WorkloadSpecT() : numMapObjects(1000), numTemplates(4), numObjectsPerTemplate(2),
+        numVarsPerObject(4), numFormulasPerObject(2), numForEachIterations(3),
+        numRowsPerTemplate(250)
+    {
+    }
+};
+
+//Writes a Templates folder, a Custom Items folder and a map to workspaceFolder,
+//in the layout that DataDuplicator::Execute expects. Any previous workload in
+//workspaceFolder is replaced.
+//@param mapPath: set to the generated map.
+bool GenerateWorkload(const WorkloadSpecT &spec, const boost::filesystem::path &workspaceFolder,
+    boost::filesystem::path &mapPath);
+
+//Writes only the map, i.e. to restore it after a run modified it.
+bool GenerateMap(const WorkloadSpecT &spec, const boost::filesystem::path &mapPath);
+
+//@return : a UnitData catalog of numObjects objects, named "Unit0", "Unit1"...
+//          Each object has array-like children (Cost, Effect, LayoutButtons).
+string GenerateUnitCatalog(size_t numObjects);
+
+#endif //_WORKLOAD_GENERATOR_H_
\ No newline at end of file
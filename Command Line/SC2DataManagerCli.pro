@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Headless command line driver
+#
+#-------------------------------------------------
+
+include(../Core/Core.pri)
+
+TARGET = SC2DataManagerCli
+
+SOURCES += main.cpp \
+    Server.cpp \
+    Watcher.cpp
+
+HEADERS += Server.h \
+    Watcher.h
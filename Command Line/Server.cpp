@@ -0,0 +1,231 @@
+#include "Server.h"
+#include <sstream>
+#include <vector>
+#include "boost/asio.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/tokenizer.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "MapManager.h"
+#include "MapCache.h"
+#include "TemplateCache.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+using namespace std;
+namespace fs = boost::filesystem;
+namespace pt = boost::posix_time;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+namespace asio = boost::asio;
+typedef asio::local::stream_protocol LocalProtocol;
+
+//---------------- CONSTANTS ------------------
+static const char FIELD_DELIM = '\t';
+
+//---------------- STATE ------------------
+/* Everything that is kept between requests. */
+struct ServerStateT
+{
+    DataDuplicator::OptionsT baseOptions;
+    MapCache maps;
+    TemplateCache templates;
+    vector<CatalogLayerPtr> dependencyLayers;   /* of baseOptions, read once. */
+    bool shouldShutDown;
+
+    ServerStateT(const DataDuplicator::OptionsT &options)
+        : baseOptions(options), maps(), templates(), dependencyLayers(), shouldShutDown(false)
+    {
+    }
+};
+
+//---------------- HELPERS ------------------
+static string ErrorReply(const string &message)
+{
+    return string("ERROR") + FIELD_DELIM + message;
+}
+
+static void SplitFields(const string &request, vector<string> &fields)
+{
+    fields.clear();
+    boost::char_separator<char> sep("\t", "", boost::keep_empty_tokens);
+    boost::tokenizer<boost::char_separator<char> > tokens(request, sep);
+    fields.assign(tokens.begin(), tokens.end());
+}
+
+static string Apply(const vector<string> &fields, ServerStateT &state)
+{
+    if(fields.size() < 2)
+    {
+        return ErrorReply("APPLY needs a map path, which may be empty.");
+    }
+    DataDuplicator::OptionsT options = state.baseOptions;
+    try
+    {
+        if(!fields[1].empty())
+        {
+            options.mapPath = fs::system_complete(fields[1]);
+            if(!fs::exists(options.mapPath))
+            {
+                return ErrorReply("map path does not exist: " + fields[1] + ".");
+            }
+        }
+        for(size_t i = 2; i < fields.size(); ++i)
+        {
+            if(!fs::exists(fields[i]))
+            {
+                return ErrorReply("custom items file does not exist: " + fields[i] + ".");
+            }
+            options.customItemsFiles.push_back(fields[i]);
+        }
+    }
+    catch(std::exception &e)
+    {
+        return ErrorReply(e.what());
+    }
+
+    pt::ptime startTime = pt::microsec_clock::universal_time();
+    boost::shared_ptr<MapManager> map;
+    if(!options.mapPath.empty())
+    {
+        map = state.maps.Get(options.mapPath);
+        if(!map)
+        {
+            return ErrorReply("could not load map " + options.mapPath.string() + ".");
+        }
+        map->SetDependencyLayers(state.dependencyLayers);
+    }
+    DataDuplicator::StatsT stats;
+    if(!DataDuplicator::Apply(options, map.get(), state.templates, stats))
+    {
+        //the map may have been changed by some of the items, so it is read again
+        //by the next request.
+        if(map)
+        {
+            state.maps.Remove(options.mapPath);
+        }
+        return ErrorReply("could not apply the custom items. See the error log.");
+    }
+    if(map)
+    {
+        state.maps.MarkSaved(options.mapPath);
+    }
+    double seconds = (pt::microsec_clock::universal_time() - startTime)
+        .total_microseconds() / 1000000.0;
+    ostringstream reply;
+    reply << "OK" << FIELD_DELIM << stats.numItemsCreated << FIELD_DELIM << seconds;
+    return reply.str();
+}
+
+static string HandleRequest(const string &request, ServerStateT &state)
+{
+    vector<string> fields;
+    SplitFields(request, fields);
+    if(fields.empty() || fields[0].empty())
+    {
+        return ErrorReply("empty request.");
+    }
+    const string &command = fields[0];
+    if(ConsoleReporter::IsVerbose())
+    {
+        ConsoleReporter::Detail("Request: " + request);
+    }
+    if(command == "APPLY")
+    {
+        string reply = Apply(fields, state);
+        //make sure the errors of the request are in the log before the client reads it.
+        ErrorLogger::Flush();
+        //a server runs for a long time, so its spans are not kept past the request.
+        Tracer::Flush();
+        return reply;
+    }
+    if(command == "STATUS")
+    {
+        ostringstream reply;
+        reply << "OK" << FIELD_DELIM << state.maps.GetNumMaps() << FIELD_DELIM
+            << state.templates.GetNumTemplates();
+        return reply.str();
+    }
+    if(command == "SHUTDOWN")
+    {
+        state.shouldShutDown = true;
+        return "OK";
+    }
+    return ErrorReply("unknown command \"" + command + "\".");
+}
+
+/* Answers every request of a single client, until it disconnects. */
+static void ServeConnection(LocalProtocol::socket &socket, ServerStateT &state)
+{
+    asio::streambuf requestBuffer;
+    boost::system::error_code error;
+    while(!state.shouldShutDown)
+    {
+        asio::read_until(socket, requestBuffer, '\n', error);
+        if(error)
+        {
+            //the client disconnected.
+            return;
+        }
+        istream requestReader(&requestBuffer);
+        string request;
+        getline(requestReader, request);
+        if(!request.empty() && request[request.size() - 1] == '\r')
+        {
+            request.erase(request.size() - 1);
+        }
+        string reply = HandleRequest(request, state) + "\n";
+        asio::write(socket, asio::buffer(reply), error);
+        if(error)
+        {
+            return;
+        }
+    }
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+bool Server::Run(const fs::path &socketPath, const DataDuplicator::OptionsT &baseOptions)
+{
+    try
+    {
+        //a server that did not shut down cleanly leaves its socket behind.
+        if(fs::exists(socketPath))
+        {
+            fs::remove(socketPath);
+        }
+        asio::io_service ioService;
+        LocalProtocol::acceptor acceptor(ioService, LocalProtocol::endpoint(socketPath.string()));
+        ConsoleReporter::Status("Listening on " + socketPath.string());
+        ServerStateT state(baseOptions);
+        if(!DataDuplicator::LoadDependencyLayers(baseOptions, state.dependencyLayers))
+        {
+            return false;
+        }
+        while(!state.shouldShutDown)
+        {
+            LocalProtocol::socket socket(ioService);
+            acceptor.accept(socket);
+            ServeConnection(socket, state);
+        }
+        acceptor.close();
+        fs::remove(socketPath);
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: Server::Run: ") + e.what() + ".");
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool Server::Run(const fs::path &/*socketPath*/, const DataDuplicator::OptionsT &/*baseOptions*/)
+{
+    ErrorLogger::Log("ERROR: Server::Run: local sockets are not supported on this platform.");
+    return false;
+}
+
+#endif
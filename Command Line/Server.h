@@ -0,0 +1,40 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include "boost/filesystem/path.hpp"
+#include "DataDuplicator.h"
+
+/*
+Serves requests on a local (Unix domain) socket, one connection at a time, until a
+client asks it to shut down. Maps and templates stay in memory between requests,
+and are only read again when their files change on disk, so a request only pays for
+the items it creates.
+
+Requests and replies are single lines. Fields are separated by tabs, so that paths
+can contain spaces. Paths should be absolute, since they are otherwise relative to
+the working directory of the server.
+
+    APPLY <map> <custom items file> <custom items file>...
+        Creates the items of the given custom items files, merges them into the map
+        and saves it. The map may be empty to only write the items to the output
+        folder. Without custom items files, every file of the custom items folder
+        is read.
+        Replies "OK <items created> <seconds>".
+    STATUS
+        Replies "OK <maps in memory> <templates in memory>".
+    SHUTDOWN
+        Replies "OK", then the server stops.
+
+A request that fails is answered with "ERROR <message>". Details are in the error log.
+*/
+namespace Server
+{
+    //@param baseOptions: folders and flags used by every request. Each request
+    //                    gives its own map and custom items files.
+    //@return : false if the socket could not be opened, or this platform does not
+    //          support local sockets.
+    bool Run(const boost::filesystem::path &socketPath,
+        const DataDuplicator::OptionsT &baseOptions);
+}
+
+#endif //_SERVER_H_
@@ -0,0 +1,251 @@
+#include "Watcher.h"
+#include <map>
+#include <set>
+#include <string>
+#include <sstream>
+#include "boost/filesystem.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "IncrementalRun.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+using namespace std;
+namespace fs = boost::filesystem;
+namespace pt = boost::posix_time;
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+//---------------- CONSTANTS ------------------
+//editors often write a file in several steps, so an update waits until nothing
+//changed for this long.
+static const int DEBOUNCE_MILLISECONDS = 100;
+static const uint32_t FILE_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+    IN_CREATE;
+
+//---------------- STATE ------------------
+static volatile sig_atomic_t wasInterrupted = 0;
+
+/* The folders being watched, by inotify watch descriptor. */
+struct WatchedFoldersT
+{
+    int inotifyFd;
+    int templatesFolderWd;
+    int customItemsFolderWd;
+    map<int, string> wdToTemplateName;
+
+    WatchedFoldersT() : inotifyFd(-1), templatesFolderWd(-1), customItemsFolderWd(-1),
+        wdToTemplateName()
+    {
+    }
+};
+
+//---------------- HELPERS ------------------
+static void OnInterrupt(int /*signal*/)
+{
+    wasInterrupted = 1;
+}
+
+static bool AddWatch(WatchedFoldersT &folders, const fs::path &folder, uint32_t events, int &wd)
+{
+    wd = inotify_add_watch(folders.inotifyFd, folder.string().c_str(), events);
+    if(wd < 0)
+    {
+        ErrorLogger::Log("ERROR: Watcher::Run: could not watch folder \"" + folder.string()
+            + "\": " + strerror(errno) + ".");
+        return false;
+    }
+    return true;
+}
+
+/* Watches every template folder, including ones that are already watched, and adds
+   the name of each to templateNames. */
+static bool WatchTemplateFolders(const DataDuplicator::OptionsT &options,
+    WatchedFoldersT &folders, set<string> &templateNames)
+{
+    try
+    {
+        for(fs::directory_iterator it(options.templatesFolder); it != fs::directory_iterator(); it++)
+        {
+            int wd;
+            if(fs::is_directory(it->path()))
+            {
+                if(!AddWatch(folders, it->path(), FILE_EVENTS, wd))
+                {
+                    return false;
+                }
+                folders.wdToTemplateName[wd] = it->path().filename();
+                templateNames.insert(it->path().filename());
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: Watcher::Run: ") + e.what() + ".");
+        return false;
+    }
+    return true;
+}
+
+static bool WatchFolders(const DataDuplicator::OptionsT &options, WatchedFoldersT &folders)
+{
+    set<string> templateNames;
+    return (AddWatch(folders, options.templatesFolder, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR,
+        folders.templatesFolderWd) &&
+        AddWatch(folders, options.customItemsFolder, FILE_EVENTS, folders.customItemsFolderWd) &&
+        WatchTemplateFolders(options, folders, templateNames));
+}
+
+/* Reads the pending events, and records what they changed.
+   @return : false if the events could not be read. */
+static bool ReadEvents(const DataDuplicator::OptionsT &options, WatchedFoldersT &folders,
+    set<string> &changedTemplateNames, bool &wasChanged)
+{
+    char buffer[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length = read(folders.inotifyFd, buffer, sizeof(buffer));
+    if(length < 0)
+    {
+        return (errno == EINTR || errno == EAGAIN);
+    }
+    for(char *ptr = buffer; ptr < buffer + length;
+        ptr += sizeof(struct inotify_event) + ((struct inotify_event *) ptr)->len)
+    {
+        const struct inotify_event *event = (const struct inotify_event *) ptr;
+        string name = (event->len > 0 ? event->name : "");
+        if(event->mask & IN_Q_OVERFLOW)
+        {
+            //events were dropped, so anything may have changed, including which
+            //template folders exist.
+            ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: Watcher::Run: too many "
+                "changes at once to tell them apart. Every template and custom items file "
+                "is checked again.");
+            WatchTemplateFolders(options, folders, changedTemplateNames);
+            wasChanged = true;
+        }
+        else if(event->wd == folders.templatesFolderWd)
+        {
+            //a new template.
+            int wd;
+            if((event->mask & IN_ISDIR) &&
+                AddWatch(folders, options.templatesFolder/name, FILE_EVENTS, wd))
+            {
+                folders.wdToTemplateName[wd] = name;
+                changedTemplateNames.insert(name);
+                wasChanged = true;
+            }
+        }
+        else if(event->wd == folders.customItemsFolderWd)
+        {
+            wasChanged = true;
+        }
+        else if(folders.wdToTemplateName.count(event->wd) > 0 &&
+            fs::path(name).extension() == ".xml")
+        {
+            changedTemplateNames.insert(folders.wdToTemplateName[event->wd]);
+            wasChanged = true;
+        }
+    }
+    return true;
+}
+
+static void ReportUpdate(bool success, size_t numItemsRedone, const pt::ptime &startTime,
+    const IncrementalRun &run)
+{
+    double seconds = (pt::microsec_clock::universal_time() - startTime).total_microseconds()
+        / 1000000.0;
+    if(!success)
+    {
+        ConsoleReporter::Status("Update failed. Details are in the error log. Waiting for "
+            "the next change.");
+        return;
+    }
+    ostringstream status;
+    status << "Updated " << numItemsRedone << " of " << run.GetNumItems() << " items in "
+        << seconds << " s.";
+    ConsoleReporter::Status(status.str());
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+bool Watcher::Run(const DataDuplicator::OptionsT &options)
+{
+    WatchedFoldersT folders;
+    folders.inotifyFd = inotify_init();
+    if(folders.inotifyFd < 0)
+    {
+        ErrorLogger::Log(string("ERROR: Watcher::Run: ") + strerror(errno) + ".");
+        return false;
+    }
+    //folders are watched before the first run, so that no change is missed.
+    IncrementalRun run;
+    size_t numItemsCreated = 0;
+    if(!WatchFolders(options, folders) || !run.Create(options, numItemsCreated))
+    {
+        close(folders.inotifyFd);
+        return false;
+    }
+    ConsoleReporter::Status("Watching " + options.templatesFolder.string() + " and "
+        + options.customItemsFolder.string() + ". Interrupt to stop.");
+    ErrorLogger::Flush();
+    Tracer::Flush();
+    signal(SIGINT, OnInterrupt);
+    signal(SIGTERM, OnInterrupt);
+
+    set<string> changedTemplateNames;
+    bool wasChanged = false;
+    bool success = true;
+    while(!wasInterrupted)
+    {
+        struct pollfd pollFd;
+        pollFd.fd = folders.inotifyFd;
+        pollFd.events = POLLIN;
+        int numReady = poll(&pollFd, 1, (wasChanged ? DEBOUNCE_MILLISECONDS : -1));
+        if(numReady < 0 && errno != EINTR)
+        {
+            ErrorLogger::Log(string("ERROR: Watcher::Run: ") + strerror(errno) + ".");
+            success = false;
+            break;
+        }
+        if(numReady > 0)
+        {
+            if(!ReadEvents(options, folders, changedTemplateNames, wasChanged))
+            {
+                ErrorLogger::Log(string("ERROR: Watcher::Run: ") + strerror(errno) + ".");
+                success = false;
+                break;
+            }
+            continue;
+        }
+        if(numReady == 0 && wasChanged)
+        {
+            pt::ptime startTime = pt::microsec_clock::universal_time();
+            size_t numItemsRedone = 0;
+            bool wasUpdated = run.Update(changedTemplateNames, numItemsRedone);
+            ReportUpdate(wasUpdated, numItemsRedone, startTime, run);
+            ErrorLogger::Flush();
+            //a watcher runs for a long time, so its spans are not kept past the update.
+            Tracer::Flush();
+            changedTemplateNames.clear();
+            wasChanged = false;
+        }
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    close(folders.inotifyFd);
+    return success;
+}
+
+#else
+
+bool Watcher::Run(const DataDuplicator::OptionsT &/*options*/)
+{
+    ErrorLogger::Log("ERROR: Watcher::Run: watching folders is not supported on this platform.");
+    return false;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _WATCHER_H_
+#define _WATCHER_H_
+
+#include "DataDuplicator.h"
+
+/*
+Updates a map every time a custom items file or template changes, until the
+program is interrupted. After a full run, only the rows that changed (and every row
+of a file whose template changed) are created again, and only the map objects that
+their items were merged into are rebuilt, so an update takes about as long as the
+changed items do. Changes that arrive close together are handled as one update.
+If so many arrive at once that the system drops some, every template and custom items
+file is checked again.
+
+The map should not be edited by anything else while it is watched, since it is only
+read once.
+*/
+namespace Watcher
+{
+    //@param options: the run to keep up to date. The map path may be empty to only
+    //                write the items to the output folder.
+    //@return : false if the first run failed, the folders could not be watched, or
+    //          this platform can not watch folders. Failed updates are reported,
+    //          and the next change is tried again.
+    bool Run(const DataDuplicator::OptionsT &options);
+}
+
+#endif //_WATCHER_H_
@@ -0,0 +1,349 @@
+/*
+	Starcraft 2 Data Manager - headless command line
+
+	--Description--
+	Runs the data duplicator without any interaction, so that it can be scripted
+	(i.e. in build jobs). Everything the desktop command line app reads from
+	"parameters.txt" is given as arguments instead, and the program exits as soon
+	as it is done. Portable: only depends on Core/, Boost and the bundled libraries.
+
+	With --serve, it instead keeps running as a server on a local socket, and keeps
+	maps and templates in memory between requests (see Server.h).
+
+	With --watch, it keeps the map up to date as custom items files and templates
+	change, redoing only the changed items (see Watcher.h).
+
+	With --plan, it only prints what updating the map would change, object by object,
+	without writing anything (see DataDuplicator::Plan).
+
+	--Exit codes--
+	0: every map was updated (or, without maps, every item was written).
+	1: the run failed. Details are in the error log.
+	2: the arguments are invalid.
+*/
+
+#include <iostream>
+#include <vector>
+#include "boost/program_options.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/foreach.hpp"
+#include "CommonConstants.h"
+#include "ErrorLogger.h"
+#include "DataDuplicator.h"
+#include "MergeChangeSet.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "MemoryAccounting.h"
+#include "Template.h"
+#include "Server.h"
+#include "Watcher.h"
+using namespace std;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+//---------------- CONSTANTS ------------------
+enum ExitCodeT
+{
+    SUCCESS_EXIT_CODE = 0,
+    FAILURE_EXIT_CODE = 1,
+    USAGE_EXIT_CODE = 2
+};
+
+/* Program arguments, as read from the command line. */
+struct ProgramArgsT
+{
+    vector<fs::path> mapPaths;      /* empty if items should only be written to the
+                                       output folder. */
+    DataDuplicator::OptionsT options;   /* everything but the map path. */
+    ConsoleReporter::VerbosityT verbosity;
+    fs::path traceFile;             /* empty if not tracing. */
+    fs::path memoryReportFile;      /* JSON report of the XML memory usage. Empty if
+                                       not counting memory. */
+    fs::path countersFile;          /* empty if the counters should not be written. */
+    fs::path socketPath;            /* empty unless running as a server. */
+    bool shouldWatch;
+    string planFormat;              /* "diff" or "json". Empty unless only planning. */
+
+    ProgramArgsT() : mapPaths(), options(), verbosity(ConsoleReporter::PROGRESS_VERBOSITY),
+        traceFile(""), memoryReportFile(""), countersFile(""), socketPath(""), shouldWatch(false),
+        planFormat("")
+    {
+    }
+};
+
+//---------------- HELPERS ------------------
+/* @return : an exit code if the program should exit right away, i.e. on --help
+             or invalid arguments. SUCCESS_EXIT_CODE if it should run. */
+static ExitCodeT ReadArgs(int argc, char *argv[], ProgramArgsT &args, bool &shouldRun)
+{
+    shouldRun = false;
+    DataDuplicator::OptionsT &options = args.options;
+    vector<string> mapPaths, dependencyPaths;
+    string templatesFolder, customItemsFolder, outputFolder, backupFolder;
+    string verbosity, traceFile, memoryReportFile, countersFile, socketPath, itemCacheFolder;
+    string snapshotFolder;
+    po::options_description description("Usage: SC2DataManagerCli [options]\nOptions");
+    description.add_options()
+        ("help,h", "print this message.")
+        ("map,m", po::value<vector<string> >(&mapPaths),
+            "map to add the items to. Repeat to update several maps at once, creating "
+            "each item only once. Without any, items are only written to the output folder.")
+        ("map-threads", po::value<size_t>(&options.numMapThreads)
+            ->default_value(options.numMapThreads),
+            "number of maps updated at once. 0 for one per processor.")
+        ("dependency,d", po::value<vector<string> >(&dependencyPaths),
+            "mod (or map) folder that every map depends on, whose objects items may modify. "
+            "Repeat in the order of the maps' dependencies; it is read once for every map.")
+        ("templates,t", po::value<string>(&templatesFolder)
+            ->default_value(options.templatesFolder.string()), "templates folder.")
+        ("custom-items,c", po::value<string>(&customItemsFolder)
+            ->default_value(options.customItemsFolder.string()), "custom items folder.")
+        ("output,o", po::value<string>(&outputFolder)
+            ->default_value(options.outputFolder.string()), "folder the items are written to.")
+        ("backup,b", po::value<string>(&backupFolder)
+            ->default_value(options.backupFolder.string()),
+            "folder every map is backed up to before it is changed.")
+        ("pipeline,p", po::bool_switch(&options.usePipeline),
+            "create, merge and write each item as soon as its row is read.")
+        ("threads,j", po::value<size_t>(&options.numInstantiateThreads)
+            ->default_value(options.numInstantiateThreads),
+            "number of threads that instantiate items. More than 1 implies --pipeline.")
+        ("parallel-merge", po::bool_switch(&options.useFileMergeWorkers),
+            "merge items into each data file of the map on its own thread.")
+        ("merge-stripes", po::value<size_t>(&options.numMergeStripes)
+            ->default_value(options.numMergeStripes),
+            "number of threads merging into each data file at once. More than 1 implies "
+            "--parallel-merge.")
+        ("bulk-merge", po::bool_switch(&options.useBulkMerge),
+            "create every item first, then merge them all into each data file in one "
+            "sorted pass. Ignored with --pipeline, --parallel-merge and --incremental.")
+        ("verbosity,v", po::value<string>(&verbosity)->default_value("progress"),
+            "quiet, progress or verbose.")
+        ("trace", po::value<string>(&traceFile),
+            "write a Chrome trace of the run to this file.")
+        ("memory-report", po::value<string>(&memoryReportFile),
+            "write the memory used by the XML data to this file.")
+        ("counters", po::value<string>(&countersFile),
+            "write the performance counters to this file.")
+        ("serve", po::value<string>(&socketPath),
+            "keep running as a server on this local socket, instead of updating maps "
+            "once. Each request names its own map.")
+        ("incremental,i", po::bool_switch(&options.useManifest),
+            "keep a manifest of the items in each map, and only redo the items that "
+            "changed since the map was last updated.")
+        ("lazy", po::bool_switch(&options.useLazyLoading),
+            "only parse the objects of each map that items merge into, and write the rest "
+            "of its data files back unchanged.")
+        ("snapshot-cache", po::value<string>(&snapshotFolder),
+            "keep the object index of each map in this folder, so that a map that did not "
+            "change is not indexed again by the next run. Implies --lazy.")
+        ("item-cache", po::value<string>(&itemCacheFolder),
+            "cache instantiated items in this folder, and read them back whenever the "
+            "same template and row are used again, by any run of any map.")
+        ("watch,w", po::bool_switch(&args.shouldWatch),
+            "keep running, and update the map every time a custom items file or template "
+            "changes, redoing only the changed items.")
+        ("plan", po::value<string>(&args.planFormat)->implicit_value("diff"),
+            "only print what updating the map would change, object by object, as a diff "
+            "or as json, without backing up, writing or saving anything.");
+    try
+    {
+        po::variables_map variables;
+        po::store(po::parse_command_line(argc, argv, description), variables);
+        po::notify(variables);
+        if(variables.count("help"))
+        {
+            cout << description << "\n";
+            return SUCCESS_EXIT_CODE;
+        }
+    }
+    catch(std::exception &e)
+    {
+        cerr << "ERROR: " << e.what() << "\n" << description << "\n";
+        return USAGE_EXIT_CODE;
+    }
+    if(!ConsoleReporter::ParseVerbosity(verbosity, args.verbosity))
+    {
+        cerr << "ERROR: invalid verbosity \"" << verbosity << "\". Expected quiet, progress "
+            "or verbose.\n";
+        return USAGE_EXIT_CODE;
+    }
+    if(options.numInstantiateThreads == 0)
+    {
+        cerr << "ERROR: --threads must be at least 1.\n";
+        return USAGE_EXIT_CODE;
+    }
+    if(options.numMergeStripes == 0)
+    {
+        cerr << "ERROR: --merge-stripes must be at least 1.\n";
+        return USAGE_EXIT_CODE;
+    }
+    if(!socketPath.empty() && !mapPaths.empty())
+    {
+        cerr << "ERROR: --map can not be used with --serve. Each request names its map.\n";
+        return USAGE_EXIT_CODE;
+    }
+    if(args.shouldWatch && (!socketPath.empty() || mapPaths.size() > 1))
+    {
+        cerr << "ERROR: --watch updates at most one map, and can not be used with --serve.\n";
+        return USAGE_EXIT_CODE;
+    }
+    if(!args.planFormat.empty())
+    {
+        if(args.planFormat != "diff" && args.planFormat != "json")
+        {
+            cerr << "ERROR: invalid plan format \"" << args.planFormat << "\". Expected diff "
+                "or json.\n";
+            return USAGE_EXIT_CODE;
+        }
+        if(mapPaths.size() != 1 || !socketPath.empty() || args.shouldWatch ||
+            options.useManifest)
+        {
+            cerr << "ERROR: --plan needs exactly one map, and can not be used with --serve, "
+                "--watch or --incremental.\n";
+            return USAGE_EXIT_CODE;
+        }
+    }
+    BOOST_FOREACH(const string &mapPath, mapPaths)
+    {
+        if(!fs::exists(mapPath))
+        {
+            cerr << "ERROR: map path does not exist: " << mapPath << ".\n";
+            return USAGE_EXIT_CODE;
+        }
+        args.mapPaths.push_back(mapPath);
+    }
+    BOOST_FOREACH(const string &dependencyPath, dependencyPaths)
+    {
+        if(!fs::exists(dependencyPath))
+        {
+            cerr << "ERROR: dependency path does not exist: " << dependencyPath << ".\n";
+            return USAGE_EXIT_CODE;
+        }
+        options.dependencyPaths.push_back(dependencyPath);
+    }
+    //a server's requests usually name their custom items files.
+    if(socketPath.empty() && !fs::exists(customItemsFolder))
+    {
+        cerr << "ERROR: custom items folder does not exist: " << customItemsFolder << ".\n";
+        return USAGE_EXIT_CODE;
+    }
+    options.templatesFolder = templatesFolder;
+    options.customItemsFolder = customItemsFolder;
+    options.outputFolder = outputFolder;
+    options.backupFolder = backupFolder;
+    options.itemCacheFolder = itemCacheFolder;
+    options.snapshotFolder = snapshotFolder;
+    options.useLazyLoading = (options.useLazyLoading || !snapshotFolder.empty());
+    options.usePipeline = (options.usePipeline || options.numInstantiateThreads > 1);
+    options.useFileMergeWorkers = (options.useFileMergeWorkers || options.numMergeStripes > 1);
+    args.traceFile = traceFile;
+    args.memoryReportFile = memoryReportFile;
+    args.countersFile = countersFile;
+    args.socketPath = socketPath;
+    shouldRun = true;
+    return SUCCESS_EXIT_CODE;
+}
+
+static bool Execute(const ProgramArgsT &args)
+{
+    if(!args.traceFile.empty() && !Tracer::Enable(args.traceFile))
+    {
+        return false;
+    }
+    //no XML document exists yet, so the allocation functions can still be replaced.
+    if(!args.memoryReportFile.empty())
+    {
+        MemoryAccounting::Install();
+    }
+    if(!args.socketPath.empty())
+    {
+        return Template::InitTemplates() && Server::Run(args.socketPath, args.options);
+    }
+    DataDuplicator::OptionsT options = args.options;
+    if(args.shouldWatch)
+    {
+        options.mapPath = (args.mapPaths.empty() ? fs::path("") : args.mapPaths.front());
+        return Template::InitTemplates() && Watcher::Run(options);
+    }
+    DataDuplicator::StatsT stats;
+    if(!args.planFormat.empty())
+    {
+        options.mapPath = args.mapPaths.front();
+        MergeChangeSet changeSet;
+        if(!DataDuplicator::Plan(options, changeSet, stats))
+        {
+            return false;
+        }
+        if(args.planFormat == "json")
+        {
+            changeSet.WriteJSON(cout);
+        }
+        else
+        {
+            changeSet.WriteDiff(cout);
+        }
+        return true;
+    }
+    if(args.mapPaths.empty())
+    {
+        return DataDuplicator::Execute(options, stats);
+    }
+    //each map has its own manifest, so incremental runs update maps one at a time.
+    if(args.mapPaths.size() > 1 && !options.useManifest)
+    {
+        return DataDuplicator::ExecuteBatch(options, args.mapPaths, stats);
+    }
+    BOOST_FOREACH(const fs::path &mapPath, args.mapPaths)
+    {
+        ConsoleReporter::Status("Updating map " + mapPath.string());
+        options.mapPath = mapPath;
+        if(!DataDuplicator::Execute(options, stats))
+        {
+            ErrorLogger::Log("ERROR: Execute: failed to update map \"" + mapPath.string() + "\".");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    ProgramArgsT args;
+    bool shouldRun = false;
+    ExitCodeT exitCode = ReadArgs(argc, argv, args, shouldRun);
+    if(!shouldRun)
+    {
+        return exitCode;
+    }
+    if(!ErrorLogger::Init())
+    {
+        return FAILURE_EXIT_CODE;
+    }
+    ConsoleReporter::SetVerbosity(args.verbosity);
+    if(!args.planFormat.empty())
+    {
+        //standard output only carries the plan.
+        ConsoleReporter::SetStream(cerr);
+    }
+    bool success = Execute(args);
+    //the trace, counters and memory report are written even if the run failed, since that is when
+    //they are most useful.
+    if(!Tracer::Close())
+    {
+        success = false;
+    }
+    if(!args.countersFile.empty() && !PerfCounters::WriteJSON(args.countersFile))
+    {
+        success = false;
+    }
+    if(MemoryAccounting::IsInstalled() && !MemoryAccounting::WriteJSON(args.memoryReportFile))
+    {
+        success = false;
+    }
+    ErrorLogger::Flush();
+    ConsoleReporter::Status(success ? "Success!" : "Failed.");
+    ErrorLogger::Shutdown();
+    return (success ? SUCCESS_EXIT_CODE : FAILURE_EXIT_CODE);
+}
@@ -0,0 +1,51 @@
+#ifndef _ATOMIC_OPS_H_
+#define _ATOMIC_OPS_H_
+
+#include "boost/version.hpp"
+#include "boost/cstdint.hpp"
+#include "boost/interprocess/detail/atomic.hpp"
+
+//Thin wrappers around the 32-bit atomic operations that Boost.Interprocess
+//provides. Every operation is a full memory barrier.
+namespace AtomicOps
+{
+#if BOOST_VERSION < 104800
+    namespace ipc = boost::interprocess::detail;
+#else
+    namespace ipc = boost::interprocess::ipcdetail;
+#endif
+
+    typedef boost::uint32_t AtomicUInt32;
+
+    inline AtomicUInt32 Load(volatile AtomicUInt32 *value)
+    {
+        return ipc::atomic_read32(value);
+    }
+
+    inline void Store(volatile AtomicUInt32 *value, AtomicUInt32 newValue)
+    {
+        ipc::atomic_write32(value, newValue);
+    }
+
+    //@return : the value before the increment.
+    inline AtomicUInt32 Increment(volatile AtomicUInt32 *value)
+    {
+        return ipc::atomic_inc32(value);
+    }
+
+    //@return : the value before the decrement.
+    inline AtomicUInt32 Decrement(volatile AtomicUInt32 *value)
+    {
+        return ipc::atomic_dec32(value);
+    }
+
+    //Sets value to newValue if it is equal to expectedValue.
+    //@return : the value before the operation.
+    inline AtomicUInt32 CompareAndSwap(volatile AtomicUInt32 *value, AtomicUInt32 newValue,
+        AtomicUInt32 expectedValue)
+    {
+        return ipc::atomic_cas32(value, newValue, expectedValue);
+    }
+}
+
+#endif //_ATOMIC_OPS_H_
\ No newline at end of file
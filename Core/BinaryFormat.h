@@ -0,0 +1,86 @@
+#ifndef _BINARY_FORMAT_H_
+#define _BINARY_FORMAT_H_
+
+#include <string>
+#include "boost/cstdint.hpp"
+using namespace std;
+
+/* Reads and writes the fixed-width fields of the binary files the program keeps
+   between runs. Integers are written little-endian whatever the platform, so the
+   files can be shared between machines. */
+namespace BinaryFormat
+{
+    inline void AppendUInt64(string &data, boost::uint64_t value)
+    {
+        for(int i = 0; i < 8; ++i)
+        {
+            data += (char) ((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    //appends str's size, then str.
+    inline void AppendString(string &data, const string &str)
+    {
+        AppendUInt64(data, str.size());
+        data += str;
+    }
+
+    /* Reads the fields of data in the order they were appended. Every read fails
+       once data runs out, so a file that was cut short is never read past. */
+    class Reader
+    {
+    public:
+        Reader(const string &data, size_t pos=0) : _data(data), _pos(pos)
+        {
+        }
+
+        bool ReadUInt64(boost::uint64_t &value)
+        {
+            if(_data.size() - _pos < 8)
+            {
+                return false;
+            }
+            value = 0;
+            for(int i = 7; i >= 0; --i)
+            {
+                value = (value << 8) | (unsigned char) _data[_pos + i];
+            }
+            _pos += 8;
+            return true;
+        }
+
+        bool ReadSize(size_t &value)
+        {
+            boost::uint64_t wideValue = 0;
+            if(!ReadUInt64(wideValue) || wideValue != (size_t) wideValue)
+            {
+                return false;
+            }
+            value = (size_t) wideValue;
+            return true;
+        }
+
+        bool ReadString(string &str)
+        {
+            size_t size = 0;
+            if(!ReadSize(size) || _data.size() - _pos < size)
+            {
+                return false;
+            }
+            str.assign(_data, _pos, size);
+            _pos += size;
+            return true;
+        }
+
+        bool IsAtEnd() const
+        {
+            return _pos == _data.size();
+        }
+
+    private:
+        const string &_data;
+        size_t _pos;
+    };
+}
+
+#endif //_BINARY_FORMAT_H_
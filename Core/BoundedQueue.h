@@ -0,0 +1,93 @@
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_
+
+#include <deque>
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+
+//A fixed-capacity FIFO queue used to hand work from one thread to another.
+//Producers block while the queue is full, and consumers block while it is
+//empty, so a chain of these queues keeps the amount of in-flight work constant.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : _capacity(capacity > 0 ? capacity : 1)
+        , _values()
+        , _isClosed(false)
+        , _isCancelled(false)
+    {
+    }
+
+    //Blocks while the queue is full.
+    //@return : false if the queue was cancelled, in which case value was dropped.
+    bool Push(const T &value)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        while(_values.size() >= _capacity && !_isCancelled)
+        {
+            _notFull.wait(lock);
+        }
+        if(_isCancelled || _isClosed)
+        {
+            return false;
+        }
+        _values.push_back(value);
+        _notEmpty.notify_one();
+        return true;
+    }
+
+    //Blocks while the queue is empty.
+    //@return : false once the queue is closed and drained, or cancelled.
+    bool Pop(T &value)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        while(_values.empty() && !_isClosed && !_isCancelled)
+        {
+            _notEmpty.wait(lock);
+        }
+        if(_isCancelled || _values.empty())
+        {
+            return false;
+        }
+        value = _values.front();
+        _values.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    //Signals that nothing more will be pushed. Consumers drain what is left.
+    void Close()
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _isClosed = true;
+        _notEmpty.notify_all();
+        _notFull.notify_all();
+    }
+
+    //Wakes up every waiting thread and makes all further operations fail.
+    //Values still in the queue are released when the queue is destroyed.
+    void Cancel()
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _isCancelled = true;
+        _notEmpty.notify_all();
+        _notFull.notify_all();
+    }
+
+private:
+    //non-copyable semantics
+    BoundedQueue(const BoundedQueue &other);
+    const BoundedQueue& operator=(const BoundedQueue&);
+
+    const size_t _capacity;
+    std::deque<T> _values;
+    bool _isClosed;
+    bool _isCancelled;
+    boost::mutex _mutex;
+    boost::condition_variable _notEmpty;
+    boost::condition_variable _notFull;
+};
+
+#endif //_BOUNDED_QUEUE_H_
\ No newline at end of file
@@ -0,0 +1,463 @@
+#include "BulkCatalogMerge.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <utility>
+#include "boost/foreach.hpp"
+#include "boost/shared_ptr.hpp"
+#include "CommonConstants.h"
+#include "CustomItem.h"
+#include "MapManager.h"
+#include "MergeChangeSet.h"
+#include "MergePlan.h"
+#include "NodeMatch.h"
+#include "ObjectMerge.h"
+#include "ErrorLogger.h"
+#include "PerfCounters.h"
+#include "Tracer.h"
+
+//---------------- CONSTANTS ------------------
+static const size_t NOT_APPENDED = (size_t) -1;
+
+//---------------- STATE ------------------
+/* Orders objects by name, then id. */
+class BulkCatalogMerge::KeyLess
+{
+public:
+    explicit KeyLess(const vector<PendingObjectT> &pendingObjects)
+        : _pendingObjects(pendingObjects)
+    {
+    }
+    bool operator()(size_t first, size_t second) const
+    {
+        const PendingObjectT &firstObject = _pendingObjects[first];
+        const PendingObjectT &secondObject = _pendingObjects[second];
+        int nameOrder = strcmp(firstObject.name, secondObject.name);
+        return (nameOrder != 0 ? nameOrder : strcmp(firstObject.id, secondObject.id)) < 0;
+    }
+
+private:
+    const vector<PendingObjectT> &_pendingObjects;
+};
+
+/* An object that the objects of a key may match, and when it was appended. */
+struct MatchT
+{
+    xml_node object;
+    size_t appendedBy;      /* index of the pending object that appended it, or
+                               NOT_APPENDED if it was already in the catalog. */
+
+    MatchT(xml_node object, size_t appendedBy) : object(object), appendedBy(appendedBy)
+    {
+    }
+};
+
+/* The objects [begin, end) of the sorted objects, which share a key, and the objects
+   they may match, first to last. Objects appended come after the catalog's, as they
+   would at the end of the catalog. */
+struct SortedKeyT
+{
+    size_t begin;
+    size_t end;
+    deque<MatchT> matches;
+    vector<xml_node> *keyObjects;   /* the catalog's objects of the key, in the index. */
+};
+
+/* An object staged to be appended to the catalog, and the key it is indexed under. */
+struct AppendedObjectT
+{
+    size_t sequence;
+    xml_node object;
+    vector<xml_node> *keyObjects;
+
+    AppendedObjectT(size_t sequence, xml_node object, vector<xml_node> *keyObjects)
+        : sequence(sequence), object(object), keyObjects(keyObjects)
+    {
+    }
+    bool operator<(const AppendedObjectT &other) const
+    {
+        return sequence < other.sequence;
+    }
+};
+
+//---------------- PUBLIC FUNCTIONS ------------------
+BulkCatalogMerge::BulkCatalogMerge(MapManager &mapManager)
+    : _mapManager(mapManager)
+    , _filenameToPendingObjects()
+    , _pendingItems()
+    , _conflicts()
+    , _changeSet(NULL)
+{
+}
+
+BulkCatalogMerge::~BulkCatalogMerge()
+{
+}
+
+void BulkCatalogMerge::Add(const boost::shared_ptr<CustomItem> &item)
+{
+    _pendingItems.push_back(item);
+    typedef pair<string, xml_document *> stringXMLDocPair;
+    BOOST_FOREACH(const stringXMLDocPair &filenameAndDoc, item->GetDataFiles())
+    {
+        vector<PendingObjectT> &pendingObjects = _filenameToPendingObjects[filenameAndDoc.first];
+        xml_node customItemCatalog = filenameAndDoc.second->child(CATALOG_NAME.c_str());
+        for(xml_node customItemObject = customItemCatalog.first_child(); customItemObject;
+            customItemObject = customItemObject.next_sibling())
+        {
+            PendingObjectT pendingObject;
+            pendingObject.object = customItemObject;
+            pendingObject.item = item.get();
+            pendingObject.name = customItemObject.name();
+            //an id with a quote is not a valid XPath literal, so it is left to the
+            //query to fail as it always has.
+            xml_attribute idAttr = customItemObject.attribute(OBJECT_ID_NAME.c_str());
+            bool isKeyedById = idAttr && strchr(idAttr.value(), '\'') == NULL &&
+                GetNodeXPath(customItemObject) == string(pendingObject.name) + "[@" +
+                OBJECT_ID_NAME + "='" + idAttr.value() + "']";
+            pendingObject.id = (isKeyedById ? idAttr.value() : NULL);
+            pendingObjects.push_back(pendingObject);
+        }
+    }
+}
+
+bool BulkCatalogMerge::Commit()
+{
+    TRACE_SCOPE("BulkMerge");
+    bool success = true;
+    typedef pair<string, vector<PendingObjectT> > stringPendingObjectsPair;
+    BOOST_FOREACH(const stringPendingObjectsPair &filenameAndObjects, _filenameToPendingObjects)
+    {
+        bool wasEdited = false;
+        success = MergeFile(filenameAndObjects.first, filenameAndObjects.second, wasEdited);
+        if(wasEdited)
+        {
+            _mapManager.SetDataFileWasEdited(filenameAndObjects.first);
+        }
+        if(!success)
+        {
+            break;
+        }
+    }
+    _filenameToPendingObjects.clear();
+    _pendingItems.clear();
+    return success;
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+bool BulkCatalogMerge::MergeFile(const string &fileName,
+    const vector<PendingObjectT> &pendingObjects, bool &wasEdited)
+{
+    TRACE_SCOPE_DETAIL("BulkMergeFile", fileName);
+    xml_node catalog = _mapManager.GetDataFileCatalog(fileName);
+    //indexed once, then kept up to date by every merge.
+    CatalogIndexT catalogIndex;
+    IndexCatalog(catalog, catalogIndex);
+    KeyToItemIdT keyToLastItemId;
+    size_t sortedBegin = 0;
+    //objects without an id split the others into runs, each merged once the objects
+    //before it are in the catalog.
+    for(size_t i = 0; i <= pendingObjects.size(); ++i)
+    {
+        if(i < pendingObjects.size() && pendingObjects[i].id)
+        {
+            continue;
+        }
+        if(!MergeSorted(fileName, catalog, catalogIndex, pendingObjects, sortedBegin, i,
+            keyToLastItemId, wasEdited))
+        {
+            return false;
+        }
+        if(i < pendingObjects.size() &&
+            !MergeUnsorted(fileName, catalog, catalogIndex, pendingObjects[i], i, wasEdited))
+        {
+            return false;
+        }
+        sortedBegin = i + 1;
+    }
+    return true;
+}
+
+bool BulkCatalogMerge::MergeSorted(const string &fileName, xml_node catalog,
+    CatalogIndexT &catalogIndex, const vector<PendingObjectT> &pendingObjects, size_t begin,
+    size_t end, KeyToItemIdT &keyToLastItemId, bool &wasEdited)
+{
+    if(begin == end)
+    {
+        return true;
+    }
+    vector<xml_node> materializedObjects;
+    for(size_t i = begin; i < end; ++i)
+    {
+        if(!_mapManager.MaterializeMatchingObjects(fileName, pendingObjects[i].object, catalog,
+            &materializedObjects))
+        {
+            return false;
+        }
+    }
+    IndexMaterializedObjects(materializedObjects, catalogIndex);
+    //each key's objects stay in the order they were added.
+    KeyLess keyLess(pendingObjects);
+    vector<size_t> sortedObjects;
+    for(size_t i = begin; i < end; ++i)
+    {
+        sortedObjects.push_back(i);
+    }
+    stable_sort(sortedObjects.begin(), sortedObjects.end(), keyLess);
+
+    //every key is planned before the catalog is changed, so that every error is
+    //reported, and a run that fails leaves the catalog as it was.
+    xml_document stagingDoc;
+    xml_node stagingCatalog = stagingDoc.append_child(CATALOG_NAME.c_str());
+    vector<boost::shared_ptr<MergePlan> > plans;
+    vector<vector<xml_node> *> plannedKeyObjects;  /* the index's objects of each plan's key. */
+    vector<SortedKeyT> duplicateKeys;   /* keys the catalog has several objects of. */
+    bool success = true;
+    for(size_t keyBegin = 0; keyBegin < sortedObjects.size();)
+    {
+        const PendingObjectT &keyObject = pendingObjects[sortedObjects[keyBegin]];
+        SortedKeyT key;
+        key.begin = keyBegin;
+        key.end = keyBegin;
+        while(key.end < sortedObjects.size() &&
+            !keyLess(sortedObjects[keyBegin], sortedObjects[key.end]))
+        {
+            ++key.end;
+        }
+        keyBegin = key.end;
+        key.keyObjects = &catalogIndex[make_pair(string(keyObject.name), string(keyObject.id))];
+        if(key.keyObjects->size() > 1)
+        {
+            BOOST_FOREACH(const xml_node &mapObject, *key.keyObjects)
+            {
+                key.matches.push_back(MatchT(mapObject, NOT_APPENDED));
+            }
+            duplicateKeys.push_back(key);
+            continue;
+        }
+        string &lastItemId = keyToLastItemId[make_pair(string(keyObject.name),
+            string(keyObject.id))];
+        boost::shared_ptr<MergePlan> plan(new MergePlan(fileName,
+            (key.keyObjects->empty() ? xml_node() : key.keyObjects->front()),
+            _mapManager.FindInheritedObject(fileName, keyObject.object), stagingCatalog,
+            lastItemId));
+        for(size_t i = key.begin; i < key.end; ++i)
+        {
+            const PendingObjectT &pendingObject = pendingObjects[sortedObjects[i]];
+            ErrorLogger::ScopedContext objectLogContext("Merge", "",
+                pendingObject.item->GetId().c_str(), fileName.c_str());
+            if(!plan->Add(pendingObject.object, pendingObject.item->GetId(), sortedObjects[i]))
+            {
+                success = false;
+            }
+        }
+        lastItemId = plan->GetLastItemId();
+        plans.push_back(plan);
+        plannedKeyObjects.push_back(key.keyObjects);
+    }
+    if(!success)
+    {
+        return false;
+    }
+
+    //appended objects are staged until every key is merged.
+    vector<AppendedObjectT> appendedObjects;
+    for(size_t i = 0; i < plans.size(); ++i)
+    {
+        xml_node plannedObject;
+        size_t plannedSequence;
+        ApplyPlan(fileName, *plans[i], plannedObject, plannedSequence, wasEdited);
+        if(plans[i]->IsMapObjectOverwritten())
+        {
+            plannedKeyObjects[i]->clear();
+        }
+        if(plannedObject)
+        {
+            appendedObjects.push_back(AppendedObjectT(plannedSequence, plannedObject,
+                plannedKeyObjects[i]));
+        }
+    }
+    //a key that the catalog has several objects of is merged one object at a time.
+    BOOST_FOREACH(SortedKeyT &key, duplicateKeys)
+    {
+        for(size_t i = key.begin; i < key.end; ++i)
+        {
+            const PendingObjectT &pendingObject = pendingObjects[sortedObjects[i]];
+            ErrorLogger::ScopedContext objectLogContext("Merge", "",
+                pendingObject.item->GetId().c_str(), fileName.c_str());
+            xml_node mapObject = (key.matches.empty() ? xml_node() : key.matches.front().object);
+            MergePlan plan(fileName, mapObject,
+                _mapManager.FindInheritedObject(fileName, pendingObject.object), stagingCatalog);
+            if(!plan.Add(pendingObject.object, pendingObject.item->GetId(), sortedObjects[i]))
+            {
+                return false;
+            }
+            xml_node plannedObject;
+            size_t plannedSequence;
+            ApplyPlan(fileName, plan, plannedObject, plannedSequence, wasEdited);
+            if(plannedObject)
+            {
+                //an object that matched something only appends when it overwrites it.
+                if(mapObject)
+                {
+                    key.matches.pop_front();
+                }
+                key.matches.push_back(MatchT(plannedObject, plannedSequence));
+            }
+        }
+        //the objects left in the catalog keep their place, before the appended ones.
+        key.keyObjects->clear();
+        BOOST_FOREACH(const MatchT &match, key.matches)
+        {
+            if(match.appendedBy == NOT_APPENDED)
+            {
+                key.keyObjects->push_back(match.object);
+            }
+            else
+            {
+                appendedObjects.push_back(AppendedObjectT(match.appendedBy, match.object,
+                    key.keyObjects));
+            }
+        }
+    }
+    sort(appendedObjects.begin(), appendedObjects.end());
+    BOOST_FOREACH(const AppendedObjectT &appendedObject, appendedObjects)
+    {
+        appendedObject.keyObjects->push_back(catalog.append_copy(appendedObject.object));
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+    }
+    return true;
+}
+
+/* Merges pendingObject, which has no id, after every object before it. */
+bool BulkCatalogMerge::MergeUnsorted(const string &fileName, xml_node catalog,
+    CatalogIndexT &catalogIndex, const PendingObjectT &pendingObject, size_t sequence,
+    bool &wasEdited)
+{
+    ErrorLogger::ScopedContext objectLogContext("Merge", "", pendingObject.item->GetId().c_str(),
+        fileName.c_str());
+    vector<xml_node> materializedObjects;
+    if(!_mapManager.MaterializeMatchingObjects(fileName, pendingObject.object, catalog,
+        &materializedObjects))
+    {
+        return false;
+    }
+    IndexMaterializedObjects(materializedObjects, catalogIndex);
+    xml_node mapObject = GetMatchingNode(pendingObject.object, catalog);
+    xml_attribute idAttr = mapObject.attribute(OBJECT_ID_NAME.c_str());
+    bool hadId = idAttr;
+    pair<string, string> mapObjectKey(mapObject.name(), idAttr.value());
+    xml_document stagingDoc;
+    xml_node stagingCatalog = stagingDoc.append_child(CATALOG_NAME.c_str());
+    MergePlan plan(fileName, mapObject,
+        _mapManager.FindInheritedObject(fileName, pendingObject.object), stagingCatalog);
+    if(!plan.Add(pendingObject.object, pendingObject.item->GetId(), sequence))
+    {
+        return false;
+    }
+    xml_node plannedObject;
+    size_t plannedSequence;
+    ApplyPlan(fileName, plan, plannedObject, plannedSequence, wasEdited);
+    //the object may have changed the id of the object it modified, which would move it
+    //to another place of the index, so the catalog is indexed again then.
+    bool shouldReindex = false;
+    if(hadId && plan.IsMapObjectOverwritten())
+    {
+        vector<xml_node> &keyObjects = catalogIndex[mapObjectKey];
+        keyObjects.erase(find(keyObjects.begin(), keyObjects.end(), mapObject));
+    }
+    else if(mapObject && plan.IsEdited())
+    {
+        idAttr = mapObject.attribute(OBJECT_ID_NAME.c_str());
+        shouldReindex = (bool(idAttr) != hadId || mapObjectKey.second != idAttr.value());
+    }
+    if(plannedObject)
+    {
+        IndexObject(catalog.append_copy(plannedObject), catalogIndex);
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+    }
+    if(shouldReindex)
+    {
+        catalogIndex.clear();
+        IndexCatalog(catalog, catalogIndex);
+    }
+    return true;
+}
+
+/* Adds object to catalogIndex, after the other objects of its key, if it has an id. */
+void BulkCatalogMerge::IndexObject(const xml_node &object, CatalogIndexT &catalogIndex)
+{
+    xml_attribute idAttr = object.attribute(OBJECT_ID_NAME.c_str());
+    if(object.type() == node_element && idAttr)
+    {
+        catalogIndex[make_pair(string(object.name()), string(idAttr.value()))].push_back(object);
+    }
+}
+
+void BulkCatalogMerge::IndexCatalog(const xml_node &catalog, CatalogIndexT &catalogIndex)
+{
+    for(xml_node mapObject = catalog.first_child(); mapObject;
+        mapObject = mapObject.next_sibling())
+    {
+        IndexObject(mapObject, catalogIndex);
+    }
+}
+
+/* Adds the objects of a LazyCatalog that were just parsed to catalogIndex. Every object
+   of a key is parsed at once, into the part of the catalog that comes before the
+   objects added to it, so they go before the objects of their key already indexed. */
+void BulkCatalogMerge::IndexMaterializedObjects(const vector<xml_node> &materializedObjects,
+    CatalogIndexT &catalogIndex)
+{
+    if(materializedObjects.empty())
+    {
+        return;
+    }
+    CatalogIndexT materializedIndex;
+    BOOST_FOREACH(const xml_node &object, materializedObjects)
+    {
+        IndexObject(object, materializedIndex);
+    }
+    typedef pair<pair<string, string>, vector<xml_node> > keyObjectsPair;
+    BOOST_FOREACH(const keyObjectsPair &keyAndObjects, materializedIndex)
+    {
+        vector<xml_node> &keyObjects = catalogIndex[keyAndObjects.first];
+        keyObjects.insert(keyObjects.begin(), keyAndObjects.second.begin(),
+            keyAndObjects.second.end());
+    }
+}
+
+/* Applies plan, logging and recording its conflicts, and recording its change in
+   _changeSet if there is one. */
+void BulkCatalogMerge::ApplyPlan(const string &fileName, MergePlan &plan,
+    xml_node &plannedObject, size_t &plannedSequence, bool &wasEdited)
+{
+    BOOST_FOREACH(const MergeConflictT &conflict, plan.GetConflicts())
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: BulkCatalogMerge: item \""
+            + conflict.overwritingItemId + "\" overwrites object \"" + conflict.objectName
+            + " " + OBJECT_ID_NAME + "=" + conflict.objectId + "\" in file \"" + fileName
+            + "\", discarding the changes of item \"" + conflict.itemId + "\".");
+        _conflicts.push_back(conflict);
+        if(_changeSet)
+        {
+            _changeSet->AddConflict(conflict);
+        }
+    }
+    vector<string> oldLines;
+    if(_changeSet)
+    {
+        MergeChangeSet::GetObjectLines(plan.GetOriginalObject(), oldLines);
+    }
+    plannedObject = xml_node();
+    plannedSequence = 0;
+    if(plan.IsEdited())
+    {
+        plan.Apply(plannedObject, plannedSequence);
+        wasEdited = true;
+    }
+    if(_changeSet)
+    {
+        _changeSet->AddChange(fileName, plan, oldLines);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef _BULK_CATALOG_MERGE_H_
+#define _BULK_CATALOG_MERGE_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "pugixml.hpp"
+#include "MergePlan.h"
+using namespace std;
+using namespace pugi;
+
+class CustomItem;
+class MapManager;
+class MergeChangeSet;
+
+/*
+Merges many custom items into a map at once, one data file at a time. Instead of
+searching the catalog for every object of every item, the objects of the catalog are
+indexed by name and id once per data file, and the objects of the items are sorted by
+name and id and looked up in the index. The objects of the items that share a key are planned
+together (see MergePlan), so the catalog gets a single net change per object, and
+items that overwrite each other's changes are reported. Every key is planned before
+the catalog is changed.
+
+Objects that a merge appends are staged, then appended to the catalog in the order
+the items were added, so every data file ends up exactly as calling
+CustomItem::AddToMap on the items one after the other would leave it.
+
+Only objects whose key is their name and id (see GetNodeXPath) are sorted. Any other
+object may match objects of several keys, so it is merged on its own, after the
+objects added before it. The objects of a key that the catalog already has several
+objects of are merged one at a time too. Every merge keeps the index up to date, so
+the catalog is only indexed again when an object without an id changes the id of
+the object it merges into.
+*/
+class BulkCatalogMerge
+{
+public:
+    explicit BulkCatalogMerge(MapManager &mapManager);
+    ~BulkCatalogMerge();
+
+    //Queues the objects of every data file of item. They are merged by Commit, and
+    //item is kept until then.
+    void Add(const boost::shared_ptr<CustomItem> &item);
+
+    //Merges every object queued since the last Commit into the map, and records which
+    //data files of the map were changed.
+    //@return : false if any object could not be merged, in which case the map may be
+    //          left half changed.
+    bool Commit();
+
+    //Records every change that Commit makes to the map in changeSet, object by
+    //object. NULL to stop recording.
+    void SetChangeSet(MergeChangeSet *changeSet)
+    {
+        _changeSet = changeSet;
+    }
+
+    //@return : the conflicts between items found by every Commit so far, which were
+    //          logged as warnings.
+    const vector<MergeConflictT> &GetConflicts() const
+    {
+        return _conflicts;
+    }
+
+private:
+    struct PendingObjectT
+    {
+        xml_node object;
+        const CustomItem *item;
+        const char *name;
+        const char *id;         /* NULL if the object is not keyed by its name and id. */
+    };
+    class KeyLess;
+
+    //the item that changed each object (by name and id) last.
+    typedef map<pair<string, string>, string> KeyToItemIdT;
+    //the objects of a catalog that have an id, by name and id, in document order.
+    typedef map<pair<string, string>, vector<xml_node> > CatalogIndexT;
+
+    bool MergeFile(const string &fileName, const vector<PendingObjectT> &pendingObjects,
+        bool &wasEdited);
+    //merges the objects [begin, end) of pendingObjects, all of which have an id.
+    bool MergeSorted(const string &fileName, xml_node catalog, CatalogIndexT &catalogIndex,
+        const vector<PendingObjectT> &pendingObjects, size_t begin, size_t end,
+        KeyToItemIdT &keyToLastItemId, bool &wasEdited);
+    bool MergeUnsorted(const string &fileName, xml_node catalog, CatalogIndexT &catalogIndex,
+        const PendingObjectT &pendingObject, size_t sequence, bool &wasEdited);
+    void ApplyPlan(const string &fileName, MergePlan &plan, xml_node &plannedObject,
+        size_t &plannedSequence, bool &wasEdited);
+    static void IndexObject(const xml_node &object, CatalogIndexT &catalogIndex);
+    static void IndexCatalog(const xml_node &catalog, CatalogIndexT &catalogIndex);
+    static void IndexMaterializedObjects(const vector<xml_node> &materializedObjects,
+        CatalogIndexT &catalogIndex);
+
+    //non-copyable semantics
+    BulkCatalogMerge(const BulkCatalogMerge &other);
+    const BulkCatalogMerge& operator=(const BulkCatalogMerge&);
+
+    MapManager &_mapManager;
+    map<string, vector<PendingObjectT> > _filenameToPendingObjects;
+    vector<boost::shared_ptr<CustomItem> > _pendingItems;
+    vector<MergeConflictT> _conflicts;
+    MergeChangeSet *_changeSet;
+};
+
+#endif //_BULK_CATALOG_MERGE_H_
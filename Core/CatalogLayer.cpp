@@ -0,0 +1,165 @@
+#include "CatalogLayer.h"
+#include <algorithm>
+#include <cstring>
+#include "boost/foreach.hpp"
+#include "boost/filesystem.hpp"
+#include "CommonConstants.h"
+#include "NodeMatch.h"
+#include "LoadXML.h"
+#include "FilesystemUtils.h"
+#include "MapArchive.h"
+#include "ContentHash.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+#include "MemoryAccounting.h"
+
+namespace fs = boost::filesystem;
+
+CatalogLayer::CatalogLayer()
+    : _path()
+    , _contentHash("")
+    , _filenameToDoc()
+    , _filenameToIndex()
+{
+}
+
+CatalogLayer::~CatalogLayer()
+{
+}
+
+bool CatalogLayer::Create(const fs::path &dependencyPath)
+{
+    string dependencyName = dependencyPath.filename();
+    ErrorLogger::ScopedContext logContext("LoadDependency", "", "", dependencyName.c_str());
+    TRACE_SCOPE_DETAIL("LoadDependency", dependencyName);
+    MemoryAccounting::ScopedTag memoryTag("LoadDependency", "dependency:" + dependencyName);
+    _path = dependencyPath;
+    _filenameToDoc.clear();
+    _filenameToIndex.clear();
+    if(MapArchive::IsArchive(dependencyPath))
+    {
+        return CreateFromArchive();
+    }
+    fs::path gameDataPath = dependencyPath/GAME_DATA_PATH;
+    if(!fs::exists(gameDataPath))
+    {
+        gameDataPath = dependencyPath;
+    }
+    try
+    {
+        if(!fs::is_directory(gameDataPath))
+        {
+            ErrorLogger::Log("ERROR: CatalogLayer::Create: dependency \"" + dependencyPath.string()
+                + "\" is neither a folder nor an archive.");
+            return false;
+        }
+        if(ConsoleReporter::IsVerbose())
+        {
+            ConsoleReporter::Detail("Reading dependency " + dependencyPath.string() + ".");
+        }
+        for(fs::directory_iterator iter(gameDataPath); iter != fs::directory_iterator(); ++iter)
+        {
+            fs::path dataFilePath = iter->path();
+            if(dataFilePath.extension() != ".xml")
+            {
+                continue;
+            }
+            boost::shared_ptr<xml_document> dataDoc(new xml_document());
+            string error = LoadXMLFile(dataDoc.get(), dataFilePath.string().c_str());
+            if(error != "")
+            {
+                ErrorLogger::Log(error);
+                return false;
+            }
+            AddDataFile(dataFilePath.filename(), dataDoc);
+        }
+        _contentHash = GetFolderContentHash(gameDataPath, ".xml");
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: CatalogLayer::Create: ") + e.what() + ".");
+        return false;
+    }
+    return true;
+}
+
+xml_node CatalogLayer::FindObject(const string &fileName, const xml_node &object) const
+{
+    map<string, boost::shared_ptr<xml_document> >::const_iterator itr = _filenameToDoc.find(fileName);
+    if(itr == _filenameToDoc.end())
+    {
+        return xml_node();
+    }
+    //objects that GetMatchingNode would match by their id alone are looked up in the
+    //index. An id with a quote is not a valid XPath literal, so it is left to the
+    //query to fail as it always has.
+    xml_attribute idAttr = object.attribute(OBJECT_ID_NAME.c_str());
+    if(idAttr && strchr(idAttr.value(), '\'') == NULL && GetNodeXPath(object) ==
+        string(object.name()) + "[@" + OBJECT_ID_NAME + "='" + idAttr.value() + "']")
+    {
+        const ObjectIndexT &objectIndex = _filenameToIndex.find(fileName)->second;
+        ObjectIndexT::const_iterator objectItr =
+            objectIndex.find(make_pair(string(object.name()), string(idAttr.value())));
+        return (objectItr == objectIndex.end() ? xml_node() : objectItr->second);
+    }
+    return GetMatchingNode(object, itr->second->child(CATALOG_NAME.c_str()));
+}
+
+void CatalogLayer::AddDataFile(const string &fileName,
+    const boost::shared_ptr<xml_document> &dataDoc)
+{
+    _filenameToDoc[fileName] = dataDoc;
+    ObjectIndexT &objectIndex = _filenameToIndex[fileName];
+    objectIndex.clear();
+    xml_node catalog = dataDoc->child(CATALOG_NAME.c_str());
+    for(xml_node layerObject = catalog.first_child(); layerObject;
+        layerObject = layerObject.next_sibling())
+    {
+        xml_attribute idAttr = layerObject.attribute(OBJECT_ID_NAME.c_str());
+        if(layerObject.type() == node_element && idAttr)
+        {
+            //insert keeps the first object of each key, like select_single_node.
+            objectIndex.insert(make_pair(make_pair(string(layerObject.name()),
+                string(idAttr.value())), layerObject));
+        }
+    }
+}
+
+bool CatalogLayer::CreateFromArchive()
+{
+    MapArchive archive;
+    vector<string> dataFileNames;
+    if(!archive.Open(_path, false) || !archive.GetDataFileNames(dataFileNames))
+    {
+        return false;
+    }
+    if(ConsoleReporter::IsVerbose())
+    {
+        ConsoleReporter::Detail("Reading dependency " + _path.string() + ".");
+    }
+    //sorted like the files of a folder, so that the hash does not depend on the
+    //order of the archive.
+    sort(dataFileNames.begin(), dataFileNames.end());
+    ContentHash contentHash;
+    BOOST_FOREACH(const string &fileName, dataFileNames)
+    {
+        string contents;
+        if(!archive.ReadDataFile(fileName, contents))
+        {
+            return false;
+        }
+        boost::shared_ptr<xml_document> dataDoc(new xml_document());
+        string error = LoadXMLBuffer(dataDoc.get(), contents, _path.filename() + "/" + fileName);
+        if(error != "")
+        {
+            ErrorLogger::Log(error);
+            return false;
+        }
+        AddDataFile(fileName, dataDoc);
+        contentHash.AddField(fileName);
+        contentHash.AddField(contents);
+    }
+    _contentHash = contentHash.GetHex();
+    return archive.Close();
+}
@@ -0,0 +1,68 @@
+#ifndef _CATALOG_LAYER_H_
+#define _CATALOG_LAYER_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include "boost/filesystem/path.hpp"
+#include "boost/shared_ptr.hpp"
+#include "pugixml.hpp"
+using namespace std;
+using namespace pugi;
+
+/*
+The data files of a dependency of a map (i.e. a mod such as Liberty.SC2Mod), which
+the map's objects inherit from. A layer is read once and never changed afterwards,
+so a single layer can be shared by any number of MapManagers, on any number of
+threads. Nodes returned by a layer must only be read. Objects are indexed by their
+element name and id when the layer is read, so that finding the object an item
+inherits from does not scan the whole catalog.
+*/
+class CatalogLayer
+{
+public:
+    CatalogLayer();
+    ~CatalogLayer();
+
+    //Reads every data file of dependencyPath's GameData folder, or of dependencyPath
+    //itself if it has no GameData folder. dependencyPath may also be an archive (see
+    //MapArchive).
+    bool Create(const boost::filesystem::path &dependencyPath);
+
+    //@return : the object of data file fileName that object matches (see
+    //          GetMatchingNode). Empty if there is none.
+    xml_node FindObject(const string &fileName, const xml_node &object) const;
+
+    const boost::filesystem::path &GetPath() const
+    {
+        return _path;
+    }
+
+    //@return : a hash of the data files the layer was read from.
+    const string &GetContentHash() const
+    {
+        return _contentHash;
+    }
+
+private:
+    /* The first object of a catalog with each element name and id. */
+    typedef map<pair<string, string>, xml_node> ObjectIndexT;
+
+    bool CreateFromArchive();
+
+    //reads a data file's document into the layer, and indexes its objects.
+    void AddDataFile(const string &fileName, const boost::shared_ptr<xml_document> &dataDoc);
+
+    //non-copyable semantics
+    CatalogLayer(const CatalogLayer &other);
+    const CatalogLayer& operator=(const CatalogLayer&);
+
+    boost::filesystem::path _path;
+    string _contentHash;
+    map<string, boost::shared_ptr<xml_document> > _filenameToDoc;
+    map<string, ObjectIndexT> _filenameToIndex;
+};
+
+typedef boost::shared_ptr<const CatalogLayer> CatalogLayerPtr;
+
+#endif //_CATALOG_LAYER_H_
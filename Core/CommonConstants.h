@@ -9,6 +9,8 @@ static const string OBJECT_ID_NAME ("id");
 static const string CATALOG_NAME ("Catalog");
 static const path GAME_DATA_PATH ("Base.SC2Data/GameData");
 static const string SC2MAP_EXTENSION(".SC2Map");
+//records which items changed the map, relative to the map folder.
+static const path MANIFEST_FILE ("SC2DataManager.manifest");
 
 //for data duplicator
 static const path WORKING_DIRECTORY		("");//Data Files");
@@ -19,13 +21,26 @@ static const path MAPS_FOLDER       	(WORKING_DIRECTORY/"Maps");
 static const path OUTPUT_FOLDER         (WORKING_DIRECTORY/"Output");
 static const path ARGS_FILE				(WORKING_DIRECTORY/"parameters.txt");
 static const path ERROR_LOG_FILE        (WORKING_DIRECTORY/"errorLog.txt");
+static const path PERF_COUNTERS_FILE    (WORKING_DIRECTORY/"perfCounters.json");
 static const path README_FILE           (WORKING_DIRECTORY/"README.txt");
 static const path EXECUTABLE_FILE       ("SC2DataManager.exe");
 
 static const string ARG_MAPPATH_NAME    ("MapPath");
+static const string ARG_PIPELINE_NAME   ("Pipeline");
+static const string ARG_VERBOSITY_NAME  ("Verbosity");
+static const string ARG_TRACE_FILE_NAME ("TraceFile");
+static const string ARG_MEMORY_REPORT_NAME ("MemoryReport");
+static const string ARG_INCREMENTAL_NAME ("Incremental");
+static const string ARG_ITEM_CACHE_NAME ("ItemCacheFolder");
+static const string ARG_DEPENDENCY_NAME ("Dependency");
+static const string ARG_LAZY_LOAD_NAME ("LazyLoad");
+static const string ARG_SNAPSHOT_FOLDER_NAME ("SnapshotFolder");
+static const string ARG_PARALLEL_MERGE_NAME ("ParallelMerge");
+static const string ARG_MERGE_STRIPES_NAME ("MergeStripes");
+static const string ARG_BULK_MERGE_NAME ("BulkMerge");
+static const string ARG_PLAN_NAME       ("Plan");
 static const string ARG_MAPPATH_DELIM   ("=");
-static const string ARG_FORMAT          ("("+ARG_MAPPATH_NAME+")"+
-                                            ARG_MAPPATH_DELIM+"(.*)");
+static const string ARG_FORMAT          ("(\\w+)"+ARG_MAPPATH_DELIM+"(.*)");
 static const string CUSTOM_ITEMS_COL_DELIM(",");
 
 #endif
\ No newline at end of file
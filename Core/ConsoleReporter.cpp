@@ -0,0 +1,185 @@
+#include "ConsoleReporter.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdarg>
+#include "boost/thread/mutex.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "AtomicOps.h"
+#include "ErrorLogger.h"
+
+using namespace AtomicOps;
+namespace pt = boost::posix_time;
+
+//---------------- CONSTANTS ------------------
+/* minimum time between two redraws of the progress line. */
+static const long PROGRESS_REFRESH_INTERVAL_MS = 250;
+/* the clock is only checked every this many items. Must be a power of 2. */
+static const AtomicUInt32 PROGRESS_CLOCK_CHECK_INTERVAL = 8;
+static const char *VERBOSITY_NAMES[] = { "quiet", "progress", "verbose" };
+
+//---------------- STATE ------------------
+static ConsoleReporter::VerbosityT currentVerbosity = ConsoleReporter::PROGRESS_VERBOSITY;
+static boost::mutex consoleMutex;
+static ostream *consoleStream = &cout;
+
+static string phaseName;
+static AtomicUInt32 numExpectedItems = 0;
+static volatile AtomicUInt32 numItemsDone = 0;
+static pt::ptime phaseStartTime;
+static pt::ptime lastRefreshTime;
+static bool isInPhase = false;
+static bool isProgressLineVisible = false;
+
+//---------------- HELPERS ------------------
+/* Ends the progress line, so that the next line printed starts on its own line.
+   consoleMutex must be held. */
+static void EndProgressLine()
+{
+    if(isProgressLineVisible)
+    {
+        *consoleStream << "\n";
+        isProgressLineVisible = false;
+    }
+}
+
+/* Redraws the progress line. consoleMutex must be held. */
+static void DrawProgressLine(const pt::ptime &now)
+{
+    AtomicUInt32 numDone = Load(&numItemsDone);
+    double secondsElapsed = (now - phaseStartTime).total_microseconds() / 1000000.0;
+    double itemsPerSecond = (secondsElapsed > 0 ? numDone / secondsElapsed : 0);
+
+    *consoleStream << "\r" << phaseName << ": " << numDone;
+    if(numExpectedItems > 0)
+    {
+        *consoleStream << "/" << numExpectedItems;
+    }
+    *consoleStream << " (" << fixed << setprecision(0) << itemsPerSecond << "/s)";
+    if(numExpectedItems > 0 && itemsPerSecond > 0 && numDone < numExpectedItems)
+    {
+        double secondsLeft = (numExpectedItems - numDone) / itemsPerSecond;
+        *consoleStream << ", ETA " << setprecision(1) << secondsLeft << "s";
+    }
+    //pad, in case the previous line was longer.
+    *consoleStream << "          " << flush;
+    isProgressLineVisible = true;
+    lastRefreshTime = now;
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+void ConsoleReporter::SetVerbosity(VerbosityT verbosity)
+{
+    currentVerbosity = verbosity;
+}
+
+ConsoleReporter::VerbosityT ConsoleReporter::GetVerbosity()
+{
+    return currentVerbosity;
+}
+
+void ConsoleReporter::SetStream(ostream &stream)
+{
+    consoleStream = &stream;
+}
+
+bool ConsoleReporter::ParseVerbosity(const string &verbosityStr, VerbosityT &verbosity)
+{
+    for(size_t i = 0; i < sizeof(VERBOSITY_NAMES)/sizeof(char *); ++i)
+    {
+        if(verbosityStr == VERBOSITY_NAMES[i])
+        {
+            verbosity = (VerbosityT) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ConsoleReporter::Status(const string &message)
+{
+    if(currentVerbosity == QUIET_VERBOSITY)
+    {
+        return;
+    }
+    boost::mutex::scoped_lock lock(consoleMutex);
+    EndProgressLine();
+    *consoleStream << message << "\n";
+}
+
+void ConsoleReporter::Detail(const string &message)
+{
+    if(!IsVerbose())
+    {
+        return;
+    }
+    ErrorLogger::Log(ErrorLogger::INFO_SEVERITY, message);
+}
+
+void ConsoleReporter::DetailFormat(const char *format, ...)
+{
+    if(!IsVerbose())
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    ErrorLogger::LogFormatArgs(ErrorLogger::INFO_SEVERITY, format, args);
+    va_end(args);
+}
+
+bool ConsoleReporter::IsVerbose()
+{
+    return (currentVerbosity == VERBOSE_VERBOSITY);
+}
+
+void ConsoleReporter::BeginPhase(const string &name, size_t numExpected)
+{
+    boost::mutex::scoped_lock lock(consoleMutex);
+    EndProgressLine();
+    phaseName = name;
+    numExpectedItems = (AtomicUInt32) numExpected;
+    Store(&numItemsDone, 0);
+    phaseStartTime = pt::microsec_clock::universal_time();
+    lastRefreshTime = phaseStartTime;
+    isInPhase = true;
+}
+
+void ConsoleReporter::ItemDone(size_t numItems)
+{
+    AtomicUInt32 numDone = 0;
+    for(size_t i = 0; i < numItems; ++i)
+    {
+        numDone = Increment(&numItemsDone) + 1;
+    }
+    if(currentVerbosity == QUIET_VERBOSITY ||
+        (numDone % PROGRESS_CLOCK_CHECK_INTERVAL != 0 && numDone != numExpectedItems))
+    {
+        return;
+    }
+    //never make a worker thread wait for the console.
+    boost::mutex::scoped_try_lock lock(consoleMutex);
+    if(!lock.owns_lock() || !isInPhase)
+    {
+        return;
+    }
+    pt::ptime now = pt::microsec_clock::universal_time();
+    if((now - lastRefreshTime).total_milliseconds() >= PROGRESS_REFRESH_INTERVAL_MS)
+    {
+        DrawProgressLine(now);
+    }
+}
+
+void ConsoleReporter::EndPhase()
+{
+    boost::mutex::scoped_lock lock(consoleMutex);
+    if(!isInPhase)
+    {
+        return;
+    }
+    if(currentVerbosity != QUIET_VERBOSITY)
+    {
+        DrawProgressLine(pt::microsec_clock::universal_time());
+        EndProgressLine();
+    }
+    isInPhase = false;
+}
\ No newline at end of file
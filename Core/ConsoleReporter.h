@@ -0,0 +1,58 @@
+#ifndef _CONSOLE_REPORTER_H_
+#define _CONSOLE_REPORTER_H_
+
+#include <iosfwd>
+#include <string>
+using namespace std;
+
+//Everything the program prints to the console, other than errors and warnings
+//(which ErrorLogger prints), goes through the ConsoleReporter. Instead of a few
+//lines per item, the console shows a single progress line per phase, which is
+//redrawn a few times per second at most.
+namespace ConsoleReporter
+{
+    enum VerbosityT
+    {
+        QUIET_VERBOSITY = 0,    /* only errors, warnings and the final result. */
+        PROGRESS_VERBOSITY,     /* status lines and progress lines. */
+        VERBOSE_VERBOSITY       /* same as PROGRESS, but per-item details are also
+                                   written to the error log as INFO records. */
+    };
+
+    void SetVerbosity(VerbosityT verbosity);
+    VerbosityT GetVerbosity();
+
+    //@param verbosityStr: "quiet", "progress" or "verbose".
+    bool ParseVerbosity(const string &verbosityStr, VerbosityT &verbosity);
+
+    //Prints status and progress lines to stream instead of cout, i.e. to cerr when
+    //cout carries the program's result. Must be called before anything is printed.
+    void SetStream(ostream &stream);
+
+    //Prints a line, unless the verbosity is QUIET.
+    void Status(const string &message);
+
+    //Records a per-item or per-file detail. Only kept when the verbosity is VERBOSE,
+    //and then only in the error log.
+    void Detail(const string &message);
+
+    //Same as Detail, but the message is formatted printf-style straight into the
+    //log record.
+    void DetailFormat(const char *format, ...);
+
+    //@return : true if details are kept. Callers check it before building a detail's
+    //          message, so that other runs do not pay for it.
+    bool IsVerbose();
+
+    //Starts a progress line for a phase of the program.
+    //@param numExpectedItems: used to estimate the remaining time. 0 if unknown.
+    void BeginPhase(const string &phaseName, size_t numExpectedItems=0);
+
+    //Counts finished items towards the current phase. Safe to call from any thread.
+    void ItemDone(size_t numItems=1);
+
+    //Prints the final progress line of the current phase.
+    void EndPhase();
+}
+
+#endif //_CONSOLE_REPORTER_H_
\ No newline at end of file
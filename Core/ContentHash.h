@@ -0,0 +1,50 @@
+#ifndef _CONTENT_HASH_H_
+#define _CONTENT_HASH_H_
+
+#include <string>
+#include <cstdio>
+#include "boost/cstdint.hpp"
+using namespace std;
+
+/* 64-bit FNV-1a hash of a sequence of strings, for telling whether content changed
+   since an earlier run. Unlike boost::hash, it is the same on every platform and
+   build, so it can be stored in files. */
+class ContentHash
+{
+public:
+    ContentHash() : _hash(0xcbf29ce484222325ULL)
+    {
+    }
+
+    void Add(const char *data, size_t size)
+    {
+        for(size_t i = 0; i < size; ++i)
+        {
+            _hash ^= (unsigned char) data[i];
+            _hash *= 0x100000001b3ULL;
+        }
+    }
+
+    //adds str and its size, so that "ab" then "c" does not hash like "a" then "bc".
+    void AddField(const string &str)
+    {
+        char size[24];
+        int sizeLength = sprintf(size, "%lu:", (unsigned long) str.size());
+        Add(size, sizeLength);
+        Add(str.data(), str.size());
+    }
+
+    //@return : the hash, as 16 hexadecimal digits.
+    string GetHex() const
+    {
+        char hex[17];
+        sprintf(hex, "%08lx%08lx", (unsigned long) (_hash >> 32),
+            (unsigned long) (_hash & 0xffffffffUL));
+        return hex;
+    }
+
+private:
+    boost::uint64_t _hash;
+};
+
+#endif //_CONTENT_HASH_H_
@@ -0,0 +1,51 @@
+#-------------------------------------------------
+#
+# Core/ and the bundled libraries, shared by every
+# program built on Core/. Include with
+# include(path/to/Core/Core.pri).
+#
+#-------------------------------------------------
+
+TEMPLATE = app
+CONFIG  += console
+CONFIG  -= qt app_bundle
+
+INCLUDEPATH += $$PWD \
+    $$PWD/../include/PugiXML \
+    $$PWD/../include/muParser
+
+SOURCES += $$files($$PWD/*.cpp) \
+    $$PWD/../include/PugiXML/pugixml.cpp \
+    $$PWD/../include/muParser/muParser.cpp \
+    $$PWD/../include/muParser/muParserBase.cpp \
+    $$PWD/../include/muParser/muParserBytecode.cpp \
+    $$PWD/../include/muParser/muParserCallback.cpp \
+    $$PWD/../include/muParser/muParserError.cpp \
+    $$PWD/../include/muParser/muParserInt.cpp \
+    $$PWD/../include/muParser/muParserTest.cpp \
+    $$PWD/../include/muParser/muParserTokenReader.cpp
+
+#---- Inclusion of external project dependencies ---
+
+# Core/ uses version 2 of Boost.Filesystem (Boost 1.44 - 1.47).
+DEFINES += BOOST_FILESYSTEM_VERSION=2
+
+# Maps and mods saved as MPQ archives are read and written with StormLib.
+# Build with "qmake CONFIG+=stormlib" to support them.
+stormlib {
+DEFINES += SC2DM_USE_STORMLIB
+LIBS    += -lstorm
+}
+
+unix {
+LIBS        += -lboost_filesystem \
+                    -lboost_system \
+                    -lboost_regex \
+                    -lboost_thread \
+                    -lboost_program_options \
+                    -lpthread
+}
+win32 {
+INCLUDEPATH += $$quote(C:/Program Files (x86)/boost/boost_1_44)
+LIBS        += -L$$quote(C:/Program Files (x86)/boost/boost_1_44/lib)
+}
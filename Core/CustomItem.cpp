@@ -6,32 +6,61 @@
 #include "NodeMatch.h"
 #include "MapManager.h"
 #include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "MemoryAccounting.h"
 
 
-enum ObjectRequiredAgeT
+typedef pair<string, xml_document *> stringXMLDocPair;
+bool CustomItem::Create(const Template &baseItemTemplate, const map<string,string> &varNameToValue)
 {
-    OLD = 0,
-    NEW,
-    EITHER
-};
+    return baseItemTemplate.Instantiate(varNameToValue, _itemData);
+}
 
-enum ObjectOldAgeActionT
+bool CustomItem::Create(const Template &baseItemTemplate, const map<string,string> &varNameToValue,
+    size_t itemIndex)
 {
-    MODIFY = 0,
-    OVERWRITE,
-    DO_NOTHING
-};
+    return baseItemTemplate.Instantiate(varNameToValue, _itemData, itemIndex);
+}
 
-static const ObjectRequiredAgeT DEFAULT_OBJECT_REQUIRED_AGE = NEW;
-static const ObjectOldAgeActionT DEFAULT_OBJECT_OLD_AGE_ACTION = DO_NOTHING;
+bool CustomItem::Create(const string &id, const xml_node &savedDataFiles)
+{
+    _itemData._id = id;
+    for(xml_node savedFile = savedDataFiles.child("File"); savedFile;
+        savedFile = savedFile.next_sibling("File"))
+    {
+        string filename = savedFile.attribute("name").value();
+        xml_node savedCatalog = savedFile.child(CATALOG_NAME.c_str());
+        if(filename.empty() || !savedCatalog || _itemData._itemFilenameToDoc.count(filename) > 0)
+        {
+            ErrorLogger::Log("ERROR: CustomItem::Create: saved data files of item \"" + id
+                + "\" are invalid.");
+            return false;
+        }
+        xml_document *itemDoc = new xml_document();
+        _itemData._itemFilenameToDoc[filename] = itemDoc;
+        itemDoc->append_copy(savedCatalog);
+    }
+    return true;
+}
 
-typedef pair<string, xml_document *> stringXMLDocPair;
-bool CustomItem::Create(const Template &baseItemTemplate, const map<string,string> &varNameToValue)
+void CustomItem::SaveDataFiles(xml_node savedDataFiles) const
 {
-    return baseItemTemplate.Instantiate(varNameToValue, _itemData);
+    BOOST_FOREACH(stringXMLDocPair filenameAndDoc, _itemData._itemFilenameToDoc)
+    {
+        xml_node catalog = filenameAndDoc.second->child(CATALOG_NAME.c_str());
+        if(!catalog)
+        {
+            continue;
+        }
+        xml_node savedFile = savedDataFiles.append_child("File");
+        savedFile.append_attribute("name") = filenameAndDoc.first.c_str();
+        savedFile.append_copy(catalog);
+    }
 }
 
-string CustomItem::GetId() const
+const string &CustomItem::GetId() const
 { 
     return _itemData._id;	
 }
@@ -45,177 +74,126 @@ void CustomItem::GetVariableData(VariableDataMap &varNameToVarData) const
     }
 }
 
-ObjectRequiredAgeT ObjectGetRequiredAge(xml_node object)
+//TODO: templates need to be able to specify which objects are adding onto existing objects, and which should be new objects.
+bool CustomItem::AddToMap(MapManager &mapManager) const
 {
-    string requiredAgeStr = object.attribute(OBJECT_REQUIRED_AGE_ATTR_NAME.c_str()).value();
-    //the attr is only useful to this application. remove it now that we've read it.
-    object.remove_attribute(OBJECT_REQUIRED_AGE_ATTR_NAME.c_str());
-    for(size_t i = 0; i < sizeof(OBJECT_REQUIRED_AGE_ATTR_VALUES)/sizeof(char *); ++i)
+    ErrorLogger::ScopedContext logContext("Merge", "", _itemData._id.c_str());
+    TRACE_SCOPE_DETAIL("Merge", _itemData._id);
+    MemoryAccounting::ScopedTag memoryTag("Merge");
+    if(ConsoleReporter::IsVerbose())
+    {
+        ConsoleReporter::DetailFormat("Merging map %s with CustomItem %s.",
+            mapManager.mapPath.filename().c_str(), _itemData._id.c_str());
+    }
+    const map<string, xml_document *> &customItemFilenameToDoc = _itemData._itemFilenameToDoc;
+
+    BOOST_FOREACH(stringXMLDocPair filenameAndDoc, customItemFilenameToDoc)
     {
-        if(requiredAgeStr == OBJECT_REQUIRED_AGE_ATTR_VALUES[i])
+        string currentFilename = filenameAndDoc.first;
+        bool wasEdited = false;
+        bool success = AddDataFileToMap(currentFilename, mapManager,
+            mapManager.GetDataFileCatalog(currentFilename), wasEdited);
+        if(wasEdited)
+        {
+            mapManager.SetDataFileWasEdited(currentFilename);
+        }
+        if(!success)
         {
-            return (ObjectRequiredAgeT) i;
+            return false;
         }
     }
-    return DEFAULT_OBJECT_REQUIRED_AGE;
+    return true;
 }
 
-ObjectOldAgeActionT ObjectGetOldAgeAction(xml_node object)
+bool CustomItem::AddDataFileToMap(const string &fileName, MapManager &mapManager,
+    xml_node mapCatalog, bool &wasEdited) const
 {
-    string oldAgeActionStr = object.attribute(OBJECT_OLD_AGE_ACTION_ATTR_NAME.c_str()).value();
-    //the attr is only useful to this application. remove it now that we've read it.
-    object.remove_attribute(OBJECT_OLD_AGE_ACTION_ATTR_NAME.c_str());
-    for(size_t i = 0; i < sizeof(OBJECT_OLD_AGE_ACTION_ATTR_VALUES)/sizeof(char *); ++i)
+    ErrorLogger::ScopedContext fileLogContext("Merge", "", _itemData._id.c_str(),
+        fileName.c_str());
+    MemoryAccounting::ScopedTag fileMemoryTag("Merge", "map:" + fileName);
+    map<string, xml_document *>::const_iterator itr = _itemData._itemFilenameToDoc.find(fileName);
+    if(itr == _itemData._itemFilenameToDoc.end())
     {
-        if(oldAgeActionStr == OBJECT_OLD_AGE_ACTION_ATTR_VALUES[i])
+        return true;
+    }
+    xml_node customItemCatalog = itr->second->child(CATALOG_NAME.c_str());
+    for(xml_node customItemObject = customItemCatalog.first_child(); customItemObject;
+        customItemObject = customItemObject.next_sibling())
+    {
+        //a lazily loaded map only parses the objects this one may match.
+        if(!mapManager.MaterializeMatchingObjects(fileName, customItemObject, mapCatalog) ||
+            !MergeObjectIntoCatalog(customItemObject, mapCatalog, fileName, wasEdited,
+                mapManager.FindInheritedObject(fileName, customItemObject)))
         {
-            return (ObjectOldAgeActionT) i;
+            return false;
         }
     }
-    return DEFAULT_OBJECT_OLD_AGE_ACTION;
+    return true;
 }
 
-void ModifyNodeUsingValuesFromNewNode(xml_node node, const xml_node &newNode)
+/* Writes to a stream, counting the bytes written. */
+class CountingStreamWriter : public pugi::xml_writer_stream
 {
-    //replace all of node's attributes with newNode's attributes.
-    while(node.first_attribute())
+public:
+    CountingStreamWriter(ostream &stream) : xml_writer_stream(stream), numBytesWritten(0)
     {
-        node.remove_attribute(node.first_attribute());
     }
-    for(xml_attribute newAttr = newNode.first_attribute(); newAttr; newAttr = 
-        newAttr.next_attribute())
+    virtual void write(const void *data, size_t size)
     {
-        node.append_copy(newAttr);
+        xml_writer_stream::write(data, size);
+        numBytesWritten += size;
     }
+    size_t numBytesWritten;
+};
 
-    //recursively modify children.
-    for(xml_node newChildNode = newNode.first_child(); newChildNode; newChildNode = 
-        newChildNode.next_sibling())
+//make sure this is called AFTER performing all other CustomItem actions.
+bool CustomItem::Output(const path &outputFolder)
+{
+    ErrorLogger::ScopedContext logContext("Output", "", _itemData._id.c_str());
+    TRACE_SCOPE_DETAIL("Output", _itemData._id);
+    MemoryAccounting::ScopedTag memoryTag("Output");
+    BOOST_FOREACH(stringXMLDocPair filenameAndDoc, _itemData._itemFilenameToDoc)
     {
-        xml_node matchingOldChildNode = GetMatchingNode(newChildNode, node);
-        if(matchingOldChildNode)
-        {
-            ModifyNodeUsingValuesFromNewNode(matchingOldChildNode, newChildNode);
-        }
-        else
+        if(!OutputDataFile(filenameAndDoc.first, outputFolder))
         {
-            //since the existing node does not have newChildNode, we need to add it.
-            node.append_copy(newChildNode);
+            return false;
         }
     }
+    return true;
 }
 
-//TODO: templates need to be able to specify which objects are adding onto existing objects, and which should be new objects.
-bool CustomItem::AddToMap(MapManager &mapManager) const
+bool CustomItem::OutputDataFile(const string &fileName, const path &outputFolder)
 {
-    cout << "Merging map " << mapManager.mapPath.filename() << " with CustomItem " << _itemData._id << "...";
-    const map<string, xml_document *> &customItemFilenameToDoc = _itemData._itemFilenameToDoc;
-    unordered_map<string, xml_document *> &mapFilenameToDoc = mapManager.mapFilenameToDoc;
-    unordered_map<string, bool> &mapFilenameToWasEdited = mapManager.mapFilenameToWasEdited;
-
-    BOOST_FOREACH(stringXMLDocPair filenameAndDoc, customItemFilenameToDoc)
+    map<string, xml_document *>::const_iterator itr = _itemData._itemFilenameToDoc.find(fileName);
+    if(itr == _itemData._itemFilenameToDoc.end())
     {
-        string currentFilename = filenameAndDoc.first;
-        if(mapFilenameToDoc.find(currentFilename) == mapFilenameToDoc.end())
-        {
-            xml_document *mapDoc = new xml_document();
-            mapFilenameToDoc[currentFilename] = mapDoc;
-            mapFilenameToWasEdited[currentFilename] = true;
-        }
-        xml_node mapCatalog = mapFilenameToDoc[currentFilename]->child(CATALOG_NAME.c_str());
-        if(!mapCatalog)
+        return true;
+    }
+    try
+    {
+        xml_node customItemCatalog = itr->second->child(CATALOG_NAME.c_str());
+
+        if(!customItemCatalog)
         {
-            mapCatalog = mapFilenameToDoc[currentFilename]->append_child(CATALOG_NAME.c_str());
-            mapFilenameToWasEdited[currentFilename] = true;
+            return true;
         }
-        xml_node customItemCatalog = filenameAndDoc.second->child(CATALOG_NAME.c_str());
+        ofstream fileWriter((outputFolder/fileName).string().c_str(),
+            ios_base::app);
+        CountingStreamWriter countingWriter(fileWriter);
+
         for(xml_node customItemObject = customItemCatalog.first_child(); customItemObject;
             customItemObject = customItemObject.next_sibling())
         {
-            ObjectRequiredAgeT requiredMapObjectAge = ObjectGetRequiredAge(customItemObject);
-            ObjectOldAgeActionT whatToDoIfMapObjectExists = ObjectGetOldAgeAction(customItemObject);
-
-            xml_node mapObject = GetMatchingNode(customItemObject, mapCatalog);
-            if(mapObject)
-            {
-                if(requiredMapObjectAge == NEW)
-                {
-                    cout << endl;
-                    ErrorLogger::Log(string("ERROR: CustomItem::AddToMap: object \"")
-                         + mapObject.name() + " " + OBJECT_ID_NAME + "=" 
-                         + mapObject.attribute(OBJECT_ID_NAME.c_str()).value() 
-                         + "\" in file \"" + currentFilename + "\" already exists "
-                         "in the map, which is a problem since \"" 
-                         + OBJECT_REQUIRED_AGE_ATTR_NAME + "="
-                         + OBJECT_REQUIRED_AGE_ATTR_VALUES[requiredMapObjectAge]
-                         + "\".");
-                    return false;
-                }
-                if(whatToDoIfMapObjectExists == MODIFY)
-                {
-                    ModifyNodeUsingValuesFromNewNode(mapObject, customItemObject);
-                    mapFilenameToWasEdited[currentFilename] = true;
-                }
-                else if(whatToDoIfMapObjectExists == OVERWRITE)
-                {
-                    mapCatalog.remove_child(mapObject);
-                    mapCatalog.append_copy(customItemObject);
-                    mapFilenameToWasEdited[currentFilename] = true;
-                }
-            }
-            else
-            {
-                if(requiredMapObjectAge == OLD)
-                {
-                    cout << endl;
-                    ErrorLogger::Log(string("ERROR: CustomItem::AddToMap: object \"")
-                         + customItemObject.name() + " " + OBJECT_ID_NAME + "=" 
-                         + customItemObject.attribute(OBJECT_ID_NAME.c_str()).value() 
-                         + "\" in file \"" + currentFilename + "\" does not exist in the map,"
-                         + " which is a problem since \"" + OBJECT_REQUIRED_AGE_ATTR_NAME + "="
-                         + OBJECT_REQUIRED_AGE_ATTR_VALUES[requiredMapObjectAge] + "\".");
-                    return false;
-                }
-                //object is new. add it to the map.
-                mapCatalog.append_copy(customItemObject);
-                mapFilenameToWasEdited[filenameAndDoc.first] = true;
-            }
-        }
-    }
-    cout << " done." << endl << endl;
-    return true;
-}
+            //before we output, delete attributes that are just notes to SC2DM.
+            customItemObject.remove_attribute(OBJECT_REQUIRED_AGE_ATTR_NAME.c_str());
+            customItemObject.remove_attribute(OBJECT_OLD_AGE_ACTION_ATTR_NAME.c_str());
 
-//make sure this is called AFTER performing all other CustomItem actions.
-bool CustomItem::Output()
-{
-    try
-    {
-        BOOST_FOREACH(stringXMLDocPair filenameAndDoc, _itemData._itemFilenameToDoc)
-        {
-            string currentFilename = filenameAndDoc.first;
-            xml_node customItemCatalog = filenameAndDoc.second->child(CATALOG_NAME.c_str());
-
-            if(!customItemCatalog)
-            {
-                continue;
-            }
-            ofstream fileWriter((OUTPUT_FOLDER/currentFilename).string().c_str(),
-                ios_base::app);
-
-            for(xml_node customItemObject = customItemCatalog.first_child(); customItemObject;
-                customItemObject = customItemObject.next_sibling())
-            {
-                //before we output, delete attributes that are just notes to SC2DM.
-                customItemObject.remove_attribute(OBJECT_REQUIRED_AGE_ATTR_NAME.c_str());
-                customItemObject.remove_attribute(OBJECT_OLD_AGE_ACTION_ATTR_NAME.c_str());
-
-                //output the object
-                customItemObject.print(fileWriter);
-            }
-
-            fileWriter.close();
+            //output the object
+            customItemObject.print(countingWriter);
         }
+        PerfCounters::Add(PerfCounters::BYTES_WRITTEN, countingWriter.numBytesWritten);
+
+        fileWriter.close();
     }
     catch(std::exception &e)
     {
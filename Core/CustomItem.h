@@ -6,16 +6,12 @@
 #include "pugixml.hpp"
 #include "boost/unordered_map.hpp"
 #include "Template.h"
+#include "ObjectMerge.h"
 using namespace std;
 using namespace pugi;
 using namespace boost;
 
 
-static const string OBJECT_REQUIRED_AGE_ATTR_NAME ("SC2DM_shouldAlreadyExist");
-static const char *OBJECT_REQUIRED_AGE_ATTR_VALUES[] = { "yes", "no", "idc" }; 
-static const string OBJECT_OLD_AGE_ACTION_ATTR_NAME ("SC2DM_whatToDoIfExists");
-static const char *OBJECT_OLD_AGE_ACTION_ATTR_VALUES[] = { "modify", "overwrite", "doNothing" };
-
 class MapManager;
 
 class CustomItem
@@ -29,13 +25,44 @@ public:
 	//@return : error message
 	bool Create(const Template &baseItemTemplate, const map<string, string> &varNameToValue);
 
+	//Same as above, but safe to call from several threads at once.
+	//@param itemIndex: position of this item in its custom items file.
+	bool Create(const Template &baseItemTemplate, const map<string, string> &varNameToValue,
+		size_t itemIndex);
+
+    //Creates the item from data files written by SaveDataFiles, instead of from a
+    //template. The item has no variable data.
+    bool Create(const string &id, const xml_node &savedDataFiles);
+
+    //Appends a copy of the catalog of each of the item's data files to savedDataFiles.
+    void SaveDataFiles(xml_node savedDataFiles) const;
+
     bool AddToMap(MapManager &mapManager) const;
 
-	string GetId() const;
+    //Merges the objects of the item's data file fileName into mapCatalog, the catalog
+    //of the same data file of mapManager, as AddToMap does. Never changes which data
+    //files mapManager has, so several threads may merge into different files of the
+    //same map at once (see FileMergeWorkers).
+    //@param wasEdited: set to true if mapCatalog was changed.
+    bool AddDataFileToMap(const string &fileName, MapManager &mapManager, xml_node mapCatalog,
+        bool &wasEdited) const;
+
+	const string &GetId() const;
 
     void GetVariableData(VariableDataMap &varNameToVarData) const;
 
-    bool Output();
+    //@return : the item's data files, by file name.
+    const map<string, xml_document *> &GetDataFiles() const
+    {
+        return _itemData._itemFilenameToDoc;
+    }
+
+    //appends the item's objects to the data files of outputFolder.
+    bool Output(const boost::filesystem::path &outputFolder);
+
+    //Same as Output, but only for the item's data file fileName. The objects are
+    //written without their merge attributes, so they must be merged first.
+    bool OutputDataFile(const string &fileName, const boost::filesystem::path &outputFolder);
 private:
 	//non-copyable semantics
 	CustomItem(const CustomItem &other);
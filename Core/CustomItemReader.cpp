@@ -5,10 +5,12 @@
 #include "boost/tokenizer.hpp"
 #include "boost/filesystem.hpp"
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include "CommonConstants.h"
 #include "ErrorLogger.h"
 using namespace std;
+using boost::lexical_cast;
 
 CustomItemReader *CustomItemReader::_instance = NULL;
 
@@ -35,64 +37,316 @@ void GetRowContents(const string &rowStr, vector<string> &contents)
     }
 }
 
-//read in the new custom items for the given map, using the given template.
+//------------------ CellValuesT ------------------------
+//i.e. "{1-6}" or "{-5-5}"
+static const boost::regex CELL_RANGE_REGEX("\\{\\s*(-?\\d+)\\s*-\\s*(-?\\d+)\\s*\\}");
+//i.e. "{Marine|Marauder|Reaper}"
+static const boost::regex CELL_LIST_REGEX("\\{([^{}]*\\|[^{}]*)\\}");
+static const string CELL_LIST_DELIM("|");
+//separates an expanded row's "_id" from the values of its expanded cells.
+static const string EXPANDED_ID_DELIM("/");
+
+size_t CellValuesT::GetNumValues() const
+{
+    switch(type)
+    {
+    case RangeCell:
+        //ParseCellValues only accepts ranges whose number of values fits.
+        return (rangeTo >= rangeFrom ?
+            (size_t) ((boost::uint64_t) rangeTo - (boost::uint64_t) rangeFrom + 1) : 0);
+    case ListCell:
+        return listValues.size();
+    default:
+        return 1;
+    }
+}
+
+string CellValuesT::GetValue(size_t index) const
+{
+    switch(type)
+    {
+    case RangeCell:
+        //added as unsigned numbers, since the range may span more than an int64_t.
+        return lexical_cast<string>((boost::int64_t) ((boost::uint64_t) rangeFrom + index));
+    case ListCell:
+        return listValues[index];
+    default:
+        return plainValue;
+    }
+}
+
+/* @return : false if cellStr is a range with more values than can be counted. */
+bool ParseCellValues(const string &cellStr, CellValuesT &cellValues)
+{
+    cellValues = CellValuesT();
+    boost::match_results<string::const_iterator> matches;
+    if(boost::regex_match(cellStr, matches, CELL_RANGE_REGEX))
+    {
+        try
+        {
+            cellValues.rangeFrom = lexical_cast<boost::int64_t>(
+                string(matches[1].first, matches[1].second));
+            cellValues.rangeTo = lexical_cast<boost::int64_t>(
+                string(matches[2].first, matches[2].second));
+            cellValues.type = CellValuesT::RangeCell;
+            //the number of values, rangeTo - rangeFrom + 1, has to fit in a size_t.
+            boost::uint64_t numValuesAfterFirst = (boost::uint64_t) cellValues.rangeTo
+                - (boost::uint64_t) cellValues.rangeFrom;
+            return (cellValues.rangeTo < cellValues.rangeFrom ||
+                numValuesAfterFirst < numeric_limits<size_t>::max());
+        }
+        catch(boost::bad_lexical_cast &)
+        {
+            //too big to be a range. treat it as plain text.
+            cellValues = CellValuesT();
+        }
+    }
+    else if(boost::regex_match(cellStr, matches, CELL_LIST_REGEX))
+    {
+        string listStr(matches[1].first, matches[1].second);
+        boost::char_separator<char> sep(CELL_LIST_DELIM.c_str(), "", boost::keep_empty_tokens);
+        boost::tokenizer<boost::char_separator<char> > tokens(listStr, sep);
+        BOOST_FOREACH(string token, tokens)
+        {
+            cellValues.listValues.push_back(token);
+        }
+        cellValues.type = CellValuesT::ListCell;
+        return true;
+    }
+    cellValues.plainValue = cellStr;
+    return true;
+}
+
+//------------------ CustomItemStream ------------------------
+CustomItemStream::CustomItemStream()
+    : _path()
+    , _fileReader()
+    , _headerVars()
+    , _lineNumber(0)
+    , _currentRow()
+    , _currentCombination()
+    , _hasCombinationsLeft(false)
+    , _isCurrentRowExpanded(false)
+{
+}
+
 namespace fs = boost::filesystem;
-bool CustomItemReader::ReadCustomItems(const fs::path &customItemsPath,
-    vector<ReadCustomItemT *> &readItems)
+bool CustomItemStream::Open(const fs::path &customItemsPath)
 {
     if(!fs::exists(customItemsPath))
     {
-        ErrorLogger::Log("ERROR: CustomItemReader::ReadCustomItems: no custom items "
+        ErrorLogger::Log("ERROR: CustomItemStream::Open: no custom items "
             "file exists at path: " + customItemsPath.string() + ".");
         return false;
     }
-	const char *customItemsCStr = customItemsPath.string().c_str();
-    readItems.clear();
-	ifstream fileReader(customItemsCStr, ios::in);
-	if(!fileReader.is_open())
+    _path = customItemsPath;
+    _headerVars.clear();
+    _lineNumber = 0;
+    _hasCombinationsLeft = false;
+    _fileReader.open(customItemsPath.string().c_str(), ios::in);
+    if(!_fileReader.is_open())
     {
-        cout << endl;
-		ErrorLogger::Log(string("ERROR: ReadCustomItems: failed to open ") 
-            + customItemsCStr);
+        ErrorLogger::Log("ERROR: CustomItemStream::Open: failed to open "
+            + customItemsPath.string());
         return false;
     }
-	else if(fileReader.eof())
+    if(_fileReader.eof())
     {
-        //cout << endl;
-		//ErrorLogger::Log(string("ERROR: ReadCustomItems: ") + customItemsCStr 
-        //    + " was empty.");
-        //return false;
+        //an empty file simply has no rows.
         return true;
     }
-	//cout << "reading " << customItemsCStr << "..." << endl;
     string currentLine;
-	std::getline(fileReader, currentLine);
-	if(fileReader.eof())
+    std::getline(_fileReader, currentLine);
+    ++_lineNumber;
+    GetRowContents(currentLine, _headerVars);
+    return true;
+}
+
+CustomItemStream::ReadResultT CustomItemStream::ReadNext(ReadCustomItemT &readItem)
+{
+    readItem.varNameToValue.clear();
+    if(_hasCombinationsLeft)
     {
-        //cout << endl;
-		//ErrorLogger::Log(string("ERROR: ReadCustomItems: ") + customItemsCStr + 
-        //    " was empty.");
-		//return false;
-        return true;
+        ReadCurrentCombination(readItem);
+        return RowRead;
+    }
+    if(!_fileReader.is_open())
+    {
+        return EndOfFile;
     }
-	vector<string> headerVars;
-	GetRowContents(currentLine, headerVars);
-	int headerVarsSize = headerVars.size();
-	while(!fileReader.eof())
-	{
-		std::getline(fileReader, currentLine);
-		if(currentLine.empty())
+    while(!_fileReader.eof())
+    {
+        string currentLine;
+        std::getline(_fileReader, currentLine);
+        ++_lineNumber;
+        if(currentLine.empty())
         {
             continue;
         }
-		vector<string> rowContents;
-		GetRowContents(currentLine, rowContents);
-		ReadCustomItemT *newItem = new ReadCustomItemT;
-		for(int i = 0; i < headerVarsSize; ++i)
+        vector<string> rowContents;
+        GetRowContents(currentLine, rowContents);
+        if(rowContents.size() < _headerVars.size())
+        {
+            ErrorLogger::Log("ERROR: CustomItemStream::ReadNext: row "
+                + lexical_cast<string>(_lineNumber) + " of " + _path.string()
+                + " has " + lexical_cast<string>(rowContents.size()) + " columns, but the"
+                " header has " + lexical_cast<string>(_headerVars.size()) + ".");
+            return ReadFailed;
+        }
+        _currentRow.resize(_headerVars.size());
+        _currentCombination.assign(_headerVars.size(), 0);
+        _isCurrentRowExpanded = false;
+        _hasCombinationsLeft = true;
+        for(size_t i = 0; i < _headerVars.size(); ++i)
         {
-			newItem->varNameToValue[headerVars[i]] = rowContents[i];
+            if(!ParseCellValues(rowContents[i], _currentRow[i]))
+            {
+                ErrorLogger::Log("ERROR: CustomItemStream::ReadNext: cell \"" + rowContents[i]
+                    + "\" of column \"" + _headerVars[i] + "\" in row "
+                    + lexical_cast<string>(_lineNumber) + " of " + _path.string()
+                    + " is a range with too many values.");
+                _hasCombinationsLeft = false;
+                return ReadFailed;
+            }
+            if(_currentRow[i].type != CellValuesT::PlainCell)
+            {
+                _isCurrentRowExpanded = true;
+            }
+            if(_currentRow[i].GetNumValues() == 0)
+            {
+                //i.e. "{6-1}". the row has no combinations at all.
+                ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: CustomItemStream::ReadNext: "
+                    "cell \"" + rowContents[i] + "\" of column \"" + _headerVars[i] + "\" in row "
+                    + lexical_cast<string>(_lineNumber) + " of " + _path.string()
+                    + " is a range that counts down, so the row creates no items.");
+                _hasCombinationsLeft = false;
+            }
         }
-		readItems.push_back(newItem);
-	}
-	return true; 
+        if(!_hasCombinationsLeft)
+        {
+            continue;
+        }
+        ReadCurrentCombination(readItem);
+        return RowRead;
+    }
+    _fileReader.close();
+    return EndOfFile;
+}
+
+void CustomItemStream::ReadCurrentCombination(ReadCustomItemT &readItem)
+{
+    string idSuffix;
+    for(size_t i = 0; i < _currentRow.size(); ++i)
+    {
+        const CellValuesT &cellValues = _currentRow[i];
+        string value = cellValues.GetValue(_currentCombination[i]);
+        readItem.varNameToValue[_headerVars[i]] = value;
+        if(cellValues.type != CellValuesT::PlainCell)
+        {
+            idSuffix += EXPANDED_ID_DELIM + value;
+        }
+    }
+    //make sure every combination of an expanded row has its own "_id".
+    map<string, string>::iterator idItr = readItem.varNameToValue.find("_id");
+    if(_isCurrentRowExpanded && idItr != readItem.varNameToValue.end())
+    {
+        idItr->second += idSuffix;
+    }
+
+    //advance to the next combination, the same way an odometer does: the last
+    //cell changes fastest.
+    _hasCombinationsLeft = false;
+    for(size_t i = _currentRow.size(); i > 0; --i)
+    {
+        if(++_currentCombination[i-1] < _currentRow[i-1].GetNumValues())
+        {
+            _hasCombinationsLeft = true;
+            break;
+        }
+        _currentCombination[i-1] = 0;
+    }
+}
+
+size_t CustomItemStream::CountItems(const fs::path &customItemsPath)
+{
+    ifstream fileReader(customItemsPath.string().c_str(), ios::in);
+    if(!fileReader.is_open() || fileReader.eof())
+    {
+        return 0;
+    }
+    string currentLine;
+    std::getline(fileReader, currentLine);
+    vector<string> headerVars;
+    GetRowContents(currentLine, headerVars);
+
+    size_t numItems = 0;
+    size_t lineNumber = 1;
+    while(!fileReader.eof())
+    {
+        std::getline(fileReader, currentLine);
+        ++lineNumber;
+        if(currentLine.empty())
+        {
+            continue;
+        }
+        vector<string> rowContents;
+        GetRowContents(currentLine, rowContents);
+        if(rowContents.size() < headerVars.size())
+        {
+            //ReadNext reports this row as an error.
+            break;
+        }
+        size_t numRowItems = 1;
+        for(size_t i = 0; i < headerVars.size(); ++i)
+        {
+            CellValuesT cellValues;
+            if(!ParseCellValues(rowContents[i], cellValues))
+            {
+                //ReadNext reports this row as an error.
+                return numItems;
+            }
+            size_t numValues = cellValues.GetNumValues();
+            if(numValues != 0 && numRowItems > numeric_limits<size_t>::max() / numValues)
+            {
+                ErrorLogger::Log("ERROR: CustomItemStream::CountItems: the ranges in row "
+                    + lexical_cast<string>(lineNumber) + " of " + customItemsPath.string()
+                    + " create too many items.");
+                //too many to show a meaningful ETA for.
+                return 0;
+            }
+            numRowItems *= numValues;
+        }
+        if(numRowItems > numeric_limits<size_t>::max() - numItems)
+        {
+            ErrorLogger::Log("ERROR: CustomItemStream::CountItems: "
+                + customItemsPath.string() + " creates too many items.");
+            return 0;
+        }
+        numItems += numRowItems;
+    }
+    return numItems;
+}
+
+//------------------ CustomItemReader ------------------------
+//read in the new custom items for the given map, using the given template.
+bool CustomItemReader::ReadCustomItems(const fs::path &customItemsPath,
+    vector<ReadCustomItemT *> &readItems)
+{
+    readItems.clear();
+    CustomItemStream customItemStream;
+    if(!customItemStream.Open(customItemsPath))
+    {
+        return false;
+    }
+    while(true)
+    {
+        ReadCustomItemT *newItem = new ReadCustomItemT;
+        CustomItemStream::ReadResultT result = customItemStream.ReadNext(*newItem);
+        if(result != CustomItemStream::RowRead)
+        {
+            delete newItem;
+            return (result == CustomItemStream::EndOfFile);
+        }
+        readItems.push_back(newItem);
+    }
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <fstream>
+#include "boost/cstdint.hpp"
 #include "boost/filesystem.hpp"
 using namespace std;
 
@@ -12,6 +14,86 @@ struct ReadCustomItemT
     std::map<string, string> varNameToValue;
 };
 
+//The values that a single cell of a custom items file can take. A cell is either
+//a plain value, an inclusive integer range such as "{1-6}", or a list of values
+//separated by "|", such as "{Marine|Marauder|Reaper}". Ranges are never expanded
+//into a list; each value is computed when it is needed.
+struct CellValuesT
+{
+    enum CellTypeT
+    {
+        PlainCell,
+        RangeCell,
+        ListCell
+    };
+    CellTypeT type;
+    string plainValue;          /* only used by plain cells. */
+    boost::int64_t rangeFrom;   /* only used by range cells. */
+    boost::int64_t rangeTo;
+    vector<string> listValues;  /* only used by list cells. */
+
+    CellValuesT() : type(PlainCell), plainValue(), rangeFrom(0), rangeTo(0), listValues()
+    {
+    }
+
+    size_t GetNumValues() const;
+    string GetValue(size_t index) const;
+};
+
+//Reads a custom items file one row at a time, so that callers never need to
+//hold every row of the file in memory at once. A row with range or list cells
+//is expanded lazily into one row per combination of its cells' values (the
+//cartesian product), one combination per call to ReadNext.
+class CustomItemStream
+{
+public:
+    enum ReadResultT
+    {
+        RowRead,
+        EndOfFile,
+        ReadFailed
+    };
+
+    CustomItemStream();
+
+    //opens the file and reads its header row.
+    bool Open(const boost::filesystem::path &customItemsPath);
+
+    //reads the next row, or the next combination of an expanded row, into readItem.
+    ReadResultT ReadNext(ReadCustomItemT &readItem);
+
+    const boost::filesystem::path &GetPath() const
+    {
+        return _path;
+    }
+
+    //@return : the number of items that ReadNext would return for the file, counting
+    //every combination of expanded rows. Only as exact as the file is valid, and 0 if
+    //the count does not fit in a size_t.
+    static size_t CountItems(const boost::filesystem::path &customItemsPath);
+
+private:
+    //non-copyable semantics
+    CustomItemStream(const CustomItemStream &other);
+    const CustomItemStream& operator=(const CustomItemStream&);
+
+    //fills readItem with the current combination of _currentRow, then advances
+    //to the next combination.
+    void ReadCurrentCombination(ReadCustomItemT &readItem);
+
+    boost::filesystem::path _path;
+    std::ifstream _fileReader;
+    vector<string> _headerVars;
+    size_t _lineNumber;
+
+    //the row currently being expanded, and the index into each of its cells'
+    //values of the combination that ReadNext returns next.
+    vector<CellValuesT> _currentRow;
+    vector<size_t> _currentCombination;
+    bool _hasCombinationsLeft;
+    bool _isCurrentRowExpanded;
+};
+
 class CustomItemReader
 {
 public:
@@ -25,10 +107,6 @@ private:
     CustomItemReader(CustomItemReader const&);
     CustomItemReader& operator=(CustomItemReader const&);
 
-    //if there is i.e. a mapping with name "name" and value "{1-6}", 
-    //it is replaced by 6 name/value mappings: "name/1", "name/2", ... , "name/6". 
-    //bool ExpandVariableRanges( std::vector<ReadCustomItemT *> &readItems );
-
     static CustomItemReader *_instance;
 };
 
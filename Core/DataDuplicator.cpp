@@ -0,0 +1,797 @@
+#include "DataDuplicator.h"
+#include <algorithm>
+#include <map>
+#include "boost/filesystem.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/foreach.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "CommonConstants.h"
+#include "Template.h"
+#include "CustomItem.h"
+#include "CustomItemReader.h"
+#include "MapManager.h"
+#include "ItemPipeline.h"
+#include "FileMergeWorkers.h"
+#include "BulkCatalogMerge.h"
+#include "IncrementalRun.h"
+#include "TemplateCache.h"
+#include "InstantiationCache.h"
+#include "FilesystemUtils.h"
+#include "MapArchive.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+
+using namespace DataDuplicator;
+namespace fs = boost::filesystem;
+namespace pt = boost::posix_time;
+
+//---------------- HELPERS ------------------
+/* Times consecutive phases of Execute. Beginning a phase ends the previous one. */
+class PhaseTimer
+{
+public:
+    PhaseTimer(StatsT &stats) : _stats(stats), _phaseName(NULL)
+    {
+    }
+    ~PhaseTimer()
+    {
+        EndPhase();
+    }
+    void BeginPhase(const char *phaseName)
+    {
+        EndPhase();
+        _phaseName = phaseName;
+        _phaseStartTime = pt::microsec_clock::universal_time();
+    }
+private:
+    void EndPhase()
+    {
+        if(!_phaseName)
+        {
+            return;
+        }
+        double seconds = (pt::microsec_clock::universal_time() - _phaseStartTime)
+            .total_microseconds() / 1000000.0;
+        _stats.phaseSeconds.push_back(make_pair(string(_phaseName), seconds));
+        _phaseName = NULL;
+    }
+
+    StatsT &_stats;
+    const char *_phaseName;
+    pt::ptime _phaseStartTime;
+};
+
+/* Counts the items of every custom items file, so that the progress line can show
+   an ETA. Skipped when nothing is shown anyway. */
+static size_t CountCustomItems(const vector<path> &customItemsFiles)
+{
+    if(ConsoleReporter::GetVerbosity() == ConsoleReporter::QUIET_VERBOSITY)
+    {
+        return 0;
+    }
+    size_t numItems = 0;
+    BOOST_FOREACH(const path &customItemsPath, customItemsFiles)
+    {
+        numItems += CustomItemStream::CountItems(customItemsPath);
+    }
+    return numItems;
+}
+
+static void ReportNumItemsCreated(size_t numItemsCreated)
+{
+    if(numItemsCreated > 0)
+    {
+        ConsoleReporter::Status("Total number of items created: "
+            + boost::lexical_cast<string>(numItemsCreated));
+    }
+    else
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: No items created! "
+            "Define items in the csv files of the Custom Items directory.");
+    }
+}
+
+/* Same as ReadAndCreateCustomItems, but streams rows through an ItemPipeline so that
+   reading, instantiating, merging and writing overlap, and only a bounded number of
+   rows are in memory at once. */
+static bool StreamAndCreateCustomItems(const OptionsT &options,
+    const vector<path> &customItemsFiles, MapManager *map, TemplateCache &templateCache,
+    InstantiationCache *instantiationCache, size_t &numItemsCreated)
+{
+    TRACE_SCOPE("CreateCustomItems");
+    ItemPipeline pipeline(map, options.numInstantiateThreads, instantiationCache,
+        options.useFileMergeWorkers, options.numMergeStripes);
+    ConsoleReporter::BeginPhase("Creating items", CountCustomItems(customItemsFiles));
+    bool success = pipeline.Run(customItemsFiles, templateCache, options.templatesFolder,
+        options.outputFolder);
+    ConsoleReporter::EndPhase();
+    if(!success)
+    {
+        return false;
+    }
+    numItemsCreated = pipeline.GetNumItemsCreated();
+    ReportNumItemsCreated(numItemsCreated);
+    return true;
+}
+
+/* Creates the items of a single custom items file. */
+static bool CreateCustomItemsFromFile(const OptionsT &options, const path &customItemsPath,
+    MapManager *map, TemplateCache &templateCache, InstantiationCache *instantiationCache,
+    FileMergeWorkers *mergeWorkers, size_t &numItemsCreated)
+{
+    TRACE_SCOPE_DETAIL("CreateCustomItemsFromFile", customItemsPath.filename());
+    CustomItemStream customItemStream;
+    if(!customItemStream.Open(customItemsPath))
+    {
+        return false;
+    }
+    //rows are read (and ranges expanded) one at a time, so the template is
+    //only created once we know the file has at least one row.
+    boost::shared_ptr<const Template> templateToUse;
+    ReadCustomItemT readCustomItem;
+    CustomItemStream::ReadResultT readResult;
+    //cached templates are shared between runs, so items are numbered here
+    //rather than by the template.
+    size_t itemIndex = 0;
+    while((readResult = customItemStream.ReadNext(readCustomItem)) ==
+        CustomItemStream::RowRead)
+    {
+        if(!templateToUse)
+        {
+            string templateForCustomItem(customItemsPath.stem());
+            templateToUse = templateCache.Get(options.templatesFolder/templateForCustomItem);
+            if(!templateToUse)
+            {
+                return false;
+            }
+        }
+        //the merge workers keep the item until it is merged into every data file.
+        boost::shared_ptr<CustomItem> currentItem(new CustomItem());
+        bool wasCreated = (instantiationCache ?
+            instantiationCache->CreateItem(*templateToUse, readCustomItem.varNameToValue,
+                itemIndex, *currentItem) :
+            currentItem->Create(*templateToUse, readCustomItem.varNameToValue, itemIndex));
+        ++itemIndex;
+        if(!wasCreated)
+        {
+            return false;
+        }
+        if(mergeWorkers)
+        {
+            //the workers also write the item.
+            if(!mergeWorkers->Add(currentItem))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if(map)
+            {
+                if(!currentItem->AddToMap(*map))
+                {
+                    return false;
+                }
+            }
+            if(!currentItem->Output(options.outputFolder))
+            {
+                return false;
+            }
+        }
+        ++numItemsCreated;
+        ConsoleReporter::ItemDone();
+    }
+    return (readResult != CustomItemStream::ReadFailed);
+}
+
+static bool ReadAndCreateCustomItems(const OptionsT &options,
+    const vector<path> &customItemsFiles, MapManager *map, TemplateCache &templateCache,
+    InstantiationCache *instantiationCache, size_t &numItemsCreated)
+{
+    TRACE_SCOPE("CreateCustomItems");
+    numItemsCreated = 0;
+    bool success = true;
+    boost::scoped_ptr<FileMergeWorkers> mergeWorkers((map && options.useFileMergeWorkers) ?
+        new FileMergeWorkers(*map, options.outputFolder, options.numMergeStripes) : NULL);
+    ConsoleReporter::BeginPhase("Creating items", CountCustomItems(customItemsFiles));
+    for(size_t i = 0; success && i < customItemsFiles.size(); ++i)
+    {
+        success = CreateCustomItemsFromFile(options, customItemsFiles[i], map, templateCache,
+            instantiationCache, mergeWorkers.get(), numItemsCreated);
+    }
+    if(mergeWorkers && !mergeWorkers->Finish())
+    {
+        success = false;
+    }
+    ConsoleReporter::EndPhase();
+    if(!success)
+    {
+        return false;
+    }
+    ReportNumItemsCreated(numItemsCreated);
+    return true;
+}
+
+/* Creates every item of customItemsFiles, in order, without merging them anywhere. */
+static bool CreateAllCustomItems(const OptionsT &options, const vector<path> &customItemsFiles,
+    TemplateCache &templateCache, InstantiationCache *instantiationCache,
+    vector<boost::shared_ptr<CustomItem> > &items)
+{
+    TRACE_SCOPE("CreateCustomItems");
+    ConsoleReporter::BeginPhase("Creating items", CountCustomItems(customItemsFiles));
+    bool success = true;
+    for(size_t i = 0; success && i < customItemsFiles.size(); ++i)
+    {
+        CustomItemStream customItemStream;
+        if(!customItemStream.Open(customItemsFiles[i]))
+        {
+            success = false;
+            break;
+        }
+        boost::shared_ptr<const Template> templateToUse;
+        ReadCustomItemT readCustomItem;
+        CustomItemStream::ReadResultT readResult;
+        size_t itemIndex = 0;
+        while(success && (readResult = customItemStream.ReadNext(readCustomItem)) ==
+            CustomItemStream::RowRead)
+        {
+            if(!templateToUse)
+            {
+                string templateForCustomItem(customItemsFiles[i].stem());
+                templateToUse = templateCache.Get(options.templatesFolder/templateForCustomItem);
+                if(!templateToUse)
+                {
+                    success = false;
+                    break;
+                }
+            }
+            boost::shared_ptr<CustomItem> item(new CustomItem());
+            success = (instantiationCache ?
+                instantiationCache->CreateItem(*templateToUse, readCustomItem.varNameToValue,
+                    itemIndex, *item) :
+                item->Create(*templateToUse, readCustomItem.varNameToValue, itemIndex));
+            ++itemIndex;
+            items.push_back(item);
+            ConsoleReporter::ItemDone();
+        }
+        success = (success && readResult != CustomItemStream::ReadFailed);
+    }
+    ConsoleReporter::EndPhase();
+    return success;
+}
+
+/* Same as ReadAndCreateCustomItems, but creates every item before merging any, then
+   merges them all at once with a BulkCatalogMerge, and only then writes them. */
+static bool BulkCreateCustomItems(const OptionsT &options,
+    const vector<path> &customItemsFiles, MapManager *map, TemplateCache &templateCache,
+    InstantiationCache *instantiationCache, size_t &numItemsCreated)
+{
+    numItemsCreated = 0;
+    vector<boost::shared_ptr<CustomItem> > items;
+    if(!CreateAllCustomItems(options, customItemsFiles, templateCache, instantiationCache,
+        items))
+    {
+        return false;
+    }
+    if(map)
+    {
+        BulkCatalogMerge bulkMerge(*map);
+        BOOST_FOREACH(const boost::shared_ptr<CustomItem> &item, items)
+        {
+            bulkMerge.Add(item);
+        }
+        if(!bulkMerge.Commit())
+        {
+            return false;
+        }
+    }
+    //writing strips the notes to SC2DM, so items are only written once merged.
+    BOOST_FOREACH(const boost::shared_ptr<CustomItem> &item, items)
+    {
+        if(!item->Output(options.outputFolder))
+        {
+            return false;
+        }
+    }
+    numItemsCreated = items.size();
+    ReportNumItemsCreated(numItemsCreated);
+    return true;
+}
+
+/* The maps of a batch, handed out to the threads that update them. */
+class BatchMapQueue
+{
+public:
+    BatchMapQueue(const OptionsT &options, const vector<path> &mapPaths,
+        const vector<boost::shared_ptr<CustomItem> > &items,
+        const vector<CatalogLayerPtr> &dependencyLayers)
+        : _options(options), _mapPaths(mapPaths), _items(items),
+        _dependencyLayers(dependencyLayers), _nextMap(0), _failedMapPaths()
+    {
+    }
+
+    //updates maps until every map was handed out.
+    void UpdateMaps()
+    {
+        path mapPath;
+        while(GetNextMap(mapPath))
+        {
+            if(!UpdateMap(mapPath))
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                _failedMapPaths.push_back(mapPath);
+            }
+        }
+    }
+
+    const vector<path> &GetFailedMapPaths() const
+    {
+        return _failedMapPaths;
+    }
+
+private:
+    bool GetNextMap(path &mapPath)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        if(_nextMap >= _mapPaths.size())
+        {
+            return false;
+        }
+        mapPath = _mapPaths[_nextMap++];
+        return true;
+    }
+
+    bool UpdateMap(const path &mapPath)
+    {
+        string mapName = mapPath.filename();
+        ErrorLogger::ScopedContext logContext("UpdateMap", "", "", mapName.c_str());
+        TRACE_SCOPE_DETAIL("UpdateMap", mapName);
+        MapManager map;
+        map.SetSnapshotFolder(_options.snapshotFolder);
+        //the progress of the batch is shown instead.
+        if(!map.Create(mapPath, false, _options.useLazyLoading))
+        {
+            return false;
+        }
+        map.SetDependencyLayers(_dependencyLayers);
+        //merging only reads the items and layers, so every thread can merge the same ones.
+        if(_options.useBulkMerge)
+        {
+            BulkCatalogMerge bulkMerge(map);
+            BOOST_FOREACH(const boost::shared_ptr<CustomItem> &item, _items)
+            {
+                bulkMerge.Add(item);
+                ConsoleReporter::ItemDone();
+            }
+            return bulkMerge.Commit() && map.Save();
+        }
+        BOOST_FOREACH(const boost::shared_ptr<CustomItem> &item, _items)
+        {
+            if(!item->AddToMap(map))
+            {
+                return false;
+            }
+            ConsoleReporter::ItemDone();
+        }
+        return map.Save();
+    }
+
+    const OptionsT &_options;
+    const vector<path> &_mapPaths;
+    const vector<boost::shared_ptr<CustomItem> > &_items;
+    const vector<CatalogLayerPtr> &_dependencyLayers;
+    size_t _nextMap;
+    vector<path> _failedMapPaths;
+    boost::mutex _mutex;
+};
+
+/* The phases that Execute and Apply share: everything after the map is backed up
+   and loaded. */
+static bool CreateItemsAndSaveMap(const OptionsT &options, MapManager *map,
+    TemplateCache &templateCache, PhaseTimer &phaseTimer, StatsT &stats)
+{
+    phaseTimer.BeginPhase("ClearOutputDirectory");
+    if(!ClearOutputDirectory(options.outputFolder))
+    {
+        return false;
+    }
+    phaseTimer.BeginPhase("CreateCustomItems");
+    vector<path> customItemsFiles;
+    if(!GetCustomItemsFiles(options, customItemsFiles))
+    {
+        return false;
+    }
+    InstantiationCache instantiationCache;
+    if(!options.itemCacheFolder.empty() && !instantiationCache.Create(options.itemCacheFolder))
+    {
+        return false;
+    }
+    bool (*createCustomItems)(const OptionsT &, const vector<path> &, MapManager *,
+        TemplateCache &, InstantiationCache *, size_t &) =
+        (options.usePipeline ? StreamAndCreateCustomItems :
+        (options.useBulkMerge && !options.useFileMergeWorkers) ? BulkCreateCustomItems :
+        ReadAndCreateCustomItems);
+    if(!createCustomItems(options, customItemsFiles, map, templateCache,
+        (options.itemCacheFolder.empty() ? NULL : &instantiationCache), stats.numItemsCreated))
+    {
+        return false;
+    }
+    if(map)
+    {
+        phaseTimer.BeginPhase("SaveMap");
+        if(!map->Save())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+bool DataDuplicator::LoadDependencyLayers(const OptionsT &options,
+    vector<CatalogLayerPtr> &layers)
+{
+    TRACE_SCOPE("LoadDependencies");
+    layers.clear();
+    BOOST_FOREACH(const path &dependencyPath, options.dependencyPaths)
+    {
+        boost::shared_ptr<CatalogLayer> layer(new CatalogLayer());
+        if(!layer->Create(dependencyPath))
+        {
+            ErrorLogger::Log("ERROR: LoadDependencyLayers: failed to read dependency \""
+                + dependencyPath.string() + "\".");
+            return false;
+        }
+        layers.push_back(layer);
+    }
+    return true;
+}
+
+bool DataDuplicator::BackupMap(const path &mapPath, const path &backupFolder)
+{
+    ErrorLogger::ScopedContext logContext("BackupMap");
+    TRACE_SCOPE("BackupMap");
+    try
+    {
+        if(!exists(backupFolder))
+        {
+            create_directories(backupFolder);
+        }
+        path backupPath = backupFolder/mapPath.filename();
+        if(exists(backupPath))
+        {
+            remove_all(backupPath);
+        }
+        if(MapArchive::IsArchive(mapPath))
+        {
+            copy_file(mapPath, backupPath);
+        }
+        else if(!CopyDirectoryAndContents( mapPath, backupPath ))
+        {
+            ErrorLogger::Log("ERROR: BackupMap: could not backup map.");
+            return false;
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: BackupMap: ") + e.what() + ".");
+        return false;
+    }
+    return true;
+}
+
+bool DataDuplicator::ClearOutputDirectory(const path &outputFolder)
+{
+    ErrorLogger::ScopedContext logContext("ClearOutputDirectory");
+    TRACE_SCOPE("ClearOutputDirectory");
+    try
+    {
+        if(!exists(outputFolder))
+        {
+            create_directory(outputFolder);
+        }
+        directory_iterator end_itr;
+        for(directory_iterator itr(outputFolder); itr != end_itr; ++itr)
+        {
+            if(is_regular_file(itr->path()) && itr->path().extension() ==
+                ".xml")
+            {
+                remove(itr->path());
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: ClearOutputDirectory: ") +
+            e.what() + ".");
+        return false;
+    }
+    return true;
+}
+
+bool DataDuplicator::GetCustomItemsFiles(const OptionsT &options, vector<path> &customItemsFiles)
+{
+    if(!options.customItemsFiles.empty())
+    {
+        customItemsFiles = options.customItemsFiles;
+        return true;
+    }
+    customItemsFiles.clear();
+    try
+    {
+        for(fs::directory_iterator it(options.customItemsFolder);
+            it != fs::directory_iterator(); it++)
+        {
+            customItemsFiles.push_back(it->path());
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: GetCustomItemsFiles: ") + e.what() + ".");
+        return false;
+    }
+    if(customItemsFiles.empty())
+    {
+        ErrorLogger::Log("ERROR: GetCustomItemsFiles: folder \""
+             + options.customItemsFolder.string() + "\" is empty. No items were "
+             "created.");
+        return false;
+    }
+    return true;
+}
+
+DataDuplicator::OptionsT::OptionsT()
+    : mapPath("")
+    , templatesFolder(TEMPLATES_FOLDER)
+    , customItemsFolder(CUSTOM_ITEMS_FOLDER)
+    , outputFolder(OUTPUT_FOLDER)
+    , backupFolder(BACKUP_FILES_FOLDER)
+    , usePipeline(false)
+    , numInstantiateThreads(1)
+    , useManifest(false)
+    , itemCacheFolder("")
+    , numMapThreads(0)
+    , dependencyPaths()
+    , useLazyLoading(false)
+    , snapshotFolder("")
+    , useFileMergeWorkers(false)
+    , numMergeStripes(1)
+    , useBulkMerge(false)
+{
+}
+
+bool DataDuplicator::Execute(const OptionsT &options, StatsT &stats)
+{
+    TRACE_SCOPE("Execute");
+    stats = StatsT();
+    PhaseTimer phaseTimer(stats);
+
+    phaseTimer.BeginPhase("InitTemplates");
+    if(!Template::InitTemplates())
+    {
+        return false;
+    }
+    const path &mapPath = options.mapPath;
+    if(options.useManifest && !mapPath.empty())
+    {
+        phaseTimer.BeginPhase("IncrementalRun");
+        IncrementalRun run;
+        if(!run.Create(options, stats.numItemsCreated))
+        {
+            return false;
+        }
+        ConsoleReporter::Status("Items created or removed: "
+            + boost::lexical_cast<string>(stats.numItemsCreated) + " of "
+            + boost::lexical_cast<string>(run.GetNumItems()));
+        return true;
+    }
+    MapManager map;
+    if(!mapPath.empty())
+    {
+        phaseTimer.BeginPhase("LoadDependencies");
+        vector<CatalogLayerPtr> dependencyLayers;
+        if(!LoadDependencyLayers(options, dependencyLayers))
+        {
+            return false;
+        }
+        map.SetDependencyLayers(dependencyLayers);
+        map.SetSnapshotFolder(options.snapshotFolder);
+        phaseTimer.BeginPhase("BackupMap");
+        if(!BackupMap(mapPath, options.backupFolder))
+        {
+            return false;
+        }
+        phaseTimer.BeginPhase("LoadMap");
+        if(!map.Create(mapPath, true, options.useLazyLoading))
+        {
+            return false;
+        }
+    }
+    TemplateCache templateCache;
+    return CreateItemsAndSaveMap(options, (mapPath.empty() ? NULL : &map), templateCache,
+        phaseTimer, stats);
+}
+
+bool DataDuplicator::Plan(const OptionsT &options, MergeChangeSet &changeSet, StatsT &stats)
+{
+    TRACE_SCOPE("Plan");
+    stats = StatsT();
+    PhaseTimer phaseTimer(stats);
+    if(options.mapPath.empty())
+    {
+        ErrorLogger::Log("ERROR: Plan: no map to plan the changes of.");
+        return false;
+    }
+
+    phaseTimer.BeginPhase("InitTemplates");
+    if(!Template::InitTemplates())
+    {
+        return false;
+    }
+    phaseTimer.BeginPhase("LoadDependencies");
+    vector<CatalogLayerPtr> dependencyLayers;
+    if(!LoadDependencyLayers(options, dependencyLayers))
+    {
+        return false;
+    }
+    MapManager map;
+    map.SetDependencyLayers(dependencyLayers);
+    map.SetSnapshotFolder(options.snapshotFolder);
+    phaseTimer.BeginPhase("LoadMap");
+    if(!map.Create(options.mapPath, true, options.useLazyLoading))
+    {
+        return false;
+    }
+
+    phaseTimer.BeginPhase("CreateCustomItems");
+    vector<path> customItemsFiles;
+    if(!GetCustomItemsFiles(options, customItemsFiles))
+    {
+        return false;
+    }
+    TemplateCache templateCache;
+    vector<boost::shared_ptr<CustomItem> > items;
+    if(!CreateAllCustomItems(options, customItemsFiles, templateCache, NULL, items))
+    {
+        return false;
+    }
+    stats.numItemsCreated = items.size();
+    ReportNumItemsCreated(stats.numItemsCreated);
+
+    phaseTimer.BeginPhase("PlanMerge");
+    BulkCatalogMerge bulkMerge(map);
+    bulkMerge.SetChangeSet(&changeSet);
+    BOOST_FOREACH(const boost::shared_ptr<CustomItem> &item, items)
+    {
+        bulkMerge.Add(item);
+    }
+    return bulkMerge.Commit();
+}
+
+bool DataDuplicator::ExecuteBatch(const OptionsT &options, const vector<path> &mapPaths,
+    StatsT &stats)
+{
+    TRACE_SCOPE("ExecuteBatch");
+    stats = StatsT();
+    PhaseTimer phaseTimer(stats);
+
+    phaseTimer.BeginPhase("InitTemplates");
+    if(!Template::InitTemplates())
+    {
+        return false;
+    }
+    phaseTimer.BeginPhase("CreateCustomItems");
+    vector<path> customItemsFiles;
+    if(!GetCustomItemsFiles(options, customItemsFiles))
+    {
+        return false;
+    }
+    TemplateCache templateCache;
+    InstantiationCache instantiationCache;
+    if(!options.itemCacheFolder.empty() && !instantiationCache.Create(options.itemCacheFolder))
+    {
+        return false;
+    }
+    vector<boost::shared_ptr<CustomItem> > items;
+    if(!CreateAllCustomItems(options, customItemsFiles, templateCache,
+        (options.itemCacheFolder.empty() ? NULL : &instantiationCache), items))
+    {
+        return false;
+    }
+    stats.numItemsCreated = items.size();
+    ReportNumItemsCreated(stats.numItemsCreated);
+
+    //read once, for every map.
+    phaseTimer.BeginPhase("LoadDependencies");
+    vector<CatalogLayerPtr> dependencyLayers;
+    if(!LoadDependencyLayers(options, dependencyLayers))
+    {
+        return false;
+    }
+
+    //backed up one after the other, before any map is changed. Maps that share a
+    //name are backed up into numbered folders, so that no backup replaces another.
+    phaseTimer.BeginPhase("BackupMaps");
+    map<string, size_t> filenameToNumMaps;
+    BOOST_FOREACH(const path &mapPath, mapPaths)
+    {
+        ++filenameToNumMaps[mapPath.filename()];
+    }
+    vector<path> backedUpMapPaths;
+    bool success = true;
+    for(size_t i = 0; i < mapPaths.size(); ++i)
+    {
+        path backupFolder = options.backupFolder;
+        if(filenameToNumMaps[mapPaths[i].filename()] > 1)
+        {
+            backupFolder /= boost::lexical_cast<string>(i + 1);
+        }
+        if(BackupMap(mapPaths[i], backupFolder))
+        {
+            backedUpMapPaths.push_back(mapPaths[i]);
+        }
+        else
+        {
+            ErrorLogger::Log("ERROR: ExecuteBatch: failed to back up map \""
+                + mapPaths[i].string() + "\", which is left as it was.");
+            success = false;
+        }
+    }
+
+    phaseTimer.BeginPhase("UpdateMaps");
+    size_t numThreads = (options.numMapThreads > 0 ? options.numMapThreads :
+        boost::thread::hardware_concurrency());
+    numThreads = max((size_t) 1, min(numThreads, backedUpMapPaths.size()));
+    BatchMapQueue mapQueue(options, backedUpMapPaths, items, dependencyLayers);
+    ConsoleReporter::BeginPhase("Updating " + boost::lexical_cast<string>(backedUpMapPaths.size())
+        + " maps", backedUpMapPaths.size() * items.size());
+    boost::thread_group mapThreads;
+    for(size_t i = 0; i < numThreads; ++i)
+    {
+        mapThreads.create_thread(boost::bind(&BatchMapQueue::UpdateMaps, &mapQueue));
+    }
+    mapThreads.join_all();
+    ConsoleReporter::EndPhase();
+    BOOST_FOREACH(const path &mapPath, mapQueue.GetFailedMapPaths())
+    {
+        ErrorLogger::Log("ERROR: ExecuteBatch: failed to update map \"" + mapPath.string() + "\".");
+    }
+
+    //writing an item removes its notes to SC2DM, so it waits until every map is merged.
+    phaseTimer.BeginPhase("Output");
+    if(!ClearOutputDirectory(options.outputFolder))
+    {
+        return false;
+    }
+    BOOST_FOREACH(const boost::shared_ptr<CustomItem> &item, items)
+    {
+        if(!item->Output(options.outputFolder))
+        {
+            return false;
+        }
+    }
+    return success && mapQueue.GetFailedMapPaths().empty();
+}
+
+bool DataDuplicator::Apply(const OptionsT &options, MapManager *map,
+    TemplateCache &templateCache, StatsT &stats)
+{
+    TRACE_SCOPE("Apply");
+    stats = StatsT();
+    PhaseTimer phaseTimer(stats);
+    if(map)
+    {
+        phaseTimer.BeginPhase("BackupMap");
+        if(!BackupMap(options.mapPath, options.backupFolder))
+        {
+            return false;
+        }
+    }
+    return CreateItemsAndSaveMap(options, map, templateCache, phaseTimer, stats);
+}
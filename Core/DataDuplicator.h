@@ -0,0 +1,124 @@
+#ifndef _DATA_DUPLICATOR_H_
+#define _DATA_DUPLICATOR_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "boost/filesystem/path.hpp"
+#include "CatalogLayer.h"
+using namespace std;
+
+class MapManager;
+class MergeChangeSet;
+class TemplateCache;
+
+//Runs the whole program, independently of how it was started: backs up the map,
+//loads it, creates an item for every row of every custom items file, merges the
+//items into the map, writes them to the output folder, and saves the map.
+namespace DataDuplicator
+{
+    struct OptionsT
+    {
+        boost::filesystem::path mapPath;    /* empty if items should only be written
+                                               to the output folder. */
+        boost::filesystem::path templatesFolder;
+        boost::filesystem::path customItemsFolder;
+        //if not empty, only these custom items files are read, instead of every
+        //file of customItemsFolder.
+        vector<boost::filesystem::path> customItemsFiles;
+        boost::filesystem::path outputFolder;
+        boost::filesystem::path backupFolder;
+        bool usePipeline;                   /* stream items through an ItemPipeline. */
+        size_t numInstantiateThreads;       /* only used by the pipeline. */
+        //keep a manifest of the items in the map, and only redo the items that
+        //changed since the last run (see IncrementalRun). Ignored without a map.
+        bool useManifest;
+        //folder of an InstantiationCache shared by every run. Empty if items should
+        //always be instantiated.
+        boost::filesystem::path itemCacheFolder;
+        size_t numMapThreads;               /* maps that ExecuteBatch updates at once. 0
+                                               for one per processor. */
+        //mods (or other maps) that every map depends on, from first to last. Their
+        //objects are read once per run and shared by every map: items may modify
+        //them, which copies them into the map.
+        vector<boost::filesystem::path> dependencyPaths;
+        //only parse the objects of the map that items merge into (see LazyCatalog).
+        //The rest of each data file is written back as it was read. Not used by
+        //incremental runs.
+        bool useLazyLoading;
+        //folder of the MapSnapshots shared by every run, so that maps loaded lazily
+        //are not indexed again while they do not change. Empty if maps should not be
+        //snapshotted. Only used with useLazyLoading.
+        boost::filesystem::path snapshotFolder;
+        //merge into each data file of the map on its own thread (see FileMergeWorkers).
+        //Not used by incremental runs, nor by ExecuteBatch, which already updates
+        //maps on their own threads.
+        bool useFileMergeWorkers;
+        //threads merging into each data file at once (see StripedCatalogMerge). Only
+        //used with useFileMergeWorkers.
+        size_t numMergeStripes;
+        //create every item first, then merge them all into each data file in a single
+        //sorted pass (see BulkCatalogMerge). Not used by the pipeline, by incremental
+        //runs, nor with useFileMergeWorkers.
+        bool useBulkMerge;
+
+        //uses the folders of the working directory.
+        OptionsT();
+    };
+
+    struct StatsT
+    {
+        size_t numItemsCreated;
+        //wall-clock time of each phase, in the order the phases ran.
+        vector<pair<string, double> > phaseSeconds;
+
+        StatsT() : numItemsCreated(0), phaseSeconds()
+        {
+        }
+    };
+
+    bool Execute(const OptionsT &options, StatsT &stats);
+
+    //Same as Execute, but merges the items into every map of mapPaths (options.mapPath
+    //is ignored). Templates and custom items files are read once, and each item is
+    //created and written to the output folder once, then the maps are backed up one
+    //after the other, and merged into and saved on their own threads. Maps that share
+    //a name are backed up into numbered subfolders of options.backupFolder. A map
+    //that fails does not stop the others.
+    //@return : false if any map could not be updated.
+    bool ExecuteBatch(const OptionsT &options, const vector<boost::filesystem::path> &mapPaths,
+        StatsT &stats);
+
+    //Same as Execute, but merges items into map, which was already loaded from
+    //options.mapPath (NULL if items should only be written to the output folder),
+    //and takes templates from templateCache. Template::InitTemplates must have been
+    //called, and map's dependency layers must have been set (see
+    //LoadDependencyLayers). If this fails, map may be left half changed.
+    bool Apply(const OptionsT &options, MapManager *map, TemplateCache &templateCache,
+        StatsT &stats);
+
+    //Works out what Execute would change in the map at options.mapPath, without
+    //changing anything on disk: the map is loaded and every item is created and
+    //merged into it in memory with a BulkCatalogMerge, which records every change in
+    //changeSet. Nothing is backed up, written to the output folder or saved, and the
+    //item cache is not used. Only the map's snapshot (see MapSnapshot) may be
+    //refreshed. options.mapPath must be set.
+    bool Plan(const OptionsT &options, MergeChangeSet &changeSet, StatsT &stats);
+
+    //Reads the dependencies of options.dependencyPaths, in the same order.
+    bool LoadDependencyLayers(const OptionsT &options, vector<CatalogLayerPtr> &layers);
+
+    //Copies the map at mapPath into backupFolder, replacing any earlier backup.
+    bool BackupMap(const boost::filesystem::path &mapPath,
+        const boost::filesystem::path &backupFolder);
+
+    //Removes the data files written by an earlier run from outputFolder.
+    bool ClearOutputDirectory(const boost::filesystem::path &outputFolder);
+
+    //Lists the custom items files to read: options.customItemsFiles, or else every
+    //file of options.customItemsFolder.
+    bool GetCustomItemsFiles(const OptionsT &options,
+        vector<boost::filesystem::path> &customItemsFiles);
+}
+
+#endif //_DATA_DUPLICATOR_H_
\ No newline at end of file
@@ -1,26 +1,423 @@
 #include "ErrorLogger.h"
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/tss.hpp"
+#include "AtomicOps.h"
+
+using namespace AtomicOps;
+
+#ifdef _MSC_VER
+#define vsnprintf _vsnprintf
+#endif
+
+//---------------- CONSTANTS ------------------
+/* number of records the ring buffer can hold. Must be a power of 2. */
+static const AtomicUInt32 LOG_BUFFER_CAPACITY = 256;
+/* maximum lengths of each field of a record. Longer values are truncated. */
+static const size_t LOG_MESSAGE_CAPACITY = 1024;
+static const size_t LOG_FIELD_CAPACITY = 128;
+static const char *LOG_SEVERITY_NAMES[] = { "INFO", "WARNING", "ERROR" };
+
+//---------------- RING BUFFER ------------------
+/* A single log record. Fields are fixed-size so that logging never allocates. */
+struct LogSlot
+{
+    volatile AtomicUInt32 sequence;
+    ErrorLogger::SeverityT severity;
+    char phase[LOG_FIELD_CAPACITY];
+    char templateName[LOG_FIELD_CAPACITY];
+    char itemId[LOG_FIELD_CAPACITY];
+    char file[LOG_FIELD_CAPACITY];
+    char message[LOG_MESSAGE_CAPACITY];
+};
+
+/* Bounded multi-producer ring buffer. Each slot's sequence number tells producers
+   whether the slot is free for the current lap around the buffer, and tells the
+   consumer whether the slot has been filled. Only the background thread consumes. */
+static LogSlot logBuffer[LOG_BUFFER_CAPACITY];
+static volatile AtomicUInt32 enqueuePos = 0;
+static volatile AtomicUInt32 dequeuePos = 0;
+
+/* Per-thread attribution of records. Points to the values of the innermost
+   ScopedContext of each kind. */
+struct LogContext
+{
+    const char *phase;
+    const char *templateName;
+    const char *itemId;
+    const char *file;
+
+    LogContext() : phase(""), templateName(""), itemId(""), file("")
+    {
+    }
+};
+static boost::thread_specific_ptr<LogContext> logContext;
 
 static ofstream logFileWriter;
 static bool hasInited = false;
+static volatile AtomicUInt32 isTakingRecords = 0;
+/* threads that are putting a record into the buffer right now. */
+static volatile AtomicUInt32 numThreadsLogging = 0;
+static volatile AtomicUInt32 shouldStop = 0;
+static boost::thread *flusherThread = NULL;
+/* The background thread waits on flusherWakeup while the buffer is empty.
+   isFlusherWaiting tells producers whether they need to wake it up, so that
+   logging only takes flusherMutex when the background thread is asleep. */
+static boost::mutex flusherMutex;
+static boost::condition_variable flusherWakeup;
+static volatile AtomicUInt32 isFlusherWaiting = 0;
+
+static void CopyField(char *dest, size_t destCapacity, const char *source, size_t length)
+{
+    length = min(length, destCapacity - 1);
+    memcpy(dest, source, length);
+    dest[length] = '\0';
+}
+
+static void CopyField(char *dest, size_t destCapacity, const char *source)
+{
+    strncpy(dest, source, destCapacity - 1);
+    dest[destCapacity - 1] = '\0';
+}
+
+static LogContext &GetContext()
+{
+    if(!logContext.get())
+    {
+        logContext.reset(new LogContext);
+    }
+    return *logContext;
+}
+
+static void InitBuffer()
+{
+    for(AtomicUInt32 i = 0; i < LOG_BUFFER_CAPACITY; ++i)
+    {
+        Store(&logBuffer[i].sequence, i);
+    }
+    Store(&enqueuePos, 0);
+    Store(&dequeuePos, 0);
+}
+
+/* Claims a slot and fills in everything but its message. Waits if the buffer is
+   full. The slot must then be published with PublishSlot. */
+static LogSlot *ClaimSlot(ErrorLogger::SeverityT severity, const char *file, AtomicUInt32 &pos)
+{
+    LogSlot *slot = NULL;
+    pos = Load(&enqueuePos);
+    while(true)
+    {
+        slot = &logBuffer[pos & (LOG_BUFFER_CAPACITY - 1)];
+        AtomicUInt32 sequence = Load(&slot->sequence);
+        boost::int32_t diff = (boost::int32_t)(sequence - pos);
+        if(diff == 0)
+        {
+            AtomicUInt32 oldPos = CompareAndSwap(&enqueuePos, pos + 1, pos);
+            if(oldPos == pos)
+            {
+                break;
+            }
+            pos = oldPos;
+        }
+        else if(diff < 0)
+        {
+            //the buffer is full. let the background thread catch up.
+            boost::this_thread::yield();
+            pos = Load(&enqueuePos);
+        }
+        else
+        {
+            pos = Load(&enqueuePos);
+        }
+    }
+
+    const LogContext &context = GetContext();
+    slot->severity = severity;
+    CopyField(slot->phase, LOG_FIELD_CAPACITY, context.phase);
+    CopyField(slot->templateName, LOG_FIELD_CAPACITY, context.templateName);
+    CopyField(slot->itemId, LOG_FIELD_CAPACITY, context.itemId);
+    CopyField(slot->file, LOG_FIELD_CAPACITY, (file ? file : context.file));
+    return slot;
+}
+
+/* Hands a filled slot to the background thread, waking it up if it is asleep. */
+static void PublishSlot(LogSlot *slot, AtomicUInt32 pos)
+{
+    Store(&slot->sequence, pos + 1);
+    //the compare-and-swap is a full barrier, so either the background thread sees
+    //the slot before it goes to sleep, or this sees that it went to sleep.
+    if(CompareAndSwap(&isFlusherWaiting, 0, 1) == 1)
+    {
+        boost::mutex::scoped_lock lock(flusherMutex);
+        flusherWakeup.notify_one();
+    }
+}
+
+static void Enqueue(ErrorLogger::SeverityT severity, const char *message, size_t messageLength,
+    const char *file)
+{
+    AtomicUInt32 pos = 0;
+    LogSlot *slot = ClaimSlot(severity, file, pos);
+    CopyField(slot->message, LOG_MESSAGE_CAPACITY, message, messageLength);
+    PublishSlot(slot, pos);
+}
+
+/* Formats the message straight into the slot, so that nothing is allocated. */
+static void EnqueueFormatted(ErrorLogger::SeverityT severity, const char *format, va_list args)
+{
+    AtomicUInt32 pos = 0;
+    LogSlot *slot = ClaimSlot(severity, NULL, pos);
+    vsnprintf(slot->message, LOG_MESSAGE_CAPACITY, format, args);
+    slot->message[LOG_MESSAGE_CAPACITY - 1] = '\0';
+    PublishSlot(slot, pos);
+}
+
+/* Writes a single record, i.e.
+   [ERROR] phase=Merge template=HeroTemplate item=HeroTemplate:3 file=UnitData.xml: message */
+static void WriteRecord(const LogSlot &slot)
+{
+    logFileWriter << "[" << LOG_SEVERITY_NAMES[slot.severity] << "]";
+    if(slot.phase[0])
+    {
+        logFileWriter << " phase=" << slot.phase;
+    }
+    if(slot.templateName[0])
+    {
+        logFileWriter << " template=" << slot.templateName;
+    }
+    if(slot.itemId[0])
+    {
+        logFileWriter << " item=" << slot.itemId;
+    }
+    if(slot.file[0])
+    {
+        logFileWriter << " file=" << slot.file;
+    }
+    logFileWriter << ": " << slot.message << "\n";
+    if(slot.severity != ErrorLogger::INFO_SEVERITY)
+    {
+        cerr << slot.message << "\n";
+    }
+}
+
+/* Writes every published record. Returns whether anything was written. */
+static bool DrainBuffer()
+{
+    bool hasWritten = false;
+    while(true)
+    {
+        AtomicUInt32 pos = Load(&dequeuePos);
+        LogSlot &slot = logBuffer[pos & (LOG_BUFFER_CAPACITY - 1)];
+        if(Load(&slot.sequence) != pos + 1)
+        {
+            break;
+        }
+        WriteRecord(slot);
+        //free the slot for the next lap around the buffer.
+        Store(&slot.sequence, pos + LOG_BUFFER_CAPACITY);
+        Store(&dequeuePos, pos + 1);
+        hasWritten = true;
+    }
+    if(hasWritten)
+    {
+        logFileWriter.flush();
+        cerr.flush();
+    }
+    return hasWritten;
+}
+
+/* @return : true if the next record has been published. */
+static bool HasPublishedRecord()
+{
+    AtomicUInt32 pos = Load(&dequeuePos);
+    return (Load(&logBuffer[pos & (LOG_BUFFER_CAPACITY - 1)].sequence) == pos + 1);
+}
+
+static void FlusherMain()
+{
+    while(!Load(&shouldStop))
+    {
+        if(DrainBuffer())
+        {
+            continue;
+        }
+        //sleep until a producer or Shutdown wakes us up.
+        boost::mutex::scoped_lock lock(flusherMutex);
+        CompareAndSwap(&isFlusherWaiting, 1, 0);
+        while(!HasPublishedRecord() && !Load(&shouldStop) && Load(&isFlusherWaiting))
+        {
+            flusherWakeup.wait(lock);
+        }
+        Store(&isFlusherWaiting, 0);
+    }
+    DrainBuffer();
+}
 
+//---------------- PUBLIC FUNCTIONS ------------------
 bool ErrorLogger::Init()
 {
-    logFileWriter.open(ERROR_LOG_FILE.string(), ios_base::trunc);
-    hasInited = logFileWriter.is_open();
-    return hasInited;
+    if(hasInited)
+    {
+        return true;
+    }
+    logFileWriter.open(ERROR_LOG_FILE.string().c_str(), ios_base::trunc);
+    if(!logFileWriter.is_open())
+    {
+        return false;
+    }
+    InitBuffer();
+    Store(&shouldStop, 0);
+    Store(&isFlusherWaiting, 0);
+    flusherThread = new boost::thread(FlusherMain);
+    hasInited = true;
+    Store(&isTakingRecords, 1);
+    atexit(ErrorLogger::Shutdown);
+    return true;
 }
 
-void ErrorLogger::Log(const string &errorMsg)
+void ErrorLogger::Flush()
+{
+    if(!hasInited)
+    {
+        return;
+    }
+    AtomicUInt32 target = Load(&enqueuePos);
+    while((boost::int32_t)(Load(&dequeuePos) - target) < 0)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+}
+
+void ErrorLogger::Shutdown()
 {
     if(!hasInited)
     {
-        cerr << "ERROR: LogError: logging system has not been initialized."
-            << endl;
         return;
     }
-    logFileWriter << errorMsg << endl;
-    cerr << errorMsg << endl;
+    //a thread that is logging now may have checked isTakingRecords before it
+    //changed, so the buffer is only known to be complete once no thread is.
+    Store(&isTakingRecords, 0);
+    while(Load(&numThreadsLogging) > 0)
+    {
+        boost::this_thread::yield();
+    }
+    Flush();
+    Store(&shouldStop, 1);
+    {
+        boost::mutex::scoped_lock lock(flusherMutex);
+        flusherWakeup.notify_one();
+    }
+    flusherThread->join();
+    delete flusherThread;
+    flusherThread = NULL;
     logFileWriter.close();
-}
\ No newline at end of file
+    hasInited = false;
+}
+
+/* Starts logging a record. If this returns false, the record must go straight to
+   cerr instead; otherwise EndLogging must be called once the record is in the buffer. */
+static bool BeginLogging()
+{
+    Increment(&numThreadsLogging);
+    if(!Load(&isTakingRecords))
+    {
+        Decrement(&numThreadsLogging);
+        cerr << "ERROR: LogError: logging system is not running." << endl;
+        return false;
+    }
+    return true;
+}
+
+static void EndLogging()
+{
+    Decrement(&numThreadsLogging);
+}
+
+void ErrorLogger::Log(const string &errorMsg)
+{
+    Log(ERROR_SEVERITY, errorMsg);
+}
+
+void ErrorLogger::Log(SeverityT severity, const string &message)
+{
+    if(!BeginLogging())
+    {
+        cerr << message << endl;
+        return;
+    }
+    Enqueue(severity, message.c_str(), message.size(), NULL);
+    EndLogging();
+}
+
+void ErrorLogger::Log(SeverityT severity, const string &message, const string &file)
+{
+    if(!BeginLogging())
+    {
+        cerr << message << endl;
+        return;
+    }
+    Enqueue(severity, message.c_str(), message.size(), (file.empty() ? NULL : file.c_str()));
+    EndLogging();
+}
+
+void ErrorLogger::LogFormat(SeverityT severity, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    LogFormatArgs(severity, format, args);
+    va_end(args);
+}
+
+void ErrorLogger::LogFormatArgs(SeverityT severity, const char *format, va_list args)
+{
+    if(!BeginLogging())
+    {
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+        return;
+    }
+    EnqueueFormatted(severity, format, args);
+    EndLogging();
+}
+
+//---------------- SCOPED CONTEXT ------------------
+ErrorLogger::ScopedContext::ScopedContext(const char *phase, const char *templateName,
+    const char *itemId, const char *file)
+{
+    LogContext &context = GetContext();
+    _oldPhase = context.phase;
+    _oldTemplateName = context.templateName;
+    _oldItemId = context.itemId;
+    _oldFile = context.file;
+    if(phase[0])
+    {
+        context.phase = phase;
+    }
+    if(templateName[0])
+    {
+        context.templateName = templateName;
+    }
+    if(itemId[0])
+    {
+        context.itemId = itemId;
+    }
+    if(file[0])
+    {
+        context.file = file;
+    }
+}
+
+ErrorLogger::ScopedContext::~ScopedContext()
+{
+    LogContext &context = GetContext();
+    context.phase = _oldPhase;
+    context.templateName = _oldTemplateName;
+    context.itemId = _oldItemId;
+    context.file = _oldFile;
+}
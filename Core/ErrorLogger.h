@@ -2,20 +2,67 @@
 #define _ERROR_LOGGER_H_
 
 #include <sstream>
+#include <cstdarg>
 #include "CommonConstants.h"
 using namespace std;
 
+//Log records are put into a lock-free ring buffer by whichever thread logs them,
+//and are written to the error log file (and, for warnings and errors, to cerr)
+//by a background thread. Logging is safe from any number of threads at once.
 namespace ErrorLogger
 {
+    enum SeverityT
+    {
+        INFO_SEVERITY = 0,
+        WARNING_SEVERITY,
+        ERROR_SEVERITY
+    };
+
+    //opens the log file and starts the background thread.
     bool Init();
-//class ErrorLogger
-//{
-//public:
- //   ErrorLogger();
 
+    //blocks until every record logged so far has been written.
+    void Flush();
+
+    //stops taking records, writes every record logged so far, and stops the
+    //background thread. Records logged afterwards go straight to cerr.
+    void Shutdown();
+
+    //logs an error. The record's phase, template, item and file come from the
+    //ScopedContext of the calling thread.
     void Log(const string &errorMsg);
 
-//};
+    void Log(SeverityT severity, const string &message);
+
+    //@param file: overrides the file of the calling thread's ScopedContext.
+    void Log(SeverityT severity, const string &message, const string &file);
+
+    //Same as Log, but the message is formatted printf-style straight into the log
+    //record, so that no string is built for it. Messages longer than a record can
+    //hold are truncated.
+    void LogFormat(SeverityT severity, const char *format, ...);
+    void LogFormatArgs(SeverityT severity, const char *format, va_list args);
+
+    //Sets the phase, template, item and file that records logged by the current
+    //thread are attributed to, until the ScopedContext is destroyed. Empty values
+    //are inherited from the enclosing ScopedContext. The values are not copied, so
+    //they must outlive the ScopedContext.
+    class ScopedContext
+    {
+    public:
+        ScopedContext(const char *phase, const char *templateName="",
+            const char *itemId="", const char *file="");
+        ~ScopedContext();
+    private:
+        //non-copyable semantics
+        ScopedContext(const ScopedContext &other);
+        const ScopedContext& operator=(const ScopedContext&);
+
+        const char *_oldPhase;
+        const char *_oldTemplateName;
+        const char *_oldItemId;
+        const char *_oldFile;
+    };
 }
 
 #endif //_ERROR_LOGGER_H_
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "FileMergeWorkers.h"
+#include "boost/bind.hpp"
+#include "boost/foreach.hpp"
+#include "CustomItem.h"
+#include "MapManager.h"
+#include "ItemPipeline.h"
+#include "StripedCatalogMerge.h"
+#include "ErrorLogger.h"
+#include "Tracer.h"
+
+//---------------- CONSTANTS ------------------
+//items merged by each StripedCatalogMerge commit. Every commit waits for every
+//stripe, so batches are large.
+static const size_t STRIPED_MERGE_BATCH_SIZE = 1024;
+
+//---------------- PUBLIC FUNCTIONS ------------------
+FileMergeWorkers::FileWorkerT::FileWorkerT(const string &fileName, xml_node mapCatalog)
+    : fileName(fileName)
+    , mapCatalog(mapCatalog)
+    , pendingItems(PIPELINE_QUEUE_CAPACITY)
+    , wasEdited(false)
+{
+}
+
+FileMergeWorkers::FileMergeWorkers(MapManager &mapManager,
+    const boost::filesystem::path &outputFolder, size_t numStripes)
+    : _mapManager(mapManager)
+    , _outputFolder(outputFolder)
+    , _numStripes(numStripes)
+    , _filenameToWorker()
+    , _workerThreads()
+    , _hasFinished(false)
+    , _hasFailed(false)
+{
+}
+
+FileMergeWorkers::~FileMergeWorkers()
+{
+    Finish();
+}
+
+bool FileMergeWorkers::Add(const boost::shared_ptr<CustomItem> &item)
+{
+    typedef pair<string, xml_document *> stringXMLDocPair;
+    BOOST_FOREACH(const stringXMLDocPair &filenameAndDoc, item->GetDataFiles())
+    {
+        boost::shared_ptr<FileWorkerT> worker;
+        {
+            boost::mutex::scoped_lock lock(_stateMutex);
+            if(_hasFailed)
+            {
+                return false;
+            }
+            boost::shared_ptr<FileWorkerT> &fileWorker = _filenameToWorker[filenameAndDoc.first];
+            if(!fileWorker)
+            {
+                //the catalog is created here, since the workers must not add data files
+                //to the map while others are merging.
+                fileWorker.reset(new FileWorkerT(filenameAndDoc.first,
+                    _mapManager.GetDataFileCatalog(filenameAndDoc.first)));
+                _workerThreads.create_thread(boost::bind(_numStripes > 1 ?
+                    &FileMergeWorkers::MergeFileInStripes : &FileMergeWorkers::MergeFile,
+                    this, fileWorker.get()));
+            }
+            worker = fileWorker;
+        }
+        if(!worker->pendingItems.Push(item))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileMergeWorkers::Finish()
+{
+    if(!_hasFinished)
+    {
+        _hasFinished = true;
+        typedef pair<string, boost::shared_ptr<FileWorkerT> > stringWorkerPair;
+        BOOST_FOREACH(const stringWorkerPair &filenameAndWorker, _filenameToWorker)
+        {
+            filenameAndWorker.second->pendingItems.Close();
+        }
+        _workerThreads.join_all();
+        BOOST_FOREACH(const stringWorkerPair &filenameAndWorker, _filenameToWorker)
+        {
+            if(filenameAndWorker.second->wasEdited)
+            {
+                _mapManager.SetDataFileWasEdited(filenameAndWorker.first);
+            }
+        }
+    }
+    return !_hasFailed;
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+/* Merges the items of worker's queue into its data file, in order. */
+void FileMergeWorkers::MergeFile(FileWorkerT *worker)
+{
+    Tracer::SetThreadName("Merge " + worker->fileName);
+    TRACE_SCOPE_DETAIL("MergeFile", worker->fileName);
+    boost::shared_ptr<CustomItem> item;
+    while(worker->pendingItems.Pop(item))
+    {
+        TRACE_SCOPE_DETAIL("Merge", item->GetId());
+        if(!item->AddDataFileToMap(worker->fileName, _mapManager, worker->mapCatalog,
+                worker->wasEdited) ||
+            (!_outputFolder.empty() && !item->OutputDataFile(worker->fileName, _outputFolder)))
+        {
+            Fail();
+            return;
+        }
+    }
+}
+
+/* Same as MergeFile, but merges the items in batches with a StripedCatalogMerge. */
+void FileMergeWorkers::MergeFileInStripes(FileWorkerT *worker)
+{
+    Tracer::SetThreadName("Merge " + worker->fileName);
+    TRACE_SCOPE_DETAIL("MergeFileInStripes", worker->fileName);
+    StripedCatalogMerge stripedMerge(_mapManager, worker->fileName, worker->mapCatalog,
+        _numStripes);
+    bool isQueueOpen = true;
+    while(isQueueOpen)
+    {
+        vector<boost::shared_ptr<CustomItem> > batch;
+        boost::shared_ptr<CustomItem> item;
+        while(batch.size() < STRIPED_MERGE_BATCH_SIZE &&
+            (isQueueOpen = worker->pendingItems.Pop(item)))
+        {
+            stripedMerge.Add(item);
+            batch.push_back(item);
+        }
+        if(batch.empty())
+        {
+            break;
+        }
+        if(!stripedMerge.Commit(worker->wasEdited))
+        {
+            Fail();
+            return;
+        }
+        if(_outputFolder.empty())
+        {
+            continue;
+        }
+        BOOST_FOREACH(const boost::shared_ptr<CustomItem> &batchItem, batch)
+        {
+            if(!batchItem->OutputDataFile(worker->fileName, _outputFolder))
+            {
+                Fail();
+                return;
+            }
+        }
+    }
+}
+
+void FileMergeWorkers::Fail()
+{
+    boost::mutex::scoped_lock lock(_stateMutex);
+    _hasFailed = true;
+    typedef pair<string, boost::shared_ptr<FileWorkerT> > stringWorkerPair;
+    BOOST_FOREACH(const stringWorkerPair &filenameAndWorker, _filenameToWorker)
+    {
+        filenameAndWorker.second->pendingItems.Cancel();
+    }
+}
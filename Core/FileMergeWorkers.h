@@ -0,0 +1,89 @@
+#ifndef _FILE_MERGE_WORKERS_H_
+#define _FILE_MERGE_WORKERS_H_
+
+#include <map>
+#include <string>
+#include "boost/filesystem/path.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+#include "pugixml.hpp"
+#include "BoundedQueue.h"
+using namespace std;
+using namespace pugi;
+
+class CustomItem;
+class MapManager;
+
+/*
+Merges custom items into a MapManager with one worker thread per data file of the
+map. Every data file is a document of its own, so merges into different files never
+touch the same nodes, and run at once. Each worker has a queue of the items waiting
+to be merged into its file, in the order they were added, so every file ends up
+exactly as calling CustomItem::AddToMap on the items one after the other would
+leave it.
+
+Once an item is merged into a file, the worker of that file also writes the item's
+objects of that file to the output folder (see CustomItem::OutputDataFile), which
+keeps each output file in the order of the items as well.
+
+With more than one stripe, each worker merges the items it has waiting in batches,
+with a StripedCatalogMerge of that many threads.
+
+Only the thread that adds the items may use the MapManager until Finish returns.
+*/
+class FileMergeWorkers
+{
+public:
+    //@param outputFolder: folder each item is written to once merged. Empty if items
+    //                     should not be written.
+    //@param numStripes: threads merging into each data file at once.
+    FileMergeWorkers(MapManager &mapManager, const boost::filesystem::path &outputFolder,
+        size_t numStripes=1);
+
+    //Waits for the workers (see Finish).
+    ~FileMergeWorkers();
+
+    //Queues item for the workers of each of its data files, starting the worker of a
+    //file the first time an item has it. Blocks while a worker's queue is full. item is
+    //kept until every worker is done with it.
+    //@return : false if a merge failed, in which case nothing more is merged.
+    bool Add(const boost::shared_ptr<CustomItem> &item);
+
+    //Waits until every item added is merged, and stops the workers. Records which data
+    //files of the map were changed.
+    //@return : false if any merge failed.
+    bool Finish();
+
+private:
+    struct FileWorkerT
+    {
+        string fileName;
+        xml_node mapCatalog;
+        BoundedQueue<boost::shared_ptr<CustomItem> > pendingItems;
+        bool wasEdited;
+
+        FileWorkerT(const string &fileName, xml_node mapCatalog);
+    };
+
+    void MergeFile(FileWorkerT *worker);
+    void MergeFileInStripes(FileWorkerT *worker);
+
+    //stops every worker as soon as possible.
+    void Fail();
+
+    //non-copyable semantics
+    FileMergeWorkers(const FileMergeWorkers &other);
+    const FileMergeWorkers& operator=(const FileMergeWorkers&);
+
+    MapManager &_mapManager;
+    boost::filesystem::path _outputFolder;
+    size_t _numStripes;
+    map<string, boost::shared_ptr<FileWorkerT> > _filenameToWorker;
+    boost::thread_group _workerThreads;
+    bool _hasFinished;
+    bool _hasFailed;
+    boost::mutex _stateMutex;
+};
+
+#endif //_FILE_MERGE_WORKERS_H_
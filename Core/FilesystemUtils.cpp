@@ -1,6 +1,10 @@
 #include "FilesystemUtils.h"
 #include <iostream>
+#include <set>
+#include <fstream>
+#include <sstream>
 #include "ErrorLogger.h"
+#include "ContentHash.h"
 
 using namespace std;
 
@@ -68,4 +72,106 @@ bool CopyDirectoryAndContents(  const boost::filesystem::path &source,
         }
     }
     return success;
-}
\ No newline at end of file
+}
+
+std::string GetFolderStamp(const boost::filesystem::path &folder, const std::string &extension)
+{
+    namespace fs = boost::filesystem;
+    //directory iteration order is unspecified, so files are sorted by name.
+    set<string> fileStamps;
+    try
+    {
+        if(!fs::exists(folder))
+        {
+            return "";
+        }
+        for(fs::directory_iterator it(folder); it != fs::directory_iterator(); it++)
+        {
+            fs::path filePath(it->path());
+            if(!fs::is_regular_file(filePath) || filePath.extension() != extension)
+            {
+                continue;
+            }
+            ostringstream fileStamp;
+            fileStamp << filePath.filename() << ":" << fs::file_size(filePath) << ":"
+                << fs::last_write_time(filePath) << ";";
+            fileStamps.insert(fileStamp.str());
+        }
+    }
+    catch(fs::filesystem_error& e)
+    {
+        ErrorLogger::Log(string("ERROR: GetFolderStamp: ") + e.what());
+        return "";
+    }
+    string folderStamp;
+    for(set<string>::const_iterator it = fileStamps.begin(); it != fileStamps.end(); ++it)
+    {
+        folderStamp += *it;
+    }
+    return folderStamp;
+}
+
+std::string GetFolderContentHash(const boost::filesystem::path &folder,
+    const std::string &extension)
+{
+    namespace fs = boost::filesystem;
+    //directory iteration order is unspecified, so files are hashed by name.
+    set<fs::path> filePaths;
+    try
+    {
+        if(!fs::exists(folder))
+        {
+            return "";
+        }
+        for(fs::directory_iterator it(folder); it != fs::directory_iterator(); it++)
+        {
+            fs::path filePath(it->path());
+            if(fs::is_regular_file(filePath) && filePath.extension() == extension)
+            {
+                filePaths.insert(filePath);
+            }
+        }
+    }
+    catch(fs::filesystem_error& e)
+    {
+        ErrorLogger::Log(string("ERROR: GetFolderContentHash: ") + e.what());
+        return "";
+    }
+    ContentHash folderHash;
+    char buffer[64 * 1024];
+    for(set<fs::path>::const_iterator it = filePaths.begin(); it != filePaths.end(); ++it)
+    {
+        const fs::path &filePath = *it;
+        folderHash.AddField(filePath.filename());
+        ifstream fileReader(filePath.string().c_str(), ios_base::binary);
+        if(!fileReader)
+        {
+            ErrorLogger::Log("ERROR: GetFolderContentHash: could not read file \""
+                + filePath.string() + "\".");
+            return "";
+        }
+        while(fileReader.read(buffer, sizeof(buffer)) || fileReader.gcount() > 0)
+        {
+            folderHash.Add(buffer, (size_t) fileReader.gcount());
+        }
+    }
+    return folderHash.GetHex();
+}
+
+bool ReadFileContents(const boost::filesystem::path &filePath, std::string &contents)
+{
+    contents.clear();
+    ifstream fileReader(filePath.string().c_str(), ios_base::binary);
+    if(!fileReader)
+    {
+        ErrorLogger::Log("ERROR: ReadFileContents: could not read file \""
+            + filePath.string() + "\".");
+        return false;
+    }
+    char buffer[64 * 1024];
+    while(fileReader.read(buffer, sizeof(buffer)) || fileReader.gcount() > 0)
+    {
+        contents.append(buffer, (size_t) fileReader.gcount());
+    }
+    return true;
+}
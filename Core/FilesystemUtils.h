@@ -1,9 +1,26 @@
 #ifndef _FILESYSTEM_UTILS_H_
 #define _FILESYSTEM_UTILS_H_
 
+#include <string>
 #include "boost/filesystem.hpp"
 
 bool CopyDirectoryAndContents(  const boost::filesystem::path &source,
                                 const boost::filesystem::path &dest );
 
+//@return : the name, size and last write time of every file of folder whose
+//          extension is extension, i.e. ".xml". Changes whenever one of those
+//          files is added, removed or written. Empty if folder does not exist.
+std::string GetFolderStamp(const boost::filesystem::path &folder, const std::string &extension);
+
+//@return : a hash of the name and contents of every file of folder whose extension
+//          is extension. Unlike GetFolderStamp, it only changes when the contents
+//          do, but it reads every file. Empty if folder does not exist or a file
+//          could not be read.
+std::string GetFolderContentHash(const boost::filesystem::path &folder,
+    const std::string &extension);
+
+//Reads the whole file at filePath into contents.
+//@return : false if the file could not be read.
+bool ReadFileContents(const boost::filesystem::path &filePath, std::string &contents);
+
 #endif //_FILESYSTEM_UTILS_H_
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "IncrementalRun.h"
+#include <set>
+#include "boost/filesystem.hpp"
+#include "boost/foreach.hpp"
+#include "CommonConstants.h"
+#include "Template.h"
+#include "CustomItem.h"
+#include "CustomItemReader.h"
+#include "ContentHash.h"
+#include "FilesystemUtils.h"
+#include "MapArchive.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+
+namespace fs = boost::filesystem;
+
+//---------------- HELPERS ------------------
+/* @return : a hash of everything an item is created from. */
+static string GetItemHash(const string &templateHash, const map<string, string> &varNameToValue)
+{
+    ContentHash itemHash;
+    itemHash.AddField(templateHash);
+    for(map<string, string>::const_iterator itr = varNameToValue.begin();
+        itr != varNameToValue.end(); ++itr)
+    {
+        itemHash.AddField(itr->first);
+        itemHash.AddField(itr->second);
+    }
+    return itemHash.GetHex();
+}
+
+/* @return : the number of items created or removed. An item that was replaced is
+             counted once. */
+static size_t CountItemsRedone(const set<ItemKeyT> &retractedKeys,
+    const vector<ItemLedger::NewItemT> &ledgerItems)
+{
+    //a replaced item keeps its id, but may have moved.
+    multiset<pair<string, string> > retractedIds;
+    BOOST_FOREACH(const ItemKeyT &retractedKey, retractedKeys)
+    {
+        retractedIds.insert(make_pair(retractedKey.customItemsFile, retractedKey.itemId));
+    }
+    size_t numItemsRedone = retractedKeys.size();
+    BOOST_FOREACH(const ItemLedger::NewItemT &ledgerItem, ledgerItems)
+    {
+        multiset<pair<string, string> >::iterator idItr =
+            retractedIds.find(make_pair(ledgerItem.key.customItemsFile, ledgerItem.key.itemId));
+        if(idItr == retractedIds.end())
+        {
+            ++numItemsRedone;
+        }
+        else
+        {
+            retractedIds.erase(idItr);
+        }
+    }
+    return numItemsRedone;
+}
+
+/* @return : the key in keyToItemHash of the item that the row with itemKey matches:
+             the occurrence'th item with the same file and id, in file order.
+             keyToItemHash.end() if there is none. */
+static map<ItemKeyT, string>::const_iterator FindMatchingItem(
+    const map<ItemKeyT, string> &keyToItemHash, const ItemKeyT &itemKey, size_t occurrence)
+{
+    map<ItemKeyT, string>::const_iterator itr =
+        keyToItemHash.lower_bound(ItemKeyT(itemKey.customItemsFile, itemKey.itemId, 0, 0));
+    for(; itr != keyToItemHash.end(); ++itr)
+    {
+        if(itr->first.customItemsFile != itemKey.customItemsFile || itr->first.itemId != itemKey.itemId)
+        {
+            break;
+        }
+        if(occurrence-- == 0)
+        {
+            return itr;
+        }
+    }
+    return keyToItemHash.end();
+}
+
+/* @return : a hash of the map's data files and of its dependencies', which the map's
+             objects were built from. Only the map's if it has no dependencies. */
+static string GetMapHash(const fs::path &mapPath, const vector<CatalogLayerPtr> &dependencyLayers)
+{
+    string mapHash = GetFolderContentHash(mapPath/GAME_DATA_PATH, ".xml");
+    if(dependencyLayers.empty())
+    {
+        return mapHash;
+    }
+    ContentHash combinedHash;
+    combinedHash.AddField(mapHash);
+    BOOST_FOREACH(const CatalogLayerPtr &layer, dependencyLayers)
+    {
+        combinedHash.AddField(layer->GetContentHash());
+    }
+    return combinedHash.GetHex();
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+IncrementalRun::IncrementalRun()
+    : _options()
+    , _map()
+    , _templateCache()
+    , _instantiationCache()
+    , _ledger()
+    , _dependencyLayers()
+    , _hasCreated(false)
+{
+}
+
+IncrementalRun::~IncrementalRun()
+{
+}
+
+bool IncrementalRun::Create(const DataDuplicator::OptionsT &options, size_t &numItemsRedone)
+{
+    TRACE_SCOPE("CreateIncrementalRun");
+    numItemsRedone = 0;
+    _options = options;
+    _ledger.Clear();
+    if(GetInstantiationCache() && !_instantiationCache.Create(_options.itemCacheFolder))
+    {
+        return false;
+    }
+    MapManager *mapManager = GetMap();
+    if(mapManager && _options.useManifest && MapArchive::IsArchive(_options.mapPath))
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: manifests are only kept "
+            "in maps saved as folders, so every item of the archived map is created again.");
+        _options.useManifest = false;
+    }
+    if(mapManager)
+    {
+        if(!DataDuplicator::LoadDependencyLayers(_options, _dependencyLayers))
+        {
+            return false;
+        }
+        fs::path manifestPath = _options.mapPath/MANIFEST_FILE;
+        if(_options.useManifest && exists(manifestPath))
+        {
+            //a manifest only describes the map as it was saved with it.
+            string manifestMapHash;
+            if(_ledger.Load(manifestPath, manifestMapHash) &&
+                manifestMapHash != GetMapHash(_options.mapPath, _dependencyLayers))
+            {
+                ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: the map or its "
+                    "dependencies were changed since it was last updated, so its manifest is "
+                    "ignored and every item is created again.");
+                _ledger.Clear();
+            }
+        }
+        if(!DataDuplicator::BackupMap(_options.mapPath, _options.backupFolder) ||
+            !mapManager->Create(_options.mapPath))
+        {
+            return false;
+        }
+        mapManager->SetDependencyLayers(_dependencyLayers);
+    }
+
+    map<ItemKeyT, string> keyToOldItemHash;
+    _ledger.GetItemHashes(keyToOldItemHash);
+    ItemMapT newItems;
+    vector<ItemLedger::NewItemT> ledgerItems;
+    set<ItemKeyT> retractedKeys;
+    map<ItemKeyT, ItemKeyT> movedKeys;
+    ConsoleReporter::BeginPhase("Creating items", 0);
+    bool success = CreateChangedItems(keyToOldItemHash, newItems, ledgerItems, retractedKeys,
+        movedKeys);
+    ConsoleReporter::EndPhase();
+    if(!success)
+    {
+        return false;
+    }
+    if(keyToOldItemHash.empty())
+    {
+        //nothing to rebuild, so items are merged directly, in order.
+        BOOST_FOREACH(const ItemLedger::NewItemT &ledgerItem, ledgerItems)
+        {
+            if(!_ledger.AddItem(ledgerItem, mapManager))
+            {
+                return false;
+            }
+        }
+    }
+    else if(!_ledger.Update(retractedKeys, movedKeys, ledgerItems, mapManager))
+    {
+        return false;
+    }
+    numItemsRedone = CountItemsRedone(retractedKeys, ledgerItems);
+    if(!Save())
+    {
+        return false;
+    }
+    _hasCreated = true;
+    return true;
+}
+
+bool IncrementalRun::Update(const set<string> &changedTemplateNames, size_t &numItemsRedone)
+{
+    TRACE_SCOPE("UpdateIncrementalRun");
+    numItemsRedone = 0;
+    if(!_hasCreated)
+    {
+        ErrorLogger::Log("ERROR: IncrementalRun::Update: the run was not created.");
+        return false;
+    }
+    BOOST_FOREACH(const string &templateName, changedTemplateNames)
+    {
+        _templateCache.Remove(_options.templatesFolder/templateName);
+    }
+    //everything is read and created before anything is changed.
+    map<ItemKeyT, string> keyToOldItemHash;
+    _ledger.GetItemHashes(keyToOldItemHash);
+    ItemMapT newItems;
+    vector<ItemLedger::NewItemT> ledgerItems;
+    set<ItemKeyT> retractedKeys;
+    map<ItemKeyT, ItemKeyT> movedKeys;
+    if(!CreateChangedItems(keyToOldItemHash, newItems, ledgerItems, retractedKeys, movedKeys))
+    {
+        return false;
+    }
+    if(ledgerItems.empty() && retractedKeys.empty() && movedKeys.empty())
+    {
+        return true;
+    }
+    //a failed update leaves the map and the ledger as they were saved, so that the
+    //next Update starts from them again.
+    if(!_ledger.Update(retractedKeys, movedKeys, ledgerItems, GetMap()))
+    {
+        return false;
+    }
+    numItemsRedone = CountItemsRedone(retractedKeys, ledgerItems);
+    return Save();
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+bool IncrementalRun::CreateChangedItems(const map<ItemKeyT, string> &keyToOldItemHash,
+    ItemMapT &newItems, vector<ItemLedger::NewItemT> &ledgerItems, set<ItemKeyT> &retractedKeys,
+    map<ItemKeyT, ItemKeyT> &movedKeys)
+{
+    vector<fs::path> customItemsFiles;
+    if(!DataDuplicator::GetCustomItemsFiles(_options, customItemsFiles))
+    {
+        return false;
+    }
+    //items are merged in the same order as a run without a manifest merges them.
+    retractedKeys.clear();
+    movedKeys.clear();
+    set<ItemKeyT> matchedOldKeys;
+    for(size_t fileIndex = 0; fileIndex < customItemsFiles.size(); ++fileIndex)
+    {
+        if(!CreateChangedItemsFromFile(customItemsFiles[fileIndex], fileIndex, keyToOldItemHash,
+            newItems, ledgerItems, retractedKeys, movedKeys, matchedOldKeys))
+        {
+            return false;
+        }
+    }
+    //items whose row or file was removed.
+    for(map<ItemKeyT, string>::const_iterator itr = keyToOldItemHash.begin();
+        itr != keyToOldItemHash.end(); ++itr)
+    {
+        if(matchedOldKeys.find(itr->first) == matchedOldKeys.end())
+        {
+            retractedKeys.insert(itr->first);
+        }
+    }
+    return true;
+}
+
+bool IncrementalRun::CreateChangedItemsFromFile(const fs::path &customItemsPath,
+    size_t fileIndex, const map<ItemKeyT, string> &keyToOldItemHash, ItemMapT &newItems,
+    vector<ItemLedger::NewItemT> &ledgerItems, set<ItemKeyT> &retractedKeys,
+    map<ItemKeyT, ItemKeyT> &movedKeys, set<ItemKeyT> &matchedOldKeys)
+{
+    TRACE_SCOPE_DETAIL("CreateChangedItemsFromFile", customItemsPath.filename());
+    CustomItemStream customItemStream;
+    if(!customItemStream.Open(customItemsPath))
+    {
+        return false;
+    }
+    string filename = customItemsPath.filename();
+    string templateForCustomItem(customItemsPath.stem());
+    fs::path templatePath = _options.templatesFolder/templateForCustomItem;
+    string templateHash;
+    boost::shared_ptr<const Template> templateToUse;
+    ReadCustomItemT readCustomItem;
+    CustomItemStream::ReadResultT readResult;
+    size_t itemIndex = 0;
+    //rows with the same id are matched to old items in order.
+    map<string, size_t> idToNumRows;
+    while((readResult = customItemStream.ReadNext(readCustomItem)) == CustomItemStream::RowRead)
+    {
+        if(templateHash.empty())
+        {
+            templateHash = GetFolderContentHash(templatePath, ".xml");
+        }
+        ItemKeyT itemKey(filename,
+            Template::GetItemId(templateForCustomItem, readCustomItem.varNameToValue, itemIndex),
+            fileIndex, itemIndex);
+        ++itemIndex;
+        string itemHash = GetItemHash(templateHash, readCustomItem.varNameToValue);
+        map<ItemKeyT, string>::const_iterator oldItr =
+            FindMatchingItem(keyToOldItemHash, itemKey, idToNumRows[itemKey.itemId]++);
+        if(oldItr != keyToOldItemHash.end())
+        {
+            matchedOldKeys.insert(oldItr->first);
+            if(oldItr->second == itemHash)
+            {
+                if(oldItr->first.fileIndex != itemKey.fileIndex ||
+                    oldItr->first.itemIndex != itemKey.itemIndex)
+                {
+                    movedKeys[oldItr->first] = itemKey;
+                }
+                continue;
+            }
+            retractedKeys.insert(oldItr->first);
+        }
+        if(!templateToUse)
+        {
+            templateToUse = _templateCache.Get(templatePath);
+            if(!templateToUse)
+            {
+                return false;
+            }
+        }
+        boost::shared_ptr<CustomItem> item(new CustomItem());
+        InstantiationCache *instantiationCache = GetInstantiationCache();
+        bool wasCreated = (instantiationCache ?
+            instantiationCache->CreateItem(*templateToUse, readCustomItem.varNameToValue,
+                itemKey.itemIndex, *item) :
+            item->Create(*templateToUse, readCustomItem.varNameToValue, itemKey.itemIndex));
+        if(!wasCreated)
+        {
+            return false;
+        }
+        newItems[itemKey] = item;
+        ItemLedger::NewItemT ledgerItem;
+        ledgerItem.key = itemKey;
+        ledgerItem.itemHash = itemHash;
+        ledgerItem.item = item.get();
+        ledgerItems.push_back(ledgerItem);
+        ConsoleReporter::ItemDone();
+    }
+    return (readResult != CustomItemStream::ReadFailed);
+}
+
+bool IncrementalRun::Save()
+{
+    TRACE_SCOPE("SaveIncrementalRun");
+    if(!DataDuplicator::ClearOutputDirectory(_options.outputFolder) ||
+        !_ledger.Output(_options.outputFolder))
+    {
+        return false;
+    }
+    MapManager *mapManager = GetMap();
+    if(!mapManager)
+    {
+        return true;
+    }
+    if(!mapManager->Save())
+    {
+        return false;
+    }
+    if(_options.useManifest)
+    {
+        return _ledger.Save(_options.mapPath/MANIFEST_FILE,
+            GetMapHash(_options.mapPath, _dependencyLayers));
+    }
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef _INCREMENTAL_RUN_H_
+#define _INCREMENTAL_RUN_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "DataDuplicator.h"
+#include "MapManager.h"
+#include "TemplateCache.h"
+#include "InstantiationCache.h"
+#include "ItemLedger.h"
+using namespace std;
+
+class Template;
+class CustomItem;
+
+/*
+A run that stays loaded after it is done, so that it can be brought up to date
+when custom items files or templates change without being redone. Only the items
+whose row or template changed are created again, and only the map objects that
+those items were merged into are rebuilt (see ItemLedger). The output folder is
+always written again in full, from the ledger.
+
+With options.useManifest, the ledger is also saved in the map (see MANIFEST_FILE),
+so that the next run of the map starts from it instead of from scratch, as long
+as the map was not changed in between.
+*/
+class IncrementalRun
+{
+public:
+    IncrementalRun();
+    ~IncrementalRun();
+
+    //Brings the map up to date: from its manifest if options.useManifest and the
+    //manifest matches the map, or else with a full run, like DataDuplicator::Execute.
+    //Keeps the map, templates and items in memory. Template::InitTemplates must
+    //have been called.
+    //@param numItemsRedone : number of items that were created or removed.
+    bool Create(const DataDuplicator::OptionsT &options, size_t &numItemsRedone);
+
+    //Reads every custom items file again and redoes the items whose row or
+    //template changed, was added or was removed. Templates of changedTemplateNames
+    //are read again even if their folder looks unchanged.
+    //If an item can not be created, or an object it is merged into can not be
+    //rebuilt, nothing is changed, so that the next Update retries once the file
+    //is fixed.
+    bool Update(const set<string> &changedTemplateNames, size_t &numItemsRedone);
+
+    const DataDuplicator::OptionsT &GetOptions() const
+    {
+        return _options;
+    }
+
+    size_t GetNumItems() const
+    {
+        return _ledger.GetNumItems();
+    }
+
+private:
+    typedef map<ItemKeyT, boost::shared_ptr<CustomItem> > ItemMapT;
+
+    //creates the items of every custom items file whose hash is not in
+    //keyToOldItemHash, and lists the items that should be retracted, and the
+    //unchanged items whose rows moved.
+    bool CreateChangedItems(const map<ItemKeyT, string> &keyToOldItemHash, ItemMapT &newItems,
+        vector<ItemLedger::NewItemT> &ledgerItems, set<ItemKeyT> &retractedKeys,
+        map<ItemKeyT, ItemKeyT> &movedKeys);
+
+    //same as above, for a single file. Every old item that a row of the file was
+    //matched to is added to matchedOldKeys, and only those are retracted.
+    bool CreateChangedItemsFromFile(const boost::filesystem::path &customItemsPath,
+        size_t fileIndex, const map<ItemKeyT, string> &keyToOldItemHash, ItemMapT &newItems,
+        vector<ItemLedger::NewItemT> &ledgerItems, set<ItemKeyT> &retractedKeys,
+        map<ItemKeyT, ItemKeyT> &movedKeys, set<ItemKeyT> &matchedOldKeys);
+
+    //writes the output folder, the map and the manifest.
+    bool Save();
+
+    MapManager *GetMap()
+    {
+        return (_options.mapPath.empty() ? NULL : &_map);
+    }
+
+    InstantiationCache *GetInstantiationCache()
+    {
+        return (_options.itemCacheFolder.empty() ? NULL : &_instantiationCache);
+    }
+
+    //non-copyable semantics
+    IncrementalRun(const IncrementalRun &other);
+    const IncrementalRun& operator=(const IncrementalRun&);
+
+    DataDuplicator::OptionsT _options;
+    MapManager _map;
+    TemplateCache _templateCache;
+    InstantiationCache _instantiationCache;
+    ItemLedger _ledger;
+    vector<CatalogLayerPtr> _dependencyLayers;
+    bool _hasCreated;
+};
+
+#endif //_INCREMENTAL_RUN_H_
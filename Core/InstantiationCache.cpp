@@ -0,0 +1,145 @@
+#include "InstantiationCache.h"
+#include <sstream>
+#include "boost/filesystem.hpp"
+#include "boost/thread/thread.hpp"
+#include "pugixml.hpp"
+#include "Template.h"
+#include "CustomItem.h"
+#include "ContentHash.h"
+#include "ErrorLogger.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+
+namespace fs = boost::filesystem;
+
+//---------------- CONSTANTS ------------------
+static const char ENTRY_ROOT_NAME[] = "SC2DataManagerItem";
+//change whenever instantiating gives different results for the same template and
+//values, so that entries of earlier versions are not used.
+static const char CACHE_VERSION[] = "1";
+
+//---------------- PUBLIC FUNCTIONS ------------------
+InstantiationCache::InstantiationCache()
+    : _cacheFolder()
+    , _numEntriesStored(0)
+{
+}
+
+InstantiationCache::~InstantiationCache()
+{
+}
+
+bool InstantiationCache::Create(const fs::path &cacheFolder)
+{
+    _cacheFolder = cacheFolder;
+    try
+    {
+        if(!fs::exists(_cacheFolder))
+        {
+            fs::create_directories(_cacheFolder);
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: InstantiationCache::Create: ") + e.what() + ".");
+        return false;
+    }
+    return true;
+}
+
+bool InstantiationCache::CreateItem(const Template &itemTemplate,
+    const map<string, string> &varNameToValue, size_t itemIndex, CustomItem &item)
+{
+    string key = GetKey(itemTemplate, varNameToValue);
+    if(Load(key, itemTemplate.GetItemId(varNameToValue, itemIndex), item))
+    {
+        PerfCounters::Add(PerfCounters::ITEM_CACHE_HITS);
+        return true;
+    }
+    PerfCounters::Add(PerfCounters::ITEM_CACHE_MISSES);
+    if(!item.Create(itemTemplate, varNameToValue, itemIndex))
+    {
+        return false;
+    }
+    Store(key, item);
+    return true;
+}
+
+string InstantiationCache::GetKey(const Template &itemTemplate,
+    const map<string, string> &varNameToValue)
+{
+    ContentHash keyHash;
+    keyHash.AddField(CACHE_VERSION);
+    keyHash.AddField(itemTemplate.GetContentHash());
+    for(map<string, string>::const_iterator itr = varNameToValue.begin();
+        itr != varNameToValue.end(); ++itr)
+    {
+        keyHash.AddField(itr->first);
+        keyHash.AddField(itr->second);
+    }
+    return keyHash.GetHex();
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+fs::path InstantiationCache::GetEntryPath(const string &key) const
+{
+    //entries are spread over subfolders, so that no folder gets too big.
+    return _cacheFolder/key.substr(0, 2)/(key + ".xml");
+}
+
+bool InstantiationCache::Load(const string &key, const string &itemId, CustomItem &item) const
+{
+    TRACE_SCOPE_DETAIL("LoadCachedItem", itemId);
+    fs::path entryPath = GetEntryPath(key);
+    if(!fs::exists(entryPath))
+    {
+        return false;
+    }
+    pugi::xml_document entryDoc;
+    pugi::xml_node root;
+    if(!entryDoc.load_file(entryPath.string().c_str()) ||
+        !(root = entryDoc.child(ENTRY_ROOT_NAME)))
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: InstantiationCache: entry \""
+            + entryPath.string() + "\" could not be read, so the item is created again.");
+        return false;
+    }
+    return item.Create(itemId, root);
+}
+
+void InstantiationCache::Store(const string &key, const CustomItem &item)
+{
+    TRACE_SCOPE_DETAIL("StoreCachedItem", item.GetId());
+    fs::path entryPath = GetEntryPath(key);
+    ostringstream temporaryName;
+    temporaryName << key << "." << boost::this_thread::get_id() << "."
+        << AtomicOps::Increment(&_numEntriesStored) << ".tmp";
+    fs::path temporaryPath = entryPath.parent_path()/temporaryName.str();
+    try
+    {
+        if(!fs::exists(entryPath.parent_path()))
+        {
+            fs::create_directories(entryPath.parent_path());
+        }
+        pugi::xml_document entryDoc;
+        item.SaveDataFiles(entryDoc.append_child(ENTRY_ROOT_NAME));
+        if(!entryDoc.save_file(temporaryPath.string().c_str(), "", pugi::format_raw))
+        {
+            ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: InstantiationCache: could "
+                "not write \"" + temporaryPath.string() + "\".");
+            return;
+        }
+        fs::rename(temporaryPath, entryPath);
+    }
+    catch(std::exception &)
+    {
+        //i.e. another process stored the same entry first.
+        try
+        {
+            fs::remove(temporaryPath);
+        }
+        catch(std::exception &)
+        {
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef _INSTANTIATION_CACHE_H_
+#define _INSTANTIATION_CACHE_H_
+
+#include <map>
+#include <string>
+#include "boost/filesystem/path.hpp"
+#include "AtomicOps.h"
+using namespace std;
+
+class Template;
+class CustomItem;
+
+/*
+Keeps instantiated items on disk, so that an item that was already created from
+the same template files and the same row values, by any earlier run of any map, is
+read back instead of being instantiated again. Entries are keyed by a hash of the
+template's contents and the row values, so they never go stale; the folder can be
+deleted at any time to reclaim space.
+
+Entries are written to a temporary file and then renamed, so several threads or
+processes can share a folder. An item read from the cache does not log the
+warnings that instantiating it did.
+*/
+class InstantiationCache
+{
+public:
+    InstantiationCache();
+    ~InstantiationCache();
+
+    //@param cacheFolder : created if it does not exist.
+    bool Create(const boost::filesystem::path &cacheFolder);
+
+    //Same as item.Create(itemTemplate, varNameToValue, itemIndex), but reads the item
+    //from the cache if it is there, and stores it otherwise. Safe to call from
+    //several threads at once.
+    bool CreateItem(const Template &itemTemplate, const map<string, string> &varNameToValue,
+        size_t itemIndex, CustomItem &item);
+
+    //@return : the key of the item created from itemTemplate and varNameToValue.
+    static string GetKey(const Template &itemTemplate, const map<string, string> &varNameToValue);
+
+private:
+    boost::filesystem::path GetEntryPath(const string &key) const;
+
+    //@return : false if the entry does not exist or can not be read.
+    bool Load(const string &key, const string &itemId, CustomItem &item) const;
+
+    //failing to store an entry is not an error, since it only costs a later run time.
+    void Store(const string &key, const CustomItem &item);
+
+    //non-copyable semantics
+    InstantiationCache(const InstantiationCache &other);
+    const InstantiationCache& operator=(const InstantiationCache&);
+
+    boost::filesystem::path _cacheFolder;
+    volatile AtomicOps::AtomicUInt32 _numEntriesStored;   /* makes temporary names unique. */
+};
+
+#endif //_INSTANTIATION_CACHE_H_
@@ -0,0 +1,460 @@
+#include "ItemLedger.h"
+#include <fstream>
+#include <algorithm>
+#include "boost/foreach.hpp"
+#include "boost/lexical_cast.hpp"
+#include "CommonConstants.h"
+#include "NodeMatch.h"
+#include "ObjectMerge.h"
+#include "CustomItem.h"
+#include "MapManager.h"
+#include "ErrorLogger.h"
+#include "Tracer.h"
+
+namespace fs = boost::filesystem;
+
+typedef pair<string, xml_document *> stringXMLDocPair;
+
+//---------------- CONSTANTS ------------------
+static const char MANIFEST_ROOT_NAME[] = "SC2DataManagerManifest";
+static const char MANIFEST_VERSION[] = "2";
+
+//---------------- HELPERS ------------------
+static boost::shared_ptr<xml_document> CopyToDocument(const xml_node &node)
+{
+    boost::shared_ptr<xml_document> doc(new xml_document());
+    if(node)
+    {
+        doc->append_copy(node);
+    }
+    return doc;
+}
+
+template <class ItemIteratorT>
+static bool IsItemMergedBefore(const ItemIteratorT &itemItr, const ItemIteratorT &otherItr)
+{
+    return itemItr->first.IsMergedBefore(otherItr->first);
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+ItemLedger::ItemLedger()
+    : _keyToObject()
+    , _keyToItem()
+{
+}
+
+ItemLedger::~ItemLedger()
+{
+}
+
+bool ItemLedger::AddItem(const NewItemT &newItem, MapManager *map)
+{
+    //the originals have to be recorded before the item changes them.
+    set<string> objectKeys;
+    RecordItem(newItem, map, objectKeys);
+    return (!map || newItem.item->AddToMap(*map));
+}
+
+bool ItemLedger::Update(const set<ItemKeyT> &retractedKeys,
+    const std::map<ItemKeyT, ItemKeyT> &movedKeys, const vector<NewItemT> &newItems, MapManager *map)
+{
+    TRACE_SCOPE("UpdateLedger");
+    //the records only hold pointers to the item objects, so they are cheap to keep
+    //until every object is known to rebuild.
+    std::map<string, ObjectRecordT> oldKeyToObject(_keyToObject);
+    std::map<ItemKeyT, ItemRecordT> oldKeyToItem(_keyToItem);
+    set<string> objectKeysToRebuild;
+    BOOST_FOREACH(const ItemKeyT &itemKey, retractedKeys)
+    {
+        std::map<ItemKeyT, ItemRecordT>::iterator itemItr = _keyToItem.find(itemKey);
+        if(itemItr == _keyToItem.end())
+        {
+            continue;
+        }
+        BOOST_FOREACH(const ItemObjectT &itemObject, itemItr->second.objects)
+        {
+            if(itemObject.objectKey.empty())
+            {
+                continue;
+            }
+            vector<ContributionT> &contributions = _keyToObject[itemObject.objectKey].contributions;
+            vector<ContributionT>::iterator contributionItr = contributions.begin();
+            while(contributionItr != contributions.end())
+            {
+                if(contributionItr->object == itemObject.object)
+                {
+                    contributionItr = contributions.erase(contributionItr);
+                }
+                else
+                {
+                    ++contributionItr;
+                }
+            }
+            objectKeysToRebuild.insert(itemObject.objectKey);
+        }
+        _keyToItem.erase(itemItr);
+    }
+    //before newItems are recorded, since they may have the keys moved items had.
+    MoveItems(movedKeys, objectKeysToRebuild);
+    BOOST_FOREACH(const NewItemT &newItem, newItems)
+    {
+        RecordItem(newItem, map, objectKeysToRebuild);
+    }
+
+    //every object is rebuilt before any of them replaces the map's, so that a failed
+    //update leaves the map and the ledger as they were.
+    bool success = true;
+    vector<boost::shared_ptr<xml_document> > rebuiltObjects;
+    BOOST_FOREACH(const string &objectKey, objectKeysToRebuild)
+    {
+        rebuiltObjects.push_back(boost::shared_ptr<xml_document>(new xml_document));
+        if(!RebuildObject(_keyToObject[objectKey], *map, *rebuiltObjects.back()))
+        {
+            success = false;
+        }
+    }
+    if(!success)
+    {
+        _keyToObject.swap(oldKeyToObject);
+        _keyToItem.swap(oldKeyToItem);
+        return false;
+    }
+    size_t objectIndex = 0;
+    BOOST_FOREACH(const string &objectKey, objectKeysToRebuild)
+    {
+        ObjectRecordT &record = _keyToObject[objectKey];
+        ReplaceObject(record, *map, *rebuiltObjects[objectIndex++]);
+        //once no item is merged into an object, it is back to its original.
+        if(record.contributions.empty())
+        {
+            _keyToObject.erase(objectKey);
+        }
+    }
+    return true;
+}
+
+void ItemLedger::GetItemHashes(map<ItemKeyT, string> &keyToItemHash) const
+{
+    keyToItemHash.clear();
+    for(std::map<ItemKeyT, ItemRecordT>::const_iterator itr = _keyToItem.begin();
+        itr != _keyToItem.end(); ++itr)
+    {
+        keyToItemHash[itr->first] = itr->second.itemHash;
+    }
+}
+
+bool ItemLedger::Output(const fs::path &outputFolder) const
+{
+    TRACE_SCOPE("OutputLedger");
+    try
+    {
+        //items are kept by id, but are written in merge order.
+        typedef std::map<ItemKeyT, ItemRecordT>::const_iterator ItemIteratorT;
+        vector<ItemIteratorT> itemsInMergeOrder;
+        for(ItemIteratorT itr = _keyToItem.begin(); itr != _keyToItem.end(); ++itr)
+        {
+            itemsInMergeOrder.push_back(itr);
+        }
+        sort(itemsInMergeOrder.begin(), itemsInMergeOrder.end(), &IsItemMergedBefore<ItemIteratorT>);
+        //files are kept open, since most items write to the same few files.
+        std::map<string, boost::shared_ptr<std::ofstream> > filenameToWriter;
+        BOOST_FOREACH(const ItemIteratorT &itr, itemsInMergeOrder)
+        {
+            BOOST_FOREACH(const ItemObjectT &itemObject, itr->second.objects)
+            {
+                boost::shared_ptr<std::ofstream> &fileWriter = filenameToWriter[itemObject.filename];
+                if(!fileWriter)
+                {
+                    fileWriter.reset(new std::ofstream((outputFolder/itemObject.filename).string().c_str(),
+                        ios_base::app));
+                }
+                //the copy still has the attributes that are just notes to SC2DM.
+                xml_document outputDoc;
+                xml_node outputObject = outputDoc.append_copy(itemObject.object->first_child());
+                RemoveMergeAttributes(outputObject);
+                outputObject.print(*fileWriter);
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: ItemLedger::Output: ") + e.what());
+        return false;
+    }
+    return true;
+}
+
+bool ItemLedger::Save(const fs::path &manifestPath, const string &mapHash) const
+{
+    TRACE_SCOPE("SaveManifest");
+    xml_document manifestDoc;
+    xml_node root = manifestDoc.append_child(MANIFEST_ROOT_NAME);
+    root.append_attribute("version") = MANIFEST_VERSION;
+    root.append_attribute("mapHash") = mapHash.c_str();
+    //originals come first, so that Load can give them their contributions.
+    for(std::map<string, ObjectRecordT>::const_iterator itr = _keyToObject.begin();
+        itr != _keyToObject.end(); ++itr)
+    {
+        xml_node originalNode = root.append_child("Original");
+        originalNode.append_attribute("file") = itr->second.filename.c_str();
+        originalNode.append_attribute("xpath") = itr->second.xpath.c_str();
+        if(itr->second.original->first_child())
+        {
+            originalNode.append_copy(itr->second.original->first_child());
+        }
+    }
+    for(std::map<ItemKeyT, ItemRecordT>::const_iterator itr = _keyToItem.begin();
+        itr != _keyToItem.end(); ++itr)
+    {
+        xml_node itemNode = root.append_child("Item");
+        itemNode.append_attribute("file") = itr->first.customItemsFile.c_str();
+        itemNode.append_attribute("id") = itr->first.itemId.c_str();
+        itemNode.append_attribute("fileIndex") = (unsigned int) itr->first.fileIndex;
+        itemNode.append_attribute("index") = (unsigned int) itr->first.itemIndex;
+        itemNode.append_attribute("hash") = itr->second.itemHash.c_str();
+        BOOST_FOREACH(const ItemObjectT &itemObject, itr->second.objects)
+        {
+            xml_node objectNode = itemNode.append_child("Object");
+            objectNode.append_attribute("file") = itemObject.filename.c_str();
+            objectNode.append_copy(itemObject.object->first_child());
+        }
+    }
+    if(!manifestDoc.save_file(manifestPath.string().c_str(), "", format_raw))
+    {
+        ErrorLogger::Log("ERROR: ItemLedger::Save: could not write manifest \""
+            + manifestPath.string() + "\".");
+        return false;
+    }
+    return true;
+}
+
+bool ItemLedger::Load(const fs::path &manifestPath, string &mapHash)
+{
+    TRACE_SCOPE("LoadManifest");
+    Clear();
+    xml_document manifestDoc;
+    xml_parse_result result = manifestDoc.load_file(manifestPath.string().c_str());
+    xml_node root = manifestDoc.child(MANIFEST_ROOT_NAME);
+    if(!result || !root || string(root.attribute("version").value()) != MANIFEST_VERSION)
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: ItemLedger::Load: manifest \""
+            + manifestPath.string() + "\" could not be read, or is from another version.");
+        return false;
+    }
+    mapHash = root.attribute("mapHash").value();
+    for(xml_node originalNode = root.child("Original"); originalNode;
+        originalNode = originalNode.next_sibling("Original"))
+    {
+        ObjectRecordT record;
+        record.filename = originalNode.attribute("file").value();
+        record.xpath = originalNode.attribute("xpath").value();
+        record.original = CopyToDocument(originalNode.first_child());
+        _keyToObject[record.filename + "/" + record.xpath] = record;
+    }
+    for(xml_node itemNode = root.child("Item"); itemNode; itemNode = itemNode.next_sibling("Item"))
+    {
+        ItemKeyT itemKey(itemNode.attribute("file").value(), itemNode.attribute("id").value(),
+            itemNode.attribute("fileIndex").as_uint(), itemNode.attribute("index").as_uint());
+        ItemRecordT &itemRecord = _keyToItem[itemKey];
+        itemRecord.itemHash = itemNode.attribute("hash").value();
+        for(xml_node objectNode = itemNode.child("Object"); objectNode;
+            objectNode = objectNode.next_sibling("Object"))
+        {
+            ItemObjectT itemObject;
+            itemObject.filename = objectNode.attribute("file").value();
+            itemObject.object = CopyToDocument(objectNode.first_child());
+            if(!_keyToObject.empty())
+            {
+                itemObject.objectKey = itemObject.filename + "/"
+                    + GetNodeXPath(itemObject.object->first_child());
+                std::map<string, ObjectRecordT>::iterator recordItr =
+                    _keyToObject.find(itemObject.objectKey);
+                if(recordItr == _keyToObject.end())
+                {
+                    ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: ItemLedger::Load: "
+                        "manifest \"" + manifestPath.string() + "\" has no original for object \""
+                        + itemObject.objectKey + "\".");
+                    Clear();
+                    return false;
+                }
+                AddContribution(recordItr->second, itemKey, itemObject.object);
+            }
+            itemRecord.objects.push_back(itemObject);
+        }
+    }
+    return true;
+}
+
+void ItemLedger::Clear()
+{
+    _keyToObject.clear();
+    _keyToItem.clear();
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+ItemLedger::ObjectRecordT &ItemLedger::GetRecord(const string &filename, const xml_node &object,
+    MapManager &map, string &objectKey)
+{
+    string xpath = GetNodeXPath(object);
+    objectKey = filename + "/" + xpath;
+    std::map<string, ObjectRecordT>::iterator itr = _keyToObject.find(objectKey);
+    if(itr != _keyToObject.end())
+    {
+        return itr->second;
+    }
+    ObjectRecordT &record = _keyToObject[objectKey];
+    record.filename = filename;
+    record.xpath = xpath;
+    record.original = CopyToDocument(GetMatchingNode(object, map.GetDataFileCatalog(filename)));
+    return record;
+}
+
+void ItemLedger::RecordItem(const NewItemT &newItem, MapManager *map, set<string> &objectKeys)
+{
+    ItemRecordT &itemRecord = _keyToItem[newItem.key];
+    itemRecord.itemHash = newItem.itemHash;
+    itemRecord.objects.clear();
+    BOOST_FOREACH(stringXMLDocPair filenameAndDoc, newItem.item->GetDataFiles())
+    {
+        xml_node itemCatalog = filenameAndDoc.second->child(CATALOG_NAME.c_str());
+        for(xml_node object = itemCatalog.first_child(); object; object = object.next_sibling())
+        {
+            ItemObjectT itemObject;
+            itemObject.filename = filenameAndDoc.first;
+            itemObject.object = CopyToDocument(object);
+            if(map)
+            {
+                ObjectRecordT &record = GetRecord(filenameAndDoc.first, object, *map,
+                    itemObject.objectKey);
+                AddContribution(record, newItem.key, itemObject.object);
+                objectKeys.insert(itemObject.objectKey);
+            }
+            itemRecord.objects.push_back(itemObject);
+        }
+    }
+}
+
+void ItemLedger::MoveItems(const std::map<ItemKeyT, ItemKeyT> &movedKeys, set<string> &objectKeys)
+{
+    //every moved record is taken out first, since items with the same id may swap keys.
+    std::map<ItemKeyT, ItemRecordT> newKeyToItem;
+    set<string> objectKeysToReorder;
+    for(std::map<ItemKeyT, ItemKeyT>::const_iterator moveItr = movedKeys.begin();
+        moveItr != movedKeys.end(); ++moveItr)
+    {
+        std::map<ItemKeyT, ItemRecordT>::iterator itemItr = _keyToItem.find(moveItr->first);
+        if(itemItr == _keyToItem.end())
+        {
+            continue;
+        }
+        BOOST_FOREACH(const ItemObjectT &itemObject, itemItr->second.objects)
+        {
+            if(itemObject.objectKey.empty())
+            {
+                continue;
+            }
+            BOOST_FOREACH(ContributionT &contribution, _keyToObject[itemObject.objectKey].contributions)
+            {
+                if(contribution.object == itemObject.object)
+                {
+                    contribution.itemKey = moveItr->second;
+                }
+            }
+            objectKeysToReorder.insert(itemObject.objectKey);
+        }
+        newKeyToItem[moveItr->second] = itemItr->second;
+        _keyToItem.erase(itemItr);
+    }
+    _keyToItem.insert(newKeyToItem.begin(), newKeyToItem.end());
+
+    //the object only has to be rebuilt if its items are now merged in another order.
+    BOOST_FOREACH(const string &objectKey, objectKeysToReorder)
+    {
+        vector<ContributionT> &contributions = _keyToObject[objectKey].contributions;
+        vector<ContributionT> reorderedContributions(contributions);
+        stable_sort(reorderedContributions.begin(), reorderedContributions.end(),
+            &IsContributionMergedBefore);
+        for(size_t i = 0; i < contributions.size(); ++i)
+        {
+            if(reorderedContributions[i].object != contributions[i].object)
+            {
+                contributions.swap(reorderedContributions);
+                objectKeys.insert(objectKey);
+                break;
+            }
+        }
+    }
+}
+
+bool ItemLedger::IsContributionMergedBefore(const ContributionT &contribution,
+    const ContributionT &other)
+{
+    return contribution.itemKey.IsMergedBefore(other.itemKey);
+}
+
+void ItemLedger::AddContribution(ObjectRecordT &record, const ItemKeyT &itemKey,
+    const boost::shared_ptr<xml_document> &object)
+{
+    ContributionT contribution;
+    contribution.itemKey = itemKey;
+    contribution.object = object;
+    //after every contribution of the same item or earlier ones.
+    vector<ContributionT>::iterator position = record.contributions.end();
+    while(position != record.contributions.begin() && itemKey.IsMergedBefore((position - 1)->itemKey))
+    {
+        --position;
+    }
+    record.contributions.insert(position, contribution);
+}
+
+bool ItemLedger::RebuildObject(const ObjectRecordT &record, MapManager &map,
+    xml_document &scratchDoc)
+{
+    ErrorLogger::ScopedContext logContext("RebuildObject", "", "", record.filename.c_str());
+    xml_node scratchCatalog = scratchDoc.append_child(CATALOG_NAME.c_str());
+    if(record.original->first_child())
+    {
+        scratchCatalog.append_copy(record.original->first_child());
+    }
+    //objects that the map inherits from a dependency start out as the dependency's.
+    xml_node inheritedObject;
+    if(!record.contributions.empty())
+    {
+        inheritedObject = map.FindInheritedObject(record.filename,
+            record.contributions.front().object->first_child());
+    }
+    bool success = true;
+    BOOST_FOREACH(const ContributionT &contribution, record.contributions)
+    {
+        bool wasEdited = false;
+        if(!MergeObjectIntoCatalog(contribution.object->first_child(), scratchCatalog,
+            record.filename, wasEdited, inheritedObject))
+        {
+            success = false;
+        }
+    }
+    return success;
+}
+
+void ItemLedger::ReplaceObject(const ObjectRecordT &record, MapManager &map,
+    const xml_document &scratchDoc)
+{
+    //put the rebuilt object where the old one was.
+    xml_node mapCatalog = map.GetDataFileCatalog(record.filename);
+    xml_node mapObject = mapCatalog.select_single_node(record.xpath.c_str()).node();
+    xml_node rebuiltObject = scratchDoc.child(CATALOG_NAME.c_str()).first_child();
+    if(mapObject && rebuiltObject)
+    {
+        mapCatalog.insert_copy_after(rebuiltObject, mapObject);
+        mapCatalog.remove_child(mapObject);
+    }
+    else if(mapObject)
+    {
+        mapCatalog.remove_child(mapObject);
+    }
+    else if(rebuiltObject)
+    {
+        mapCatalog.append_copy(rebuiltObject);
+    }
+    map.SetDataFileWasEdited(record.filename);
+}
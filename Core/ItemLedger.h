@@ -0,0 +1,189 @@
+#ifndef _ITEM_LEDGER_H_
+#define _ITEM_LEDGER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+#include "boost/filesystem/path.hpp"
+#include "boost/shared_ptr.hpp"
+#include "pugixml.hpp"
+using namespace std;
+using namespace pugi;
+
+class CustomItem;
+class MapManager;
+
+/* Identifies the item created from a row of a custom items file, by its id, so that
+   rows added or removed above it do not change it. The position in the file only
+   tells apart items with the same id. */
+struct ItemKeyT
+{
+    string customItemsFile;     /* file name, without its folder. */
+    string itemId;              /* as given by Template::GetItemId. */
+    size_t fileIndex;           /* position of the file in DataDuplicator::GetCustomItemsFiles. */
+    size_t itemIndex;           /* position in the file. */
+
+    ItemKeyT() : customItemsFile(), itemId(), fileIndex(0), itemIndex(0)
+    {
+    }
+    ItemKeyT(const string &a_customItemsFile, const string &a_itemId, size_t a_fileIndex,
+        size_t a_itemIndex)
+        : customItemsFile(a_customItemsFile), itemId(a_itemId), fileIndex(a_fileIndex),
+          itemIndex(a_itemIndex)
+    {
+    }
+    bool operator<(const ItemKeyT &other) const
+    {
+        if(customItemsFile != other.customItemsFile)
+        {
+            return customItemsFile < other.customItemsFile;
+        }
+        return (itemId != other.itemId ? itemId < other.itemId : itemIndex < other.itemIndex);
+    }
+    //@return : true if a run merges this item before other: in the order of the
+    //          files, then of the rows.
+    bool IsMergedBefore(const ItemKeyT &other) const
+    {
+        return (fileIndex != other.fileIndex ? fileIndex < other.fileIndex
+            : itemIndex < other.itemIndex);
+    }
+};
+
+/*
+Records every item that was merged into a map, so that single items can later be
+retracted or replaced without redoing the others. For every map object that items
+were merged into, the ledger keeps the object as it was before any item (or the
+fact that it did not exist), and a copy of each item object that was merged into
+it, in merge order. An object is rebuilt by restoring it, then merging the recorded
+item objects into it again, in a scratch document so that the rest of the map is
+never touched. The rebuilt object takes the place of the old one in its catalog.
+
+Every item also keeps a hash of what it was created from, so that a later run can
+tell which items changed. The ledger can be saved to a manifest file, and loaded
+again by a later run of the same map.
+*/
+class ItemLedger
+{
+public:
+    /* An item to record. */
+    struct NewItemT
+    {
+        ItemKeyT key;
+        string itemHash;            /* hash of the template and row values. */
+        const CustomItem *item;
+    };
+
+    ItemLedger();
+    ~ItemLedger();
+
+    //Merges item into map, like CustomItem::AddToMap, and records what it merged.
+    //Used to build the ledger on a full run, so items must be added in order.
+    //@param map : NULL if items are only written to the output folder.
+    bool AddItem(const NewItemT &newItem, MapManager *map);
+
+    //Forgets the items of retractedKeys, gives the unchanged items of movedKeys
+    //their new keys, and records newItems (which may have the same keys), then
+    //rebuilds every map object that any of them was merged into. Objects that only
+    //moved items were merged into are rebuilt only if their merge order changed.
+    //@param movedKeys : old key to new key, of items whose row or file moved.
+    //@return : false if an object could not be rebuilt, i.e. because an item
+    //          object should already exist but no longer does. The map and the
+    //          ledger are then left as they were.
+    bool Update(const set<ItemKeyT> &retractedKeys, const map<ItemKeyT, ItemKeyT> &movedKeys,
+        const vector<NewItemT> &newItems, MapManager *map);
+
+    void GetItemHashes(map<ItemKeyT, string> &keyToItemHash) const;
+
+    //Appends the objects of every item to the data files of outputFolder, in item
+    //order, like CustomItem::Output.
+    bool Output(const boost::filesystem::path &outputFolder) const;
+
+    //@param mapHash : identifies the map the ledger is for, as it was saved.
+    bool Save(const boost::filesystem::path &manifestPath, const string &mapHash) const;
+
+    //@return : false if the manifest could not be read. The ledger is then empty.
+    bool Load(const boost::filesystem::path &manifestPath, string &mapHash);
+
+    void Clear();
+
+    size_t GetNumItems() const
+    {
+        return _keyToItem.size();
+    }
+
+    size_t GetNumObjects() const
+    {
+        return _keyToObject.size();
+    }
+
+private:
+    /* An item object, and the data file it belongs to. */
+    struct ItemObjectT
+    {
+        string filename;
+        string objectKey;                           /* key of its record, if any. */
+        boost::shared_ptr<xml_document> object;     /* a copy, as the only child. */
+    };
+
+    /* An item that was recorded. */
+    struct ItemRecordT
+    {
+        string itemHash;
+        vector<ItemObjectT> objects;                /* in output order. */
+    };
+
+    /* An item object that was merged into a map object. */
+    struct ContributionT
+    {
+        ItemKeyT itemKey;
+        boost::shared_ptr<xml_document> object;     /* shared with the item record. */
+    };
+
+    /* A map object that items were merged into. */
+    struct ObjectRecordT
+    {
+        string filename;                            /* data file of the object. */
+        string xpath;                               /* finds the object in its catalog. */
+        boost::shared_ptr<xml_document> original;   /* the object before any item, as the
+                                                       only child. Empty if it did not exist. */
+        vector<ContributionT> contributions;        /* in merge order. */
+    };
+
+    //@return : the record of the map object that object is merged into. Created,
+    //          with a copy of the map object as it is now, if there is none.
+    ObjectRecordT &GetRecord(const string &filename, const xml_node &object,
+        MapManager &map, string &objectKey);
+
+    //records every object of newItem, and adds the key of every object record it
+    //was recorded in to objectKeys.
+    void RecordItem(const NewItemT &newItem, MapManager *map, set<string> &objectKeys);
+
+    //gives every item of movedKeys its new key, and adds the key of every object
+    //record whose merge order changed because of it to objectKeys.
+    void MoveItems(const map<ItemKeyT, ItemKeyT> &movedKeys, set<string> &objectKeys);
+
+    static bool IsContributionMergedBefore(const ContributionT &contribution,
+        const ContributionT &other);
+
+    void AddContribution(ObjectRecordT &record, const ItemKeyT &itemKey,
+        const boost::shared_ptr<xml_document> &object);
+
+    //merges the contributions of record into a copy of its original object, in
+    //scratchDoc, which must be empty.
+    bool RebuildObject(const ObjectRecordT &record, MapManager &map, xml_document &scratchDoc);
+
+    //replaces the map object of record by the object RebuildObject built.
+    void ReplaceObject(const ObjectRecordT &record, MapManager &map,
+        const xml_document &scratchDoc);
+
+    //non-copyable semantics
+    ItemLedger(const ItemLedger &other);
+    const ItemLedger& operator=(const ItemLedger&);
+
+    map<string, ObjectRecordT> _keyToObject;    /* by file name and XPath. */
+    map<ItemKeyT, ItemRecordT> _keyToItem;
+};
+
+#endif //_ITEM_LEDGER_H_
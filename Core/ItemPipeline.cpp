@@ -0,0 +1,230 @@
+// ItemPipeline.cpp
+#include "ItemPipeline.h"
+
+#include <iostream>
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/scoped_ptr.hpp"
+
+#include "CommonConstants.h"
+#include "Template.h"
+#include "TemplateCache.h"
+#include "InstantiationCache.h"
+#include "CustomItem.h"
+#include "MapManager.h"
+#include "FileMergeWorkers.h"
+#include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+using namespace std;
+namespace fs = boost::filesystem;
+
+ItemPipeline::ItemPipeline(MapManager *mapManager, size_t numInstantiateThreads,
+    InstantiationCache *instantiationCache, bool useFileMergeWorkers, size_t numMergeStripes)
+    : _mapManager(mapManager)
+    , _instantiationCache(instantiationCache)
+    , _useFileMergeWorkers(useFileMergeWorkers && mapManager != NULL)
+    , _numMergeStripes(numMergeStripes)
+    , _numInstantiateThreads(numInstantiateThreads > 0 ? numInstantiateThreads : 1)
+    , _numInstantiateThreadsRunning(0)
+    , _numItemsCreated(0)
+    , _hasFailed(false)
+    , _readQueue(PIPELINE_QUEUE_CAPACITY)
+    , _instantiatedQueue(PIPELINE_QUEUE_CAPACITY)
+    , _mergedQueue(PIPELINE_QUEUE_CAPACITY)
+    , _outputFolder()
+{
+}
+
+ItemPipeline::~ItemPipeline()
+{
+}
+
+bool ItemPipeline::Run(const vector<fs::path> &customItemsFiles, TemplateCache &templateCache,
+    const fs::path &templatesFolder, const fs::path &outputFolder)
+{
+    _outputFolder = outputFolder;
+    _numInstantiateThreadsRunning = _numInstantiateThreads;
+
+    boost::thread_group stages;
+    stages.create_thread(boost::bind(&ItemPipeline::ReadStage, this,
+        boost::cref(customItemsFiles), boost::ref(templateCache), templatesFolder));
+    for(size_t i = 0; i < _numInstantiateThreads; ++i)
+    {
+        stages.create_thread(boost::bind(&ItemPipeline::InstantiateStage, this));
+    }
+    stages.create_thread(boost::bind(&ItemPipeline::MergeStage, this));
+    stages.create_thread(boost::bind(&ItemPipeline::OutputStage, this));
+    stages.join_all();
+
+    return !_hasFailed;
+}
+
+void ItemPipeline::Fail()
+{
+    {
+        boost::mutex::scoped_lock lock(_stateMutex);
+        _hasFailed = true;
+    }
+    _readQueue.Cancel();
+    _instantiatedQueue.Cancel();
+    _mergedQueue.Cancel();
+}
+
+/* Reads rows from every custom items file, and gets the template of each file
+   the first time one of its rows is read. */
+void ItemPipeline::ReadStage(const vector<fs::path> &customItemsFiles,
+    TemplateCache &templateCache, const fs::path &templatesFolder)
+{
+    Tracer::SetThreadName("ReadStage");
+    TRACE_SCOPE("ReadStage");
+    size_t sequence = 0;
+    try
+    {
+        for(size_t fileIndex = 0; fileIndex < customItemsFiles.size(); ++fileIndex)
+        {
+            const path &customItemsPath(customItemsFiles[fileIndex]);
+            CustomItemStream customItemStream;
+            if(!customItemStream.Open(customItemsPath))
+            {
+                Fail();
+                return;
+            }
+            boost::shared_ptr<const Template> templateToUse;
+            for(size_t itemIndex = 0; ; ++itemIndex)
+            {
+                PipelineItemPtr pipelineItem(new PipelineItem);
+                CustomItemStream::ReadResultT result =
+                    customItemStream.ReadNext(pipelineItem->readItem);
+                if(result == CustomItemStream::EndOfFile)
+                {
+                    break;
+                }
+                if(result == CustomItemStream::ReadFailed)
+                {
+                    Fail();
+                    return;
+                }
+                if(!templateToUse)
+                {
+                    string templateForCustomItem(customItemsPath.stem());
+                    templateToUse = templateCache.Get(templatesFolder/templateForCustomItem);
+                    if(!templateToUse)
+                    {
+                        Fail();
+                        return;
+                    }
+                }
+                pipelineItem->sequence = sequence++;
+                pipelineItem->itemIndex = itemIndex;
+                pipelineItem->itemTemplate = templateToUse;
+                if(!_readQueue.Push(pipelineItem))
+                {
+                    //a later stage failed.
+                    return;
+                }
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: ItemPipeline::ReadStage: ") + e.what());
+        Fail();
+        return;
+    }
+    _readQueue.Close();
+}
+
+/* Instantiates templates. Several of these may run at once, so items can leave this
+   stage in a different order than they entered it. */
+void ItemPipeline::InstantiateStage()
+{
+    Tracer::SetThreadName("InstantiateStage");
+    TRACE_SCOPE("InstantiateStage");
+    PipelineItemPtr pipelineItem;
+    while(_readQueue.Pop(pipelineItem))
+    {
+        pipelineItem->customItem.reset(new CustomItem());
+        bool wasCreated = (_instantiationCache ?
+            _instantiationCache->CreateItem(*pipelineItem->itemTemplate,
+                pipelineItem->readItem.varNameToValue, pipelineItem->itemIndex,
+                *pipelineItem->customItem) :
+            pipelineItem->customItem->Create(*pipelineItem->itemTemplate,
+                pipelineItem->readItem.varNameToValue, pipelineItem->itemIndex));
+        if(!wasCreated)
+        {
+            Fail();
+            return;
+        }
+        //the row is no longer needed.
+        pipelineItem->readItem.varNameToValue.clear();
+        if(!_instantiatedQueue.Push(pipelineItem))
+        {
+            return;
+        }
+    }
+    boost::mutex::scoped_lock lock(_stateMutex);
+    if(--_numInstantiateThreadsRunning == 0)
+    {
+        _instantiatedQueue.Close();
+    }
+}
+
+/* Merges items into the map, in the order in which their rows were read. */
+void ItemPipeline::MergeStage()
+{
+    Tracer::SetThreadName("MergeStage");
+    TRACE_SCOPE("MergeStage");
+    map<size_t, PipelineItemPtr> outOfOrderItems;
+    size_t nextSequence = 0;
+    boost::scoped_ptr<FileMergeWorkers> mergeWorkers(_useFileMergeWorkers ?
+        new FileMergeWorkers(*_mapManager, _outputFolder, _numMergeStripes) : NULL);
+    PipelineItemPtr pipelineItem;
+    while(_instantiatedQueue.Pop(pipelineItem))
+    {
+        outOfOrderItems[pipelineItem->sequence] = pipelineItem;
+        map<size_t, PipelineItemPtr>::iterator itr;
+        while((itr = outOfOrderItems.find(nextSequence)) != outOfOrderItems.end())
+        {
+            PipelineItemPtr nextItem = itr->second;
+            outOfOrderItems.erase(itr);
+            ++nextSequence;
+            bool wasMerged = (mergeWorkers ? mergeWorkers->Add(nextItem->customItem) :
+                (!_mapManager || nextItem->customItem->AddToMap(*_mapManager)));
+            if(!wasMerged)
+            {
+                Fail();
+                return;
+            }
+            if(!_mergedQueue.Push(nextItem))
+            {
+                return;
+            }
+        }
+    }
+    if(mergeWorkers && !mergeWorkers->Finish())
+    {
+        Fail();
+        return;
+    }
+    _mergedQueue.Close();
+}
+
+/* Writes items to the output folder. */
+void ItemPipeline::OutputStage()
+{
+    Tracer::SetThreadName("OutputStage");
+    TRACE_SCOPE("OutputStage");
+    PipelineItemPtr pipelineItem;
+    while(_mergedQueue.Pop(pipelineItem))
+    {
+        //the merge workers write the items themselves.
+        if(!_useFileMergeWorkers && !pipelineItem->customItem->Output(_outputFolder))
+        {
+            Fail();
+            return;
+        }
+        ++_numItemsCreated;
+        ConsoleReporter::ItemDone();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+// ItemPipeline.h
+#ifndef __ITEM_PIPELINE_H__
+#define __ITEM_PIPELINE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "boost/filesystem.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+#include "BoundedQueue.h"
+#include "CustomItemReader.h"
+using namespace std;
+
+class Template;
+class TemplateCache;
+class CustomItem;
+class MapManager;
+class InstantiationCache;
+
+/*
+The ItemPipeline creates custom items one row at a time, instead of reading every
+row of every custom items file before the first item is created. Each row flows
+through four stages, which run on their own threads:
+
+    read -> instantiate -> merge into the MapManager -> write to the output folder
+
+The stages are connected by bounded queues, so the number of rows in memory stays
+constant no matter how long the custom items files are. Items are merged and written
+in exactly the same order as the serial code path would, even when several threads
+are instantiating.
+*/
+
+/* Maximum number of rows waiting between two stages of the pipeline. */
+static const size_t PIPELINE_QUEUE_CAPACITY = 64;
+
+class ItemPipeline
+{
+public:
+    //@param mapManager: map that items are merged into. May be NULL, in which case
+    //                   items are only written to the output folder.
+    //@param numInstantiateThreads: number of threads that instantiate templates.
+    //@param instantiationCache: cache that items are read from and stored in. May be
+    //                           NULL, in which case every item is instantiated.
+    //@param useFileMergeWorkers: merge into each data file of the map on its own
+    //                            thread (see FileMergeWorkers), which then also
+    //                            writes the items to the output folder.
+    //@param numMergeStripes: threads merging into each data file at once. Only used
+    //                        with useFileMergeWorkers.
+    ItemPipeline(MapManager *mapManager, size_t numInstantiateThreads=1,
+        InstantiationCache *instantiationCache=NULL, bool useFileMergeWorkers=false,
+        size_t numMergeStripes=1);
+    ~ItemPipeline();
+
+    //Streams every file of customItemsFiles through the pipeline. The template of
+    //each file is taken from templateCache, which reads it from templatesFolder, and
+    //items are written to outputFolder.
+    bool Run(const vector<boost::filesystem::path> &customItemsFiles,
+        TemplateCache &templateCache, const boost::filesystem::path &templatesFolder,
+        const boost::filesystem::path &outputFolder);
+
+    size_t GetNumItemsCreated() const
+    {
+        return _numItemsCreated;
+    }
+
+private:
+    /* A single row, as it travels through the stages. */
+    struct PipelineItem
+    {
+        size_t sequence;                            /* order in which the row was read. */
+        size_t itemIndex;                           /* row index within its file. */
+        boost::shared_ptr<const Template> itemTemplate;
+        ReadCustomItemT readItem;
+        boost::shared_ptr<CustomItem> customItem;   /* set by the instantiate stage. */
+    };
+    typedef boost::shared_ptr<PipelineItem> PipelineItemPtr;
+
+    void ReadStage(const vector<boost::filesystem::path> &customItemsFiles,
+        TemplateCache &templateCache, const boost::filesystem::path &templatesFolder);
+    void InstantiateStage();
+    void MergeStage();
+    void OutputStage();
+
+    //stops every stage as soon as possible.
+    void Fail();
+
+    //non-copyable semantics
+    ItemPipeline(const ItemPipeline &other);
+    const ItemPipeline& operator=(const ItemPipeline&);
+
+    MapManager *_mapManager;
+    InstantiationCache *_instantiationCache;
+    bool _useFileMergeWorkers;
+    size_t _numMergeStripes;
+    size_t _numInstantiateThreads;
+    size_t _numInstantiateThreadsRunning;
+    size_t _numItemsCreated;
+    bool _hasFailed;
+    boost::mutex _stateMutex;
+
+    BoundedQueue<PipelineItemPtr> _readQueue;
+    BoundedQueue<PipelineItemPtr> _instantiatedQueue;
+    BoundedQueue<PipelineItemPtr> _mergedQueue;
+
+    boost::filesystem::path _outputFolder;
+};
+
+#endif // __ITEM_PIPELINE_H__
\ No newline at end of file
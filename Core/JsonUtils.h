@@ -0,0 +1,39 @@
+#ifndef _JSON_UTILS_H_
+#define _JSON_UTILS_H_
+
+#include <string>
+#include <cstdio>
+using namespace std;
+
+//@return : str as a quoted JSON string.
+inline string QuoteJSONString(const string &str)
+{
+    string quoted("\"");
+    for(size_t i = 0; i < str.size(); ++i)
+    {
+        char c = str[i];
+        switch(c)
+        {
+        case '"':   quoted += "\\\""; break;
+        case '\\':  quoted += "\\\\"; break;
+        case '\n':  quoted += "\\n"; break;
+        case '\r':  quoted += "\\r"; break;
+        case '\t':  quoted += "\\t"; break;
+        default:
+            if((unsigned char)c < 0x20)
+            {
+                char escaped[8];
+                sprintf(escaped, "\\u%04x", (unsigned int)(unsigned char)c);
+                quoted += escaped;
+            }
+            else
+            {
+                quoted += c;
+            }
+        }
+    }
+    quoted += "\"";
+    return quoted;
+}
+
+#endif //_JSON_UTILS_H_
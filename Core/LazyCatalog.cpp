@@ -0,0 +1,581 @@
+#include "LazyCatalog.h"
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include "boost/lexical_cast.hpp"
+#include "CommonConstants.h"
+#include "NodeMatch.h"
+#include "ErrorLogger.h"
+#include "PerfCounters.h"
+#include "BinaryFormat.h"
+
+//---------------- CONSTANTS ------------------
+//processing instructions are never matched, merged or output, so they can mark
+//nodes without changing what the merges do.
+static const char *OBJECT_INDEX_PI_NAME = "SC2DM_objectIndex";
+static const char *SEPARATOR_PI_NAME = "SC2DM_addedObjects";
+static const char *UTF8_BOM = "\xEF\xBB\xBF";
+static const size_t NOT_INDEXED = (size_t) -1;
+//change whenever GetIndex writes a different index, so that older ones are not read.
+static const boost::uint64_t INDEX_VERSION = 1;
+
+//---------------- HELPERS ------------------
+static bool StartsWith(const string &text, size_t pos, const char *prefix)
+{
+    return text.compare(pos, strlen(prefix), prefix) == 0;
+}
+
+/* Moves pos after the next terminator. @return : false if there is none. */
+static bool SkipPast(const string &text, size_t &pos, const char *terminator)
+{
+    pos = text.find(terminator, pos);
+    if(pos == string::npos)
+    {
+        return false;
+    }
+    pos += strlen(terminator);
+    return true;
+}
+
+static bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void SkipWhitespace(const string &text, size_t &pos)
+{
+    while(pos < text.size() && IsWhitespace(text[pos]))
+    {
+        ++pos;
+    }
+}
+
+/* Reads the start tag at pos, and moves pos after it.
+   @param id : if not NULL, gets the value of the tag's id attribute.
+   @return : false if the tag is malformed, or its id has references. */
+static bool ReadStartTag(const string &text, size_t &pos, string &name, string *id,
+    bool &isEmpty)
+{
+    size_t nameBegin = ++pos;
+    while(pos < text.size() && !IsWhitespace(text[pos]) && text[pos] != '/' && text[pos] != '>')
+    {
+        ++pos;
+    }
+    name.assign(text, nameBegin, pos - nameBegin);
+    while(true)
+    {
+        SkipWhitespace(text, pos);
+        if(pos >= text.size())
+        {
+            return false;
+        }
+        if(StartsWith(text, pos, "/>"))
+        {
+            pos += 2;
+            isEmpty = true;
+            return !name.empty();
+        }
+        if(text[pos] == '>')
+        {
+            ++pos;
+            isEmpty = false;
+            return !name.empty();
+        }
+        size_t attrNameBegin = pos;
+        while(pos < text.size() && !IsWhitespace(text[pos]) && text[pos] != '=')
+        {
+            ++pos;
+        }
+        string attrName(text, attrNameBegin, pos - attrNameBegin);
+        SkipWhitespace(text, pos);
+        if(pos >= text.size() || text[pos] != '=')
+        {
+            return false;
+        }
+        ++pos;
+        SkipWhitespace(text, pos);
+        if(pos >= text.size() || (text[pos] != '"' && text[pos] != '\''))
+        {
+            return false;
+        }
+        size_t valueEnd = text.find(text[pos], pos + 1);
+        if(valueEnd == string::npos)
+        {
+            return false;
+        }
+        if(id && attrName == OBJECT_ID_NAME)
+        {
+            id->assign(text, pos + 1, valueEnd - pos - 1);
+            if(id->find('&') != string::npos)
+            {
+                return false;
+            }
+        }
+        pos = valueEnd + 1;
+    }
+}
+
+/* Moves pos after the end tag of the element whose start tag ends at pos. */
+static bool SkipElementContent(const string &text, size_t &pos)
+{
+    size_t depth = 1;
+    string name;
+    while(depth > 0)
+    {
+        pos = text.find('<', pos);
+        if(pos == string::npos)
+        {
+            return false;
+        }
+        bool success = true;
+        if(StartsWith(text, pos, "<!--"))
+        {
+            success = SkipPast(text, pos, "-->");
+        }
+        else if(StartsWith(text, pos, "<![CDATA["))
+        {
+            success = SkipPast(text, pos, "]]>");
+        }
+        else if(StartsWith(text, pos, "<?"))
+        {
+            success = SkipPast(text, pos, "?>");
+        }
+        else if(StartsWith(text, pos, "</"))
+        {
+            success = SkipPast(text, pos, ">");
+            --depth;
+        }
+        else if(StartsWith(text, pos, "<!"))
+        {
+            success = false;
+        }
+        else
+        {
+            bool isEmpty = false;
+            success = ReadStartTag(text, pos, name, NULL, isEmpty);
+            if(!isEmpty)
+            {
+                ++depth;
+            }
+        }
+        if(!success)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* @return : the start of pos's line if only indentation comes before pos on it, or
+             else pos. */
+static size_t GetLineBegin(const string &text, size_t pos, bool &isLineBegin)
+{
+    size_t lineBegin = pos;
+    while(lineBegin > 0 && (text[lineBegin - 1] == ' ' || text[lineBegin - 1] == '\t'))
+    {
+        --lineBegin;
+    }
+    isLineBegin = (lineBegin == 0 || text[lineBegin - 1] == '\n');
+    return (isLineBegin ? lineBegin : pos);
+}
+
+/* @return : the start of the next line if nothing but whitespace comes after pos on
+             its line, or else pos. */
+static size_t GetLineEnd(const string &text, size_t pos, bool &isLineEnd)
+{
+    size_t lineEnd = pos;
+    while(lineEnd < text.size() && (text[lineEnd] == ' ' || text[lineEnd] == '\t' ||
+        text[lineEnd] == '\r'))
+    {
+        ++lineEnd;
+    }
+    isLineEnd = (lineEnd < text.size() && text[lineEnd] == '\n');
+    return (isLineEnd ? lineEnd + 1 : pos);
+}
+
+/* @return : which object of the file object is, or NOT_INDEXED. */
+static size_t GetObjectIndex(const xml_node &object)
+{
+    xml_node indexNote = object.first_child();
+    if(indexNote.type() != node_pi || strcmp(indexNote.name(), OBJECT_INDEX_PI_NAME) != 0)
+    {
+        return NOT_INDEXED;
+    }
+    return (size_t) strtoul(indexNote.value(), NULL, 10);
+}
+
+/* @return : object as it is written in the file: indented on its own lines, like
+             MapManager::Save writes whole files, or else raw. */
+static string PrintObject(const xml_node &object, bool isOnOwnLine)
+{
+    ostringstream printed;
+    if(isOnOwnLine)
+    {
+        object.print(printed, "    ", format_indent, encoding_utf8, 1);
+    }
+    else
+    {
+        object.print(printed, "", format_raw, encoding_utf8);
+    }
+    return printed.str();
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+LazyCatalog::LazyCatalog()
+    : _contents("")
+    , _objects()
+    , _catalogEnd(0)
+    , _isCatalogEndOnOwnLine(false)
+    , _catalogEndLine(0)
+    , _nameToObjects()
+    , _nameAndIdToObjects()
+    , _separator()
+{
+}
+
+LazyCatalog::~LazyCatalog()
+{
+}
+
+bool LazyCatalog::Create(const string &contents, xml_node catalog)
+{
+    return CreateIndex(contents, NULL, catalog);
+}
+
+bool LazyCatalog::Create(const string &contents, const string &index, xml_node catalog)
+{
+    return CreateIndex(contents, &index, catalog);
+}
+
+string LazyCatalog::GetIndex() const
+{
+    string index;
+    BinaryFormat::AppendUInt64(index, INDEX_VERSION);
+    BinaryFormat::AppendUInt64(index, _catalogEnd);
+    BinaryFormat::AppendUInt64(index, _isCatalogEndOnOwnLine ? 1 : 0);
+    BinaryFormat::AppendUInt64(index, _catalogEndLine);
+    BinaryFormat::AppendUInt64(index, _objects.size());
+    for(vector<ObjectRangeT>::const_iterator itr = _objects.begin(); itr != _objects.end(); ++itr)
+    {
+        BinaryFormat::AppendString(index, itr->name);
+        BinaryFormat::AppendString(index, itr->id);
+        BinaryFormat::AppendUInt64(index, itr->begin);
+        BinaryFormat::AppendUInt64(index, itr->end);
+        BinaryFormat::AppendUInt64(index, itr->isOnOwnLine ? 1 : 0);
+        BinaryFormat::AppendUInt64(index, itr->lineBegin);
+        BinaryFormat::AppendUInt64(index, itr->lineEnd);
+    }
+    return index;
+}
+
+bool LazyCatalog::Materialize(const xml_node &object, xml_node catalog,
+    vector<xml_node> *materializedObjects)
+{
+    //objects with an id are matched by name and id (see GetNodeXPath). Any other
+    //object may match any object of the same name.
+    string name(object.name());
+    xml_attribute idAttr = object.attribute(OBJECT_ID_NAME.c_str());
+    const vector<size_t> *candidates = NULL;
+    if(idAttr && GetNodeXPath(object) == name + "[@" + OBJECT_ID_NAME + "='" + idAttr.value() + "']")
+    {
+        map<pair<string, string>, vector<size_t> >::const_iterator itr =
+            _nameAndIdToObjects.find(make_pair(name, string(idAttr.value())));
+        candidates = (itr == _nameAndIdToObjects.end() ? NULL : &itr->second);
+    }
+    else
+    {
+        map<string, vector<size_t> >::const_iterator itr = _nameToObjects.find(name);
+        candidates = (itr == _nameToObjects.end() ? NULL : &itr->second);
+    }
+    if(!candidates)
+    {
+        return true;
+    }
+    for(size_t i = 0; i < candidates->size(); ++i)
+    {
+        size_t objectIndex = (*candidates)[i];
+        if(!_objects[objectIndex].isMaterialized &&
+            !MaterializeObject(objectIndex, catalog, materializedObjects))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LazyCatalog::MaterializeAll(xml_node catalog)
+{
+    for(size_t i = 0; i < _objects.size(); ++i)
+    {
+        if(!_objects[i].isMaterialized && !MaterializeObject(i, catalog))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+string LazyCatalog::Splice(xml_node catalog) const
+{
+    vector<string> printedObjects(_objects.size());
+    vector<bool> isKept(_objects.size(), false);
+    string addedObjects;
+    bool isAdded = false;
+    for(xml_node object = catalog.first_child(); object; object = object.next_sibling())
+    {
+        if(object == _separator)
+        {
+            isAdded = true;
+            continue;
+        }
+        if(object.type() != node_element)
+        {
+            continue;
+        }
+        size_t objectIndex = GetObjectIndex(object);
+        if(isAdded || objectIndex == NOT_INDEXED)
+        {
+            addedObjects += PrintObject(object, _isCatalogEndOnOwnLine);
+            continue;
+        }
+        object.remove_child(object.first_child());
+        printedObjects[objectIndex] = PrintObject(object, _objects[objectIndex].isOnOwnLine);
+        isKept[objectIndex] = true;
+    }
+
+    string spliced;
+    spliced.reserve(_contents.size() + addedObjects.size());
+    size_t copiedEnd = 0;
+    for(size_t i = 0; i < _objects.size(); ++i)
+    {
+        const ObjectRangeT &range = _objects[i];
+        if(!range.isMaterialized)
+        {
+            continue;
+        }
+        spliced.append(_contents, copiedEnd, range.lineBegin - copiedEnd);
+        if(isKept[i])
+        {
+            spliced += printedObjects[i];
+        }
+        copiedEnd = range.lineEnd;
+    }
+    spliced.append(_contents, copiedEnd, _catalogEndLine - copiedEnd);
+    spliced += addedObjects;
+    spliced.append(_contents, _catalogEndLine, string::npos);
+    return spliced;
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+bool LazyCatalog::CreateIndex(const string &contents, const string *index, xml_node catalog)
+{
+    _contents = contents;
+    _objects.clear();
+    _nameToObjects.clear();
+    _nameAndIdToObjects.clear();
+    while(catalog.first_child())
+    {
+        catalog.remove_child(catalog.first_child());
+    }
+    bool hasIndexed = (index ? ReadIndex(*index) : IndexObjects());
+    if(!hasIndexed)
+    {
+        _contents.clear();
+        _objects.clear();
+        return false;
+    }
+    for(size_t i = 0; i < _objects.size(); ++i)
+    {
+        _nameToObjects[_objects[i].name].push_back(i);
+        _nameAndIdToObjects[make_pair(_objects[i].name, _objects[i].id)].push_back(i);
+    }
+    _separator = catalog.append_child(node_pi);
+    _separator.set_name(SEPARATOR_PI_NAME);
+    return true;
+}
+
+bool LazyCatalog::IndexObjects()
+{
+    const string &text = _contents;
+    //only UTF-8 can be spliced, since objects are written back as UTF-8.
+    if(StartsWith(text, 0, "\xFF\xFE") || StartsWith(text, 0, "\xFE\xFF"))
+    {
+        return false;
+    }
+    size_t pos = (StartsWith(text, 0, UTF8_BOM) ? strlen(UTF8_BOM) : 0);
+    while(true)
+    {
+        SkipWhitespace(text, pos);
+        if(StartsWith(text, pos, "<?"))
+        {
+            if(!SkipPast(text, pos, "?>"))
+            {
+                return false;
+            }
+        }
+        else if(StartsWith(text, pos, "<!--"))
+        {
+            if(!SkipPast(text, pos, "-->"))
+            {
+                return false;
+            }
+        }
+        else if(StartsWith(text, pos, "<!") || !StartsWith(text, pos, "<"))
+        {
+            //a DOCTYPE may define entities that objects use.
+            return false;
+        }
+        else
+        {
+            break;
+        }
+    }
+    string name;
+    bool isEmpty = false;
+    if(!ReadStartTag(text, pos, name, NULL, isEmpty) || name != CATALOG_NAME || isEmpty)
+    {
+        return false;
+    }
+
+    while(true)
+    {
+        SkipWhitespace(text, pos);
+        if(StartsWith(text, pos, "<!--"))
+        {
+            if(!SkipPast(text, pos, "-->"))
+            {
+                return false;
+            }
+        }
+        else if(StartsWith(text, pos, "<?"))
+        {
+            if(!SkipPast(text, pos, "?>"))
+            {
+                return false;
+            }
+        }
+        else if(StartsWith(text, pos, "</"))
+        {
+            if(!StartsWith(text, pos, ("</" + CATALOG_NAME).c_str()))
+            {
+                return false;
+            }
+            _catalogEnd = pos;
+            _catalogEndLine = GetLineBegin(text, pos, _isCatalogEndOnOwnLine);
+            return true;
+        }
+        else if(StartsWith(text, pos, "<!") || !StartsWith(text, pos, "<"))
+        {
+            //text or CDATA between objects.
+            return false;
+        }
+        else
+        {
+            ObjectRangeT range;
+            range.begin = pos;
+            if(!ReadStartTag(text, pos, range.name, &range.id, isEmpty) ||
+                (!isEmpty && !SkipElementContent(text, pos)))
+            {
+                return false;
+            }
+            range.end = pos;
+            //objects on their own lines are replaced line by line, so that the
+            //indentation stays the same.
+            bool isLineBegin = false, isLineEnd = false;
+            range.lineBegin = GetLineBegin(text, range.begin, isLineBegin);
+            range.lineEnd = GetLineEnd(text, range.end, isLineEnd);
+            range.isOnOwnLine = (isLineBegin && isLineEnd);
+            if(!range.isOnOwnLine)
+            {
+                range.lineBegin = range.begin;
+                range.lineEnd = range.end;
+            }
+            range.isMaterialized = false;
+            _objects.push_back(range);
+        }
+    }
+}
+
+bool LazyCatalog::ReadIndex(const string &index)
+{
+    const string &text = _contents;
+    BinaryFormat::Reader reader(index);
+    boost::uint64_t version = 0, isCatalogEndOnOwnLine = 0;
+    size_t numObjects = 0;
+    if(!reader.ReadUInt64(version) || version != INDEX_VERSION ||
+        !reader.ReadSize(_catalogEnd) || !reader.ReadUInt64(isCatalogEndOnOwnLine) ||
+        !reader.ReadSize(_catalogEndLine) || !reader.ReadSize(numObjects))
+    {
+        return false;
+    }
+    _isCatalogEndOnOwnLine = (isCatalogEndOnOwnLine != 0);
+    //the file may have changed without its size or write time changing, so every
+    //range must still start and end where an object does.
+    size_t previousEnd = 0;
+    for(size_t i = 0; i < numObjects; ++i)
+    {
+        ObjectRangeT range;
+        boost::uint64_t isOnOwnLine = 0;
+        if(!reader.ReadString(range.name) || !reader.ReadString(range.id) ||
+            !reader.ReadSize(range.begin) || !reader.ReadSize(range.end) ||
+            !reader.ReadUInt64(isOnOwnLine) || !reader.ReadSize(range.lineBegin) ||
+            !reader.ReadSize(range.lineEnd))
+        {
+            return false;
+        }
+        range.isOnOwnLine = (isOnOwnLine != 0);
+        range.isMaterialized = false;
+        if(range.lineBegin < previousEnd || range.lineBegin > range.begin ||
+            range.begin >= range.end || range.end > range.lineEnd ||
+            range.lineEnd > _catalogEndLine || text[range.end - 1] != '>' ||
+            !StartsWith(text, range.begin, ("<" + range.name).c_str()))
+        {
+            return false;
+        }
+        char afterName = text[range.begin + 1 + range.name.size()];
+        if(!IsWhitespace(afterName) && afterName != '>' && afterName != '/')
+        {
+            return false;
+        }
+        previousEnd = range.lineEnd;
+        _objects.push_back(range);
+    }
+    return reader.IsAtEnd() && _catalogEndLine <= _catalogEnd &&
+        StartsWith(text, _catalogEnd, ("</" + CATALOG_NAME).c_str());
+}
+
+bool LazyCatalog::MaterializeObject(size_t objectIndex, xml_node catalog,
+    vector<xml_node> *materializedObjects)
+{
+    ObjectRangeT &range = _objects[objectIndex];
+    xml_document objectDoc;
+    xml_parse_result result = objectDoc.load_buffer(_contents.data() + range.begin,
+        range.end - range.begin);
+    PerfCounters::Add(PerfCounters::OBJECTS_MATERIALIZED);
+    if(!result || !objectDoc.first_child())
+    {
+        ErrorLogger::Log("ERROR: LazyCatalog::MaterializeObject: object \"" + range.name + " "
+            + OBJECT_ID_NAME + "=" + range.id + "\" could not be parsed: "
+            + result.description() + ".");
+        return false;
+    }
+    //after the objects that come before it in the file, so that matching finds the
+    //same object as if the whole file had been parsed.
+    xml_node position = _separator;
+    for(xml_node previous = _separator.previous_sibling(); previous &&
+        GetObjectIndex(previous) > objectIndex; previous = previous.previous_sibling())
+    {
+        position = previous;
+    }
+    xml_node object = catalog.insert_copy_before(objectDoc.first_child(), position);
+    PerfCounters::Add(PerfCounters::APPEND_COPIES);
+    xml_node indexNote = object.prepend_child(node_pi);
+    indexNote.set_name(OBJECT_INDEX_PI_NAME);
+    indexNote.set_value(boost::lexical_cast<string>(objectIndex).c_str());
+    range.isMaterialized = true;
+    if(materializedObjects)
+    {
+        materializedObjects->push_back(object);
+    }
+    return true;
+}
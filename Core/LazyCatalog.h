@@ -0,0 +1,101 @@
+#ifndef _LAZY_CATALOG_H_
+#define _LAZY_CATALOG_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "pugixml.hpp"
+using namespace std;
+using namespace pugi;
+
+/*
+The text of a map data file, with an index of where each of its objects starts and
+ends, so that an object is only parsed once a merge or query needs it. The objects
+that were parsed are kept in a catalog node, in the same order as in the file, and
+saving splices them back into the text: objects that were never parsed are written
+back exactly as they were read.
+
+The catalog holds, in order: the objects parsed so far, each with a processing
+instruction that says which object of the file it is, then a separator, then the
+objects that were added to the catalog. Code that only matches and appends objects
+(i.e. MergeObjectIntoCatalog) never sees the difference.
+*/
+class LazyCatalog
+{
+public:
+    LazyCatalog();
+    ~LazyCatalog();
+
+    //Indexes contents, and empties catalog.
+    //@return : false if contents is not a catalog the index understands (i.e. is not
+    //          UTF-8, or has text between objects). The file should then be parsed
+    //          in full.
+    bool Create(const string &contents, xml_node catalog);
+
+    //Same as above, but reads the index of contents from index (see GetIndex)
+    //instead of scanning contents, i.e. from a MapSnapshot.
+    //@return : false if index does not describe contents. Create(contents, catalog)
+    //          should then be called.
+    bool Create(const string &contents, const string &index, xml_node catalog);
+
+    //@return : the index of the objects of the file, in a compact binary form.
+    string GetIndex() const;
+
+    //Parses every object of the file that object may match (see GetMatchingNode)
+    //into catalog, unless it already is.
+    //@param materializedObjects: if not NULL, the objects parsed are added to it.
+    bool Materialize(const xml_node &object, xml_node catalog,
+        vector<xml_node> *materializedObjects=NULL);
+
+    //Parses every object of the file into catalog.
+    bool MaterializeAll(xml_node catalog);
+
+    //@return : the text of the file with the objects of catalog spliced in: objects
+    //          that were parsed are written again, objects that were removed from
+    //          catalog are removed, and objects added to catalog are added before
+    //          the end of the catalog. Removes the index's notes from catalog, so
+    //          Create must be called again before catalog is used.
+    string Splice(xml_node catalog) const;
+
+    size_t GetNumObjects() const
+    {
+        return _objects.size();
+    }
+
+private:
+    struct ObjectRangeT
+    {
+        string name;
+        string id;
+        size_t begin;           /* of the object's start tag. */
+        size_t end;             /* after the object's end tag. */
+        bool isOnOwnLine;       /* only indentation comes before the object on its
+                                   line, and nothing after it. */
+        size_t lineBegin;       /* the start of its line if isOnOwnLine, else begin. */
+        size_t lineEnd;         /* after the end of its line if isOnOwnLine, else end. */
+        bool isMaterialized;
+    };
+
+    bool CreateIndex(const string &contents, const string *index, xml_node catalog);
+    bool IndexObjects();
+    bool ReadIndex(const string &index);
+    bool MaterializeObject(size_t objectIndex, xml_node catalog,
+        vector<xml_node> *materializedObjects=NULL);
+
+    //non-copyable semantics
+    LazyCatalog(const LazyCatalog &other);
+    const LazyCatalog& operator=(const LazyCatalog&);
+
+    string _contents;
+    vector<ObjectRangeT> _objects;
+    size_t _catalogEnd;         /* of the catalog's end tag. */
+    bool _isCatalogEndOnOwnLine;
+    size_t _catalogEndLine;     /* the start of its line if _isCatalogEndOnOwnLine, else
+                                   _catalogEnd. Added objects are spliced in there. */
+    map<string, vector<size_t> > _nameToObjects;
+    map<pair<string, string>, vector<size_t> > _nameAndIdToObjects;
+    xml_node _separator;
+};
+
+#endif //_LAZY_CATALOG_H_
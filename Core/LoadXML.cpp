@@ -1,10 +1,12 @@
 #include "LoadXML.h"
 #include <sstream>
 #include <fstream>
+#include "PerfCounters.h"
 
 string LoadXMLFile(xml_document *xmlDoc, const char *filePath)
 {
 	xml_parse_result result = xmlDoc->load_file(filePath);
+	PerfCounters::Add(PerfCounters::DOCUMENTS_LOADED);
 	stringstream errorMsg("");
 	if (!result)
 	{
@@ -17,4 +19,21 @@ string LoadXMLFile(xml_document *xmlDoc, const char *filePath)
 		errorMsg << "Error offset: " << result.offset << " (error at [..." << line << "...]" << endl << endl;
 	}
 	return errorMsg.str();
-}
\ No newline at end of file
+}
+
+string LoadXMLBuffer(xml_document *xmlDoc, const string &contents, const string &name)
+{
+	xml_parse_result result = xmlDoc->load_buffer(contents.data(), contents.size());
+	PerfCounters::Add(PerfCounters::DOCUMENTS_LOADED);
+	stringstream errorMsg("");
+	if (!result)
+	{
+		size_t lineEnd = contents.find('\n', result.offset);
+		errorMsg << "XML [" << name << "] parsed with errors." << endl
+			<< "Error description: " << result.description() << endl
+			<< "Error offset: " << result.offset << " (error at [..."
+			<< contents.substr(result.offset, lineEnd == string::npos ? string::npos : lineEnd - result.offset)
+			<< "...]" << endl << endl;
+	}
+	return errorMsg.str();
+}
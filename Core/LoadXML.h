@@ -8,4 +8,8 @@ using namespace pugi;
 
 string LoadXMLFile(xml_document *xmlDoc, const char *filePath);
 
+//Same as LoadXMLFile, for a file that was already read into contents (i.e. from an
+//archive). name is only used in errors.
+string LoadXMLBuffer(xml_document *xmlDoc, const string &contents, const string &name);
+
 #endif //__LOAD_XML_H___
\ No newline at end of file
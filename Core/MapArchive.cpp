@@ -0,0 +1,220 @@
+#include "MapArchive.h"
+#include "boost/filesystem.hpp"
+#include "boost/foreach.hpp"
+#include "boost/lexical_cast.hpp"
+#include "CommonConstants.h"
+#include "ErrorLogger.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#if defined(SC2DM_USE_STORMLIB)
+#include "StormLib.h"
+#endif
+
+namespace fs = boost::filesystem;
+
+//---------------- CONSTANTS ------------------
+//archives name their files with backslashes, whatever the platform.
+static const char ARCHIVE_PATH_DELIM = '\\';
+
+//---------------- HELPERS ------------------
+#if defined(SC2DM_USE_STORMLIB)
+static string GetStormError()
+{
+    return "StormLib error " + boost::lexical_cast<string>(GetLastError());
+}
+#endif
+
+//---------------- PUBLIC FUNCTIONS ------------------
+MapArchive::MapArchive()
+    : _path("")
+    , _handle(NULL)
+{
+}
+
+MapArchive::~MapArchive()
+{
+#if defined(SC2DM_USE_STORMLIB)
+    if(_handle)
+    {
+        SFileCloseArchive(_handle);
+    }
+#endif
+}
+
+bool MapArchive::IsArchive(const fs::path &archivePath)
+{
+    try
+    {
+        return fs::is_regular_file(archivePath);
+    }
+    catch(std::exception &)
+    {
+        return false;
+    }
+}
+
+bool MapArchive::IsSupported()
+{
+#if defined(SC2DM_USE_STORMLIB)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(SC2DM_USE_STORMLIB)
+
+bool MapArchive::Open(const fs::path &archivePath, bool shouldWrite)
+{
+    TRACE_SCOPE_DETAIL("OpenArchive", archivePath.filename());
+    _path = archivePath;
+    HANDLE handle = NULL;
+    if(!SFileOpenArchive(archivePath.string().c_str(), 0,
+        (shouldWrite ? 0 : STREAM_FLAG_READ_ONLY), &handle))
+    {
+        ErrorLogger::Log("ERROR: MapArchive::Open: could not open archive \""
+            + archivePath.string() + "\": " + GetStormError() + ".");
+        return false;
+    }
+    _handle = handle;
+    return true;
+}
+
+bool MapArchive::GetDataFileNames(vector<string> &fileNames) const
+{
+    fileNames.clear();
+    string dataFilesMask = GetArchivedName("*.xml");
+    SFILE_FIND_DATA findData;
+    HANDLE findHandle = SFileFindFirstFile(_handle, dataFilesMask.c_str(), &findData, NULL);
+    if(!findHandle)
+    {
+        //an archive without data files is fine.
+        return true;
+    }
+    string gameDataPrefix = GetArchivedName("");
+    do
+    {
+        string archivedName(findData.cFileName);
+        //the mask also matches data files of subfolders.
+        if(archivedName.find(ARCHIVE_PATH_DELIM, gameDataPrefix.size()) == string::npos)
+        {
+            fileNames.push_back(archivedName.substr(gameDataPrefix.size()));
+        }
+    } while(SFileFindNextFile(findHandle, &findData));
+    SFileFindClose(findHandle);
+    return true;
+}
+
+bool MapArchive::ReadDataFile(const string &fileName, string &contents) const
+{
+    TRACE_SCOPE_DETAIL("ReadArchivedFile", fileName);
+    contents.clear();
+    HANDLE fileHandle = NULL;
+    if(!SFileOpenFileEx(_handle, GetArchivedName(fileName).c_str(), SFILE_OPEN_FROM_MPQ,
+        &fileHandle))
+    {
+        ErrorLogger::Log("ERROR: MapArchive::ReadDataFile: could not open \"" + fileName
+            + "\" in archive \"" + _path.string() + "\": " + GetStormError() + ".");
+        return false;
+    }
+    DWORD fileSize = SFileGetFileSize(fileHandle, NULL);
+    contents.resize(fileSize);
+    DWORD numBytesRead = 0;
+    bool success = (fileSize == 0 ||
+        (SFileReadFile(fileHandle, &contents[0], fileSize, &numBytesRead, NULL) &&
+        numBytesRead == fileSize));
+    if(!success)
+    {
+        ErrorLogger::Log("ERROR: MapArchive::ReadDataFile: could not read \"" + fileName
+            + "\" in archive \"" + _path.string() + "\": " + GetStormError() + ".");
+    }
+    SFileCloseFile(fileHandle);
+    return success;
+}
+
+bool MapArchive::WriteDataFile(const string &fileName, const string &contents)
+{
+    TRACE_SCOPE_DETAIL("WriteArchivedFile", fileName);
+    HANDLE fileHandle = NULL;
+    if(!SFileCreateFile(_handle, GetArchivedName(fileName).c_str(), 0, (DWORD) contents.size(),
+        0, MPQ_FILE_COMPRESS | MPQ_FILE_REPLACEEXISTING, &fileHandle))
+    {
+        ErrorLogger::Log("ERROR: MapArchive::WriteDataFile: could not add \"" + fileName
+            + "\" to archive \"" + _path.string() + "\": " + GetStormError() + ".");
+        return false;
+    }
+    bool success = (contents.empty() ||
+        SFileWriteFile(fileHandle, contents.data(), (DWORD) contents.size(),
+            MPQ_COMPRESSION_ZLIB));
+    //the file is only added once it is finished, even if writing failed.
+    success = (SFileFinishFile(fileHandle) && success);
+    if(!success)
+    {
+        ErrorLogger::Log("ERROR: MapArchive::WriteDataFile: could not write \"" + fileName
+            + "\" to archive \"" + _path.string() + "\": " + GetStormError() + ".");
+        return false;
+    }
+    PerfCounters::Add(PerfCounters::BYTES_WRITTEN, contents.size());
+    return true;
+}
+
+bool MapArchive::Close()
+{
+    if(!_handle)
+    {
+        return true;
+    }
+    bool success = SFileCloseArchive(_handle);
+    _handle = NULL;
+    if(!success)
+    {
+        ErrorLogger::Log("ERROR: MapArchive::Close: could not write archive \""
+            + _path.string() + "\": " + GetStormError() + ".");
+    }
+    return success;
+}
+
+#else
+
+bool MapArchive::Open(const fs::path &archivePath, bool /*shouldWrite*/)
+{
+    ErrorLogger::Log("ERROR: MapArchive::Open: \"" + archivePath.string() + "\" is an "
+        "archive, and this build can not read archives. Save it as a folder in the editor, "
+        "or build with SC2DM_USE_STORMLIB.");
+    return false;
+}
+
+bool MapArchive::GetDataFileNames(vector<string> &fileNames) const
+{
+    fileNames.clear();
+    return false;
+}
+
+bool MapArchive::ReadDataFile(const string &/*fileName*/, string &contents) const
+{
+    contents.clear();
+    return false;
+}
+
+bool MapArchive::WriteDataFile(const string &/*fileName*/, const string &/*contents*/)
+{
+    return false;
+}
+
+bool MapArchive::Close()
+{
+    return true;
+}
+
+#endif
+
+//---------------- PRIVATE FUNCTIONS ------------------
+string MapArchive::GetArchivedName(const string &fileName)
+{
+    string archivedName;
+    BOOST_FOREACH(const string &folderName, GAME_DATA_PATH)
+    {
+        archivedName += folderName + ARCHIVE_PATH_DELIM;
+    }
+    return archivedName + fileName;
+}
@@ -0,0 +1,61 @@
+#ifndef _MAP_ARCHIVE_H_
+#define _MAP_ARCHIVE_H_
+
+#include <string>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+using namespace std;
+
+/*
+A map or mod saved as a single MPQ archive, as the StarCraft 2 editor saves them
+by default, instead of as a folder. Only the data files of its GameData folder are
+read and written; every other file of the archive (models, textures, sounds, ...)
+is left as it is, so a map never has to be extracted and packed again.
+
+Reading and writing archives needs StormLib: define SC2DM_USE_STORMLIB and link
+with StormLib. Without it, Open fails and maps must be saved as folders.
+*/
+class MapArchive
+{
+public:
+    MapArchive();
+    //closes the archive, without reporting errors. Call Close to know whether the
+    //changes were written.
+    ~MapArchive();
+
+    //@return : true if archivePath is a file (and so an archive) rather than a folder.
+    static bool IsArchive(const boost::filesystem::path &archivePath);
+
+    //@return : false if archives can not be read in this build.
+    static bool IsSupported();
+
+    //@param shouldWrite: false if the archive is only read, so that it can be
+    //                    opened while the editor has it open.
+    bool Open(const boost::filesystem::path &archivePath, bool shouldWrite);
+
+    //Lists the data files of the archive, by their name in the GameData folder
+    //(i.e. "UnitData.xml").
+    bool GetDataFileNames(vector<string> &fileNames) const;
+
+    bool ReadDataFile(const string &fileName, string &contents) const;
+
+    //Adds data file fileName to the archive, replacing it if it exists. The archive
+    //must have been opened with shouldWrite.
+    bool WriteDataFile(const string &fileName, const string &contents);
+
+    //Writes the changes to disk and closes the archive.
+    bool Close();
+
+private:
+    //@return : the name of data file fileName inside the archive.
+    static string GetArchivedName(const string &fileName);
+
+    //non-copyable semantics
+    MapArchive(const MapArchive &other);
+    const MapArchive& operator=(const MapArchive&);
+
+    boost::filesystem::path _path;
+    void *_handle;              /* StormLib's HANDLE of the open archive. NULL if closed. */
+};
+
+#endif //_MAP_ARCHIVE_H_
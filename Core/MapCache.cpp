@@ -0,0 +1,85 @@
+#include "MapCache.h"
+#include "boost/lexical_cast.hpp"
+#include "MapManager.h"
+#include "CommonConstants.h"
+#include "FilesystemUtils.h"
+#include "MapArchive.h"
+#include "ConsoleReporter.h"
+
+namespace fs = boost::filesystem;
+
+//---------------- HELPERS ------------------
+/* @return : a stamp that changes whenever the data files of the map at mapPath do. */
+static string GetDataFilesStamp(const fs::path &mapPath)
+{
+    if(!MapArchive::IsArchive(mapPath))
+    {
+        return GetFolderStamp(mapPath/GAME_DATA_PATH, ".xml");
+    }
+    try
+    {
+        return boost::lexical_cast<string>(fs::file_size(mapPath)) + ":"
+            + boost::lexical_cast<string>(fs::last_write_time(mapPath));
+    }
+    catch(std::exception &)
+    {
+        return "";
+    }
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+
+MapCache::MapCache()
+    : _pathToMap()
+{
+}
+
+MapCache::~MapCache()
+{
+}
+
+boost::shared_ptr<MapManager> MapCache::Get(const fs::path &mapPath)
+{
+    string dataFilesStamp = GetDataFilesStamp(mapPath);
+    map<string, CachedMapT>::iterator itr = _pathToMap.find(mapPath.string());
+    if(itr != _pathToMap.end())
+    {
+        if(itr->second.dataFilesStamp == dataFilesStamp)
+        {
+            return itr->second.mapManager;
+        }
+        if(ConsoleReporter::IsVerbose())
+        {
+            ConsoleReporter::Detail("Map " + mapPath.string() + " changed on disk.");
+        }
+        _pathToMap.erase(itr);
+    }
+    boost::shared_ptr<MapManager> mapManager(new MapManager());
+    if(!mapManager->Create(mapPath))
+    {
+        return boost::shared_ptr<MapManager>();
+    }
+    CachedMapT &cachedMap = _pathToMap[mapPath.string()];
+    cachedMap.mapManager = mapManager;
+    cachedMap.dataFilesStamp = dataFilesStamp;
+    return mapManager;
+}
+
+void MapCache::MarkSaved(const fs::path &mapPath)
+{
+    map<string, CachedMapT>::iterator itr = _pathToMap.find(mapPath.string());
+    if(itr != _pathToMap.end())
+    {
+        itr->second.dataFilesStamp = GetDataFilesStamp(mapPath);
+    }
+}
+
+void MapCache::Remove(const fs::path &mapPath)
+{
+    _pathToMap.erase(mapPath.string());
+}
+
+size_t MapCache::GetNumMaps() const
+{
+    return _pathToMap.size();
+}
@@ -0,0 +1,51 @@
+#ifndef _MAP_CACHE_H_
+#define _MAP_CACHE_H_
+
+#include <map>
+#include <string>
+#include "boost/filesystem/path.hpp"
+#include "boost/shared_ptr.hpp"
+using namespace std;
+
+class MapManager;
+
+/*
+Keeps loaded maps in memory, so that a map updated by several runs is only read and
+parsed once. A map is loaded again when any of its data files is added, removed or
+written by anything but the MapManager itself.
+*/
+class MapCache
+{
+public:
+    MapCache();
+    ~MapCache();
+
+    //@return : the map at mapPath, loaded if it is not cached or changed on disk
+    //          since it was loaded or last saved. Empty if it could not be loaded.
+    boost::shared_ptr<MapManager> Get(const boost::filesystem::path &mapPath);
+
+    //Records that the map at mapPath was saved, so that its own changes do not
+    //cause it to be loaded again.
+    void MarkSaved(const boost::filesystem::path &mapPath);
+
+    //Forgets the map at mapPath, i.e. after a failed run left it half changed.
+    void Remove(const boost::filesystem::path &mapPath);
+
+    size_t GetNumMaps() const;
+
+private:
+    /* A map, and the stamp of its data files when it was loaded or last saved. */
+    struct CachedMapT
+    {
+        boost::shared_ptr<MapManager> mapManager;
+        string dataFilesStamp;
+    };
+
+    //non-copyable semantics
+    MapCache(const MapCache &other);
+    const MapCache& operator=(const MapCache&);
+
+    map<string, CachedMapT> _pathToMap;
+};
+
+#endif //_MAP_CACHE_H_
@@ -1,10 +1,18 @@
 #include "MapManager.h"
 #include "NodeMatch.h"
 #include <iostream>
+#include <sstream>
+#include <fstream>
 #include "boost/foreach.hpp"
 #include "LoadXML.h"
 #include "CommonConstants.h"
 #include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "MemoryAccounting.h"
+#include "MapArchive.h"
+#include "FilesystemUtils.h"
 
 typedef pair<string, xml_document *> stringXMLDocPair;
 
@@ -69,6 +77,12 @@ MapManager::MapManager()
 	: mapPath("")
     , mapFilenameToDoc()
 	, mapFilenameToWasEdited()
+    , dependencyLayers()
+    , shouldLoadLazily(false)
+    , mapFilenameToLazyCatalog()
+    , snapshotFolder("")
+    , snapshot()
+    , isSnapshotStale(false)
 	, hasCreated(false)
 {
 }
@@ -82,8 +96,11 @@ MapManager::~MapManager()
 	}
 }
 
-bool MapManager::Create(const path &mapPath)
+bool MapManager::Create(const path &mapPath, bool shouldShowProgress, bool shouldLoadLazily)
 {
+    ErrorLogger::ScopedContext logContext("LoadMap");
+    TRACE_SCOPE("LoadMap");
+    MemoryAccounting::ScopedTag memoryTag("LoadMap");
 	//make sure Create is only called once per instance of MapManager.
 	if(hasCreated)
 	{
@@ -97,10 +114,10 @@ bool MapManager::Create(const path &mapPath)
 		     + "\" does not exist!");
         return false;
     }
-	if( !boost::filesystem::is_directory(mapPath) )
+	if( !boost::filesystem::is_directory(mapPath) && !MapArchive::IsArchive(mapPath) )
 	{
 		ErrorLogger::Log("ERROR: MapManager::Create: file path(" + mapPath.string()
-			 + ") is not a directory!");
+			 + ") is neither a directory nor an archive!");
         return false;
 	}
 	if(mapPath.extension() != SC2MAP_EXTENSION)
@@ -112,12 +129,23 @@ bool MapManager::Create(const path &mapPath)
 	}
 
     this->mapPath = mapPath;
+    this->shouldLoadLazily = shouldLoadLazily;
+    if(MapArchive::IsArchive(mapPath))
+    {
+        return CreateFromArchive(shouldShowProgress);
+    }
     path gameDataPath = mapPath/GAME_DATA_PATH;
+    if(shouldLoadLazily && !snapshotFolder.empty() && !snapshot.Create(snapshotFolder, mapPath))
+    {
+        return false;
+    }
 	//if the game data folder exists, read from it.
     if(boost::filesystem::exists(gameDataPath))
     {
-		cout << "Reading from map " << gameDataPath << endl 
-            << "{" << endl;
+		if(shouldShowProgress)
+		{
+			ConsoleReporter::BeginPhase("Reading map " + mapPath.filename());
+		}
 		directory_iterator end;
 		for(directory_iterator iter(gameDataPath); iter != end; ++iter)
 		{
@@ -126,25 +154,64 @@ bool MapManager::Create(const path &mapPath)
 			{
 				continue;
 			}
-			cout << "Reading from map data file " << currentDataFilePath.filename() << "...";
-			xml_document *currentDataDoc = new xml_document();
+			if(ConsoleReporter::IsVerbose())
+			{
+				ConsoleReporter::Detail("Reading from map data file " + currentDataFilePath.filename() + ".");
+			}
 			string currentFilename = currentDataFilePath.filename();
-			mapFilenameToDoc[currentFilename] = currentDataDoc;
-			string error = LoadXMLFile(currentDataDoc, currentDataFilePath.string().c_str());
-			if(error != "")
+			ErrorLogger::ScopedContext fileLogContext("", "", "", currentFilename.c_str());
+			TRACE_SCOPE_DETAIL("LoadMapFile", currentFilename);
+			MemoryAccounting::ScopedTag fileMemoryTag("", "map:" + currentFilename);
+			bool hasLoaded = false;
+			if(shouldLoadLazily)
+			{
+				if(!snapshotFolder.empty())
+				{
+					//stamped before it is read, so that a change made meanwhile is seen.
+					snapshot.StampDataFile(currentFilename, currentDataFilePath);
+				}
+				string contents;
+				hasLoaded = ReadFileContents(currentDataFilePath, contents)
+					&& LoadDataFile(currentFilename, contents, currentDataFilePath.string(),
+						snapshot.GetDataFileIndex(currentFilename, currentDataFilePath));
+			}
+			else
+			{
+				xml_document *currentDataDoc = new xml_document();
+				mapFilenameToDoc[currentFilename] = currentDataDoc;
+				string error = LoadXMLFile(currentDataDoc, currentDataFilePath.string().c_str());
+				if(error != "")
+				{
+					ErrorLogger::Log(error);
+				}
+				hasLoaded = (error == "");
+			}
+			if(!hasLoaded)
 			{
-                cout << endl;
-				ErrorLogger::Log(error);
+				if(shouldShowProgress)
+				{
+					ConsoleReporter::EndPhase();
+				}
 				return false;
 			}
-			cout << " done." << endl;
+			if(shouldShowProgress)
+			{
+				ConsoleReporter::ItemDone();
+			}
+		}
+		if(shouldShowProgress)
+		{
+			ConsoleReporter::EndPhase();
+		}
+		if(isSnapshotStale)
+		{
+			SaveSnapshot();
 		}
-		cout << "}" << endl << endl;
 	}
 	else
 	{
-        cout << "Warning: MapManager::Create: map(" << mapPath.string() 
-			<< ") does not have a Game Data folder, but that's okay." << endl;
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Warning: MapManager::Create: map("
+            + mapPath.string() + ") does not have a Game Data folder, but that's okay.");
     }
 	hasCreated = true;
     return true;
@@ -178,6 +245,12 @@ MapManager::ObjectAddingErrorT MapManager::AddObjectToDataFile(const xml_node &o
 		docCatalog = fileDoc->append_child(CATALOG_NAME.c_str());
         mapFilenameToWasEdited[fileName] = true;
     }
+    unordered_map<string, boost::shared_ptr<LazyCatalog> >::iterator lazyItr =
+        mapFilenameToLazyCatalog.find(fileName);
+    if(lazyItr != mapFilenameToLazyCatalog.end() && !lazyItr->second->Materialize(objectToAdd, docCatalog))
+    {
+        return MapManager::ObjectNotAppendable;
+    }
     //check if the objectToAdd already exists
     const char *objectToAddName = objectToAdd.name();
     xml_node nextExistingObject;
@@ -198,6 +271,7 @@ MapManager::ObjectAddingErrorT MapManager::AddObjectToDataFile(const xml_node &o
             }
         }
     }
+    PerfCounters::Add(PerfCounters::APPEND_COPIES);
     if( docCatalog.append_copy(objectToAdd).empty() )
     {
         ErrorLogger::Log(string("ERROR: MapManager::AddObjectToDataFile: problem"
@@ -208,9 +282,91 @@ MapManager::ObjectAddingErrorT MapManager::AddObjectToDataFile(const xml_node &o
     return MapManager::NoError;
 }
 
+xml_node MapManager::GetDataFileCatalog(const string &fileName)
+{
+    xml_document *&fileDoc = mapFilenameToDoc[fileName];
+    if(!fileDoc)
+    {
+        fileDoc = new xml_document();
+        mapFilenameToWasEdited[fileName] = true;
+    }
+    xml_node docCatalog = fileDoc->child(CATALOG_NAME.c_str());
+    if(!docCatalog)
+    {
+        docCatalog = fileDoc->append_child(CATALOG_NAME.c_str());
+        mapFilenameToWasEdited[fileName] = true;
+    }
+    return docCatalog;
+}
+
+bool MapManager::MaterializeMatchingObjects(const string &fileName, const xml_node &object,
+    xml_node catalog, vector<xml_node> *materializedObjects)
+{
+    unordered_map<string, boost::shared_ptr<LazyCatalog> >::iterator itr =
+        mapFilenameToLazyCatalog.find(fileName);
+    return (itr == mapFilenameToLazyCatalog.end() ||
+        itr->second->Materialize(object, catalog, materializedObjects));
+}
+
+void MapManager::SetSnapshotFolder(const path &snapshotFolder)
+{
+    this->snapshotFolder = snapshotFolder;
+}
+
+void MapManager::SetDependencyLayers(const vector<CatalogLayerPtr> &layers)
+{
+    dependencyLayers = layers;
+}
+
+xml_node MapManager::FindInheritedObject(const string &fileName, const xml_node &object) const
+{
+    for(vector<CatalogLayerPtr>::const_reverse_iterator itr = dependencyLayers.rbegin();
+        itr != dependencyLayers.rend(); ++itr)
+    {
+        xml_node inheritedObject = (*itr)->FindObject(fileName, object);
+        if(inheritedObject)
+        {
+            return inheritedObject;
+        }
+    }
+    return xml_node();
+}
+
+xml_node MapManager::FindObject(const string &fileName, const xml_node &object) const
+{
+    unordered_map<string, xml_document *>::const_iterator itr = mapFilenameToDoc.find(fileName);
+    if(itr != mapFilenameToDoc.end())
+    {
+        xml_node docCatalog = itr->second->child(CATALOG_NAME.c_str());
+        unordered_map<string, boost::shared_ptr<LazyCatalog> >::const_iterator lazyItr =
+            mapFilenameToLazyCatalog.find(fileName);
+        if(lazyItr != mapFilenameToLazyCatalog.end())
+        {
+            lazyItr->second->Materialize(object, docCatalog);
+        }
+        xml_node mapObject = GetMatchingNode(object, docCatalog);
+        if(mapObject)
+        {
+            return mapObject;
+        }
+    }
+    return FindInheritedObject(fileName, object);
+}
+
+void MapManager::SetDataFileWasEdited(const string &fileName)
+{
+    mapFilenameToWasEdited[fileName] = true;
+}
 
 bool MapManager::Save()
 {
+    ErrorLogger::ScopedContext logContext("SaveMap");
+    TRACE_SCOPE("SaveMap");
+    MemoryAccounting::ScopedTag memoryTag("SaveMap");
+    if(MapArchive::IsArchive(mapPath))
+    {
+        return SaveToArchive();
+    }
 	//make sure GameData folder and all of its parents exist.
 	path currentPath( mapPath );
 	BOOST_FOREACH(string dirThatShouldExist, GAME_DATA_PATH)
@@ -236,18 +392,224 @@ bool MapManager::Save()
         string mapName = mapPath.leaf();
         if(mapFilenameToWasEdited[filenameAndDoc.first])
         {
-            if(!mapFilenameToDoc[currentFilename]->save_file(mapDataFilePath.string().c_str(), "    "))
+            TRACE_SCOPE_DETAIL("SaveMapFile", currentFilename);
+            bool hasSaved = false;
+            if(mapFilenameToLazyCatalog.count(currentFilename))
+            {
+                //untouched objects are written back as they were read.
+                string contents = SerializeDataFile(currentFilename);
+                std::ofstream fileWriter(mapDataFilePath.string().c_str(), ios_base::binary | ios_base::trunc);
+                fileWriter.write(contents.data(), contents.size());
+                fileWriter.close();
+                hasSaved = !fileWriter.fail() && ReindexDataFile(currentFilename, contents);
+                if(hasSaved && !snapshotFolder.empty())
+                {
+                    snapshot.StampDataFile(currentFilename, mapDataFilePath);
+                }
+            }
+            else
+            {
+                hasSaved = mapFilenameToDoc[currentFilename]->save_file(mapDataFilePath.string().c_str(), "    ");
+            }
+            if(!hasSaved)
             {
                 ErrorLogger::Log("ERROR: MapManager::Save: Failed to save changes"
                     " to file(" + currentFilename + ") in map(" + mapName + ").");
                 return false;
             }
+            PerfCounters::Add(PerfCounters::DOCUMENTS_SAVED);
+            PerfCounters::Add(PerfCounters::BYTES_WRITTEN,
+                boost::filesystem::file_size(mapDataFilePath));
+        }
+    }
+    //the files that were written have new write times.
+    if(!snapshotFolder.empty() && !mapFilenameToLazyCatalog.empty())
+    {
+        SaveSnapshot();
+    }
+    mapFilenameToWasEdited.clear();
+    return true;
+}
+
+bool MapManager::CreateFromArchive(bool shouldShowProgress)
+{
+    //only the data files are read, so the rest of the archive is never extracted.
+    MapArchive archive;
+    vector<string> dataFileNames;
+    if(!archive.Open(mapPath, false) || !archive.GetDataFileNames(dataFileNames))
+    {
+        return false;
+    }
+    if(shouldShowProgress)
+    {
+        ConsoleReporter::BeginPhase("Reading map " + mapPath.filename(), dataFileNames.size());
+    }
+    bool success = true;
+    BOOST_FOREACH(const string &currentFilename, dataFileNames)
+    {
+        if(ConsoleReporter::IsVerbose())
+        {
+            ConsoleReporter::Detail("Reading from map data file " + currentFilename + ".");
+        }
+        ErrorLogger::ScopedContext fileLogContext("", "", "", currentFilename.c_str());
+        TRACE_SCOPE_DETAIL("LoadMapFile", currentFilename);
+        MemoryAccounting::ScopedTag fileMemoryTag("", "map:" + currentFilename);
+        string contents;
+        if(!archive.ReadDataFile(currentFilename, contents)
+            || !LoadDataFile(currentFilename, contents, mapPath.filename() + "/" + currentFilename))
+        {
+            success = false;
+            break;
+        }
+        if(shouldShowProgress)
+        {
+            ConsoleReporter::ItemDone();
+        }
+    }
+    if(shouldShowProgress)
+    {
+        ConsoleReporter::EndPhase();
+    }
+    if(!success || !archive.Close())
+    {
+        return false;
+    }
+    hasCreated = true;
+    return true;
+}
+
+bool MapManager::SaveToArchive()
+{
+    //only the data files that changed are written back.
+    vector<string> editedFilenames;
+    BOOST_FOREACH(stringXMLDocPair filenameAndDoc, mapFilenameToDoc)
+    {
+        if(mapFilenameToWasEdited[filenameAndDoc.first])
+        {
+            editedFilenames.push_back(filenameAndDoc.first);
+        }
+    }
+    if(editedFilenames.empty())
+    {
+        return true;
+    }
+    MapArchive archive;
+    if(!archive.Open(mapPath, true))
+    {
+        return false;
+    }
+    BOOST_FOREACH(const string &currentFilename, editedFilenames)
+    {
+        TRACE_SCOPE_DETAIL("SaveMapFile", currentFilename);
+        string contents = SerializeDataFile(currentFilename);
+        if(!archive.WriteDataFile(currentFilename, contents)
+            || !ReindexDataFile(currentFilename, contents))
+        {
+            ErrorLogger::Log("ERROR: MapManager::Save: Failed to save changes"
+                " to file(" + currentFilename + ") in map(" + mapPath.filename() + ").");
+            return false;
         }
+        PerfCounters::Add(PerfCounters::DOCUMENTS_SAVED);
+    }
+    if(!archive.Close())
+    {
+        return false;
     }
     mapFilenameToWasEdited.clear();
     return true;
 }
 
+void MapManager::SaveSnapshot()
+{
+    snapshot.Clear();
+    typedef pair<string, boost::shared_ptr<LazyCatalog> > stringLazyCatalogPair;
+    BOOST_FOREACH(const stringLazyCatalogPair &filenameAndCatalog, mapFilenameToLazyCatalog)
+    {
+        snapshot.SetDataFileIndex(filenameAndCatalog.first, filenameAndCatalog.second->GetIndex());
+    }
+    snapshot.Save();
+    isSnapshotStale = false;
+}
+
+bool MapManager::LoadDataFile(const string &fileName, const string &contents,
+    const string &sourceName, const string &snapshotIndex)
+{
+    xml_document *dataDoc = new xml_document();
+    mapFilenameToDoc[fileName] = dataDoc;
+    if(shouldLoadLazily)
+    {
+        boost::shared_ptr<LazyCatalog> lazyCatalog(new LazyCatalog());
+        xml_node catalog = dataDoc->append_child(CATALOG_NAME.c_str());
+        if(!snapshotIndex.empty() && lazyCatalog->Create(contents, snapshotIndex, catalog))
+        {
+            PerfCounters::Add(PerfCounters::SNAPSHOT_HITS);
+            mapFilenameToLazyCatalog[fileName] = lazyCatalog;
+            return true;
+        }
+        if(lazyCatalog->Create(contents, catalog))
+        {
+            if(!snapshotFolder.empty())
+            {
+                PerfCounters::Add(PerfCounters::SNAPSHOT_MISSES);
+                isSnapshotStale = true;
+            }
+            mapFilenameToLazyCatalog[fileName] = lazyCatalog;
+            return true;
+        }
+        //files the index does not understand are parsed in full.
+        if(ConsoleReporter::IsVerbose())
+        {
+            ConsoleReporter::Detail("Parsing map data file " + fileName + " in full.");
+        }
+        dataDoc->reset();
+    }
+    string error = LoadXMLBuffer(dataDoc, contents, sourceName);
+    if(error != "")
+    {
+        ErrorLogger::Log(error);
+        return false;
+    }
+    return true;
+}
+
+string MapManager::SerializeDataFile(const string &fileName)
+{
+    unordered_map<string, boost::shared_ptr<LazyCatalog> >::iterator itr =
+        mapFilenameToLazyCatalog.find(fileName);
+    if(itr != mapFilenameToLazyCatalog.end())
+    {
+        return itr->second->Splice(mapFilenameToDoc[fileName]->child(CATALOG_NAME.c_str()));
+    }
+    ostringstream contents;
+    mapFilenameToDoc[fileName]->save(contents, "    ");
+    return contents.str();
+}
+
+bool MapManager::ReindexDataFile(const string &fileName, const string &contents)
+{
+    unordered_map<string, boost::shared_ptr<LazyCatalog> >::iterator itr =
+        mapFilenameToLazyCatalog.find(fileName);
+    if(itr == mapFilenameToLazyCatalog.end())
+    {
+        return true;
+    }
+    xml_document *dataDoc = mapFilenameToDoc[fileName];
+    dataDoc->reset();
+    if(itr->second->Create(contents, dataDoc->append_child(CATALOG_NAME.c_str())))
+    {
+        return true;
+    }
+    mapFilenameToLazyCatalog.erase(itr);
+    dataDoc->reset();
+    string error = LoadXMLBuffer(dataDoc, contents, fileName);
+    if(error != "")
+    {
+        ErrorLogger::Log(error);
+        return false;
+    }
+    return true;
+}
+
 
 
 /*to create a series of custom items and add them to the xml documents of the map, we need to do the following:
@@ -355,8 +717,18 @@ void MapManager::GetObjectsInDataFile(string fileName, vector<const xml_node> &o
 		//cout << "Unable to find catalog. This means no objects are in data file." << endl;
 		return;
 	}
+    unordered_map<string, boost::shared_ptr<LazyCatalog> >::const_iterator lazyItr =
+        mapFilenameToLazyCatalog.find(fileName);
+    if(lazyItr != mapFilenameToLazyCatalog.end())
+    {
+        lazyItr->second->MaterializeAll(catalog);
+    }
     for(xml_node object = catalog.first_child(); object; object = object.next_sibling())
     {
-        objects.push_back(object);
+        //skips the notes of a lazy catalog.
+        if(object.type() == node_element)
+        {
+            objects.push_back(object);
+        }
     }
 }
@@ -9,6 +9,9 @@
 #include <map>
 #include "boost/filesystem.hpp"
 #include "CustomItem.h"
+#include "CatalogLayer.h"
+#include "LazyCatalog.h"
+#include "MapSnapshot.h"
 using namespace std;
 using namespace pugi;
 using namespace boost::filesystem;
@@ -26,8 +29,20 @@ public:
 	// throwing errors work as desired. For more control, we use the Create
 	// function in place of the normal constructor.
 
-    //Read the map from the specified path
-    bool Create(const path &mapPath );
+    //Read the map from the specified path: a map folder, or a map archive, of
+    //which only the data files are read.
+    //@param shouldShowProgress: false if the map is read while another phase is
+    //                           shown, i.e. by one of several threads.
+    //@param shouldLoadLazily: only index the objects of each data file, and parse
+    //                         an object when it is first merged into or looked up
+    //                         (see LazyCatalog). Saving then splices the changed
+    //                         objects into the files, and leaves the rest as read.
+    bool Create(const path &mapPath, bool shouldShowProgress=true, bool shouldLoadLazily=false);
+
+    //Keeps a MapSnapshot of the objects index in snapshotFolder, so that the next
+    //Create of the same map does not scan the data files that did not change. Only
+    //used if the map is a folder loaded lazily. Must be called before Create.
+    void SetSnapshotFolder(const path &snapshotFolder);
 
 	//Destroys all state held by the map manager.
 	~MapManager();
@@ -49,9 +64,34 @@ public:
     ObjectAddingErrorT AddObjectToDataFile(const xml_node &object, const string &fileName,
         bool overwriteExisting=false);
 
+    //@return : the catalog of data file fileName. The file and its catalog are
+    //          created if they do not exist yet. If the map is loaded lazily, the
+    //          catalog only holds the objects parsed so far.
+    xml_node GetDataFileCatalog(const string &fileName);
+
+    //Parses every object of data file fileName that object may match (see
+    //GetMatchingNode) into catalog, the file's catalog, if the map is loaded lazily.
+    //Call it before merging object into the catalog. Never changes which data files
+    //the map has, so several threads may call it at once for different files.
+    //@param materializedObjects: if not NULL, the objects parsed are added to it, in
+    //                            the order they were parsed.
+    //@return : false if one of those objects could not be parsed.
+    bool MaterializeMatchingObjects(const string &fileName, const xml_node &object,
+        xml_node catalog, vector<xml_node> *materializedObjects=NULL);
+
+    //Records that data file fileName was changed, so that Save writes it.
+    void SetDataFileWasEdited(const string &fileName);
+
+    //Sets the dependencies whose objects the map's objects inherit from, from the
+    //first to the last dependency of the map (later ones override earlier ones).
+    //The layers are only read, so they may be shared with other maps.
+    void SetDependencyLayers(const vector<CatalogLayerPtr> &layers);
+
     //Merge the XML trees of the map with those of the CustomItem.
     //string MergeWithCustomItem(const CustomItem &item);
 
+    //Writes the data files that changed. If the map is loaded lazily, the objects
+    //parsed so far are forgotten: nodes of the catalogs must not be kept across Save.
     bool Save();
 
     //---------------- GETTERS -----------------
@@ -64,6 +104,15 @@ public:
     // top of the hierarchy.
     void GetObjectsInDataFile(string fileName, vector<const xml_node> &objects) const;
 
+    //@return : the object of the dependency layers that object matches in data file
+    //          fileName, searched from the last layer to the first. Empty if none does.
+    //          It belongs to a shared layer, so it must only be read.
+    xml_node FindInheritedObject(const string &fileName, const xml_node &object) const;
+
+    //@return : the object that object matches in the map's own data file fileName, or
+    //          else in the dependency layers. Empty if none does.
+    xml_node FindObject(const string &fileName, const xml_node &object) const;
+
     path GetPath() const
     {
         return mapPath;
@@ -75,11 +124,36 @@ private /*dummy methods*/:
     const MapManager& operator=(const MapManager&);
 
 private /*methods*/:
-	
+    //Create and Save, for a map saved as an archive (see MapArchive).
+    bool CreateFromArchive(bool shouldShowProgress);
+    bool SaveToArchive();
+
+    //Parses data file fileName from contents, or indexes it if the map is loaded
+    //lazily, reading the index from snapshotIndex if it still matches contents.
+    //sourceName is only used in errors.
+    bool LoadDataFile(const string &fileName, const string &contents, const string &sourceName,
+        const string &snapshotIndex="");
+
+    //@return : the text of data file fileName, as Save writes it.
+    string SerializeDataFile(const string &fileName);
+
+    //Makes contents, which was just saved, the text that data file fileName is
+    //indexed from, if the map is loaded lazily.
+    bool ReindexDataFile(const string &fileName, const string &contents);
+
+    //Writes the index of every lazily loaded data file to the snapshot.
+    void SaveSnapshot();
+
 private /*variables*/:
     path mapPath;
     unordered_map<string, xml_document *> mapFilenameToDoc;
     unordered_map<string, bool> mapFilenameToWasEdited;
+    vector<CatalogLayerPtr> dependencyLayers;
+    bool shouldLoadLazily;
+    unordered_map<string, boost::shared_ptr<LazyCatalog> > mapFilenameToLazyCatalog;
+    path snapshotFolder;        /* empty if the map is not snapshotted. */
+    MapSnapshot snapshot;
+    bool isSnapshotStale;       /* a data file was indexed without the snapshot. */
 	bool hasCreated;
 };
 
@@ -0,0 +1,219 @@
+#include "MapSnapshot.h"
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include "boost/filesystem.hpp"
+#include "boost/thread/thread.hpp"
+#include "BinaryFormat.h"
+#include "ContentHash.h"
+#include "FilesystemUtils.h"
+#include "ErrorLogger.h"
+#include "Tracer.h"
+
+namespace fs = boost::filesystem;
+
+//---------------- CONSTANTS ------------------
+static const char SNAPSHOT_MAGIC[] = "SC2DataManagerSnapshot";
+//change whenever Save writes a different snapshot, so that older ones are not read.
+static const boost::uint64_t SNAPSHOT_VERSION = 3;
+
+//---------------- PUBLIC FUNCTIONS ------------------
+MapSnapshot::MapSnapshot()
+    : _snapshotPath()
+    , _filenameToDataFile()
+    , _filenameToStamp()
+{
+}
+
+MapSnapshot::~MapSnapshot()
+{
+}
+
+bool MapSnapshot::Create(const fs::path &snapshotFolder, const fs::path &mapPath)
+{
+    TRACE_SCOPE("LoadMapSnapshot");
+    _filenameToDataFile.clear();
+    _filenameToStamp.clear();
+    try
+    {
+        if(!fs::exists(snapshotFolder))
+        {
+            fs::create_directories(snapshotFolder);
+        }
+        //the same map may be reached by several relative paths.
+        ContentHash mapPathHash;
+        mapPathHash.AddField(fs::system_complete(mapPath).string());
+        _snapshotPath = snapshotFolder/(mapPathHash.GetHex() + ".snapshot");
+        if(!fs::exists(_snapshotPath))
+        {
+            return true;
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: MapSnapshot::Create: ") + e.what() + ".");
+        return false;
+    }
+
+    string contents, magic, checksum, payload;
+    BinaryFormat::Reader reader(contents);
+    if(!ReadFileContents(_snapshotPath, contents) || !reader.ReadString(magic) ||
+        magic != SNAPSHOT_MAGIC || !reader.ReadString(checksum) ||
+        !reader.ReadString(payload) || !reader.IsAtEnd())
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: MapSnapshot: snapshot \""
+            + _snapshotPath.string() + "\" could not be read, so the map is indexed again.");
+        return true;
+    }
+    ContentHash payloadHash;
+    payloadHash.Add(payload.data(), payload.size());
+    BinaryFormat::Reader payloadReader(payload);
+    boost::uint64_t version = 0;
+    size_t numDataFiles = 0;
+    if(checksum != payloadHash.GetHex() || !payloadReader.ReadUInt64(version) ||
+        version != SNAPSHOT_VERSION || !payloadReader.ReadSize(numDataFiles))
+    {
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: MapSnapshot: snapshot \""
+            + _snapshotPath.string() + "\" is damaged or out of date, so the map is indexed again.");
+        return true;
+    }
+    for(size_t i = 0; i < numDataFiles; ++i)
+    {
+        string fileName;
+        DataFileT dataFile;
+        if(!payloadReader.ReadString(fileName) || !payloadReader.ReadUInt64(dataFile.size) ||
+            !payloadReader.ReadUInt64(dataFile.lastWriteTime) ||
+            !payloadReader.ReadUInt64(dataFile.stampTime) ||
+            !payloadReader.ReadString(dataFile.index))
+        {
+            _filenameToDataFile.clear();
+            return true;
+        }
+        _filenameToDataFile[fileName] = dataFile;
+    }
+    return true;
+}
+
+string MapSnapshot::GetDataFileIndex(const string &fileName, const fs::path &dataFilePath) const
+{
+    map<string, DataFileT>::const_iterator itr = _filenameToDataFile.find(fileName);
+    DataFileT currentStamp;
+    //a file written in the second it was stamped may have been written again in
+    //that second without its write time changing.
+    if(itr == _filenameToDataFile.end() ||
+        itr->second.lastWriteTime >= itr->second.stampTime ||
+        !GetStamp(dataFilePath, currentStamp) || currentStamp.size != itr->second.size ||
+        currentStamp.lastWriteTime != itr->second.lastWriteTime)
+    {
+        return "";
+    }
+    return itr->second.index;
+}
+
+void MapSnapshot::StampDataFile(const string &fileName, const fs::path &dataFilePath)
+{
+    DataFileT dataFile;
+    if(!GetStamp(dataFilePath, dataFile))
+    {
+        _filenameToStamp.erase(fileName);
+        return;
+    }
+    _filenameToStamp[fileName] = dataFile;
+}
+
+void MapSnapshot::SetDataFileIndex(const string &fileName, const string &index)
+{
+    map<string, DataFileT>::const_iterator itr = _filenameToStamp.find(fileName);
+    if(itr == _filenameToStamp.end())
+    {
+        _filenameToDataFile.erase(fileName);
+        return;
+    }
+    DataFileT &dataFile = _filenameToDataFile[fileName];
+    dataFile = itr->second;
+    dataFile.index = index;
+}
+
+void MapSnapshot::Clear()
+{
+    _filenameToDataFile.clear();
+}
+
+void MapSnapshot::Save() const
+{
+    if(_snapshotPath.empty())
+    {
+        return;
+    }
+    TRACE_SCOPE("SaveMapSnapshot");
+    string payload;
+    BinaryFormat::AppendUInt64(payload, SNAPSHOT_VERSION);
+    BinaryFormat::AppendUInt64(payload, _filenameToDataFile.size());
+    for(map<string, DataFileT>::const_iterator itr = _filenameToDataFile.begin();
+        itr != _filenameToDataFile.end(); ++itr)
+    {
+        BinaryFormat::AppendString(payload, itr->first);
+        BinaryFormat::AppendUInt64(payload, itr->second.size);
+        BinaryFormat::AppendUInt64(payload, itr->second.lastWriteTime);
+        BinaryFormat::AppendUInt64(payload, itr->second.stampTime);
+        BinaryFormat::AppendString(payload, itr->second.index);
+    }
+    ContentHash payloadHash;
+    payloadHash.Add(payload.data(), payload.size());
+    string contents;
+    BinaryFormat::AppendString(contents, SNAPSHOT_MAGIC);
+    BinaryFormat::AppendString(contents, payloadHash.GetHex());
+    BinaryFormat::AppendString(contents, payload);
+
+    //written to a temporary file and then renamed, so that a run that reads the
+    //snapshot meanwhile never sees half of it.
+    ostringstream temporaryName;
+    temporaryName << _snapshotPath.string() << "." << boost::this_thread::get_id() << ".tmp";
+    fs::path temporaryPath(temporaryName.str());
+    try
+    {
+        std::ofstream fileWriter(temporaryPath.string().c_str(), ios_base::binary | ios_base::trunc);
+        fileWriter.write(contents.data(), contents.size());
+        fileWriter.close();
+        if(fileWriter.fail())
+        {
+            ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "WARNING: MapSnapshot: could not "
+                "write \"" + temporaryPath.string() + "\".");
+            fs::remove(temporaryPath);
+            return;
+        }
+        if(fs::exists(_snapshotPath))
+        {
+            fs::remove(_snapshotPath);
+        }
+        fs::rename(temporaryPath, _snapshotPath);
+    }
+    catch(std::exception &)
+    {
+        //i.e. another process saved the same snapshot first.
+        try
+        {
+            fs::remove(temporaryPath);
+        }
+        catch(std::exception &)
+        {
+        }
+    }
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+bool MapSnapshot::GetStamp(const fs::path &dataFilePath, DataFileT &dataFile)
+{
+    try
+    {
+        //read first, so that a write in the same second as the stamp is always seen.
+        dataFile.stampTime = (boost::uint64_t) std::time(NULL);
+        dataFile.size = fs::file_size(dataFilePath);
+        dataFile.lastWriteTime = (boost::uint64_t) fs::last_write_time(dataFilePath);
+    }
+    catch(std::exception &)
+    {
+        return false;
+    }
+    return true;
+}
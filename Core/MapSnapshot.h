@@ -0,0 +1,78 @@
+#ifndef _MAP_SNAPSHOT_H_
+#define _MAP_SNAPSHOT_H_
+
+#include <map>
+#include <string>
+#include "boost/cstdint.hpp"
+#include "boost/filesystem/path.hpp"
+using namespace std;
+
+/*
+The object index of every data file of a map loaded lazily (see LazyCatalog), kept
+in binary form in a snapshot folder shared by every run, so that reloading a map
+that did not change reads each file's index back instead of scanning the file.
+
+A file's index is only used while the file still has the size and last write time
+it had when it was read or written (see StampDataFile). Since a file can be rewritten
+within the resolution of its write time, a file that was last written in the same
+second as it was stamped is indexed again by the next run. A snapshot whose checksum
+does not match (i.e. that was cut short) is ignored as a whole. The folder can be
+deleted at any time to reclaim space.
+*/
+class MapSnapshot
+{
+public:
+    MapSnapshot();
+    ~MapSnapshot();
+
+    //Reads the snapshot of the map at mapPath from snapshotFolder. A missing or
+    //unreadable snapshot is not an error: the snapshot is then empty.
+    //@param snapshotFolder : created if it does not exist.
+    bool Create(const boost::filesystem::path &snapshotFolder,
+        const boost::filesystem::path &mapPath);
+
+    //Must be called after dataFilePath is read, so that a file changed meanwhile
+    //does not match.
+    //@return : the index of data file fileName, read from dataFilePath. Empty if the
+    //          snapshot does not have it, or if the file changed since.
+    string GetDataFileIndex(const string &fileName,
+        const boost::filesystem::path &dataFilePath) const;
+
+    //Records the size and last write time of data file fileName, at dataFilePath, as
+    //those of the text its index is later set from. Must be called before the file
+    //is read, or after it is written, so that a change made meanwhile is seen.
+    void StampDataFile(const string &fileName, const boost::filesystem::path &dataFilePath);
+
+    //Sets the index of data file fileName to index, as indexed from the text it
+    //had when it was last stamped. Not kept if the file was never stamped.
+    void SetDataFileIndex(const string &fileName, const string &index);
+
+    //Forgets the index of every data file, but not their stamps.
+    void Clear();
+
+    //Writes the snapshot to the snapshot folder. Failing to is not an error, since
+    //it only costs a later run time.
+    void Save() const;
+
+private:
+    struct DataFileT
+    {
+        boost::uint64_t size;
+        boost::uint64_t lastWriteTime;
+        boost::uint64_t stampTime;      /* when size and lastWriteTime were read. */
+        string index;
+    };
+
+    //@return : false if dataFilePath can not be read.
+    static bool GetStamp(const boost::filesystem::path &dataFilePath, DataFileT &dataFile);
+
+    //non-copyable semantics
+    MapSnapshot(const MapSnapshot &other);
+    const MapSnapshot& operator=(const MapSnapshot&);
+
+    boost::filesystem::path _snapshotPath;
+    map<string, DataFileT> _filenameToDataFile;
+    map<string, DataFileT> _filenameToStamp;    /* without an index. */
+};
+
+#endif //_MAP_SNAPSHOT_H_
@@ -0,0 +1,369 @@
+#include "MemoryAccounting.h"
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include "boost/cstdint.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/tss.hpp"
+#include "boost/foreach.hpp"
+#include "pugixml.hpp"
+#include "JsonUtils.h"
+#include "ErrorLogger.h"
+
+//---------------- CONSTANTS ------------------
+/* name of the phase/document of allocations made outside of any ScopedTag. */
+static const string UNTAGGED_NAME("(untagged)");
+/* bytes a thread may allocate and free before its counts are folded into the
+   totals, which is also how far a peak may be under-reported per thread. */
+static const boost::uint64_t FOLD_INTERVAL_BYTES = 64 * 1024;
+
+//---------------- STATE ------------------
+/* Put in front of every allocation, so that it can be un-counted when freed. Its
+   size keeps the memory returned to pugixml as aligned as malloc's. */
+struct AllocationHeader
+{
+    boost::uint64_t size;
+    boost::uint32_t phaseIndex;
+    boost::uint32_t documentIndex;
+};
+
+/* Usage attributed to a single phase or document. Usage is signed, since the
+   frees of one thread may be folded in before the allocations of another. */
+struct TagUsage
+{
+    string name;
+    boost::int64_t currentBytes;
+    boost::int64_t peakBytes;
+    boost::uint64_t totalAllocatedBytes;
+    boost::uint64_t numAllocations;
+    /* highest overall usage reached by an allocation attributed to this tag. */
+    boost::int64_t peakOverallBytes;
+
+    TagUsage(const string &tagName) : name(tagName), currentBytes(0), peakBytes(0),
+        totalAllocatedBytes(0), numAllocations(0), peakOverallBytes(0)
+    {
+    }
+};
+
+/* Changes to the usage of a tag that a thread has not folded in yet. */
+struct PendingUsage
+{
+    boost::int64_t bytes;
+    boost::uint64_t allocatedBytes;
+    boost::uint64_t numAllocations;
+
+    PendingUsage() : bytes(0), allocatedBytes(0), numAllocations(0)
+    {
+    }
+};
+
+/* Each thread counts into its own block, without a lock, and only folds it into
+   the totals (under usageMutex) every FOLD_INTERVAL_BYTES, when the thread exits,
+   and when the usage is reported. Indexed like phaseUsages and documentUsages. */
+struct ThreadUsageBlock
+{
+    vector<PendingUsage> phases;
+    vector<PendingUsage> documents;
+    boost::int64_t overallBytes;
+    boost::uint64_t bytesSinceFold;
+
+    ThreadUsageBlock() : overallBytes(0), bytesSinceFold(0)
+    {
+    }
+};
+
+/* Tags are never removed, so indices into these stay valid. Guarded, like the
+   totals and usageBlocks, by usageMutex. */
+static boost::mutex usageMutex;
+static vector<TagUsage> phaseUsages;
+static vector<TagUsage> documentUsages;
+static map<string, size_t> phaseNameToIndex;
+static map<string, size_t> documentNameToIndex;
+static boost::int64_t currentOverallBytes = 0;
+static boost::int64_t peakOverallBytes = 0;
+static vector<ThreadUsageBlock *> usageBlocks;
+static bool isInstalled = false;
+
+/* A thread's block is folded in and deleted when the thread exits. Declared after
+   usageMutex, since the main thread's block is folded in when it is destroyed. */
+static void FoldAndDeleteBlock(ThreadUsageBlock *block);
+static boost::thread_specific_ptr<ThreadUsageBlock> currentThreadBlock(FoldAndDeleteBlock);
+
+struct MemoryContext
+{
+    size_t phaseIndex;
+    size_t documentIndex;
+
+    MemoryContext() : phaseIndex(0), documentIndex(0)
+    {
+    }
+};
+static boost::thread_specific_ptr<MemoryContext> memoryContext;
+
+//---------------- HELPERS ------------------
+static MemoryContext &GetContext()
+{
+    if(!memoryContext.get())
+    {
+        memoryContext.reset(new MemoryContext);
+    }
+    return *memoryContext;
+}
+
+/* usageMutex must be held. */
+static size_t GetTagIndex(const string &name, vector<TagUsage> &usages,
+    map<string, size_t> &nameToIndex)
+{
+    map<string, size_t>::iterator itr = nameToIndex.find(name);
+    if(itr != nameToIndex.end())
+    {
+        return itr->second;
+    }
+    usages.push_back(TagUsage(name));
+    nameToIndex[name] = usages.size() - 1;
+    return usages.size() - 1;
+}
+
+static ThreadUsageBlock &GetThreadBlock()
+{
+    ThreadUsageBlock *block = currentThreadBlock.get();
+    if(!block)
+    {
+        block = new ThreadUsageBlock();
+        boost::mutex::scoped_lock lock(usageMutex);
+        usageBlocks.push_back(block);
+        currentThreadBlock.reset(block);
+    }
+    return *block;
+}
+
+static PendingUsage &GetPendingUsage(vector<PendingUsage> &pendingUsages, size_t tagIndex)
+{
+    if(tagIndex >= pendingUsages.size())
+    {
+        pendingUsages.resize(tagIndex + 1);
+    }
+    return pendingUsages[tagIndex];
+}
+
+/* usageMutex must be held. */
+static void FoldPendingUsages(vector<PendingUsage> &pendingUsages, vector<TagUsage> &usages)
+{
+    for(size_t i = 0; i < pendingUsages.size(); ++i)
+    {
+        PendingUsage &pending = pendingUsages[i];
+        if(pending.bytes == 0 && pending.numAllocations == 0)
+        {
+            continue;
+        }
+        TagUsage &usage = usages[i];
+        usage.currentBytes += pending.bytes;
+        usage.peakBytes = max(usage.peakBytes, usage.currentBytes);
+        usage.totalAllocatedBytes += pending.allocatedBytes;
+        usage.numAllocations += pending.numAllocations;
+        if(pending.numAllocations > 0)
+        {
+            usage.peakOverallBytes = max(usage.peakOverallBytes, currentOverallBytes);
+        }
+        pending = PendingUsage();
+    }
+}
+
+/* usageMutex must be held. */
+static void FoldBlock(ThreadUsageBlock &block)
+{
+    currentOverallBytes += block.overallBytes;
+    peakOverallBytes = max(peakOverallBytes, currentOverallBytes);
+    FoldPendingUsages(block.phases, phaseUsages);
+    FoldPendingUsages(block.documents, documentUsages);
+    block.overallBytes = 0;
+    block.bytesSinceFold = 0;
+}
+
+/* usageMutex must be held. */
+static void FoldAllBlocks()
+{
+    BOOST_FOREACH(ThreadUsageBlock *block, usageBlocks)
+    {
+        FoldBlock(*block);
+    }
+}
+
+static void FoldAndDeleteBlock(ThreadUsageBlock *block)
+{
+    boost::mutex::scoped_lock lock(usageMutex);
+    FoldBlock(*block);
+    usageBlocks.erase(find(usageBlocks.begin(), usageBlocks.end(), block));
+    delete block;
+}
+
+/* Counts an allocation (positive size) or a free (negative size) of memory that
+   is attributed to the given phase and document. */
+static void CountUsage(boost::int64_t size, size_t phaseIndex, size_t documentIndex)
+{
+    ThreadUsageBlock &block = GetThreadBlock();
+    PendingUsage *pendingUsages[] = { &GetPendingUsage(block.phases, phaseIndex),
+        &GetPendingUsage(block.documents, documentIndex) };
+    for(size_t i = 0; i < 2; ++i)
+    {
+        PendingUsage &pending = *pendingUsages[i];
+        pending.bytes += size;
+        if(size > 0)
+        {
+            pending.allocatedBytes += size;
+            ++pending.numAllocations;
+        }
+    }
+    block.overallBytes += size;
+    block.bytesSinceFold += (size > 0 ? size : -size);
+    if(block.bytesSinceFold >= FOLD_INTERVAL_BYTES)
+    {
+        boost::mutex::scoped_lock lock(usageMutex);
+        FoldBlock(block);
+    }
+}
+
+static void *CountingAllocate(size_t size)
+{
+    AllocationHeader *header = (AllocationHeader *) malloc(sizeof(AllocationHeader) + size);
+    if(!header)
+    {
+        return NULL;
+    }
+    const MemoryContext &context = GetContext();
+    header->size = size;
+    header->phaseIndex = (boost::uint32_t) context.phaseIndex;
+    header->documentIndex = (boost::uint32_t) context.documentIndex;
+    CountUsage((boost::int64_t) size, header->phaseIndex, header->documentIndex);
+    return header + 1;
+}
+
+static void CountingDeallocate(void *ptr)
+{
+    if(!ptr)
+    {
+        return;
+    }
+    AllocationHeader *header = ((AllocationHeader *) ptr) - 1;
+    CountUsage(-(boost::int64_t) header->size, header->phaseIndex, header->documentIndex);
+    free(header);
+}
+
+static void WriteUsages(ofstream &reportWriter, const vector<TagUsage> &usages)
+{
+    reportWriter << "[";
+    for(size_t i = 0; i < usages.size(); ++i)
+    {
+        const TagUsage &usage = usages[i];
+        reportWriter << (i == 0 ? "\n" : ",\n")
+            << "{\"name\":" << QuoteJSONString(usage.name)
+            << ",\"currentBytes\":" << usage.currentBytes
+            << ",\"peakBytes\":" << usage.peakBytes
+            << ",\"totalAllocatedBytes\":" << usage.totalAllocatedBytes
+            << ",\"numAllocations\":" << usage.numAllocations
+            << ",\"peakOverallBytes\":" << usage.peakOverallBytes << "}";
+    }
+    reportWriter << "\n]";
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+void MemoryAccounting::Install()
+{
+    if(isInstalled)
+    {
+        return;
+    }
+    {
+        boost::mutex::scoped_lock lock(usageMutex);
+        GetTagIndex(UNTAGGED_NAME, phaseUsages, phaseNameToIndex);
+        GetTagIndex(UNTAGGED_NAME, documentUsages, documentNameToIndex);
+    }
+    pugi::set_memory_management_functions(CountingAllocate, CountingDeallocate);
+    isInstalled = true;
+}
+
+bool MemoryAccounting::IsInstalled()
+{
+    return isInstalled;
+}
+
+boost::uint64_t MemoryAccounting::GetPeakBytes()
+{
+    boost::mutex::scoped_lock lock(usageMutex);
+    FoldAllBlocks();
+    return (boost::uint64_t) peakOverallBytes;
+}
+
+void MemoryAccounting::ResetPeakBytes()
+{
+    boost::mutex::scoped_lock lock(usageMutex);
+    FoldAllBlocks();
+    peakOverallBytes = currentOverallBytes;
+}
+
+bool MemoryAccounting::WriteJSON(const boost::filesystem::path &reportPath)
+{
+    ofstream reportWriter(reportPath.string().c_str(), ios_base::trunc);
+    if(!reportWriter.is_open())
+    {
+        ErrorLogger::Log("ERROR: MemoryAccounting::WriteJSON: could not open report file "
+            + reportPath.string() + ".");
+        return false;
+    }
+    {
+        boost::mutex::scoped_lock lock(usageMutex);
+        FoldAllBlocks();
+        reportWriter << "{\n\"currentBytes\":" << currentOverallBytes
+            << ",\n\"peakBytes\":" << peakOverallBytes
+            << ",\n\"phases\":";
+        WriteUsages(reportWriter, phaseUsages);
+        reportWriter << ",\n\"documents\":";
+        WriteUsages(reportWriter, documentUsages);
+        reportWriter << "\n}\n";
+    }
+    reportWriter.close();
+    if(reportWriter.fail())
+    {
+        ErrorLogger::Log("ERROR: MemoryAccounting::WriteJSON: could not write report file "
+            + reportPath.string() + ".");
+        return false;
+    }
+    return true;
+}
+
+//---------------- SCOPED TAG ------------------
+MemoryAccounting::ScopedTag::ScopedTag(const string &phase, const string &document)
+    : _isActive(isInstalled)
+    , _oldPhaseIndex(0)
+    , _oldDocumentIndex(0)
+{
+    if(!_isActive)
+    {
+        return;
+    }
+    MemoryContext &context = GetContext();
+    _oldPhaseIndex = context.phaseIndex;
+    _oldDocumentIndex = context.documentIndex;
+    boost::mutex::scoped_lock lock(usageMutex);
+    if(!phase.empty())
+    {
+        context.phaseIndex = GetTagIndex(phase, phaseUsages, phaseNameToIndex);
+    }
+    if(!document.empty())
+    {
+        context.documentIndex = GetTagIndex(document, documentUsages, documentNameToIndex);
+    }
+}
+
+MemoryAccounting::ScopedTag::~ScopedTag()
+{
+    if(!_isActive)
+    {
+        return;
+    }
+    MemoryContext &context = GetContext();
+    context.phaseIndex = _oldPhaseIndex;
+    context.documentIndex = _oldDocumentIndex;
+}
\ No newline at end of file
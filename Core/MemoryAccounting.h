@@ -0,0 +1,55 @@
+#ifndef _MEMORY_ACCOUNTING_H_
+#define _MEMORY_ACCOUNTING_H_
+
+#include <string>
+#include "boost/cstdint.hpp"
+#include "boost/filesystem/path.hpp"
+using namespace std;
+
+//Counts the memory that pugixml allocates (every XML document, and every XPath
+//query), and attributes each allocation to the phase and document that the
+//allocating thread is working on. Memory is attributed to the phase and document
+//it was allocated in, even if it is freed in another. Each thread counts on its
+//own and only adds its counts to the totals every 64 KiB or so, so allocating
+//never waits for other threads, and peaks are exact to within that per thread.
+namespace MemoryAccounting
+{
+    //Installs counting allocation functions into pugixml. Must be called before
+    //any pugixml document is created, since pugixml would otherwise free memory
+    //that was not allocated by the counting functions.
+    void Install();
+
+    bool IsInstalled();
+
+    //@return : the most memory that was in use at once since Install. Call when no
+    //          other thread is allocating.
+    boost::uint64_t GetPeakBytes();
+
+    //starts GetPeakBytes again from the memory in use now, i.e. before each run of
+    //a benchmark. Call when no other thread is allocating.
+    void ResetPeakBytes();
+
+    //writes the current and peak usage, overall, per phase and per document. Call
+    //when no other thread is allocating.
+    bool WriteJSON(const boost::filesystem::path &reportPath);
+
+    //Attributes allocations made by the current thread to a phase (i.e. "Merge")
+    //and/or a document (i.e. "map:UnitData.xml"), until destroyed. Empty names
+    //are inherited from the enclosing scope. Does nothing unless installed.
+    class ScopedTag
+    {
+    public:
+        ScopedTag(const string &phase, const string &document="");
+        ~ScopedTag();
+    private:
+        //non-copyable semantics
+        ScopedTag(const ScopedTag &other);
+        const ScopedTag& operator=(const ScopedTag&);
+
+        bool _isActive;
+        size_t _oldPhaseIndex;
+        size_t _oldDocumentIndex;
+    };
+}
+
+#endif //_MEMORY_ACCOUNTING_H_
\ No newline at end of file
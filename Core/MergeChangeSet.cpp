@@ -0,0 +1,233 @@
+#include "MergeChangeSet.h"
+#include <algorithm>
+#include <sstream>
+#include "boost/foreach.hpp"
+#include "CommonConstants.h"
+#include "JsonUtils.h"
+
+//---------------- CONSTANTS ------------------
+static const char *CHANGE_NAMES[] = { "added", "modified", "overwritten", "skipped" };
+static const char *CHANGE_MARKS[] = { "+", "~", "!", "=" };
+static const size_t NUM_CHANGES = sizeof(CHANGE_NAMES)/sizeof(char *);
+//above this many pairs of lines, an object's lines are all shown as replaced instead
+//of being compared.
+static const size_t MAX_DIFF_CELLS = 1000000;
+
+//---------------- HELPERS ------------------
+/* Splits the lines of an object that were removed and added, keeping the order of
+   each: the lines that are not part of their longest common subsequence. */
+static void DiffLines(const vector<string> &oldLines, const vector<string> &newLines,
+    vector<string> &removedLines, vector<string> &addedLines)
+{
+    size_t numOld = oldLines.size();
+    size_t numNew = newLines.size();
+    if(numOld * numNew > MAX_DIFF_CELLS)
+    {
+        removedLines = oldLines;
+        addedLines = newLines;
+        return;
+    }
+    //commonLengths[i][j]: length of the longest common subsequence of the lines from
+    //i on and from j on.
+    vector<vector<size_t> > commonLengths(numOld + 1, vector<size_t>(numNew + 1, 0));
+    for(size_t i = numOld; i-- > 0;)
+    {
+        for(size_t j = numNew; j-- > 0;)
+        {
+            commonLengths[i][j] = (oldLines[i] == newLines[j] ?
+                commonLengths[i + 1][j + 1] + 1 :
+                max(commonLengths[i + 1][j], commonLengths[i][j + 1]));
+        }
+    }
+    size_t i = 0, j = 0;
+    while(i < numOld && j < numNew)
+    {
+        if(oldLines[i] == newLines[j])
+        {
+            ++i;
+            ++j;
+        }
+        else if(commonLengths[i + 1][j] >= commonLengths[i][j + 1])
+        {
+            removedLines.push_back(oldLines[i++]);
+        }
+        else
+        {
+            addedLines.push_back(newLines[j++]);
+        }
+    }
+    removedLines.insert(removedLines.end(), oldLines.begin() + i, oldLines.end());
+    addedLines.insert(addedLines.end(), newLines.begin() + j, newLines.end());
+}
+
+static void WriteJSONLines(ostream &jsonWriter, const vector<string> &lines)
+{
+    jsonWriter << "[";
+    for(size_t i = 0; i < lines.size(); ++i)
+    {
+        jsonWriter << (i == 0 ? "" : ",") << QuoteJSONString(lines[i]);
+    }
+    jsonWriter << "]";
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+MergeChangeSet::MergeChangeSet() : _changes(), _keyToChangeIndex(), _conflicts()
+{
+}
+
+MergeChangeSet::~MergeChangeSet()
+{
+}
+
+void MergeChangeSet::AddChange(const string &fileName, const MergePlan &plan,
+    const vector<string> &oldLines)
+{
+    MergePlan::ChangeT planChange = plan.GetChange();
+    pair<map<pair<string, string>, size_t>::iterator, bool> inserted =
+        _keyToChangeIndex.insert(make_pair(make_pair(fileName, plan.GetObjectKey()),
+        _changes.size()));
+    if(inserted.second)
+    {
+        ObjectChangeT change;
+        change.change = planChange;
+        change.fileName = fileName;
+        change.objectKey = plan.GetObjectKey();
+        change.itemIds = plan.GetItemIds();
+        if(change.change != MergePlan::ADDED_OBJECT)
+        {
+            change.oldLines = oldLines;
+        }
+        GetObjectLines(plan.GetResultObject(), change.newLines);
+        _changes.push_back(change);
+        return;
+    }
+    ObjectChangeT &change = _changes[inserted.first->second];
+    BOOST_FOREACH(const string &itemId, plan.GetItemIds())
+    {
+        if(change.itemIds.empty() || change.itemIds.back() != itemId)
+        {
+            change.itemIds.push_back(itemId);
+        }
+    }
+    if(planChange == MergePlan::SKIPPED_OBJECT)
+    {
+        return;
+    }
+    //an object added earlier is still new, whatever is done to it since.
+    if(change.change == MergePlan::SKIPPED_OBJECT)
+    {
+        change.change = planChange;
+        change.oldLines = (planChange == MergePlan::ADDED_OBJECT ? vector<string>() : oldLines);
+    }
+    else if(change.change != MergePlan::ADDED_OBJECT)
+    {
+        change.change = max(change.change, planChange);
+    }
+    GetObjectLines(plan.GetResultObject(), change.newLines);
+}
+
+void MergeChangeSet::AddConflict(const MergeConflictT &conflict)
+{
+    _conflicts.push_back(conflict);
+}
+
+void MergeChangeSet::WriteDiff(ostream &diffWriter) const
+{
+    size_t numChanges[NUM_CHANGES] = { 0 };
+    BOOST_FOREACH(const ObjectChangeT &change, _changes)
+    {
+        ++numChanges[change.change];
+        diffWriter << CHANGE_MARKS[change.change] << " " << change.fileName << " "
+            << change.objectKey << " (";
+        for(size_t i = 0; i < change.itemIds.size(); ++i)
+        {
+            diffWriter << (i == 0 ? "" : ", ") << change.itemIds[i];
+        }
+        diffWriter << ")\n";
+        if(change.change == MergePlan::SKIPPED_OBJECT)
+        {
+            continue;
+        }
+        vector<string> removedLines, addedLines;
+        DiffLines(change.oldLines, change.newLines, removedLines, addedLines);
+        BOOST_FOREACH(const string &line, removedLines)
+        {
+            diffWriter << "    - " << line << "\n";
+        }
+        BOOST_FOREACH(const string &line, addedLines)
+        {
+            diffWriter << "    + " << line << "\n";
+        }
+    }
+    BOOST_FOREACH(const MergeConflictT &conflict, _conflicts)
+    {
+        diffWriter << "conflict: item " << conflict.overwritingItemId << " overwrites "
+            << conflict.objectName << " " << OBJECT_ID_NAME << "=" << conflict.objectId
+            << " in " << conflict.fileName << ", discarding the changes of item "
+            << conflict.itemId << "\n";
+    }
+    diffWriter << numChanges[MergePlan::ADDED_OBJECT] << " added, "
+        << numChanges[MergePlan::MODIFIED_OBJECT] << " modified, "
+        << numChanges[MergePlan::OVERWRITTEN_OBJECT] << " overwritten, "
+        << numChanges[MergePlan::SKIPPED_OBJECT] << " skipped, "
+        << _conflicts.size() << " conflicts.\n";
+}
+
+void MergeChangeSet::WriteJSON(ostream &jsonWriter) const
+{
+    size_t numChanges[NUM_CHANGES] = { 0 };
+    jsonWriter << "{\n\"changes\":[";
+    for(size_t i = 0; i < _changes.size(); ++i)
+    {
+        const ObjectChangeT &change = _changes[i];
+        ++numChanges[change.change];
+        jsonWriter << (i == 0 ? "\n" : ",\n") << "{\"file\":" << QuoteJSONString(change.fileName)
+            << ",\"object\":" << QuoteJSONString(change.objectKey)
+            << ",\"change\":\"" << CHANGE_NAMES[change.change] << "\",\"items\":";
+        WriteJSONLines(jsonWriter, change.itemIds);
+        vector<string> removedLines, addedLines;
+        DiffLines(change.oldLines, change.newLines, removedLines, addedLines);
+        jsonWriter << ",\"removed\":";
+        WriteJSONLines(jsonWriter, removedLines);
+        jsonWriter << ",\"added\":";
+        WriteJSONLines(jsonWriter, addedLines);
+        jsonWriter << "}";
+    }
+    jsonWriter << "\n],\n\"conflicts\":[";
+    for(size_t i = 0; i < _conflicts.size(); ++i)
+    {
+        const MergeConflictT &conflict = _conflicts[i];
+        jsonWriter << (i == 0 ? "\n" : ",\n") << "{\"file\":" << QuoteJSONString(conflict.fileName)
+            << ",\"object\":" << QuoteJSONString(conflict.objectName + " " + OBJECT_ID_NAME
+                + "=" + conflict.objectId)
+            << ",\"item\":" << QuoteJSONString(conflict.itemId)
+            << ",\"overwritingItem\":" << QuoteJSONString(conflict.overwritingItemId) << "}";
+    }
+    jsonWriter << "\n],\n\"totals\":{";
+    for(size_t i = 0; i < NUM_CHANGES; ++i)
+    {
+        jsonWriter << (i == 0 ? "" : ",") << "\"" << CHANGE_NAMES[i] << "\":" << numChanges[i];
+    }
+    jsonWriter << ",\"conflicts\":" << _conflicts.size() << "}\n}\n";
+}
+
+void MergeChangeSet::GetObjectLines(const xml_node &object, vector<string> &lines)
+{
+    lines.clear();
+    if(!object)
+    {
+        return;
+    }
+    ostringstream objectWriter;
+    object.print(objectWriter, "  ");
+    istringstream objectReader(objectWriter.str());
+    string line;
+    while(getline(objectReader, line))
+    {
+        size_t textBegin = line.find_first_not_of(" \t");
+        if(textBegin != string::npos && line.compare(textBegin, 2, "<?") != 0)
+        {
+            lines.push_back(line);
+        }
+    }
+}
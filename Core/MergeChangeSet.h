@@ -0,0 +1,76 @@
+#ifndef _MERGE_CHANGE_SET_H_
+#define _MERGE_CHANGE_SET_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MergePlan.h"
+using namespace std;
+
+//The net change that merging items makes to one object of a map.
+struct ObjectChangeT
+{
+    MergePlan::ChangeT change;
+    string fileName;
+    string objectKey;           /* see GetNodeXPath. */
+    vector<string> itemIds;     /* of the items whose objects were merged into it. */
+    //the object before and after the change, one line of XML per element. Empty if
+    //there was no object before (ADDED_OBJECT), or none after.
+    vector<string> oldLines;
+    vector<string> newLines;
+};
+
+/*
+Every change that merging items into a map makes, object by object, so that a run
+can be previewed without saving anything (see DataDuplicator::Plan). Filled by a
+BulkCatalogMerge as it applies its MergePlans.
+*/
+class MergeChangeSet
+{
+public:
+    MergeChangeSet();
+    ~MergeChangeSet();
+
+    //Records the change that plan made, once it is applied. A plan for an object that
+    //already has a change (i.e. the objects of a key were merged in several runs)
+    //extends it, so that each object has a single net change.
+    //@param oldLines: the lines of plan's original object, from GetObjectLines, taken
+    //                 before plan was applied.
+    void AddChange(const string &fileName, const MergePlan &plan,
+        const vector<string> &oldLines);
+
+    void AddConflict(const MergeConflictT &conflict);
+
+    const vector<ObjectChangeT> &GetChanges() const
+    {
+        return _changes;
+    }
+    const vector<MergeConflictT> &GetConflicts() const
+    {
+        return _conflicts;
+    }
+
+    //Writes one block per changed object: a header line, then the lines of the
+    //object that were removed ("-") and added ("+"). Skipped objects only get a
+    //header line.
+    void WriteDiff(ostream &diffWriter) const;
+
+    void WriteJSON(ostream &jsonWriter) const;
+
+    //Fills lines with object as indented XML, one line per element, without the notes
+    //of a LazyCatalog. Empty if object is.
+    static void GetObjectLines(const xml_node &object, vector<string> &lines);
+
+private:
+    //non-copyable semantics
+    MergeChangeSet(const MergeChangeSet &other);
+    const MergeChangeSet& operator=(const MergeChangeSet&);
+
+    vector<ObjectChangeT> _changes;
+    map<pair<string, string>, size_t> _keyToChangeIndex;    /* by file and object key. */
+    vector<MergeConflictT> _conflicts;
+};
+
+#endif //_MERGE_CHANGE_SET_H_
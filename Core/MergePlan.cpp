@@ -0,0 +1,146 @@
+#include "MergePlan.h"
+#include "boost/foreach.hpp"
+#include "CommonConstants.h"
+#include "NodeMatch.h"
+#include "ObjectMerge.h"
+#include "PerfCounters.h"
+
+//---------------- PUBLIC FUNCTIONS ------------------
+MergePlan::MergePlan(const string &fileName, xml_node mapObject,
+    const xml_node &inheritedObject, xml_node stagingCatalog, const string &lastItemId)
+    : _fileName(fileName)
+    , _mapObject(mapObject)
+    , _inheritedObject(inheritedObject)
+    , _stagingCatalog(stagingCatalog)
+    , _isMapObjectOverwritten(false)
+    , _mapObjectModifications()
+    , _plannedObject()
+    , _plannedSequence(0)
+    , _isEdited(false)
+    , _isOverwritten(false)
+    , _objectKey()
+    , _itemIds()
+    , _lastItemId(lastItemId)
+    , _conflicts()
+{
+}
+
+MergePlan::~MergePlan()
+{
+}
+
+bool MergePlan::Add(const xml_node &object, const string &itemId, size_t sequence)
+{
+    //what object matches once the objects before it are merged: the planned object is
+    //appended to the catalog, and an overwritten object is gone from it.
+    xml_node matchedObject = (_plannedObject ? _plannedObject :
+        _isMapObjectOverwritten ? xml_node() : _mapObject);
+    ObjectMergeActionT action;
+    if(!GetObjectMergeAction(object, matchedObject,
+        (matchedObject ? xml_node() : _inheritedObject), _fileName, action))
+    {
+        return false;
+    }
+    if(_itemIds.empty())
+    {
+        _objectKey = GetNodeXPath(object);
+    }
+    if(_itemIds.empty() || _itemIds.back() != itemId)
+    {
+        _itemIds.push_back(itemId);
+    }
+    if(action == KEEP_OBJECT)
+    {
+        return true;
+    }
+    bool isMapObjectMatched = (matchedObject && matchedObject == _mapObject);
+    if(action == MODIFY_OBJECT && isMapObjectMatched)
+    {
+        _mapObjectModifications.push_back(object);
+    }
+    else if(action == MODIFY_OBJECT && _plannedObject)
+    {
+        ModifyNodeUsingValuesFromNewNode(_plannedObject, object);
+        RemoveMergeAttributes(_plannedObject);
+    }
+    else if(action == MODIFY_OBJECT)
+    {
+        //the dependency is shared, so the map gets its own copy to modify.
+        _plannedObject = _stagingCatalog.append_copy(_inheritedObject);
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+        ModifyNodeUsingValuesFromNewNode(_plannedObject, object);
+        RemoveMergeAttributes(_plannedObject);
+        _plannedSequence = sequence;
+    }
+    else
+    {
+        //object is new, or discards every change planned before it.
+        if(action == OVERWRITE_OBJECT && !_lastItemId.empty() && _lastItemId != itemId)
+        {
+            MergeConflictT conflict;
+            conflict.fileName = _fileName;
+            conflict.objectName = object.name();
+            conflict.objectId = object.attribute(OBJECT_ID_NAME.c_str()).value();
+            conflict.itemId = _lastItemId;
+            conflict.overwritingItemId = itemId;
+            _conflicts.push_back(conflict);
+        }
+        _isOverwritten = (_isOverwritten || action == OVERWRITE_OBJECT);
+        if(isMapObjectMatched)
+        {
+            _isMapObjectOverwritten = true;
+            _mapObjectModifications.clear();
+        }
+        if(_plannedObject)
+        {
+            _stagingCatalog.remove_child(_plannedObject);
+        }
+        _plannedObject = _stagingCatalog.append_copy(object);
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+        RemoveMergeAttributes(_plannedObject);
+        _plannedSequence = sequence;
+    }
+    _isEdited = true;
+    _lastItemId = itemId;
+    return true;
+}
+
+void MergePlan::Apply(xml_node &plannedObject, size_t &plannedSequence)
+{
+    if(_isMapObjectOverwritten)
+    {
+        _mapObject.parent().remove_child(_mapObject);
+    }
+    else
+    {
+        BOOST_FOREACH(const xml_node &modification, _mapObjectModifications)
+        {
+            ModifyNodeUsingValuesFromNewNode(_mapObject, modification);
+            RemoveMergeAttributes(_mapObject);
+        }
+    }
+    plannedObject = _plannedObject;
+    plannedSequence = _plannedSequence;
+}
+
+MergePlan::ChangeT MergePlan::GetChange() const
+{
+    if(!_isEdited)
+    {
+        return SKIPPED_OBJECT;
+    }
+    if(!GetOriginalObject())
+    {
+        return ADDED_OBJECT;
+    }
+    return (_isOverwritten ? OVERWRITTEN_OBJECT : MODIFIED_OBJECT);
+}
+
+xml_node MergePlan::GetResultObject() const
+{
+    if(!_isEdited)
+    {
+        return xml_node();
+    }
+    return (_plannedObject ? _plannedObject : _isMapObjectOverwritten ? xml_node() : _mapObject);
+}
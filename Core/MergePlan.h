@@ -0,0 +1,147 @@
+#ifndef _MERGE_PLAN_H_
+#define _MERGE_PLAN_H_
+
+#include <string>
+#include <vector>
+#include "pugixml.hpp"
+using namespace std;
+using namespace pugi;
+
+//An item that discards the changes another item made to the same object, by
+//overwriting it.
+struct MergeConflictT
+{
+    string fileName;
+    string objectName;
+    string objectId;
+    string itemId;              /* of the item whose changes are discarded. */
+    string overwritingItemId;
+};
+
+/*
+The net change that the objects of several items make to a single object of a
+catalog, i.e. every object of one key (see GetNodeXPath), worked out before the
+catalog is touched. Objects are added in the order they would be merged, and each is
+checked as MergeObjectIntoCatalog would check it:
+    - an object that overwrites discards everything planned before it, so the
+      catalog's object is removed once, and only the last overwrite is copied.
+    - objects that modify an object that is not in the catalog yet (a new object, an
+      overwrite, or an object of a dependency) are folded into a single planned
+      object, which is copied into the catalog once.
+    - objects that modify the catalog's own object are applied to it in order when
+      the plan is applied.
+Applying the plan leaves the catalog exactly as merging the objects one after the
+other would, except that new objects are returned for the caller to append, so that
+the objects of several plans are appended in the order they were merged.
+*/
+class MergePlan
+{
+public:
+    //What the plan does to the object, compared to the map and its dependencies.
+    enum ChangeT
+    {
+        ADDED_OBJECT = 0,       /* the object is new. */
+        MODIFIED_OBJECT,
+        OVERWRITTEN_OBJECT,     /* the object was replaced, then maybe modified. */
+        SKIPPED_OBJECT          /* every object said to do nothing. */
+    };
+
+    //@param mapObject: the object of the catalog that the objects match. Empty if none
+    //                  does. There must be no other.
+    //@param inheritedObject: the object of the map's dependencies that the objects
+    //                        match (see MapManager::FindInheritedObject).
+    //@param stagingCatalog: catalog of a document of the caller's, that planned
+    //                       objects are copied into until the plan is applied.
+    //@param lastItemId: the item that changed the object last before the plan, if
+    //                   any, so that the plan reports it if the object is overwritten.
+    MergePlan(const string &fileName, xml_node mapObject, const xml_node &inheritedObject,
+        xml_node stagingCatalog, const string &lastItemId="");
+    ~MergePlan();
+
+    //Plans merging object, which belongs to item itemId, after every object added so
+    //far. object must be kept until the plan is applied.
+    //@param sequence: the order the object would be merged in, among the objects of
+    //                 every plan.
+    //@return : false if object should already exist but does not, or the other way
+    //          around, which is logged. Nothing is planned for object then.
+    bool Add(const xml_node &object, const string &itemId, size_t sequence);
+
+    //Changes the catalog's object as planned.
+    //@param plannedObject: set to the object to append to the catalog, in
+    //                      stagingCatalog, or to an empty node if there is none.
+    //@param plannedSequence: the sequence of the object that planned it.
+    void Apply(xml_node &plannedObject, size_t &plannedSequence);
+
+    //@return : true if applying the plan changes the catalog.
+    bool IsEdited() const
+    {
+        return _isEdited;
+    }
+
+    //@return : true if applying the plan removes the catalog's object.
+    bool IsMapObjectOverwritten() const
+    {
+        return _isMapObjectOverwritten;
+    }
+
+    const vector<MergeConflictT> &GetConflicts() const
+    {
+        return _conflicts;
+    }
+
+    ChangeT GetChange() const;
+
+    //@return : the key that the plan's objects share (see GetNodeXPath).
+    const string &GetObjectKey() const
+    {
+        return _objectKey;
+    }
+
+    //@return : the items whose objects were planned, in order, without repeats in a
+    //          row.
+    const vector<string> &GetItemIds() const
+    {
+        return _itemIds;
+    }
+
+    //@return : the object that the plan changes, as it was: the map's object, or else
+    //          its dependencies'. Empty if the object is new.
+    xml_node GetOriginalObject() const
+    {
+        return (_mapObject ? _mapObject : _inheritedObject);
+    }
+
+    //@return : once the plan is applied, the object as the map has it, or as it will
+    //          be appended. Empty if the plan did not change it.
+    xml_node GetResultObject() const;
+
+    //@return : the item that changed the object last, i.e. lastItemId if the plan
+    //          does not change it.
+    const string &GetLastItemId() const
+    {
+        return _lastItemId;
+    }
+
+private:
+    //non-copyable semantics
+    MergePlan(const MergePlan &other);
+    const MergePlan& operator=(const MergePlan&);
+
+    string _fileName;
+    xml_node _mapObject;
+    xml_node _inheritedObject;
+    xml_node _stagingCatalog;
+    bool _isMapObjectOverwritten;
+    vector<xml_node> _mapObjectModifications;   /* objects that modify _mapObject. */
+    xml_node _plannedObject;                    /* in _stagingCatalog. */
+    size_t _plannedSequence;
+    bool _isEdited;
+    bool _isOverwritten;                        /* by any object planned. */
+    string _objectKey;
+    vector<string> _itemIds;
+    string _lastItemId;                         /* of the last item that changed the
+                                                   object. */
+    vector<MergeConflictT> _conflicts;
+};
+
+#endif //_MERGE_PLAN_H_
@@ -2,6 +2,8 @@
 #include "CommonConstants.h"
 #include <vector>
 #include <stack>
+#include <cstring>
+#include "PerfCounters.h"
 
 //--------static functions-------
 //checks if the two element nodes have the same value. if both their first attributes have names
@@ -20,6 +22,22 @@
 	return false;
 }*/
 
+static bool IsSC2DMAttr(const xml_attribute &attr)
+{
+    return strncmp(attr.name(), SC2DM_ATTR_PREFIX, sizeof(SC2DM_ATTR_PREFIX) - 1) == 0;
+}
+
+/* @return : the first attribute of node that is not a note to SC2DM. */
+static xml_attribute GetFirstMatchableAttr(const xml_node &node)
+{
+    xml_attribute attr = node.first_attribute();
+    while(attr && IsSC2DMAttr(attr))
+    {
+        attr = attr.next_attribute();
+    }
+    return attr;
+}
+
 string GetNodeNamePlusAttrXPath(const xml_node &node, const xml_attribute &attr)
 {
     return string(node.name())+"[@"+attr.name()+"='"+attr.value()+"']";
@@ -28,15 +46,19 @@ string GetNodeNamePlusAttrXPath(const xml_node &node, const xml_attribute &attr)
 string GetNodeFullXPath(const xml_node &node)
 {
     string xpath(node.name());
-    if(!node.first_attribute())
+    xml_attribute firstAttr = GetFirstMatchableAttr(node);
+    if(!firstAttr)
     {
         return xpath;
     }
     string stuffInBrackets;
-    for(xml_attribute attr = node.first_attribute(); attr;
-        attr = attr.next_attribute())
+    for(xml_attribute attr = firstAttr; attr; attr = attr.next_attribute())
     {
-        if(attr != node.first_attribute())
+        if(IsSC2DMAttr(attr))
+        {
+            continue;
+        }
+        if(attr != firstAttr)
         {
             stuffInBrackets.append(" and ");
         }
@@ -51,7 +73,7 @@ string GetNodeXPath(const xml_node &node)
     string nodeName(node.name());
 
     //has attr with an "index" name?
-    for(xml_attribute attr = node.first_attribute(); attr; attr = attr.next_attribute())
+    for(xml_attribute attr = GetFirstMatchableAttr(node); attr; attr = attr.next_attribute())
     {
         string attrName(attr.name());
         for(size_t i = 0; i < sizeof(ATTR_POSSIBLE_INDEX_NAMES)/sizeof(char *); ++i)
@@ -101,7 +123,7 @@ string GetNodeXPath(const xml_node &node)
     //0 attributes OR (1 attr and no children)
     return node.name();
     */
-    xml_attribute firstAttr = node.first_attribute();
+    xml_attribute firstAttr = GetFirstMatchableAttr(node);
     if(firstAttr)
     {
         //1 attr
@@ -142,5 +164,6 @@ xml_node GetMatchingNode(const xml_node &toMatch, const xml_node &otherParent)
     {
         return xml_node();
     }
+    PerfCounters::Add(PerfCounters::XPATH_QUERIES);
     return otherParent.select_single_node( query.c_str() ).node();
 }
\ No newline at end of file
@@ -24,10 +24,18 @@ static const char *NODE_POSSIBLE_ARRAY_NAMES[] = { "Cost", "Effect", "LayoutButt
 // OR if its name contains one of the following values as substrings:
 static const char *NODE_POSSIBLE_ARRAY_SUBSTRS[] = { "Array" };
 
+//Attributes whose names start with this are notes to SC2DM (i.e. SC2DM_shouldAlreadyExist),
+// which are never copied into a map. Matching ignores them.
+static const char SC2DM_ATTR_PREFIX[] = "SC2DM_";
+
 //checks if the two element nodes have the same value. if both their first attributes have names
 // equal to firstAttrName, this also checks if both attributes have the same value.
 //bool NodeMatch(const xml_node &node0, const xml_node &node1, const string &firstAttrName);
 
 xml_node GetMatchingNode(const xml_node &toMatch, const xml_node &otherParent);//, const string &firstAttrName);
 
+//@return : the XPath query, relative to node's parent, that GetMatchingNode uses to find
+//          the node that matches node.
+string GetNodeXPath(const xml_node &node);
+
 #endif // __NODEMATCH_H__
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "ObjectMerge.h"
+#include "CommonConstants.h"
+#include "NodeMatch.h"
+#include "ErrorLogger.h"
+#include "PerfCounters.h"
+
+enum ObjectRequiredAgeT
+{
+    OLD = 0,
+    NEW,
+    EITHER
+};
+
+enum ObjectOldAgeActionT
+{
+    MODIFY = 0,
+    OVERWRITE,
+    DO_NOTHING
+};
+
+static const ObjectRequiredAgeT DEFAULT_OBJECT_REQUIRED_AGE = NEW;
+static const ObjectOldAgeActionT DEFAULT_OBJECT_OLD_AGE_ACTION = DO_NOTHING;
+
+//---------------- HELPERS ------------------
+static ObjectRequiredAgeT ObjectGetRequiredAge(const xml_node &object)
+{
+    string requiredAgeStr = object.attribute(OBJECT_REQUIRED_AGE_ATTR_NAME.c_str()).value();
+    for(size_t i = 0; i < sizeof(OBJECT_REQUIRED_AGE_ATTR_VALUES)/sizeof(char *); ++i)
+    {
+        if(requiredAgeStr == OBJECT_REQUIRED_AGE_ATTR_VALUES[i])
+        {
+            return (ObjectRequiredAgeT) i;
+        }
+    }
+    return DEFAULT_OBJECT_REQUIRED_AGE;
+}
+
+static ObjectOldAgeActionT ObjectGetOldAgeAction(const xml_node &object)
+{
+    string oldAgeActionStr = object.attribute(OBJECT_OLD_AGE_ACTION_ATTR_NAME.c_str()).value();
+    for(size_t i = 0; i < sizeof(OBJECT_OLD_AGE_ACTION_ATTR_VALUES)/sizeof(char *); ++i)
+    {
+        if(oldAgeActionStr == OBJECT_OLD_AGE_ACTION_ATTR_VALUES[i])
+        {
+            return (ObjectOldAgeActionT) i;
+        }
+    }
+    return DEFAULT_OBJECT_OLD_AGE_ACTION;
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+void ModifyNodeUsingValuesFromNewNode(xml_node node, const xml_node &newNode)
+{
+    //replace all of node's attributes with newNode's attributes.
+    while(node.first_attribute())
+    {
+        node.remove_attribute(node.first_attribute());
+    }
+    for(xml_attribute newAttr = newNode.first_attribute(); newAttr; newAttr = 
+        newAttr.next_attribute())
+    {
+        node.append_copy(newAttr);
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+    }
+
+    //recursively modify children.
+    for(xml_node newChildNode = newNode.first_child(); newChildNode; newChildNode = 
+        newChildNode.next_sibling())
+    {
+        xml_node matchingOldChildNode = GetMatchingNode(newChildNode, node);
+        if(matchingOldChildNode)
+        {
+            ModifyNodeUsingValuesFromNewNode(matchingOldChildNode, newChildNode);
+        }
+        else
+        {
+            //since the existing node does not have newChildNode, we need to add it.
+            node.append_copy(newChildNode);
+            PerfCounters::Add(PerfCounters::APPEND_COPIES);
+        }
+    }
+}
+
+bool MergeObjectIntoCatalog(const xml_node &object, xml_node catalog, const string &filename,
+    bool &wasEdited, const xml_node &inheritedObject)
+{
+    xml_node appendedObject;
+    return MergeObjectIntoMatch(object, GetMatchingNode(object, catalog), catalog, filename,
+        wasEdited, inheritedObject, appendedObject);
+}
+
+bool GetObjectMergeAction(const xml_node &object, const xml_node &mapObject,
+    const xml_node &inheritedObject, const string &filename, ObjectMergeActionT &action)
+{
+    ObjectRequiredAgeT requiredMapObjectAge = ObjectGetRequiredAge(object);
+    ObjectOldAgeActionT whatToDoIfMapObjectExists = ObjectGetOldAgeAction(object);
+
+    if(mapObject)
+    {
+        if(requiredMapObjectAge == NEW)
+        {
+            ErrorLogger::Log(string("ERROR: MergeObjectIntoCatalog: object \"")
+                 + mapObject.name() + " " + OBJECT_ID_NAME + "=" 
+                 + mapObject.attribute(OBJECT_ID_NAME.c_str()).value() 
+                 + "\" in file \"" + filename + "\" already exists "
+                 "in the map, which is a problem since \"" 
+                 + OBJECT_REQUIRED_AGE_ATTR_NAME + "="
+                 + OBJECT_REQUIRED_AGE_ATTR_VALUES[requiredMapObjectAge]
+                 + "\".");
+            return false;
+        }
+    }
+    else if(inheritedObject)
+    {
+        if(requiredMapObjectAge == NEW)
+        {
+            ErrorLogger::Log(string("ERROR: MergeObjectIntoCatalog: object \"")
+                 + object.name() + " " + OBJECT_ID_NAME + "="
+                 + object.attribute(OBJECT_ID_NAME.c_str()).value()
+                 + "\" in file \"" + filename + "\" already exists "
+                 "in a dependency of the map, which is a problem since \""
+                 + OBJECT_REQUIRED_AGE_ATTR_NAME + "="
+                 + OBJECT_REQUIRED_AGE_ATTR_VALUES[requiredMapObjectAge]
+                 + "\".");
+            return false;
+        }
+    }
+    else
+    {
+        if(requiredMapObjectAge == OLD)
+        {
+            ErrorLogger::Log(string("ERROR: MergeObjectIntoCatalog: object \"")
+                 + object.name() + " " + OBJECT_ID_NAME + "=" 
+                 + object.attribute(OBJECT_ID_NAME.c_str()).value() 
+                 + "\" in file \"" + filename + "\" does not exist in the map,"
+                 + " which is a problem since \"" + OBJECT_REQUIRED_AGE_ATTR_NAME + "="
+                 + OBJECT_REQUIRED_AGE_ATTR_VALUES[requiredMapObjectAge] + "\".");
+            return false;
+        }
+        //object is new.
+        action = ADD_OBJECT;
+        return true;
+    }
+    action = (whatToDoIfMapObjectExists == MODIFY ? MODIFY_OBJECT :
+        whatToDoIfMapObjectExists == OVERWRITE ? OVERWRITE_OBJECT : KEEP_OBJECT);
+    return true;
+}
+
+bool MergeObjectIntoMatch(const xml_node &object, xml_node mapObject, xml_node appendCatalog,
+    const string &filename, bool &wasEdited, const xml_node &inheritedObject,
+    xml_node &appendedObject)
+{
+    appendedObject = xml_node();
+    ObjectMergeActionT action;
+    if(!GetObjectMergeAction(object, mapObject, inheritedObject, filename, action))
+    {
+        return false;
+    }
+    if(action == KEEP_OBJECT)
+    {
+        return true;
+    }
+    if(mapObject && action == MODIFY_OBJECT)
+    {
+        ModifyNodeUsingValuesFromNewNode(mapObject, object);
+        RemoveMergeAttributes(mapObject);
+    }
+    else if(!mapObject && inheritedObject && action == MODIFY_OBJECT)
+    {
+        //the dependency is shared, so the map gets its own copy to modify.
+        appendedObject = appendCatalog.append_copy(inheritedObject);
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+        ModifyNodeUsingValuesFromNewNode(appendedObject, object);
+        RemoveMergeAttributes(appendedObject);
+    }
+    else
+    {
+        //object is new, replaces the map's object, or hides the dependency's.
+        if(mapObject)
+        {
+            mapObject.parent().remove_child(mapObject);
+        }
+        appendedObject = appendCatalog.append_copy(object);
+        RemoveMergeAttributes(appendedObject);
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+    }
+    wasEdited = true;
+    return true;
+}
+
+void RemoveMergeAttributes(xml_node object)
+{
+    object.remove_attribute(OBJECT_REQUIRED_AGE_ATTR_NAME.c_str());
+    object.remove_attribute(OBJECT_OLD_AGE_ACTION_ATTR_NAME.c_str());
+}
@@ -0,0 +1,66 @@
+#ifndef _OBJECT_MERGE_H_
+#define _OBJECT_MERGE_H_
+
+#include <string>
+#include "pugixml.hpp"
+using namespace std;
+using namespace pugi;
+
+/*
+Merging the objects of a custom item into the catalogs of a map's data files. Used by
+CustomItem::AddToMap, and by ItemLedger to merge recorded objects again.
+*/
+
+static const string OBJECT_REQUIRED_AGE_ATTR_NAME ("SC2DM_shouldAlreadyExist");
+static const char *OBJECT_REQUIRED_AGE_ATTR_VALUES[] = { "yes", "no", "idc" }; 
+static const string OBJECT_OLD_AGE_ACTION_ATTR_NAME ("SC2DM_whatToDoIfExists");
+static const char *OBJECT_OLD_AGE_ACTION_ATTR_VALUES[] = { "modify", "overwrite", "doNothing" };
+
+//What merging an object does to the object it matches, as its
+//SC2DM_whatToDoIfExists attribute says. ADD_OBJECT if it matches nothing.
+enum ObjectMergeActionT
+{
+    ADD_OBJECT = 0,
+    MODIFY_OBJECT,
+    OVERWRITE_OBJECT,
+    KEEP_OBJECT
+};
+
+//Replaces node's attributes with newNode's, then merges each child of newNode into
+//the matching child of node (see GetMatchingNode), or appends it if there is none.
+void ModifyNodeUsingValuesFromNewNode(xml_node node, const xml_node &newNode);
+
+//Merges object into catalog, as object's SC2DM_shouldAlreadyExist and
+//SC2DM_whatToDoIfExists attributes say. object is not changed, and those attributes
+//are never copied into catalog.
+//@param filename: name of the data file that catalog belongs to, for errors.
+//@param wasEdited: set to true if catalog was changed.
+//@param inheritedObject: the object of a dependency of the map that object matches
+//                        (see MapManager::FindInheritedObject). Used when catalog has no
+//                        match: it counts as existing, and is copied into catalog before
+//                        being modified. It is never changed.
+//@return : false if object should already exist in catalog but does not, or the
+//          other way around.
+bool MergeObjectIntoCatalog(const xml_node &object, xml_node catalog, const string &filename,
+    bool &wasEdited, const xml_node &inheritedObject=xml_node());
+
+//Same as MergeObjectIntoCatalog, but the object of the map that object matches was
+//already found (see GetMatchingNode), and any object added to the map is appended to
+//appendCatalog, which need not be the catalog mapObject belongs to.
+//@param mapObject: empty if object matches nothing. Removed from its catalog if
+//                  object overwrites it.
+//@param appendedObject: set to the object appended to appendCatalog, or empty if none.
+bool MergeObjectIntoMatch(const xml_node &object, xml_node mapObject, xml_node appendCatalog,
+    const string &filename, bool &wasEdited, const xml_node &inheritedObject,
+    xml_node &appendedObject);
+
+//Finds what MergeObjectIntoMatch would do, without changing anything.
+//@return : false if object should already exist but does not, or the other way
+//          around, which is logged.
+bool GetObjectMergeAction(const xml_node &object, const xml_node &mapObject,
+    const xml_node &inheritedObject, const string &filename, ObjectMergeActionT &action);
+
+//Removes the attributes that are only notes to SC2DM from object.
+void RemoveMergeAttributes(xml_node object);
+
+#endif //_OBJECT_MERGE_H_
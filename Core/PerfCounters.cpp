@@ -0,0 +1,126 @@
+#include "PerfCounters.h"
+#include <vector>
+#include <fstream>
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/tss.hpp"
+#include "boost/foreach.hpp"
+#include "JsonUtils.h"
+#include "ErrorLogger.h"
+
+using namespace std;
+
+//---------------- CONSTANTS ------------------
+static const char *COUNTER_NAMES[] =
+{
+    "regexSearches",
+    "xpathQueries",
+    "appendCopies",
+    "documentCopies",
+    "formulaParses",
+    "formulaEvals",
+    "documentsLoaded",
+    "documentsSaved",
+    "bytesWritten",
+    "itemCacheHits",
+    "itemCacheMisses",
+    "objectsMaterialized",
+    "snapshotHits",
+    "snapshotMisses"
+};
+
+//---------------- STATE ------------------
+/* Only ever written by the thread that owns it. */
+struct ThreadCounterBlock
+{
+    boost::uint64_t counts[PerfCounters::NUM_COUNTERS];
+};
+
+/* Blocks outlive their threads, so that the counts of finished threads are still
+   reported. They are owned by counterBlocks. */
+static void DoNotDeleteBlock(ThreadCounterBlock *)
+{
+}
+static boost::thread_specific_ptr<ThreadCounterBlock> currentThreadBlock(DoNotDeleteBlock);
+static vector<ThreadCounterBlock *> counterBlocks;
+static boost::mutex counterBlocksMutex;
+
+static ThreadCounterBlock &GetThreadBlock()
+{
+    ThreadCounterBlock *block = currentThreadBlock.get();
+    if(!block)
+    {
+        block = new ThreadCounterBlock();
+        for(int i = 0; i < PerfCounters::NUM_COUNTERS; ++i)
+        {
+            block->counts[i] = 0;
+        }
+        boost::mutex::scoped_lock lock(counterBlocksMutex);
+        counterBlocks.push_back(block);
+        currentThreadBlock.reset(block);
+    }
+    return *block;
+}
+
+static void WriteCounts(ofstream &countersWriter, const boost::uint64_t *counts)
+{
+    countersWriter << "{";
+    for(int i = 0; i < PerfCounters::NUM_COUNTERS; ++i)
+    {
+        countersWriter << (i == 0 ? "" : ",") << QuoteJSONString(COUNTER_NAMES[i])
+            << ":" << counts[i];
+    }
+    countersWriter << "}";
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+void PerfCounters::Add(CounterT counter, boost::uint64_t amount)
+{
+    GetThreadBlock().counts[counter] += amount;
+}
+
+boost::uint64_t PerfCounters::GetTotal(CounterT counter)
+{
+    boost::mutex::scoped_lock lock(counterBlocksMutex);
+    boost::uint64_t total = 0;
+    BOOST_FOREACH(const ThreadCounterBlock *block, counterBlocks)
+    {
+        total += block->counts[counter];
+    }
+    return total;
+}
+
+bool PerfCounters::WriteJSON(const boost::filesystem::path &countersPath)
+{
+    ofstream countersWriter(countersPath.string().c_str(), ios_base::trunc);
+    if(!countersWriter.is_open())
+    {
+        ErrorLogger::Log("ERROR: PerfCounters::WriteJSON: could not open counters file "
+            + countersPath.string() + ".");
+        return false;
+    }
+    boost::uint64_t totals[NUM_COUNTERS];
+    for(int i = 0; i < NUM_COUNTERS; ++i)
+    {
+        totals[i] = GetTotal((CounterT) i);
+    }
+    countersWriter << "{\n\"totals\":";
+    WriteCounts(countersWriter, totals);
+    countersWriter << ",\n\"threads\":[";
+    {
+        boost::mutex::scoped_lock lock(counterBlocksMutex);
+        for(size_t i = 0; i < counterBlocks.size(); ++i)
+        {
+            countersWriter << (i == 0 ? "\n" : ",\n");
+            WriteCounts(countersWriter, counterBlocks[i]->counts);
+        }
+    }
+    countersWriter << "\n]\n}\n";
+    countersWriter.close();
+    if(countersWriter.fail())
+    {
+        ErrorLogger::Log("ERROR: PerfCounters::WriteJSON: could not write counters file "
+            + countersPath.string() + ".");
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
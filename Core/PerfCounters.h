@@ -0,0 +1,43 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#include "boost/cstdint.hpp"
+#include "boost/filesystem/path.hpp"
+
+//Always-on counts of the operations that dominate the cost of a run. Each thread
+//counts into its own block, so counting never takes a lock; the blocks are only
+//added up when the counters are reported. Unlike timings, these counts do not
+//depend on the machine, so they catch algorithmic regressions (i.e. a merge that
+//becomes quadratic) even on small test maps.
+namespace PerfCounters
+{
+    enum CounterT
+    {
+        REGEX_SEARCHES = 0,     /* boost::regex_search calls in the tokenizers. */
+        XPATH_QUERIES,          /* select_single_node calls while matching nodes. */
+        APPEND_COPIES,          /* append_copy calls, i.e. nodes and attributes copied. */
+        DOCUMENT_COPIES,        /* whole documents copied with reset. */
+        FORMULA_PARSES,         /* expressions muParser compiled, i.e. formulas that
+                                   differ from the previous one of their thread. */
+        FORMULA_EVALS,          /* muParser evaluations. */
+        DOCUMENTS_LOADED,
+        DOCUMENTS_SAVED,
+        BYTES_WRITTEN,          /* to the output folder and the map. */
+        ITEM_CACHE_HITS,        /* items read from an InstantiationCache. */
+        ITEM_CACHE_MISSES,      /* items instantiated and stored in an InstantiationCache. */
+        OBJECTS_MATERIALIZED,   /* map objects parsed on demand by a LazyCatalog. */
+        SNAPSHOT_HITS,          /* map data files whose index was read from a MapSnapshot. */
+        SNAPSHOT_MISSES,        /* map data files indexed again, and stored in a MapSnapshot. */
+        NUM_COUNTERS
+    };
+
+    void Add(CounterT counter, boost::uint64_t amount=1);
+
+    //@return : the sum of counter over every thread.
+    boost::uint64_t GetTotal(CounterT counter);
+
+    //writes the totals and each thread's counts. Call when no other thread is counting.
+    bool WriteJSON(const boost::filesystem::path &countersPath);
+}
+
+#endif //_PERF_COUNTERS_H_
\ No newline at end of file
@@ -0,0 +1,345 @@
+#include "StripedCatalogMerge.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <utility>
+#include "boost/bind.hpp"
+#include "boost/foreach.hpp"
+#include "boost/functional/hash.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/thread/thread.hpp"
+#include "CommonConstants.h"
+#include "CustomItem.h"
+#include "MapManager.h"
+#include "NodeMatch.h"
+#include "ObjectMerge.h"
+#include "ErrorLogger.h"
+#include "PerfCounters.h"
+#include "Tracer.h"
+
+//---------------- CONSTANTS ------------------
+static const size_t NOT_STRIPED = (size_t) -1;
+//notes on the objects of a staging catalog. Processing instructions are never matched
+//nor merged, and are appended so that they do not hide a LazyCatalog's note, which
+//must come first.
+static const char *STAGED_ORIGIN_NOTE_NAME = "SC2DM_stagedOrigin";   /* index of the
+                                                                       object copied. */
+static const char *STAGED_APPEND_NOTE_NAME = "SC2DM_stagedAppend";   /* index of the
+                                                                       object merged. */
+
+//---------------- STATE ------------------
+struct StripedCatalogMerge::StripeT
+{
+    size_t index;
+    xml_document stagingDoc;
+    xml_node stagingCatalog;
+    set<string> stagedKeys;
+    vector<xml_node> origins;       /* objects of the catalog copied into stagingCatalog. */
+    bool wasEdited;
+    bool hasFailed;
+};
+
+//---------------- HELPERS ------------------
+/* @return : object's note named noteName, or an empty node. */
+static xml_node FindStagingNote(const xml_node &object, const char *noteName)
+{
+    for(xml_node child = object.first_child(); child; child = child.next_sibling())
+    {
+        if(child.type() == node_pi && strcmp(child.name(), noteName) == 0)
+        {
+            return child;
+        }
+    }
+    return xml_node();
+}
+
+static void AddStagingNote(xml_node object, const char *noteName, size_t value)
+{
+    xml_node note = object.append_child(node_pi);
+    note.set_name(noteName);
+    note.set_value(boost::lexical_cast<string>(value).c_str());
+}
+
+static size_t GetStagingNoteValue(const xml_node &note)
+{
+    return (size_t) strtoul(note.value(), NULL, 10);
+}
+
+static void RemoveStagingNotes(xml_node object)
+{
+    xml_node note;
+    while((note = FindStagingNote(object, STAGED_ORIGIN_NOTE_NAME)))
+    {
+        object.remove_child(note);
+    }
+    while((note = FindStagingNote(object, STAGED_APPEND_NOTE_NAME)))
+    {
+        object.remove_child(note);
+    }
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+StripedCatalogMerge::StripedCatalogMerge(MapManager &mapManager, const string &fileName,
+    xml_node catalog, size_t numStripes)
+    : _mapManager(mapManager)
+    , _fileName(fileName)
+    , _catalog(catalog)
+    , _numStripes(max(numStripes, (size_t) 1))
+    , _pendingObjects()
+    , _pendingItems()
+    , _stripes()
+    , _stripeThreads()
+    , _segmentBegin(0)
+    , _segmentEnd(0)
+    , _segmentNumber(0)
+    , _numStripesMerging(0)
+    , _isStopping(false)
+{
+}
+
+StripedCatalogMerge::~StripedCatalogMerge()
+{
+    {
+        boost::mutex::scoped_lock lock(_segmentMutex);
+        _isStopping = true;
+        _segmentReady.notify_all();
+    }
+    _stripeThreads.join_all();
+}
+
+void StripedCatalogMerge::Add(const boost::shared_ptr<CustomItem> &item)
+{
+    map<string, xml_document *>::const_iterator itr = item->GetDataFiles().find(_fileName);
+    if(itr == item->GetDataFiles().end())
+    {
+        return;
+    }
+    _pendingItems.push_back(item);
+    xml_node customItemCatalog = itr->second->child(CATALOG_NAME.c_str());
+    for(xml_node customItemObject = customItemCatalog.first_child(); customItemObject;
+        customItemObject = customItemObject.next_sibling())
+    {
+        PendingObjectT pendingObject;
+        pendingObject.object = customItemObject;
+        pendingObject.item = item.get();
+        pendingObject.key = GetNodeXPath(customItemObject);
+        xml_attribute idAttr = customItemObject.attribute(OBJECT_ID_NAME.c_str());
+        bool isKeyedById = idAttr && pendingObject.key == string(customItemObject.name()) +
+            "[@" + OBJECT_ID_NAME + "='" + idAttr.value() + "']";
+        pendingObject.stripe = (isKeyedById ?
+            boost::hash<string>()(pendingObject.key) % _numStripes : NOT_STRIPED);
+        _pendingObjects.push_back(pendingObject);
+    }
+}
+
+bool StripedCatalogMerge::Commit(bool &wasEdited)
+{
+    TRACE_SCOPE_DETAIL("CommitStripes", _fileName);
+    bool success = true;
+    size_t segmentBegin = 0;
+    //objects that are not striped split the others into segments, each merged once the
+    //objects before it are in the catalog.
+    for(size_t i = 0; success && i <= _pendingObjects.size(); ++i)
+    {
+        if(i < _pendingObjects.size() && _pendingObjects[i].stripe != NOT_STRIPED)
+        {
+            continue;
+        }
+        success = CommitStripes(segmentBegin, i, wasEdited);
+        if(success && i < _pendingObjects.size())
+        {
+            success = _mapManager.MaterializeMatchingObjects(_fileName,
+                    _pendingObjects[i].object, _catalog) &&
+                MergeObject(_pendingObjects[i], _catalog, wasEdited);
+        }
+        segmentBegin = i + 1;
+    }
+    _pendingObjects.clear();
+    _pendingItems.clear();
+    return success;
+}
+
+//---------------- PRIVATE FUNCTIONS ------------------
+bool StripedCatalogMerge::CommitStripes(size_t begin, size_t end, bool &wasEdited)
+{
+    if(begin == end)
+    {
+        return true;
+    }
+    //the stripes only read the catalog, so the objects they may match are parsed first.
+    for(size_t i = begin; i < end; ++i)
+    {
+        if(!_mapManager.MaterializeMatchingObjects(_fileName, _pendingObjects[i].object,
+            _catalog))
+        {
+            return false;
+        }
+    }
+    if(_stripes.empty())
+    {
+        for(size_t i = 0; i < _numStripes; ++i)
+        {
+            boost::shared_ptr<StripeT> stripe(new StripeT());
+            stripe->index = i;
+            _stripes.push_back(stripe);
+            _stripeThreads.create_thread(boost::bind(&StripedCatalogMerge::RunStripe, this,
+                stripe.get()));
+        }
+    }
+    //the stripes are idle between segments, so they are reset here.
+    BOOST_FOREACH(const boost::shared_ptr<StripeT> &stripe, _stripes)
+    {
+        stripe->stagingDoc.reset();
+        stripe->stagingCatalog = stripe->stagingDoc.append_child(CATALOG_NAME.c_str());
+        stripe->stagedKeys.clear();
+        stripe->origins.clear();
+        stripe->wasEdited = false;
+        stripe->hasFailed = false;
+    }
+    {
+        boost::mutex::scoped_lock lock(_segmentMutex);
+        _segmentBegin = begin;
+        _segmentEnd = end;
+        ++_segmentNumber;
+        _numStripesMerging = _stripes.size();
+        _segmentReady.notify_all();
+        while(_numStripesMerging > 0)
+        {
+            _segmentDone.wait(lock);
+        }
+    }
+    BOOST_FOREACH(const boost::shared_ptr<StripeT> &stripe, _stripes)
+    {
+        if(stripe->hasFailed)
+        {
+            return false;
+        }
+    }
+
+    //the catalog is only changed once no stripe reads it, in the same order whichever
+    //stripe finished first.
+    TRACE_SCOPE_DETAIL("CommitStagedObjects", _fileName);
+    vector<pair<size_t, xml_node> > appendedObjects;
+    BOOST_FOREACH(const boost::shared_ptr<StripeT> &stripe, _stripes)
+    {
+        if(!stripe->wasEdited)
+        {
+            continue;
+        }
+        wasEdited = true;
+        vector<xml_node> stagedObjects(stripe->origins.size());    /* empty if removed. */
+        for(xml_node stagedObject = stripe->stagingCatalog.first_child(); stagedObject;
+            stagedObject = stagedObject.next_sibling())
+        {
+            xml_node note = FindStagingNote(stagedObject, STAGED_ORIGIN_NOTE_NAME);
+            if(note)
+            {
+                stagedObjects[GetStagingNoteValue(note)] = stagedObject;
+            }
+            else if((note = FindStagingNote(stagedObject, STAGED_APPEND_NOTE_NAME)))
+            {
+                appendedObjects.push_back(make_pair(GetStagingNoteValue(note), stagedObject));
+            }
+        }
+        for(size_t i = 0; i < stripe->origins.size(); ++i)
+        {
+            if(stagedObjects[i])
+            {
+                RemoveStagingNotes(_catalog.insert_copy_before(stagedObjects[i],
+                    stripe->origins[i]));
+                PerfCounters::Add(PerfCounters::APPEND_COPIES);
+            }
+            _catalog.remove_child(stripe->origins[i]);
+        }
+    }
+    sort(appendedObjects.begin(), appendedObjects.end());
+    for(size_t i = 0; i < appendedObjects.size(); ++i)
+    {
+        RemoveStagingNotes(_catalog.append_copy(appendedObjects[i].second));
+        PerfCounters::Add(PerfCounters::APPEND_COPIES);
+    }
+    return true;
+}
+
+/* Merges every segment handed to the stripes until the merge is destroyed. Runs on
+   the stripe's own thread. */
+void StripedCatalogMerge::RunStripe(StripeT *stripe)
+{
+    Tracer::SetThreadName("Stripe " + boost::lexical_cast<string>(stripe->index) + " "
+        + _fileName);
+    size_t segmentNumber = 0;
+    while(true)
+    {
+        size_t begin, end;
+        {
+            boost::mutex::scoped_lock lock(_segmentMutex);
+            while(!_isStopping && _segmentNumber == segmentNumber)
+            {
+                _segmentReady.wait(lock);
+            }
+            if(_isStopping)
+            {
+                return;
+            }
+            segmentNumber = _segmentNumber;
+            begin = _segmentBegin;
+            end = _segmentEnd;
+        }
+        MergeStripe(stripe, begin, end);
+        boost::mutex::scoped_lock lock(_segmentMutex);
+        if(--_numStripesMerging == 0)
+        {
+            _segmentDone.notify_one();
+        }
+    }
+}
+
+/* Merges the objects [begin, end) of _pendingObjects that belong to stripe into its
+   staging catalog, in order. */
+void StripedCatalogMerge::MergeStripe(StripeT *stripe, size_t begin, size_t end)
+{
+    TRACE_SCOPE_DETAIL("MergeStripe", _fileName);
+    for(size_t i = begin; i < end; ++i)
+    {
+        const PendingObjectT &pendingObject = _pendingObjects[i];
+        if(pendingObject.stripe != stripe->index)
+        {
+            continue;
+        }
+        if(stripe->stagedKeys.insert(pendingObject.key).second)
+        {
+            //copies every object of the key, in order, so that the staging catalog
+            //matches the same one the catalog would.
+            xpath_node_set matches = _catalog.select_nodes(pendingObject.key.c_str());
+            PerfCounters::Add(PerfCounters::XPATH_QUERIES);
+            for(xpath_node_set::const_iterator itr = matches.begin(); itr != matches.end(); ++itr)
+            {
+                AddStagingNote(stripe->stagingCatalog.append_copy(itr->node()),
+                    STAGED_ORIGIN_NOTE_NAME, stripe->origins.size());
+                stripe->origins.push_back(itr->node());
+            }
+        }
+        if(!MergeObject(pendingObject, stripe->stagingCatalog, stripe->wasEdited))
+        {
+            stripe->hasFailed = true;
+            return;
+        }
+        //a merge appends at most one object, which has no note yet.
+        xml_node lastObject = stripe->stagingCatalog.last_child();
+        if(lastObject && !FindStagingNote(lastObject, STAGED_ORIGIN_NOTE_NAME) &&
+            !FindStagingNote(lastObject, STAGED_APPEND_NOTE_NAME))
+        {
+            AddStagingNote(lastObject, STAGED_APPEND_NOTE_NAME, i);
+        }
+    }
+}
+
+bool StripedCatalogMerge::MergeObject(const PendingObjectT &pendingObject, xml_node catalog,
+    bool &wasEdited)
+{
+    ErrorLogger::ScopedContext objectLogContext("Merge", "", pendingObject.item->GetId().c_str(),
+        _fileName.c_str());
+    return MergeObjectIntoCatalog(pendingObject.object, catalog, _fileName, wasEdited,
+        _mapManager.FindInheritedObject(_fileName, pendingObject.object));
+}
@@ -0,0 +1,94 @@
+#ifndef _STRIPED_CATALOG_MERGE_H_
+#define _STRIPED_CATALOG_MERGE_H_
+
+#include <string>
+#include <vector>
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+#include "pugixml.hpp"
+using namespace std;
+using namespace pugi;
+
+class CustomItem;
+class MapManager;
+
+/*
+Merges custom items into the catalog of a single data file of a map with several
+threads. Every object is identified by its key (see GetNodeXPath), and every key
+belongs to one stripe, whose thread merges all the objects of that key in the order
+they were added. Objects of different keys never match the same object of the
+catalog, so the stripes run at once.
+
+A pugixml document can not be changed by several threads, so each stripe merges into
+a staging catalog of its own: the first time a key is merged, the catalog's objects
+of that key are copied into the stripe's catalog. Commit then puts the staged
+objects back in place of the ones they were copied from, and appends the new objects
+in the order the merges would have appended them, so the catalog ends up exactly as
+merging the items one after the other would leave it.
+
+Only objects whose key is their name and id are striped. Any other object may match
+objects of several keys, so Commit merges it on its own, after the objects added
+before it. The objects between two such objects make a segment; every segment is
+handed to the same stripe threads, which are started by the first segment and kept
+until the merge is destroyed.
+*/
+class StripedCatalogMerge
+{
+public:
+    //@param catalog: the catalog of data file fileName of mapManager.
+    //@param numStripes: number of threads merging at once.
+    StripedCatalogMerge(MapManager &mapManager, const string &fileName, xml_node catalog,
+        size_t numStripes);
+    ~StripedCatalogMerge();
+
+    //Queues the objects of item's data file. They are merged by Commit, and item is
+    //kept until then.
+    void Add(const boost::shared_ptr<CustomItem> &item);
+
+    //Merges every object queued since the last Commit into the catalog.
+    //@param wasEdited: set to true if the catalog was changed.
+    //@return : false if any object could not be merged.
+    bool Commit(bool &wasEdited);
+
+private:
+    struct PendingObjectT
+    {
+        xml_node object;
+        const CustomItem *item;
+        string key;
+        size_t stripe;          /* NOT_STRIPED if merged on its own. */
+    };
+    struct StripeT;
+
+    //merges the objects [begin, end) of _pendingObjects, none of which is NOT_STRIPED.
+    bool CommitStripes(size_t begin, size_t end, bool &wasEdited);
+    void RunStripe(StripeT *stripe);
+    void MergeStripe(StripeT *stripe, size_t begin, size_t end);
+    bool MergeObject(const PendingObjectT &pendingObject, xml_node catalog, bool &wasEdited);
+
+    //non-copyable semantics
+    StripedCatalogMerge(const StripedCatalogMerge &other);
+    const StripedCatalogMerge& operator=(const StripedCatalogMerge&);
+
+    MapManager &_mapManager;
+    string _fileName;
+    xml_node _catalog;
+    size_t _numStripes;
+    vector<PendingObjectT> _pendingObjects;
+    vector<boost::shared_ptr<CustomItem> > _pendingItems;
+    vector<boost::shared_ptr<StripeT> > _stripes;
+    boost::thread_group _stripeThreads;
+    //the segment handed to the stripes, [_segmentBegin, _segmentEnd) of _pendingObjects.
+    boost::mutex _segmentMutex;
+    boost::condition_variable _segmentReady;
+    boost::condition_variable _segmentDone;
+    size_t _segmentBegin;
+    size_t _segmentEnd;
+    size_t _segmentNumber;          /* of the last segment handed out. */
+    size_t _numStripesMerging;      /* that have not finished the segment yet. */
+    bool _isStopping;
+};
+
+#endif //_STRIPED_CATALOG_MERGE_H_
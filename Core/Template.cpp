@@ -1,5 +1,6 @@
 // Template.cpp
 #include "Template.h"
+#include "TemplateTokens.h"
 
 #include <iostream>
 #include <fstream>
@@ -10,12 +11,18 @@
 #include "boost/regex.hpp"
 #include "boost/functional/hash.hpp"
 #include "boost/lexical_cast.hpp"
+#include "boost/thread/tss.hpp"
 #include "muParser.h"
 
 #include "CommonConstants.h"
 #include "NodeMatch.h"
 #include "LoadXML.h"
+#include "FilesystemUtils.h"
 #include "ErrorLogger.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "MemoryAccounting.h"
 using namespace std;
 using namespace pugi;
 using namespace boost;
@@ -29,44 +36,8 @@ static boost::regex REQ_VAR_REGEX;
 static boost::regex OPT_VAR_REGEX;
 static boost::regex FORMULA_REGEX;
 
-//--------------- ENUMERATION/STRUCT DEFINITIONS -----------------
-enum AttrTokenType
-{
-    REQUIRED_VAR_TOK=REQUIRED_VAR,
-    OPTIONAL_VAR_TOK=OPTIONAL_VAR,
-    FORMULA_TOK,             /* Token representing a formula (i.e. =2*#damage#=) */
-    REGULAR_TEXT_TOK         /* Token representing everything else. */
-};
-
-struct AttrToken
-{
-    AttrTokenType type;
-    string tokenText;
-
-    //only used by variables:
-    string varName;
-    string defaultVal; //only used by optional vars
-
-    //only used by formulas:
-    string formulaContents;
-
-    AttrToken(const string &a_tokenText) 
-        : type(REGULAR_TEXT_TOK)
-        , tokenText(a_tokenText)
-    {
-    }
-
-    AttrToken(AttrTokenType a_type, const string &a_tokenText)
-        : type(a_type)
-        , tokenText(a_tokenText)
-    {
-    }
-};
-
 //----------------- FUNCTION PROTOTYPES -------------------
 bool IsNodeDescendantOfNode( xml_node node, xml_node possibleAncestor );
-bool GetFormulaTokensInStr(const string &str, vector<AttrToken> &tokens);
-bool GetVariableTokensInStr(const string &str, vector<AttrToken> &tokens);
 
 //------------------ INITIALIZATION ------------------------
 bool TryToAssignRegEx(boost::regex &regEx, const string &format)
@@ -86,6 +57,7 @@ bool TryToAssignRegEx(boost::regex &regEx, const string &format)
 
 bool Template::InitTemplates()
 {
+    TRACE_SCOPE("InitTemplates");
     for(int i = 0; i < 2; ++i)
     {
         bool isRequired = (i==0);
@@ -112,24 +84,30 @@ bool Template::InitTemplates()
 //---TEMPLATE------
 bool Template::Create(const path &templatePath)
 {
-    cout << "Creating template from path " << templatePath << "...";
+    string templateName = templatePath.filename();
+    ErrorLogger::ScopedContext logContext("CreateTemplate", templateName.c_str());
+    TRACE_SCOPE_DETAIL("CreateTemplate", templateName);
+    MemoryAccounting::ScopedTag memoryTag("CreateTemplate", "template:" + templateName);
+    if(ConsoleReporter::IsVerbose())
+    {
+        ConsoleReporter::Detail("Creating template from path " + templatePath.string() + ".");
+    }
     if(!hasInited)
     {
-        cout << endl;
         ErrorLogger::Log("ERROR: Template::Create: Template system has"
             " not been initialized! Please call InitTemplates.");
         return false;
     }
     _numItemsCreated = 0;
-    _name = templatePath.filename();
+    _name = templateName;
+    _path = templatePath;
+    _contentHash.clear();
     if(!_itemData.Create(templatePath))
     {
-        cout << endl;
         ErrorLogger::Log("ERROR: Template::Create: could not load Template "
             "from file: " + templatePath.string() + ".");
         return false;
     }
-    cout << " done." << endl << endl;
     return true;
 }
 
@@ -151,6 +129,32 @@ const string &Template::GetName() const
     return _name;
 }
 
+const string &Template::GetContentHash() const
+{
+    boost::mutex::scoped_lock lock(_contentHashMutex);
+    if(_contentHash.empty())
+    {
+        _contentHash = GetFolderContentHash(_path, ".xml");
+    }
+    return _contentHash;
+}
+
+string Template::GetItemId(const map<string, string> &varNameToValue, size_t itemIndex) const
+{
+    return GetItemId(_itemData._id, varNameToValue, itemIndex);
+}
+
+string Template::GetItemId(const string &templateName, const map<string, string> &varNameToValue,
+    size_t itemIndex)
+{
+    map<string,string>::const_iterator itr = varNameToValue.find("_id");
+    if(itr != varNameToValue.end())
+    {
+        return templateName + ":" + itr->second;
+    }
+    return templateName + ":" + lexical_cast<string>(itemIndex);
+}
+
 /* Returns a copy of the Template's ItemData, by reference. */
 void Template::GetItemData(ItemData &itemData) const
 {
@@ -162,33 +166,33 @@ void Template::GetItemData(ItemData &itemData) const
         xml_document *currDoc = filenameAndDoc.second;
         xml_document *currDocCopy = new xml_document();
         currDocCopy->reset(*currDoc);
+        PerfCounters::Add(PerfCounters::DOCUMENT_COPIES);
         itemData._itemFilenameToDoc[filenameAndDoc.first] = currDocCopy;
     }
 }
 
 bool Template::Instantiate(const map<string, string> &varNameToValue, ItemData& itemData) const
 {
-    //first, get a copy of our ItemData.
-    GetItemData(itemData);
-    map<string,string>::const_iterator itr = varNameToValue.find("_id");
-    if(itr != varNameToValue.end())
-    {
-        itemData._id += ":"+itr->second;
-    }
-    else
-    {
-        itemData._id += ":"+lexical_cast<string>(_numItemsCreated);
-    }
-    cout << "Creating CustomItem \"" << itemData._id << "\"...";
-
     //ignore const-ness of this method, since this really doesn't change any state that the 
     //caller knows about.
-    ++((Template *)(this))->_numItemsCreated;
+    size_t itemIndex = ((Template *)(this))->_numItemsCreated++;
+    return Instantiate(varNameToValue, itemData, itemIndex);
+}
+
+bool Template::Instantiate(const map<string, string> &varNameToValue, ItemData& itemData,
+    size_t itemIndex) const
+{
+    TRACE_SCOPE_DETAIL("Instantiate", _name + ":" + lexical_cast<string>(itemIndex));
+    //items are tallied per template, since that is what decides their size.
+    MemoryAccounting::ScopedTag memoryTag("Instantiate", "items:" + _name);
+    //first, get a copy of our ItemData.
+    GetItemData(itemData);
+    itemData._id = GetItemId(varNameToValue, itemIndex);
+    ErrorLogger::ScopedContext logContext("Instantiate", _name.c_str(), itemData._id.c_str());
+    ConsoleReporter::DetailFormat("Creating CustomItem \"%s\".", itemData._id.c_str());
 
     //fill in all the variables.
     bool success = itemData.SetVariables(varNameToValue);
-
-    cout << (success ? "done." : "failed.") << endl;
     return success;
 }
 
@@ -198,7 +202,6 @@ bool ItemData::Create (const path &itemDataPath)
 {
     if(!boost::filesystem::exists(itemDataPath))
     {
-        cout << endl;
         ErrorLogger::Log("ERROR: ItemData::Create: " + itemDataPath.string() 
              + " does not exist!");
         return false;
@@ -218,7 +221,6 @@ bool ItemData::Create (const path &itemDataPath)
         string error = LoadXMLFile(baseItemDoc, currentDataFilePath.string().c_str());
         if(error != "")
         {
-            cout << endl;
             ErrorLogger::Log("ERROR: Template::Create: " + error);
             return false;
         }
@@ -542,9 +544,7 @@ bool ItemData::EvaluateFormulasInXMLNode(xml_node &node, const string &filename)
                 double formulaResult = 0;
                 try
                 {
-                    mu::Parser exprParser;
-                    exprParser.SetExpr(token.formulaContents);
-                    formulaResult = exprParser.Eval();
+                    formulaResult = EvaluateFormula(token.formulaContents);
                 }
                 catch (mu::Parser::exception_type &e)
                 {
@@ -655,6 +655,7 @@ bool ItemData::ExpandForEachLoop(xml_node &node, const string &filename,
             childOfForeach = childOfForeach.next_sibling())
         {
             xml_node childCopy = node.parent().append_copy(childOfForeach);
+            PerfCounters::Add(PerfCounters::APPEND_COPIES);
             map<string, string> childVarNameToValue(varNameToValue);
             childVarNameToValue[forEachVarName] = valueStr;
 
@@ -690,6 +691,7 @@ bool GetVariableTokensInStr(const string &str, vector<AttrToken> &tokens)
     {
         bool matchedReq = boost::regex_search(begin, end, reqVarMatches, REQ_VAR_REGEX);
         bool matchedOpt = boost::regex_search(begin, end, optVarMatches, OPT_VAR_REGEX);
+        PerfCounters::Add(PerfCounters::REGEX_SEARCHES, 2);
         if(!matchedReq && !matchedOpt)
         {
             break;
@@ -744,8 +746,10 @@ bool GetFormulaTokensInStr(const string &str, vector<AttrToken> &tokens)
     string::const_iterator end = str.end();
 
     boost::match_results<string::const_iterator> matches;
+    PerfCounters::Add(PerfCounters::REGEX_SEARCHES);
     while( boost::regex_search(begin, end, matches, FORMULA_REGEX) )
     {
+        PerfCounters::Add(PerfCounters::REGEX_SEARCHES);
         string nonFormulaTokenStr(begin, matches[0].first);
         if(!nonFormulaTokenStr.empty())
         {
@@ -766,6 +770,41 @@ bool GetFormulaTokensInStr(const string &str, vector<AttrToken> &tokens)
     return true;
 }
 
+/* Each thread keeps its parser, so that a formula that is the same as the thread's
+   previous one is evaluated from the bytecode muParser compiled for it, instead
+   of being parsed again. */
+struct FormulaParserT
+{
+    mu::Parser parser;
+    string expression;
+    bool hasExpression;
+
+    FormulaParserT() : hasExpression(false)
+    {
+    }
+};
+static boost::thread_specific_ptr<FormulaParserT> formulaParser;
+
+double EvaluateFormula(const string &formulaContents)
+{
+    FormulaParserT *threadParser = formulaParser.get();
+    if(!threadParser)
+    {
+        threadParser = new FormulaParserT;
+        formulaParser.reset(threadParser);
+    }
+    if(!threadParser->hasExpression || threadParser->expression != formulaContents)
+    {
+        threadParser->parser.SetExpr(formulaContents);
+        threadParser->expression = formulaContents;
+        threadParser->hasExpression = true;
+        PerfCounters::Add(PerfCounters::FORMULA_PARSES);
+    }
+    double formulaResult = threadParser->parser.Eval();
+    PerfCounters::Add(PerfCounters::FORMULA_EVALS);
+    return formulaResult;
+}
+
 /* Returns whether or not "node" is a descendant of "possibleAncestor". */
 bool IsNodeDescendantOfNode( xml_node node, xml_node possibleAncestor )
 {
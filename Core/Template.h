@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "boost/filesystem.hpp"
+#include "boost/thread/mutex.hpp"
 #include "pugixml.hpp"
 #include <string>
 using namespace std;
@@ -167,10 +168,30 @@ public:
        ItemData object by reference. */
     bool Instantiate(const map<string, string> &varNameToValue, ItemData& itemData) const;
 
+    /* Same as above, but "itemIndex" is used in place of the number of items created so
+       far when the item has no "_id" value. Does not modify the Template, so it is safe
+       to call from several threads at once. */
+    bool Instantiate(const map<string, string> &varNameToValue, ItemData& itemData,
+        size_t itemIndex) const;
+
     void GetVariableData(map<string, VariableData> &varNameToVarData) const;
 
     const string &GetName() const;
 
+    /* Hash of every file the template was read from. Two templates with the same
+       hash instantiate the same items from the same values. Only computed the first
+       time it is asked for (i.e. by an InstantiationCache), since it reads every file
+       of the template again. */
+    const string &GetContentHash() const;
+
+    /* The id that Instantiate gives to the item created from varNameToValue. */
+    string GetItemId(const map<string, string> &varNameToValue, size_t itemIndex) const;
+
+    /* Same as above, for the template in the folder named templateName, without
+       reading the template. */
+    static string GetItemId(const string &templateName, const map<string, string> &varNameToValue,
+        size_t itemIndex);
+
     //-----------CREATING A TEMPLATE---------------
     //TODO: implement methods to create a template from scratch.
     
@@ -187,6 +208,9 @@ private:
 
     ItemData _itemData;
     string _name;
+    path _path;
+    mutable string _contentHash;            /* empty until GetContentHash is called. */
+    mutable boost::mutex _contentHashMutex;
     size_t _numItemsCreated;
 };
 
@@ -0,0 +1,61 @@
+#include "TemplateCache.h"
+#include "Template.h"
+#include "FilesystemUtils.h"
+#include "ConsoleReporter.h"
+
+namespace fs = boost::filesystem;
+
+TemplateCache::TemplateCache()
+    : _pathToTemplate()
+{
+}
+
+TemplateCache::~TemplateCache()
+{
+}
+
+boost::shared_ptr<const Template> TemplateCache::Get(const fs::path &templatePath)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    string folderStamp = GetFolderStamp(templatePath, ".xml");
+    map<string, CachedTemplateT>::iterator itr = _pathToTemplate.find(templatePath.string());
+    if(itr != _pathToTemplate.end())
+    {
+        if(itr->second.folderStamp == folderStamp)
+        {
+            return itr->second.itemTemplate;
+        }
+        if(ConsoleReporter::IsVerbose())
+        {
+            ConsoleReporter::Detail("Template " + templatePath.string() + " changed on disk.");
+        }
+        _pathToTemplate.erase(itr);
+    }
+    boost::shared_ptr<Template> itemTemplate(new Template());
+    if(!itemTemplate->Create(templatePath))
+    {
+        return boost::shared_ptr<const Template>();
+    }
+    CachedTemplateT &cachedTemplate = _pathToTemplate[templatePath.string()];
+    cachedTemplate.itemTemplate = itemTemplate;
+    cachedTemplate.folderStamp = folderStamp;
+    return itemTemplate;
+}
+
+void TemplateCache::Remove(const fs::path &templatePath)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _pathToTemplate.erase(templatePath.string());
+}
+
+size_t TemplateCache::GetNumTemplates() const
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _pathToTemplate.size();
+}
+
+void TemplateCache::Clear()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _pathToTemplate.clear();
+}
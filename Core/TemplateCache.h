@@ -0,0 +1,52 @@
+#ifndef _TEMPLATE_CACHE_H_
+#define _TEMPLATE_CACHE_H_
+
+#include <map>
+#include <string>
+#include "boost/filesystem/path.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+using namespace std;
+
+class Template;
+
+/*
+Keeps created Templates in memory, so that a template used by several runs is only
+read and parsed once. A template is created again when any of its files is added,
+removed or written.
+*/
+class TemplateCache
+{
+public:
+    TemplateCache();
+    ~TemplateCache();
+
+    //@return : the template in templatePath, created if it is not cached or changed
+    //          on disk since it was created. Empty if it could not be created.
+    boost::shared_ptr<const Template> Get(const boost::filesystem::path &templatePath);
+
+    //Forgets the template in templatePath, so that the next Get creates it again
+    //even if its folder looks unchanged, i.e. after a write within the same second.
+    void Remove(const boost::filesystem::path &templatePath);
+
+    size_t GetNumTemplates() const;
+
+    void Clear();
+
+private:
+    /* A template, and the stamp of its folder when it was created. */
+    struct CachedTemplateT
+    {
+        boost::shared_ptr<const Template> itemTemplate;
+        string folderStamp;
+    };
+
+    //non-copyable semantics
+    TemplateCache(const TemplateCache &other);
+    const TemplateCache& operator=(const TemplateCache&);
+
+    map<string, CachedTemplateT> _pathToTemplate;
+    mutable boost::mutex _mutex;
+};
+
+#endif //_TEMPLATE_CACHE_H_
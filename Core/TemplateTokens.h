@@ -0,0 +1,62 @@
+#ifndef _TEMPLATE_TOKENS_H_
+#define _TEMPLATE_TOKENS_H_
+
+#include <string>
+#include <vector>
+#include "Template.h"
+using namespace std;
+
+/*
+Tokenizing and formula evaluation of template attribute values. Used by Template
+to fill in variables and evaluate formulas, and exposed so that they can be
+measured on their own. Template::InitTemplates must be called before tokenizing.
+*/
+
+//--------------- ENUMERATION/STRUCT DEFINITIONS -----------------
+enum AttrTokenType
+{
+    REQUIRED_VAR_TOK=REQUIRED_VAR,
+    OPTIONAL_VAR_TOK=OPTIONAL_VAR,
+    FORMULA_TOK,             /* Token representing a formula (i.e. =2*#damage#=) */
+    REGULAR_TEXT_TOK         /* Token representing everything else. */
+};
+
+struct AttrToken
+{
+    AttrTokenType type;
+    string tokenText;
+
+    //only used by variables:
+    string varName;
+    string defaultVal; //only used by optional vars
+
+    //only used by formulas:
+    string formulaContents;
+
+    AttrToken(const string &a_tokenText) 
+        : type(REGULAR_TEXT_TOK)
+        , tokenText(a_tokenText)
+    {
+    }
+
+    AttrToken(AttrTokenType a_type, const string &a_tokenText)
+        : type(a_type)
+        , tokenText(a_tokenText)
+    {
+    }
+};
+
+//----------------- FUNCTIONS -------------------
+/* Tokenizes str into plain text tokens and variable declarations. Formulas are
+   treated like plain text. Tokens are appended to tokens. */
+bool GetVariableTokensInStr(const string &str, vector<AttrToken> &tokens);
+
+/* Tokenizes str into plain text tokens and formula declarations. Tokens are
+   appended to tokens. */
+bool GetFormulaTokensInStr(const string &str, vector<AttrToken> &tokens);
+
+/* @return : the value of formulaContents, the contents of a formula token.
+   @throws mu::Parser::exception_type if formulaContents is not a valid expression. */
+double EvaluateFormula(const string &formulaContents);
+
+#endif //_TEMPLATE_TOKENS_H_
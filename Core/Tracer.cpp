@@ -0,0 +1,218 @@
+#include "Tracer.h"
+#include <vector>
+#include <fstream>
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/tss.hpp"
+#include "boost/foreach.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "JsonUtils.h"
+#include "ErrorLogger.h"
+
+namespace pt = boost::posix_time;
+
+//---------------- STATE ------------------
+/* A single complete span ("ph":"X" in the trace-event format). */
+struct TraceEvent
+{
+    const char *name;
+    string detail;
+    long long startMicroseconds;
+    long long durationMicroseconds;
+};
+
+/* Spans are only ever appended by the thread that owns the buffer, so recording a
+   span does not need a lock. */
+struct ThreadTraceBuffer
+{
+    size_t threadIndex;
+    string threadName;
+    bool isThreadNameWritten;
+    bool hasThreadExited;
+    vector<TraceEvent> events;
+
+    ThreadTraceBuffer() : threadIndex(0), isThreadNameWritten(false), hasThreadExited(false)
+    {
+    }
+};
+
+/* Buffers outlive their threads, so the spans of a thread can be written after it
+   has finished. They are owned by threadBuffers, and deleted by the first Flush
+   after their thread exits.
+   threadBuffersMutex is declared first, since the main thread's buffer is marked
+   when currentThreadBuffer is destroyed. */
+static boost::mutex threadBuffersMutex;
+static vector<ThreadTraceBuffer *> threadBuffers;
+static size_t nextThreadIndex = 0;
+static void MarkThreadExited(ThreadTraceBuffer *buffer);
+static boost::thread_specific_ptr<ThreadTraceBuffer> currentThreadBuffer(MarkThreadExited);
+
+/* spans are written to the trace file by every Flush, so that a long-running server
+   or watcher only keeps the spans of its current request or update in memory. */
+static ofstream traceWriter;
+static boost::filesystem::path tracePath;
+static bool isFirstEvent = true;
+
+static pt::ptime traceStartTime;
+bool Tracer::isEnabled = false;
+
+//---------------- HELPERS ------------------
+static ThreadTraceBuffer &GetThreadBuffer()
+{
+    ThreadTraceBuffer *buffer = currentThreadBuffer.get();
+    if(!buffer)
+    {
+        buffer = new ThreadTraceBuffer();
+        boost::mutex::scoped_lock lock(threadBuffersMutex);
+        buffer->threadIndex = nextThreadIndex++;
+        threadBuffers.push_back(buffer);
+        currentThreadBuffer.reset(buffer);
+    }
+    return *buffer;
+}
+
+static void MarkThreadExited(ThreadTraceBuffer *buffer)
+{
+    boost::mutex::scoped_lock lock(threadBuffersMutex);
+    buffer->hasThreadExited = true;
+}
+
+/* Starts the next event of the trace file. */
+static void BeginEvent()
+{
+    traceWriter << (isFirstEvent ? "\n" : ",\n");
+    isFirstEvent = false;
+}
+
+/* Writes the spans of a buffer, and empties it. threadBuffersMutex must be held. */
+static void WriteBuffer(ThreadTraceBuffer &buffer)
+{
+    if(!buffer.threadName.empty() && !buffer.isThreadNameWritten)
+    {
+        BeginEvent();
+        traceWriter << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << buffer.threadIndex << ",\"args\":{\"name\":"
+            << QuoteJSONString(buffer.threadName) << "}}";
+        buffer.isThreadNameWritten = true;
+    }
+    BOOST_FOREACH(const TraceEvent &event, buffer.events)
+    {
+        BeginEvent();
+        traceWriter << "{\"name\":" << QuoteJSONString(event.name)
+            << ",\"cat\":\"sc2dm\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.threadIndex
+            << ",\"ts\":" << event.startMicroseconds
+            << ",\"dur\":" << event.durationMicroseconds;
+        if(!event.detail.empty())
+        {
+            traceWriter << ",\"args\":{\"detail\":" << QuoteJSONString(event.detail) << "}";
+        }
+        traceWriter << "}";
+    }
+    //swap rather than clear, so that the buffer's memory is released too.
+    vector<TraceEvent>().swap(buffer.events);
+}
+
+static long long GetMicrosecondsSinceStart()
+{
+    return (pt::microsec_clock::universal_time() - traceStartTime).total_microseconds();
+}
+
+//---------------- PUBLIC FUNCTIONS ------------------
+bool Tracer::Enable(const boost::filesystem::path &newTracePath)
+{
+    if(isEnabled)
+    {
+        return true;
+    }
+    traceWriter.open(newTracePath.string().c_str(), ios_base::trunc);
+    if(!traceWriter.is_open())
+    {
+        ErrorLogger::Log("ERROR: Tracer::Enable: could not open trace file "
+            + newTracePath.string() + ".");
+        return false;
+    }
+    tracePath = newTracePath;
+    traceWriter << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    isFirstEvent = true;
+    traceStartTime = pt::microsec_clock::universal_time();
+    isEnabled = true;
+    SetThreadName("Main");
+    return true;
+}
+
+void Tracer::SetThreadName(const string &threadName)
+{
+    if(!isEnabled)
+    {
+        return;
+    }
+    ThreadTraceBuffer &buffer = GetThreadBuffer();
+    buffer.threadName = threadName;
+    buffer.isThreadNameWritten = false;
+}
+
+bool Tracer::Flush()
+{
+    if(!isEnabled)
+    {
+        return true;
+    }
+    boost::mutex::scoped_lock lock(threadBuffersMutex);
+    vector<ThreadTraceBuffer *> liveBuffers;
+    BOOST_FOREACH(ThreadTraceBuffer *buffer, threadBuffers)
+    {
+        WriteBuffer(*buffer);
+        if(buffer->hasThreadExited)
+        {
+            delete buffer;
+        }
+        else
+        {
+            liveBuffers.push_back(buffer);
+        }
+    }
+    threadBuffers.swap(liveBuffers);
+    traceWriter.flush();
+    if(traceWriter.fail())
+    {
+        ErrorLogger::Log("ERROR: Tracer::Flush: could not write trace file "
+            + tracePath.string() + ".");
+        return false;
+    }
+    return true;
+}
+
+bool Tracer::Close()
+{
+    if(!isEnabled)
+    {
+        return true;
+    }
+    bool success = Flush();
+    isEnabled = false;
+    traceWriter << "\n]}\n";
+    traceWriter.close();
+    if(success && traceWriter.fail())
+    {
+        ErrorLogger::Log("ERROR: Tracer::Close: could not write trace file "
+            + tracePath.string() + ".");
+        return false;
+    }
+    return success;
+}
+
+//---------------- SCOPED SPAN ------------------
+void Tracer::ScopedSpan::Begin(const char *name)
+{
+    _name = name;
+    _startMicroseconds = GetMicrosecondsSinceStart();
+}
+
+void Tracer::ScopedSpan::End()
+{
+    TraceEvent event;
+    event.name = _name;
+    event.detail = _detail;
+    event.startMicroseconds = _startMicroseconds;
+    event.durationMicroseconds = GetMicrosecondsSinceStart() - _startMicroseconds;
+    GetThreadBuffer().events.push_back(event);
+}
\ No newline at end of file
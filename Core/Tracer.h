@@ -0,0 +1,97 @@
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include <string>
+#include "boost/filesystem/path.hpp"
+using namespace std;
+
+//Records how long each phase of the program takes, as spans on a timeline per
+//thread, and writes them as Chrome trace-event JSON (viewable in chrome://tracing
+//or Perfetto). While tracing is disabled, a span costs a single bool check.
+namespace Tracer
+{
+    extern bool isEnabled;
+
+    inline bool IsEnabled()
+    {
+        return isEnabled;
+    }
+
+    //opens the trace file and starts recording spans. Timestamps are relative to
+    //the first call.
+    bool Enable(const boost::filesystem::path &tracePath);
+
+    //names the calling thread in the trace.
+    void SetThreadName(const string &threadName);
+
+    //appends every span recorded so far to the trace file, and forgets them. Call
+    //when no other thread is recording, i.e. between the requests of a server.
+    bool Flush();
+
+    //flushes, and finishes the trace file. Spans are no longer recorded afterwards.
+    bool Close();
+
+    //A span lasts from its construction to its destruction. name must be a string
+    //literal (or otherwise outlive the Tracer).
+    class ScopedSpan
+    {
+    public:
+        explicit ScopedSpan(const char *name)
+            : _name(NULL)
+            , _detail()
+            , _startMicroseconds(0)
+        {
+            if(isEnabled)
+            {
+                Begin(name);
+            }
+        }
+        //@param detail: shown in the trace viewer when the span is selected, i.e. an
+        //               item's id.
+        ScopedSpan(const char *name, const string &detail)
+            : _name(NULL)
+            , _detail()
+            , _startMicroseconds(0)
+        {
+            if(isEnabled)
+            {
+                _detail = detail;
+                Begin(name);
+            }
+        }
+        ~ScopedSpan()
+        {
+            if(_name)
+            {
+                End();
+            }
+        }
+    private:
+        //non-copyable semantics
+        ScopedSpan(const ScopedSpan &other);
+        const ScopedSpan& operator=(const ScopedSpan&);
+
+        void Begin(const char *name);
+        void End();
+
+        const char *_name;
+        string _detail;
+        long long _startMicroseconds;
+    };
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+//Traces the rest of the enclosing scope.
+#define TRACE_SCOPE(name) \
+    Tracer::ScopedSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+//Same as TRACE_SCOPE, but also attaches a detail string to the span. detail is
+//only evaluated while tracing is enabled. A single declaration, like TRACE_SCOPE,
+//so that an unbraced if or loop never takes only half of it.
+#define TRACE_SCOPE_DETAIL(name, detail) \
+    Tracer::ScopedSpan TRACE_CONCAT(traceSpan, __LINE__)(name, \
+        (Tracer::IsEnabled() ? string(detail) : string()))
+
+#endif //_TRACER_H_
\ No newline at end of file
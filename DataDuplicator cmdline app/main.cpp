@@ -37,48 +37,116 @@
 #include <direct.h> 
 #include "boost/filesystem.hpp"
 #include "boost/foreach.hpp"
+#include "boost/lexical_cast.hpp"
 #include "boost/regex.hpp"
 #include "pugixml.hpp"
-#include "Template.h"
-#include "CustomItem.h"
-#include "MapManager.h"
 #include "CommonConstants.h"
-#include "CustomItemReader.h"
-#include "FilesystemUtils.h"
 #include "ErrorLogger.h"
+#include "DataDuplicator.h"
+#include "MergeChangeSet.h"
+#include "ConsoleReporter.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "MemoryAccounting.h"
 using namespace std;
 using namespace boost;
 namespace fs = boost::filesystem;
 
 boost::regex ARG_REGEX(ARG_FORMAT);
 
-bool ReadArgs(path &mapPath)
+/* Program parameters, as read from the parameters file. */
+struct ProgramArgsT
 {
-    mapPath = "";
+    vector<path> mapPaths;  /* one per MapPath line. Empty if output should not be
+                               copied to a map. */
+    bool usePipeline;   /* stream items through an ItemPipeline instead of reading
+                           every custom item before creating any of them. */
+    ConsoleReporter::VerbosityT verbosity;
+    path traceFile;     /* where to write a trace of the run. Empty if not tracing. */
+    path memoryReportFile;  /* where to write the JSON report of the XML memory
+                               usage. Empty if not counting memory. */
+    bool useManifest;   /* only redo the items that changed since the map was last
+                           updated. */
+    path itemCacheFolder;   /* where instantiated items are cached. Empty if not
+                               caching. */
+    vector<path> dependencyPaths;   /* one per Dependency line, in order. */
+    bool useLazyLoading;    /* only parse the objects of the maps that items merge
+                               into. */
+    path snapshotFolder;    /* where the maps' object indexes are kept. Empty if
+                               not snapshotting. */
+    bool useFileMergeWorkers;   /* merge into each data file on its own thread. */
+    size_t numMergeStripes;     /* threads merging into each data file at once. */
+    bool useBulkMerge;  /* merge every item at once, in a sorted pass per data file. */
+    string planFormat;  /* "diff" or "json" if the maps' changes should only be
+                           printed. Empty otherwise. */
+
+    ProgramArgsT() : mapPaths(), usePipeline(false),
+        verbosity(ConsoleReporter::PROGRESS_VERBOSITY), traceFile(""), memoryReportFile(""),
+        useManifest(false), itemCacheFolder(""), dependencyPaths(), useLazyLoading(false),
+        snapshotFolder(""), useFileMergeWorkers(false), numMergeStripes(1),
+        useBulkMerge(false), planFormat("")
+    {
+    }
+};
+
+/* Finds mapPath in the maps folder if it does not exist as given.
+   @return : false if the map does not exist. */
+static bool ResolveMapPath(path &mapPath)
+{
+    try
+    {
+        if(!exists(mapPath))
+        {
+            if(!mapPath.is_complete())
+            {
+                mapPath = MAPS_FOLDER/mapPath;
+                if(!exists(mapPath))
+                {
+                    ErrorLogger::Log("ERROR: ReadArgs: map path does "
+                        "not exist: " + mapPath.string() + ".");
+                    return false;
+                }
+            }
+            else
+            {
+                ErrorLogger::Log("ERROR: ReadArgs: map path does not exist: "
+                    + mapPath.string() + ".");
+                return false;
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        ErrorLogger::Log(string("ERROR: ReadArgs: ") + e.what());
+    }
+    return true;
+}
+
+bool ReadArgs(ProgramArgsT &args)
+{
+    ErrorLogger::ScopedContext logContext("ReadArgs");
+    args = ProgramArgsT();
 	const string argsStr = ARGS_FILE.string();
-	cout << "Reading program parameters from " << argsStr << endl
-        << "{" << endl;
     bool canReadArgs = true;
     if(!exists(ARGS_FILE))
     {
-        cout << "Parameters file \"" << ARGS_FILE.string() <<
-            "\" does not exist. " << endl;
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Parameters file \""
+            + argsStr + "\" does not exist.");
         canReadArgs = false;
     }
 	ifstream fileReader(argsStr.c_str());
 	if(canReadArgs && !fileReader.is_open())
     {
-        cout << "Parameters file \"" << ARGS_FILE.string() <<
-            "\" could not be opened. Output will NOT be copied to a map."
-            << endl;
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Parameters file \""
+            + argsStr + "\" could not be opened. Output will NOT be copied to a map.");
         canReadArgs = false;
     }
 
     if(canReadArgs && fileReader.eof())
     {
-        cout << "Parameters file \"" << ARGS_FILE.string() <<
-            "\" is empty. To specify a map to copy into, type \""
-            << ARG_MAPPATH_NAME << "=C:/Path/To/Map\"." << endl;
+        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Parameters file \""
+            + argsStr + "\" is empty. To specify a map to copy into, type \""
+            + ARG_MAPPATH_NAME + "=C:/Path/To/Map\".");
         canReadArgs = false;
     }
     if(canReadArgs)
@@ -92,226 +160,243 @@ bool ReadArgs(path &mapPath)
                 boost::match_results<string::const_iterator> matches;
                 if(!boost::regex_match(currentLine, matches, ARG_REGEX))
                 {
-                    cout << "Invalid map path parameter. A valid map path has the form "
-                        "\"" << ARG_MAPPATH_NAME << "=Path/To/Map\"." << endl;
+                    ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Invalid parameter \""
+                        + currentLine + "\". A valid parameter has the form \"Name"
+                        + ARG_MAPPATH_DELIM + "Value\".");
                     continue;
                 }
-                mapPath = string(matches[2].first, matches[2].second);
-                if(!mapPath.empty())
+                string argName(matches[1].first, matches[1].second);
+                string argValue(matches[2].first, matches[2].second);
+                if(argName == ARG_MAPPATH_NAME)
                 {
-                    break;
+                    //every map gets the same items.
+                    args.mapPaths.push_back(argValue);
                 }
-            }
-        }
-    }
-    if(!mapPath.empty())
-    {
-        try
-        {
-            if(!exists(mapPath))
-            {
-                if(!mapPath.is_complete())
+                else if(argName == ARG_PIPELINE_NAME)
+                {
+                    args.usePipeline = (argValue == "yes");
+                }
+                else if(argName == ARG_VERBOSITY_NAME)
                 {
-                    mapPath = MAPS_FOLDER/mapPath;
-                    if(!exists(mapPath))
+                    if(!ConsoleReporter::ParseVerbosity(argValue, args.verbosity))
                     {
-                        ErrorLogger::Log("ERROR: ReadArgs: map path does "
-                            "not exist: " + mapPath.string() + ".");
-                        return false;
+                        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Invalid "
+                            + ARG_VERBOSITY_NAME + " \"" + argValue + "\". Expected "
+                            "quiet, progress or verbose.");
+                    }
+                }
+                else if(argName == ARG_TRACE_FILE_NAME)
+                {
+                    args.traceFile = argValue;
+                }
+                else if(argName == ARG_MEMORY_REPORT_NAME)
+                {
+                    args.memoryReportFile = argValue;
+                }
+                else if(argName == ARG_INCREMENTAL_NAME)
+                {
+                    args.useManifest = (argValue == "yes");
+                }
+                else if(argName == ARG_ITEM_CACHE_NAME)
+                {
+                    args.itemCacheFolder = argValue;
+                }
+                else if(argName == ARG_DEPENDENCY_NAME)
+                {
+                    args.dependencyPaths.push_back(argValue);
+                }
+                else if(argName == ARG_LAZY_LOAD_NAME)
+                {
+                    args.useLazyLoading = (argValue == "yes");
+                }
+                else if(argName == ARG_SNAPSHOT_FOLDER_NAME)
+                {
+                    args.snapshotFolder = argValue;
+                }
+                else if(argName == ARG_PARALLEL_MERGE_NAME)
+                {
+                    args.useFileMergeWorkers = (argValue == "yes");
+                }
+                else if(argName == ARG_BULK_MERGE_NAME)
+                {
+                    args.useBulkMerge = (argValue == "yes");
+                }
+                else if(argName == ARG_PLAN_NAME)
+                {
+                    if(argValue == "diff" || argValue == "json")
+                    {
+                        args.planFormat = argValue;
+                    }
+                    else if(argValue != "no")
+                    {
+                        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Invalid "
+                            + ARG_PLAN_NAME + " \"" + argValue + "\". Expected diff, json "
+                            "or no.");
+                    }
+                }
+                else if(argName == ARG_MERGE_STRIPES_NAME)
+                {
+                    try
+                    {
+                        args.numMergeStripes = boost::lexical_cast<size_t>(argValue);
+                    }
+                    catch(boost::bad_lexical_cast &)
+                    {
+                        args.numMergeStripes = 0;
+                    }
+                    if(args.numMergeStripes == 0)
+                    {
+                        ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Invalid "
+                            + ARG_MERGE_STRIPES_NAME + " \"" + argValue + "\". Expected "
+                            "a number of at least 1.");
+                        args.numMergeStripes = 1;
                     }
                 }
                 else
                 {
-                    ErrorLogger::Log("ERROR: ReadArgs: map path does not exist: "
-                        + mapPath.string() + ".");
-                    return false;
+                    ErrorLogger::Log(ErrorLogger::WARNING_SEVERITY, "Unknown parameter \""
+                        + argName + "\".");
                 }
             }
         }
-        catch(std::exception &e)
-        {
-            ErrorLogger::Log(string("ERROR: ReadArgs: ") + e.what());
-        }
     }
-        
-    if(mapPath.empty())
+    for(size_t i = 0; i < args.mapPaths.size(); ++i)
     {
-        cout << ARG_MAPPATH_NAME << ": NONE. Output will NOT be copied to a map." << endl;
-    }
-    else
-    {
-        cout << ARG_MAPPATH_NAME << ": " << mapPath.string() << ". Output will be"
-            " copied here." << endl;
-    }
-
-    cout << "}" << endl << endl;
-	return true;
-}
-
-bool BackupMap(const path &mapPath)
-{
-    try
-    {
-        if(!exists(BACKUP_FILES_FOLDER))
-        {
-            create_directory(BACKUP_FILES_FOLDER);
-        }
-        path backupPath = BACKUP_FILES_FOLDER/mapPath.filename();
-        if(exists(backupPath))
+        if(!ResolveMapPath(args.mapPaths[i]))
         {
-            remove_all(backupPath);
+            return false;
         }
-        if(!CopyDirectoryAndContents( mapPath, backupPath ))
+    }
+    BOOST_FOREACH(const path &dependencyPath, args.dependencyPaths)
+    {
+        if(!exists(dependencyPath))
         {
-            ErrorLogger::Log("ERROR: BackupMap: could not backup map.");
+            ErrorLogger::Log("ERROR: ReadArgs: dependency path does not exist: "
+                + dependencyPath.string() + ".");
             return false;
         }
     }
-    catch(std::exception &e)
+
+    //the verbosity has to be known before anything else is printed.
+    ConsoleReporter::SetVerbosity(args.verbosity);
+    ConsoleReporter::Status("Reading program parameters from " + argsStr + "\n{");
+    if(args.mapPaths.empty())
     {
-        ErrorLogger::Log(string("ERROR: BackupMap: ") + e.what() + ".");
-        return false;
+        ConsoleReporter::Status(ARG_MAPPATH_NAME + ": NONE. Output will NOT be copied to a map.");
     }
-    return true;
-}
-
-bool ClearOutputDirectory ()
-{
-    try
+    BOOST_FOREACH(const path &mapPath, args.mapPaths)
     {
-        if(!exists(OUTPUT_FOLDER))
-        {
-            create_directory(OUTPUT_FOLDER);
-        }
-        directory_iterator end_itr;
-        for(directory_iterator itr(OUTPUT_FOLDER); itr != end_itr; ++itr)
-        {
-            if(is_regular_file(itr->path()) && itr->path().extension() == 
-                ".xml")
-            {
-                remove(itr->path());
-            }
-        }
+        ConsoleReporter::Status(ARG_MAPPATH_NAME + ": " + mapPath.string() + ". Output will be"
+            " copied here.");
     }
-    catch(std::exception &e)
+    BOOST_FOREACH(const path &dependencyPath, args.dependencyPaths)
     {
-        ErrorLogger::Log(string("ERROR: ClearOutputDirectory: ") + 
-            e.what() + ".");
-        return false;
+        ConsoleReporter::Status(ARG_DEPENDENCY_NAME + ": " + dependencyPath.string());
     }
-    return true;
-}
-
-bool ReadAndCreateCustomItems(MapManager *map=NULL)
-{
-    CustomItemReader *customItemReader = CustomItemReader::GetInstance();
-    if(!customItemReader)
+    ConsoleReporter::Status(ARG_PIPELINE_NAME + ": " + (args.usePipeline ? "yes" : "no"));
+    ConsoleReporter::Status(ARG_INCREMENTAL_NAME + ": " + (args.useManifest ? "yes" : "no"));
+    ConsoleReporter::Status(ARG_PARALLEL_MERGE_NAME + ": "
+        + (args.useFileMergeWorkers ? "yes" : "no"));
+    ConsoleReporter::Status(ARG_BULK_MERGE_NAME + ": " + (args.useBulkMerge ? "yes" : "no"));
+    if(args.numMergeStripes > 1)
     {
-        return false;
+        ConsoleReporter::Status(ARG_MERGE_STRIPES_NAME + ": "
+            + boost::lexical_cast<string>(args.numMergeStripes));
     }
-    if(fs::is_empty(CUSTOM_ITEMS_FOLDER))
+    ConsoleReporter::Status(ARG_LAZY_LOAD_NAME + ": " + (args.useLazyLoading ? "yes" : "no"));
+    if(!args.planFormat.empty())
     {
-        ErrorLogger::Log("ERROR: ReadAndCreateCustomItems: folder \""
-             + CUSTOM_ITEMS_FOLDER.string() + "\" is empty. No items were "
-             "created.");
-        return false;
+        ConsoleReporter::Status(ARG_PLAN_NAME + ": " + args.planFormat + ". Nothing will be "
+            "written.");
     }
-    size_t totalNumItemsCreated = 0;
-    for(fs::directory_iterator it(CUSTOM_ITEMS_FOLDER); 
-        it != fs::directory_iterator(); it++)
+    if(!args.snapshotFolder.empty())
     {
-        path customItemsPath(it->path());
-        vector<ReadCustomItemT *> readCustomItems;
-        if(!customItemReader->ReadCustomItems(customItemsPath, readCustomItems))
-        {
-            return false;
-        }
-        if(readCustomItems.empty())
-        {
-            continue;
-        }
-        string templateForCustomItem(customItemsPath.stem());
-        Template templateToUse;
-        if(!templateToUse.Create(TEMPLATES_FOLDER/templateForCustomItem))
-        {
-            return false;
-        }
-        for(size_t i = 0; i < readCustomItems.size(); i ++)
-        {
-            CustomItem currentItem;
-            if(!currentItem.Create(templateToUse, 
-                readCustomItems[i]->varNameToValue))
-            {
-                return false;
-            }
-            if(map)
-            {
-                if(!currentItem.AddToMap(*map))
-                {
-                    return false;
-                }
-            }
-            if(!currentItem.Output())
-            {
-                return false;
-            }
-            ++totalNumItemsCreated;
-        }
+        ConsoleReporter::Status(ARG_SNAPSHOT_FOLDER_NAME + ": " + args.snapshotFolder.string());
     }
-    if(totalNumItemsCreated > 0)
+    if(!args.itemCacheFolder.empty())
     {
-        cout << endl << "Total number of items created: " 
-            << totalNumItemsCreated << endl;
+        ConsoleReporter::Status(ARG_ITEM_CACHE_NAME + ": " + args.itemCacheFolder.string());
     }
-    else
+    if(!args.traceFile.empty())
     {
-        cout << "WARNING: No items created! Define items in the csv files"
-            " of the Custom Items directory." << endl;
+        ConsoleReporter::Status(ARG_TRACE_FILE_NAME + ": " + args.traceFile.string());
     }
-    return true;
+    if(!args.memoryReportFile.empty())
+    {
+        ConsoleReporter::Status(ARG_MEMORY_REPORT_NAME + ": " + args.memoryReportFile.string());
+    }
+    ConsoleReporter::Status("}\n");
+	return true;
 }
 
-bool Execute()
+bool Execute(ProgramArgsT &args)
 {
-    if(!Template::InitTemplates())
+    //the parameters are read first, since they say whether to trace the rest.
+    if(!ReadArgs(args))
     {
         return false;
     }
-    path mapPath;
-    if(!ReadArgs(mapPath))
+    if(!args.traceFile.empty() && !Tracer::Enable(args.traceFile))
     {
         return false;
     }
-    MapManager map;
-    if(!mapPath.empty())
+    //no XML document exists yet, so the allocation functions can still be replaced.
+    if(!args.memoryReportFile.empty())
     {
-        if(!BackupMap(mapPath))
+        MemoryAccounting::Install();
+    }
+    DataDuplicator::OptionsT options;
+    options.usePipeline = args.usePipeline;
+    options.useManifest = args.useManifest;
+    options.itemCacheFolder = args.itemCacheFolder;
+    options.dependencyPaths = args.dependencyPaths;
+    options.useLazyLoading = (args.useLazyLoading || !args.snapshotFolder.empty());
+    options.snapshotFolder = args.snapshotFolder;
+    options.useFileMergeWorkers = (args.useFileMergeWorkers || args.numMergeStripes > 1);
+    options.numMergeStripes = args.numMergeStripes;
+    options.useBulkMerge = args.useBulkMerge;
+    DataDuplicator::StatsT stats;
+    //a plan only prints what each map would get.
+    if(!args.planFormat.empty())
+    {
+        if(args.mapPaths.empty())
         {
+            ErrorLogger::Log("ERROR: Execute: " + ARG_PLAN_NAME + " needs a map.");
             return false;
         }
-        if(!map.Create(mapPath))
+        BOOST_FOREACH(const path &mapPath, args.mapPaths)
         {
-            return false;
+            options.mapPath = mapPath;
+            MergeChangeSet changeSet;
+            if(!DataDuplicator::Plan(options, changeSet, stats))
+            {
+                return false;
+            }
+            ConsoleReporter::Status("Changes to map " + mapPath.string() + ":");
+            if(args.planFormat == "json")
+            {
+                changeSet.WriteJSON(cout);
+            }
+            else
+            {
+                changeSet.WriteDiff(cout);
+            }
         }
+        return true;
     }
-    if(!ClearOutputDirectory())
+    //each map has its own manifest, so incremental runs update maps one at a time.
+    if(args.mapPaths.size() > 1 && !args.useManifest)
     {
-        return false;
+        return DataDuplicator::ExecuteBatch(options, args.mapPaths, stats);
     }
-    if(!mapPath.empty())
+    if(args.mapPaths.empty())
     {
-        if(!ReadAndCreateCustomItems(&map))
-        {
-            return false;
-        }
-        if(!map.Save())
-        {
-            return false;
-        }
+        return DataDuplicator::Execute(options, stats);
     }
-    else
+    BOOST_FOREACH(const path &mapPath, args.mapPaths)
     {
-        if(!ReadAndCreateCustomItems())
+        options.mapPath = mapPath;
+        if(!DataDuplicator::Execute(options, stats))
         {
             return false;
         }
@@ -325,14 +410,33 @@ int main(int argc, char *argv[])
     {
         return 1;
     }
-	if(!Execute())
+    ProgramArgsT args;
+	bool success = Execute(args);
+    //the trace, counters and memory report are written even if the run failed, since that is when
+    //they are most useful.
+    if(!Tracer::Close())
+    {
+        success = false;
+    }
+    if(!PerfCounters::WriteJSON(PERF_COUNTERS_FILE))
+    {
+        success = false;
+    }
+    if(MemoryAccounting::IsInstalled() && !MemoryAccounting::WriteJSON(args.memoryReportFile))
+    {
+        success = false;
+    }
+    //make sure every error is visible before the result.
+    ErrorLogger::Flush();
+	if(!success)
     {
-		cout << endl << "Failed." << endl;
+		cout << "\nFailed.\n";
     }
 	else 
     {
-		cout << endl << "Success!" << endl;
+		cout << "\nSuccess!\n";
     }
+    ErrorLogger::Shutdown();
 	Sleep(600000);	//give user a chance to see errors or Success message
 	return 0;
 }
\ No newline at end of file